@@ -31,6 +31,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "gmutil.h"
 #include "history.h"
 #include "ipc.h"
+#include "pagecache.h"
+#include "persist.h"
+#include "searchindex.h"
 #include "ui/certimportwidget.h"
 #include "ui/color.h"
 #include "ui/command.h"
@@ -53,6 +56,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <the_Foundation/time.h>
 #include <SDL.h>
 
+#include <math.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <errno.h>
@@ -106,6 +110,8 @@ struct Impl_App {
     iMimeHooks * mimehooks;
     iGmCerts *   certs;
     iVisited *   visited;
+    iPageCache * pageCache;
+    iSearchIndex *searchIndex;
     iBookmarks * bookmarks;
     iWindow *    window;
     iSortedArray tickers;
@@ -123,6 +129,9 @@ struct Impl_App {
     iBool        isFinishedLaunching;
     iTime        lastDropTime; /* for detecting drops of multiple items */
     int          autoReloadTimer;
+    uint64_t     launchTime; /* performance counter */
+    iString *    startupTrace;
+    iBool        isStartupTraceFinished;
     /* Preferences: */
     iBool        commandEcho;         /* --echo */
     iBool        forceSoftwareRender; /* --sw */
@@ -211,6 +220,8 @@ static iString *serializePrefs_App_(const iApp *d) {
     appendFormat_String(str, "smoothscroll arg:%d\n", d->prefs.smoothScrolling);
     appendFormat_String(str, "imageloadscroll arg:%d\n", d->prefs.loadImageInsteadOfScrolling);
     appendFormat_String(str, "cachesize.set arg:%d\n", d->prefs.maxCacheSize);
+    appendFormat_String(str, "feeds.concurrency arg:%d perhost:%d\n",
+                        d->prefs.feedConcurrency, d->prefs.feedConcurrencyPerHost);
     appendFormat_String(str, "decodeurls arg:%d\n", d->prefs.decodeUserVisibleURLs);
     appendFormat_String(str, "linewidth.set arg:%d\n", d->prefs.lineWidth);
     appendFormat_String(str, "prefs.biglede.changed arg:%d\n", d->prefs.bigFirstParagraph);
@@ -393,6 +404,7 @@ iObjectList *listDocuments_App(void) {
 static void saveState_App_(const iApp *d) {
     iUnused(d);
     trimCache_App();
+    save_PageCache(d->pageCache);
     iFile *f = newCStr_File(concatPath_CStr(dataDir_App_(), stateFileName_App_));
     if (open_File(f, writeOnly_FileMode)) {
         writeData_File(f, magicState_App_, 4);
@@ -485,6 +497,9 @@ static void communicateWithRunningInstance_App_(iApp *d, iProcessId instance,
 }
 
 static void init_App_(iApp *d, int argc, char **argv) {
+    d->launchTime             = SDL_GetPerformanceCounter();
+    d->startupTrace           = new_String();
+    d->isStartupTraceFinished = iFalse;
     init_CommandLine(&d->args, argc, argv);
     /* Where was the app started from? We ask SDL first because the command line alone is
        not a reliable source of this information, particularly when it comes to different
@@ -605,8 +620,11 @@ static void init_App_(iApp *d, int argc, char **argv) {
     d->window            = NULL;
     set_Atomic(&d->pendingRefresh, iFalse);
     d->mimehooks         = new_MimeHooks();
+    init_Persist();
     d->certs             = new_GmCerts(dataDir_App_());
     d->visited           = new_Visited();
+    d->pageCache         = new_PageCache();
+    d->searchIndex       = new_SearchIndex();
     d->bookmarks         = new_Bookmarks();
     d->tabEnum           = 0; /* generates unique IDs for tab pages */
     setThemePalette_Color(d->prefs.theme);
@@ -619,8 +637,12 @@ static void init_App_(iApp *d, int argc, char **argv) {
     init_Keys();
     loadPrefs_App_(d);
     load_Keys(dataDir_App_());
+    traceStartup_App("prefs loaded");
     d->window = new_Window(d->initialWindowRect);
+    traceStartup_App("window created");
     load_Visited(d->visited, dataDir_App_());
+    load_PageCache(d->pageCache, dataDir_App_());
+    load_SearchIndex(d->searchIndex, dataDir_App_());
     load_Bookmarks(d->bookmarks, dataDir_App_());
     load_MimeHooks(d->mimehooks, dataDir_App_());
     if (isFirstRun) {
@@ -637,11 +659,13 @@ static void init_App_(iApp *d, int argc, char **argv) {
                       0x1f306);
     }
     init_Feeds(dataDir_App_());
+    traceStartup_App("user data loaded");
     /* Widget state init. */
     processEvents_App(postedEventsOnly_AppEventMode);
     if (!loadState_App_(d)) {
         postCommand_App("open url:about:help");
     }
+    traceStartup_App("state restored");
     postCommand_App("window.unfreeze");
     d->autoReloadTimer = SDL_AddTimer(60 * 1000, postAutoReloadCommand_App_, NULL);
     postCommand_App("document.autoreload");
@@ -673,9 +697,14 @@ static void deinit_App(iApp *d) {
     savePrefs_App_(d);
     deinit_Prefs(&d->prefs);
     save_Bookmarks(d->bookmarks, dataDir_App_());
-    delete_Bookmarks(d->bookmarks);
     save_Visited(d->visited, dataDir_App_());
+    save_SearchIndex(d->searchIndex);
+    deinit_Persist(); /* finish writing before the data is deleted */
+    delete_Bookmarks(d->bookmarks);
     delete_Visited(d->visited);
+    save_PageCache(d->pageCache);
+    delete_PageCache(d->pageCache);
+    delete_SearchIndex(d->searchIndex);
     delete_GmCerts(d->certs);
     save_MimeHooks(d->mimehooks);
     delete_MimeHooks(d->mimehooks);
@@ -685,6 +714,7 @@ static void deinit_App(iApp *d) {
     deinit_CommandLine(&d->args);
     iRelease(d->launchCommands);
     delete_String(d->execPath);
+    delete_String(d->startupTrace);
     deinit_Ipc();
     iRecycle();
 }
@@ -756,6 +786,57 @@ const iString *downloadPathForUrl_App(const iString *url, const iString *mime) {
     return collect_String(savePath);
 }
 
+void traceStartup_App(const char *milestone) {
+    iApp *d = &app_;
+    if (d->isStartupTraceFinished) {
+        return;
+    }
+    const double elapsed = (double) (SDL_GetPerformanceCounter() - d->launchTime) * 1000.0 /
+                           (double) SDL_GetPerformanceFrequency();
+    appendFormat_String(d->startupTrace, "* %s: %.1f ms\n", milestone, elapsed);
+#if !defined (NDEBUG)
+    printf("[Startup] %s: %.1f ms\n", milestone, elapsed);
+    fflush(stdout);
+#endif
+}
+
+void finishStartupTrace_App(void) {
+    if (!app_.isStartupTraceFinished) {
+        traceStartup_App("first frame presented");
+        app_.isStartupTraceFinished = iTrue;
+    }
+}
+
+iDeclareType(MemoryUsage)
+
+struct Impl_MemoryUsage {
+    size_t responses; /* cached in tab histories */
+    size_t layouts;   /* including document sources */
+    size_t images;
+};
+
+static const iBlock *sourceData_(const iGmDocument *doc) {
+    return &source_GmDocument(doc)->chars;
+}
+
+static iMemoryUsage memoryUsage_App_(const iObjectList *docs) {
+    /* A document's source shares its data with the cached response it was made from. The
+       shared block is counted once, as part of the document. */
+    iMemoryUsage usage;
+    iZap(usage);
+    iConstForEach(ObjectList, i, docs) {
+        const iGmDocument *doc = document_DocumentWidget(i.object);
+        usage.responses += cacheSize_History(history_DocumentWidget(i.object), sourceData_(doc));
+        usage.layouts   += memorySize_GmDocument(doc);
+        usage.images    += memorySize_Media(constMedia_GmDocument(doc));
+    }
+    return usage;
+}
+
+static size_t total_MemoryUsage_(const iMemoryUsage *d) {
+    return d->responses + d->layouts + d->images;
+}
+
 const iString *debugInfo_App(void) {
     extern char **environ; /* The environment variables. */
     iApp *d = &app_;
@@ -782,6 +863,23 @@ const iString *debugInfo_App(void) {
     iConstForEach(StringList, j, d->launchCommands) {
         appendFormat_String(msg, "%s\n", cstr_String(j.value));
     }
+    appendFormat_String(msg, "## Startup\n");
+    append_String(msg, d->startupTrace);
+    appendFormat_String(msg, "## Saved files\n");
+    append_String(msg, collect_String(debugInfo_Persist()));
+    appendFormat_String(msg, "## Glyph cache\n");
+    append_String(msg, debugInfo_Text());
+    appendFormat_String(msg, "## Memory cache\n");
+    iObjectList *docs = listDocuments_App();
+    const iMemoryUsage usage = memoryUsage_App_(docs);
+    iRelease(docs);
+    appendFormat_String(msg, "* Responses: %zu bytes\n", usage.responses);
+    appendFormat_String(msg, "* Layouts: %zu bytes\n", usage.layouts);
+    appendFormat_String(msg, "* Images: %zu bytes\n", usage.images);
+    appendFormat_String(msg, "* Total: %zu / %zu bytes\n", total_MemoryUsage_(&usage),
+                        (size_t) d->prefs.maxCacheSize * 1000000);
+    appendFormat_String(msg, "## Search index\n");
+    appendFormat_String(msg, "* Pages: %zu\n", numPages_SearchIndex(d->searchIndex));
     appendFormat_String(msg, "## MIME hooks\n");
     append_String(msg, debugInfo_MimeHooks(d->mimehooks));
     return msg;
@@ -794,28 +892,50 @@ static void clearCache_App_(void) {
 }
 
 void trimCache_App(void) {
+    /* All tabs share a single budget for cached responses, layouts, and decoded images.
+       The least important item among all the tabs is evicted first: either a cached
+       response, or the layout and images of a background tab. Both are scored by size and
+       by how long ago they were used. The page in the current tab is never evicted. */
     iApp *d = &app_;
-    size_t cacheSize = 0;
     const size_t limit = d->prefs.maxCacheSize * 1000000;
     iObjectList *docs = listDocuments_App();
-    iForEach(ObjectList, i, docs) {
-        cacheSize += cacheSize_History(history_DocumentWidget(i.object));
-    }
-    init_ObjectListIterator(&i, docs);
-    iBool wasPruned = iFalse;
-    while (cacheSize > limit) {
-        iDocumentWidget *doc = i.object;
-        const size_t pruned = pruneLeastImportant_History(history_DocumentWidget(doc));
-        if (pruned) {
-            cacheSize -= pruned;
-            wasPruned = iTrue;
+    const iMemoryUsage usage = memoryUsage_App_(docs);
+    size_t total = total_MemoryUsage_(&usage);
+    while (total > limit) {
+        iHistory *       chosen      = NULL;
+        const iBlock *   chosenInUse = NULL;
+        iDocumentWidget *chosenTab   = NULL;
+        double           score       = 0.0;
+        iForEach(ObjectList, i, docs) {
+            iDocumentWidget *doc       = i.object;
+            iHistory *       hist      = history_DocumentWidget(doc);
+            const iBlock *   inUse     = sourceData_(document_DocumentWidget(doc));
+            const double     histScore = leastImportantScore_History(hist, inUse);
+            if (histScore > score) {
+                chosen      = hist;
+                chosenInUse = inUse;
+                chosenTab   = NULL;
+                score       = histScore;
+            }
+            /* Same scoring as for cached responses in History. */
+            const double tabScore = discardableSize_DocumentWidget(doc) *
+                                    pow(hiddenSeconds_DocumentWidget(doc) / 60.0, 1.25);
+            if (tabScore > score) {
+                chosen    = NULL;
+                chosenTab = doc;
+                score     = tabScore;
+            }
+        }
+        size_t freed = 0;
+        if (chosenTab) {
+            freed = discardableSize_DocumentWidget(chosenTab);
+            discardLayout_DocumentWidget(chosenTab);
         }
-        next_ObjectListIterator(&i);
-        if (!i.value) {
-            if (!wasPruned) break;
-            wasPruned = iFalse;
-            init_ObjectListIterator(&i, docs);
+        else if (chosen) {
+            freed = pruneLeastImportant_History(chosen, chosenInUse);
         }
+        if (!freed) break;
+        total -= iMin(freed, total);
     }
     iRelease(docs);
 }
@@ -1194,6 +1314,14 @@ iBookmarks *bookmarks_App(void) {
     return app_.bookmarks;
 }
 
+iPageCache *pageCache_App(void) {
+    return app_.pageCache;
+}
+
+iSearchIndex *searchIndex_App(void) {
+    return app_.searchIndex;
+}
+
 static void updatePrefsThemeButtons_(iWidget *d) {
     for (size_t i = 0; i < max_ColorTheme; i++) {
         setFlags_Widget(findChild_Widget(d, format_CStr("prefs.theme.%u", i)),
@@ -1621,6 +1749,11 @@ iBool handleCommand_App(const char *cmd) {
         }
         return iTrue;
     }
+    else if (equal_Command(cmd, "feeds.concurrency")) {
+        d->prefs.feedConcurrency        = iMax(1, arg_Command(cmd));
+        d->prefs.feedConcurrencyPerHost = iMax(1, argLabel_Command(cmd, "perhost"));
+        return iTrue;
+    }
     else if (equal_Command(cmd, "searchurl")) {
         iString *url = &d->prefs.searchUrl;
         setCStr_String(url, suffixPtr_Command(cmd, "address"));
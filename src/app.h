@@ -35,6 +35,8 @@ iDeclareType(Bookmarks)
 iDeclareType(DocumentWidget)
 iDeclareType(GmCerts)
 iDeclareType(MimeHooks)
+iDeclareType(PageCache)
+iDeclareType(SearchIndex)
 iDeclareType(Visited)
 iDeclareType(Window)
 
@@ -63,6 +65,9 @@ const iString *dataDir_App      (void);
 const iString *downloadDir_App  (void);
 const iString *debugInfo_App    (void);
 
+void        traceStartup_App            (const char *milestone); /* time since launch */
+void        finishStartupTrace_App      (void); /* first frame has been presented */
+
 int         run_App                     (int argc, char **argv);
 void        processEvents_App           (enum iAppEventMode mode);
 iBool       handleCommand_App           (const char *cmd);
@@ -77,6 +82,8 @@ iGmCerts *          certs_App           (void);
 iVisited *          visited_App         (void);
 iBookmarks *        bookmarks_App       (void);
 iMimeHooks *        mimeHooks_App       (void);
+iPageCache *        pageCache_App       (void);
+iSearchIndex *      searchIndex_App     (void);
 iDocumentWidget *   document_App        (void);
 iObjectList *       listDocuments_App   (void);
 iDocumentWidget *   newTab_App          (const iDocumentWidget *duplicateOf, iBool switchToNew);
@@ -22,12 +22,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include "buf.h"
 
+static const size_t seekWindow_InputBuf_   = 1024 * 1024; /* decoded data that is kept */
+static const size_t discardChunk_InputBuf_ = 1024 * 1024;
+
 iDefineTypeConstruction(InputBuf)
 
 void init_InputBuf(iInputBuf *d) {
     init_Mutex(&d->mtx);
     init_Condition(&d->changed);
     init_Block(&d->data, 0);
+    d->discarded  = 0;
     d->isComplete = iTrue;
 }
 
@@ -38,7 +42,25 @@ void deinit_InputBuf(iInputBuf *d) {
 }
 
 size_t size_InputBuf(const iInputBuf *d) {
-    return size_Block(&d->data);
+    return d->discarded + size_Block(&d->data);
+}
+
+void clear_InputBuf(iInputBuf *d) {
+    clear_Block(&d->data);
+    d->discarded = 0;
+}
+
+void append_InputBuf(iInputBuf *d, const void *data, size_t size) {
+    appendData_Block(&d->data, data, size);
+}
+
+void discardBefore_InputBuf(iInputBuf *d, size_t pos) {
+    /* The data is dropped in large chunks so the rest doesn't need to be moved often. */
+    if (pos > d->discarded + seekWindow_InputBuf_ + discardChunk_InputBuf_) {
+        const size_t n = pos - seekWindow_InputBuf_ - d->discarded;
+        remove_Block(&d->data, 0, n);
+        d->discarded += n;
+    }
 }
 
 /*----------------------------------------------------------------------------------------------*/
@@ -52,8 +74,8 @@ void init_SampleBuf(iSampleBuf *d, SDL_AudioFormat format, size_t numChannels, s
     d->sampleSize  = SDL_AUDIO_BITSIZE(format) / 8 * numChannels;
     d->count       = count + 1; /* considered empty if head==tail */
     d->data        = malloc(d->sampleSize * d->count);
-    d->head        = 0;
-    d->tail        = 0;
+    SDL_AtomicSet(&d->head, 0);
+    SDL_AtomicSet(&d->tail, 0);
     init_Condition(&d->moreNeeded);
 }
 
@@ -63,7 +85,10 @@ void deinit_SampleBuf(iSampleBuf *d) {
 }
 
 size_t size_SampleBuf(const iSampleBuf *d) {
-    return d->head - d->tail;
+    iSampleBuf *buf = iConstCast(iSampleBuf *, d);
+    const size_t head = SDL_AtomicGet(&buf->head);
+    const size_t tail = SDL_AtomicGet(&buf->tail);
+    return (head + d->count - tail) % d->count;
 }
 
 size_t vacancy_SampleBuf(const iSampleBuf *d) {
@@ -75,8 +100,12 @@ iBool isFull_SampleBuf(const iSampleBuf *d) {
 }
 
 void write_SampleBuf(iSampleBuf *d, const void *samples, const size_t n) {
+    /* Note: Only called by the writer. */
     iAssert(n <= vacancy_SampleBuf(d));
-    const size_t headPos = d->head % d->count;
+    /* The caller has seen the tail move past the vacant samples. The reader must be done
+       with them before they are overwritten. */
+    SDL_MemoryBarrierAcquire();
+    const size_t headPos = SDL_AtomicGet(&d->head);
     const size_t avail   = d->count - headPos;
     if (n > avail) {
         const char *in = samples;
@@ -87,12 +116,17 @@ void write_SampleBuf(iSampleBuf *d, const void *samples, const size_t n) {
     else {
         memcpy(ptr_SampleBuf_(d, headPos), samples, d->sampleSize * n);
     }
-    d->head += n;
+    /* The samples become visible to the reader only after they have been copied.
+       SDL_AtomicSet() alone is not a release barrier on all compilers. */
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&d->head, (int) ((headPos + n) % d->count));
 }
 
-void read_SampleBuf(iSampleBuf *d, const size_t n, void *samples_out) {
-    iAssert(n <= size_SampleBuf(d));
-    const size_t tailPos = d->tail % d->count;
+size_t read_SampleBuf(iSampleBuf *d, size_t n, void *samples_out) {
+    /* Note: Only called by the reader. */
+    n = iMin(n, size_SampleBuf(d));
+    SDL_MemoryBarrierAcquire(); /* samples written before the head was moved are visible */
+    const size_t tailPos = SDL_AtomicGet(&d->tail);
     const size_t avail   = d->count - tailPos;
     if (n > avail) {
         char *out = samples_out;
@@ -103,5 +137,7 @@ void read_SampleBuf(iSampleBuf *d, const size_t n, void *samples_out) {
     else {
         memcpy(samples_out, ptr_SampleBuf_(d, tailPos), d->sampleSize * n);
     }
-    d->tail += n;
+    SDL_MemoryBarrierRelease(); /* done reading before the samples are given back */
+    SDL_AtomicSet(&d->tail, (int) ((tailPos + n) % d->count));
+    return n;
 }
@@ -25,6 +25,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "the_Foundation/block.h"
 #include "the_Foundation/mutex.h"
 
+#include <SDL_atomic.h>
 #include <SDL_audio.h>
 
 iDeclareType(InputBuf)
@@ -37,26 +38,41 @@ iDeclareType(SampleBuf)
 #   define AUDIO_F64LSB     0x8140  /* 64-bit floating point samples */
 #endif
 
+/* Stream of encoded input. Data is only appended, and the beginning of the stream is dropped
+   after it has been decoded. Positions are counted from the start of the stream. */
+
 struct Impl_InputBuf {
     iMutex     mtx;
     iCondition changed;
-    iBlock     data;
+    iBlock     data;      /* excluding the discarded part */
+    size_t     discarded; /* number of bytes dropped from the beginning */
     iBool      isComplete;
 };
 
 iDeclareTypeConstruction(InputBuf)
 
-size_t  size_InputBuf   (const iInputBuf *);
+size_t  size_InputBuf       (const iInputBuf *); /* total received, including discarded */
+void    clear_InputBuf      (iInputBuf *);
+void    append_InputBuf     (iInputBuf *, const void *data, size_t size);
+void    discardBefore_InputBuf(iInputBuf *, size_t pos); /* no longer needed for decoding */
+
+iLocalDef const char *ptr_InputBuf(const iInputBuf *d, size_t pos) {
+    iAssert(pos >= d->discarded);
+    return constData_Block(&d->data) + (pos - d->discarded);
+}
 
 /*----------------------------------------------------------------------------------------------*/
 
+/* Ring buffer with a single writer and a single reader, which don't need to lock it.
+   The writer only moves the head and the reader only moves the tail. */
+
 struct Impl_SampleBuf {
     SDL_AudioFormat format;
     uint8_t         numChannels;
     uint8_t         sampleSize; /* as bytes; one sample includes values for all channels */
     void *          data;
     size_t          count;
-    size_t          head, tail;
+    SDL_atomic_t    head, tail; /* positions in `data`; empty if equal */
     iCondition      moreNeeded;
 };
 
@@ -71,4 +87,4 @@ iLocalDef void *ptr_SampleBuf_(iSampleBuf *d, size_t pos) {
 }
 
 void    write_SampleBuf     (iSampleBuf *, const void *samples, const size_t n);
-void    read_SampleBuf      (iSampleBuf *, const size_t n, void *samples_out);
+size_t  read_SampleBuf      (iSampleBuf *, const size_t n, void *samples_out); /* returns number read */
@@ -28,6 +28,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include <the_Foundation/buffer.h>
 #include <the_Foundation/thread.h>
+#include <SDL_atomic.h>
 #include <SDL_audio.h>
 #include <SDL_timer.h>
 
@@ -67,9 +68,11 @@ struct Impl_Decoder {
     size_t            inputPos;
     size_t            totalInputSize;
     unsigned int      outputFreq;
-    iSampleBuf        output;
-    iMutex            outputMutex;
+    iSampleBuf        output;       /* written here, read in the audio callback */
+    iMutex            outputMutex;  /* for waiting until more output is needed */
+    SDL_atomic_t      numUnderruns; /* audio callback ran out of samples */
     iArray            pendingOutput;
+    SDL_SpinLock      sampleLock;   /* written by the decoder, read in other threads */
     uint64_t          currentSample;
     uint64_t          totalSamples; /* zero if unknown */
     iMutex            tagMutex;
@@ -87,6 +90,28 @@ enum iDecoderStatus {
     needMoreInput_DecoderStatus,
 };
 
+/* The decoder thread is the only one changing the sample counts, so it can read them without
+   locking. The spinlock keeps other threads from seeing half-written values. */
+
+static void advance_Decoder_(iDecoder *d, size_t numSamples) {
+    SDL_AtomicLock(&d->sampleLock);
+    d->currentSample += numSamples;
+    SDL_AtomicUnlock(&d->sampleLock);
+}
+
+static void setTotalSamples_Decoder_(iDecoder *d, uint64_t totalSamples) {
+    SDL_AtomicLock(&d->sampleLock);
+    d->totalSamples = totalSamples;
+    SDL_AtomicUnlock(&d->sampleLock);
+}
+
+static void samples_Decoder_(iDecoder *d, uint64_t *current_out, uint64_t *total_out) {
+    SDL_AtomicLock(&d->sampleLock);
+    if (current_out) *current_out = d->currentSample;
+    if (total_out)   *total_out   = d->totalSamples;
+    SDL_AtomicUnlock(&d->sampleLock);
+}
+
 static enum iDecoderStatus decodeWav_Decoder_(iDecoder *d, iRanges inputRange) {
     const uint8_t numChannels     = d->output.numChannels;
     const size_t  inputSampleSize = numChannels * SDL_AUDIO_BITSIZE(d->inputFormat) / 8;
@@ -103,11 +128,10 @@ static enum iDecoderStatus decodeWav_Decoder_(iDecoder *d, iRanges inputRange) {
     void *samples = malloc(inputSampleSize * n);
     /* Get a copy of the input for further processing. */ {
         lock_Mutex(&d->input->mtx);
-        iAssert(inputSampleSize * d->inputPos < size_Block(&d->input->data));
-        memcpy(samples,
-               constData_Block(&d->input->data) + inputSampleSize * d->inputPos,
-               inputSampleSize * n);
+        iAssert(inputSampleSize * d->inputPos < size_InputBuf(d->input));
+        memcpy(samples, ptr_InputBuf(d->input, inputSampleSize * d->inputPos), inputSampleSize * n);
         d->inputPos += n;
+        discardBefore_InputBuf(d->input, inputSampleSize * d->inputPos);
         unlock_Mutex(&d->input->mtx);
     }
     /* Gain. */ {
@@ -161,21 +185,41 @@ static enum iDecoderStatus decodeWav_Decoder_(iDecoder *d, iRanges inputRange) {
             }
         }
     }
-    iGuardMutex(&d->outputMutex, write_SampleBuf(&d->output, samples, n));
-    d->currentSample += n;
+    write_SampleBuf(&d->output, samples, n);
+    advance_Decoder_(d, n);
     free(samples);
     return ok_DecoderStatus;
 }
 
 static void writePending_Decoder_(iDecoder *d) {
     /* Write as much as we can. */
-    lock_Mutex(&d->outputMutex);
     size_t avail = vacancy_SampleBuf(&d->output);
     size_t n = iMin(avail, size_Array(&d->pendingOutput));
     write_SampleBuf(&d->output, constData_Array(&d->pendingOutput), n);
     removeN_Array(&d->pendingOutput, 0, n);
-    unlock_Mutex(&d->outputMutex);
-    d->currentSample += n;
+    advance_Decoder_(d, n);
+}
+
+static uint64_t lastGranulePos_Ogg_(const char *data, size_t size) {
+    /* The granule position of the last Ogg page is the length of the stream in samples. */
+    const size_t headerSize = 27;
+    const size_t maxScan    = 65536;
+    if (size < headerSize) {
+        return 0;
+    }
+    for (size_t pos = size - headerSize, end = size > maxScan ? size - maxScan : 0; ; pos--) {
+        if (!memcmp(data + pos, "OggS", 4)) {
+            uint64_t granule = 0;
+            for (int i = 7; i >= 0; i--) {
+                granule = (granule << 8) | (uint8_t) data[pos + 6 + i];
+            }
+            if (granule != UINT64_MAX) { /* no packet ends on this page */
+                return granule;
+            }
+        }
+        if (pos == end) break;
+    }
+    return 0;
 }
 
 static enum iDecoderStatus decodeVorbis_Decoder_(iDecoder *d) {
@@ -184,9 +228,11 @@ static enum iDecoderStatus decodeVorbis_Decoder_(iDecoder *d) {
         lock_Mutex(&d->input->mtx);
         int error;
         int consumed;
-        d->vorbis = stb_vorbis_open_pushdata(
-            constData_Block(input), size_Block(input), &consumed, &error, NULL);
+        d->vorbis = stb_vorbis_open_pushdata(ptr_InputBuf(d->input, d->inputPos),
+                                             size_InputBuf(d->input) - d->inputPos,
+                                             &consumed, &error, NULL);
         if (!d->vorbis) {
+            unlock_Mutex(&d->input->mtx);
             return needMoreInput_DecoderStatus;
         }
         d->inputPos += consumed;
@@ -214,16 +260,12 @@ static enum iDecoderStatus decodeVorbis_Decoder_(iDecoder *d) {
         }
     }
     if (d->totalSamples == 0 && d->input->isComplete) {
-        /* Time to check the stream size. */
+        /* Time to check the stream size. The beginning of the stream may already have
+           been discarded, but the length is found at the end. */
         lock_Mutex(&d->input->mtx);
-        d->totalInputSize = size_Block(input);
-        int error = 0;
-        stb_vorbis *vrb = stb_vorbis_open_memory(constData_Block(input), size_Block(input),
-                                                 &error, NULL);
-        if (vrb) {
-            d->totalSamples = stb_vorbis_stream_length_in_samples(vrb);
-            stb_vorbis_close(vrb);
-        }
+        d->totalInputSize = size_InputBuf(d->input);
+        setTotalSamples_Decoder_(d, lastGranulePos_Ogg_(constData_Block(input),
+                                                        size_Block(input)));
         unlock_Mutex(&d->input->mtx);
     }
     enum iDecoderStatus status = ok_DecoderStatus;
@@ -232,11 +274,13 @@ static enum iDecoderStatus decodeVorbis_Decoder_(iDecoder *d) {
         lock_Mutex(&d->input->mtx);
         int     count     = 0;
         float **samples   = NULL;
-        int     remaining = d->inputPos < size_Block(input) ? size_Block(input) - d->inputPos : 0;
+        const size_t inputSize = size_InputBuf(d->input);
+        int     remaining = d->inputPos < inputSize ? inputSize - d->inputPos : 0;
         int     consumed  = stb_vorbis_decode_frame_pushdata(
-            d->vorbis, constData_Block(input) + d->inputPos, remaining, NULL, &samples, &count);
+            d->vorbis, ptr_InputBuf(d->input, d->inputPos), remaining, NULL, &samples, &count);
         d->inputPos += consumed;
-        iAssert(d->inputPos <= size_Block(input));
+        iAssert(d->inputPos <= inputSize);
+        discardBefore_InputBuf(d->input, d->inputPos);
         unlock_Mutex(&d->input->mtx);
         if (count == 0) {
             if (consumed == 0) {
@@ -269,7 +313,6 @@ static const char *mpegStr_(const mpg123_string *str) {
 enum iDecoderStatus decodeMpeg_Decoder_(iDecoder *d) {
     enum iDecoderStatus status = ok_DecoderStatus;
 #if defined (LAGRANGE_ENABLE_MPG123)
-    const iBlock *input = &d->input->data;
     if (!d->mpeg) {
         d->inputPos = 0;
         d->mpeg = mpg123_new(NULL, NULL);
@@ -279,11 +322,13 @@ enum iDecoderStatus decodeMpeg_Decoder_(iDecoder *d) {
     }
     /* Feed more input. */ {
         lock_Mutex(&d->input->mtx);
+        const size_t inputSize = size_InputBuf(d->input);
         if (d->input->isComplete) {
-            d->totalInputSize = size_Block(input);
+            d->totalInputSize = inputSize;
         }
-        if (d->inputPos < size_Block(input)) {
-            mpg123_feed(d->mpeg, constData_Block(input) + d->inputPos, size_Block(input) - d->inputPos);
+        if (d->inputPos < inputSize) {
+            mpg123_feed(d->mpeg, (const uint8_t *) ptr_InputBuf(d->input, d->inputPos),
+                        inputSize - d->inputPos);
             if (d->inputPos == 0) {
                 long r; int ch, enc;
                 mpg123_getformat(d->mpeg, &r, &ch, &enc);
@@ -291,7 +336,8 @@ enum iDecoderStatus decodeMpeg_Decoder_(iDecoder *d) {
                 iAssert(ch == d->output.numChannels);
                 iAssert(enc == MPG123_ENC_SIGNED_16);
             }
-            d->inputPos = size_Block(input);
+            d->inputPos = inputSize;
+            discardBefore_InputBuf(d->input, d->inputPos); /* mpg123 has its own copy */
         }
         unlock_Mutex(&d->input->mtx);
     }
@@ -328,7 +374,7 @@ enum iDecoderStatus decodeMpeg_Decoder_(iDecoder *d) {
     /* Check if we know the total length already. This info should be available eventually. */
     const off_t off = mpg123_length(d->mpeg);
     if (off > 0) {
-        d->totalSamples = off;
+        setTotalSamples_Decoder_(d, off);
     }
     writePending_Decoder_(d);
 #endif
@@ -369,7 +415,7 @@ static iThreadResult run_Decoder_(iThread *thread) {
         }
         else {
             iGuardMutex(
-                &d->outputMutex, if (isFull_SampleBuf(&d->output)) {
+                &d->outputMutex, if (d->type && isFull_SampleBuf(&d->output)) {
                     wait_Condition(&d->output.moreNeeded, &d->outputMutex);
                 });
         }
@@ -385,6 +431,7 @@ void init_Decoder(iDecoder *d, iInputBuf *input, const iContentSpec *spec) {
     d->inputFormat    = spec->inputFormat;
     d->totalInputSize = spec->totalInputSize;
     d->outputFreq     = spec->output.freq;
+    d->sampleLock     = 0;
     d->currentSample  = 0;
     d->totalSamples   = spec->totalSamples;
     init_Array(&d->pendingOutput, spec->output.channels * SDL_AUDIO_BITSIZE(spec->output.format) / 8);
@@ -403,14 +450,17 @@ void init_Decoder(iDecoder *d, iInputBuf *input, const iContentSpec *spec) {
     d->id3v2 = NULL;
 #endif
     init_Mutex(&d->outputMutex);
+    SDL_AtomicSet(&d->numUnderruns, 0);
     d->thread = new_Thread(run_Decoder_);
     setUserData_Thread(d->thread, d);
     start_Thread(d->thread);
 }
 
 void deinit_Decoder(iDecoder *d) {
-    d->type = none_DecoderType;
-    signal_Condition(&d->output.moreNeeded);
+    iGuardMutex(&d->outputMutex, {
+        d->type = none_DecoderType;
+        signal_Condition(&d->output.moreNeeded);
+    });
     signal_Condition(&d->input->changed);
     join_Thread(d->thread);
     iRelease(d->thread);
@@ -444,6 +494,7 @@ struct Impl_Player {
     float             volume;
     int               flags;
     iInputBuf *       data;
+    size_t            probedSize; /* input size when the format could not be detected yet */
     uint32_t          lastInteraction;
     iDecoder *        decoder;
 };
@@ -462,6 +513,7 @@ static iContentSpec contentSpec_Player_(const iPlayer *d) {
     iContentSpec content;
     iZap(content);
     const size_t dataSize = size_InputBuf(d->data);
+    iAssert(d->data->discarded == 0); /* checked by start_Player */
     iBuffer *buf = iClob(new_Buffer());
     open_Buffer(buf, &d->data->data);
     if (!cmp_String(&d->mime, "audio/wave") || !cmp_String(&d->mime, "audio/wav") ||
@@ -612,15 +664,19 @@ static void writeOutputSamples_Player_(void *plr, Uint8 *stream, int len) {
     iAssert(d->decoder);
     const size_t sampleSize = sampleSize_Player_(d);
     const size_t count      = len / sampleSize;
-    lock_Mutex(&d->decoder->outputMutex);
-    if (size_SampleBuf(&d->decoder->output) >= count) {
-        read_SampleBuf(&d->decoder->output, count, stream);
-    }
-    else {
-        memset(stream, d->spec.silence, len);
+    /* Never blocks: whatever has been decoded is played, and the rest is silence. */
+    const size_t numRead    = read_SampleBuf(&d->decoder->output, count, stream);
+    if (numRead < count) {
+        memset(stream + numRead * sampleSize, d->spec.silence, (count - numRead) * sampleSize);
+        uint64_t current, total;
+        samples_Decoder_(d->decoder, &current, &total);
+        if (!total || current < total) {
+            SDL_AtomicAdd(&d->decoder->numUnderruns, 1);
+        }
     }
+    /* The decoder may miss this if it wasn't waiting yet, but then it will be woken up by
+       the next callback at the latest, while the rest of the buffer is still playing. */
     signal_Condition(&d->decoder->output.moreNeeded);
-    unlock_Mutex(&d->decoder->outputMutex);
 }
 
 void init_Player(iPlayer *d) {
@@ -629,6 +685,7 @@ void init_Player(iPlayer *d) {
     d->device  = 0;
     d->decoder = NULL;
     d->data    = new_InputBuf();
+    d->probedSize = 0;
     d->volume  = 1.0f;
     d->flags   = 0;
 }
@@ -643,6 +700,15 @@ iBool isStarted_Player(const iPlayer *d) {
     return d->device != 0;
 }
 
+iBool isRestartable_Player(const iPlayer *d) {
+    /* Playing from the start requires the beginning of the stream. */
+    iInputBuf *input = d->data;
+    lock_Mutex(&input->mtx);
+    const iBool ok = (input->discarded == 0);
+    unlock_Mutex(&input->mtx);
+    return ok;
+}
+
 iBool isPaused_Player(const iPlayer *d) {
     if (!d->device) return iTrue;
     return SDL_GetAudioDeviceStatus(d->device) == SDL_AUDIO_PAUSED;
@@ -662,19 +728,16 @@ void updateSourceData_Player(iPlayer *d, const iString *mimeType, const iBlock *
     }
     switch (update) {
         case replace_PlayerUpdate:
-            set_Block(&input->data, data);
+            clear_InputBuf(input);
+            append_InputBuf(input, constData_Block(data), size_Block(data));
             input->isComplete = iFalse;
+            d->probedSize = 0;
             break;
-        case append_PlayerUpdate: {
-            const size_t oldSize = size_Block(&input->data);
-            const size_t newSize = size_Block(data);
-            iAssert(newSize >= oldSize);
-            /* The old parts cannot have changed. */
-//            iAssert(memcmp(constData_Block(&input->data), constData_Block(data), oldSize) == 0);
-            appendData_Block(&input->data, constBegin_Block(data) + oldSize, newSize - oldSize);
+        case append_PlayerUpdate:
+            /* `data` continues the stream; the caller doesn't need to keep earlier data. */
+            append_InputBuf(input, constData_Block(data), size_Block(data));
             input->isComplete = iFalse;
             break;
-        }
         case complete_PlayerUpdate:
             input->isComplete = iTrue;
             break;
@@ -684,11 +747,18 @@ void updateSourceData_Player(iPlayer *d, const iString *mimeType, const iBlock *
 }
 
 iBool start_Player(iPlayer *d) {
-    if (isStarted_Player(d)) {
+    if (isStarted_Player(d) || !isRestartable_Player(d)) {
+        return iFalse;
+    }
+    /* Probing examines all of the input received so far, so if the format couldn't be
+       detected yet, wait until there is considerably more input before trying again. */
+    const size_t inputSize = size_InputBuf(d->data);
+    if (d->probedSize && inputSize < 2 * d->probedSize && !d->data->isComplete) {
         return iFalse;
     }
     iContentSpec content = contentSpec_Player_(d);
     if (!content.output.freq) {
+        d->probedSize = iMax(inputSize, 1);
         return iFalse;
     }
     content.output.callback = writeOutputSamples_Player_;
@@ -755,12 +825,16 @@ const iString *tag_Player(const iPlayer *d, enum iPlayerTag tag) {
 
 float time_Player(const iPlayer *d) {
     if (!d->decoder) return 0;
-    return (float) ((double) d->decoder->currentSample / (double) d->spec.freq);
+    uint64_t current;
+    samples_Decoder_(d->decoder, &current, NULL);
+    return (float) ((double) current / (double) d->spec.freq);
 }
 
 float duration_Player(const iPlayer *d) {
     if (!d->decoder) return 0;
-    return (float) ((double) d->decoder->totalSamples / (double) d->spec.freq);
+    uint64_t total;
+    samples_Decoder_(d->decoder, NULL, &total);
+    return (float) ((double) total / (double) d->spec.freq);
 }
 
 float streamProgress_Player(const iPlayer *d) {
@@ -800,6 +874,14 @@ iString *metadataLabel_Player(const iPlayer *d) {
         appendFormat_String(meta, "%d-bit %s %d Hz", SDL_AUDIO_BITSIZE(d->decoder->inputFormat),
                                 SDL_AUDIO_ISFLOAT(d->decoder->inputFormat) ? "float" : "integer",
                                 d->spec.freq);
+        const int underruns = numUnderruns_Player(d);
+        if (underruns) {
+            appendFormat_String(meta, "\nUnderruns: %d", underruns);
+        }
     }
     return meta;
 }
+
+int numUnderruns_Player(const iPlayer *d) {
+    return d->decoder ? SDL_AtomicGet(&d->decoder->numUnderruns) : 0;
+}
@@ -59,6 +59,7 @@ void    setNotIdle_Player       (iPlayer *);
 int     flags_Player            (const iPlayer *);
 const iString *tag_Player       (const iPlayer *, enum iPlayerTag tag);
 iBool   isStarted_Player        (const iPlayer *);
+iBool   isRestartable_Player    (const iPlayer *); /* beginning of the stream still available */
 iBool   isPaused_Player         (const iPlayer *);
 float   volume_Player           (const iPlayer *);
 float   time_Player             (const iPlayer *);
@@ -67,3 +68,4 @@ float   streamProgress_Player   (const iPlayer *); /* normalized 0...1 */
 
 uint32_t    idleTimeMs_Player       (const iPlayer *);
 iString *   metadataLabel_Player    (const iPlayer *);
+int         numUnderruns_Player     (const iPlayer *); /* times the output ran out of samples */
@@ -24,6 +24,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "visited.h"
 #include "gmrequest.h"
 #include "app.h"
+#include "persist.h"
 
 #include <the_Foundation/file.h>
 #include <the_Foundation/hash.h>
@@ -169,34 +170,38 @@ void load_Bookmarks(iBookmarks *d, const char *dirPath) {
     iRelease(f);
 }
 
-void save_Bookmarks(const iBookmarks *d, const char *dirPath) {
+static void serialize_Bookmarks_(const void *object, iStream *outs) {
+    const iBookmarks *d = object;
     lock_Mutex(d->mtx);
     iRegExp *remotePattern = iClob(new_RegExp("\\bremote\\b", caseSensitive_RegExpOption));
-    iFile *f = newCStr_File(concatPath_CStr(dirPath, fileName_Bookmarks_));
-    if (open_File(f, writeOnly_FileMode | text_FileMode)) {
-        iString *str = collectNew_String();
-        iConstForEach(Hash, i, &d->bookmarks) {
-            const iBookmark *bm = (const iBookmark *) i.value;
-            iRegExpMatch m;
-            init_RegExpMatch(&m);
-            if (matchString_RegExp(remotePattern, &bm->tags, &m)) {
-                /* Remote bookmarks are not saved. */
-                continue;
-            }
-            format_String(str,
-                          "%08x %lf %s\n%s\n%s\n",
-                          bm->icon,
-                          seconds_Time(&bm->when),
-                          cstr_String(&bm->url),
-                          cstr_String(&bm->title),
-                          cstr_String(&bm->tags));
-            writeData_File(f, cstr_String(str), size_String(str));
+    iString *str = collectNew_String();
+    iConstForEach(Hash, i, &d->bookmarks) {
+        const iBookmark *bm = (const iBookmark *) i.value;
+        iRegExpMatch m;
+        init_RegExpMatch(&m);
+        if (matchString_RegExp(remotePattern, &bm->tags, &m)) {
+            /* Remote bookmarks are not saved. */
+            continue;
         }
+        format_String(str,
+                      "%08x %lf %s\n%s\n%s\n",
+                      bm->icon,
+                      seconds_Time(&bm->when),
+                      cstr_String(&bm->url),
+                      cstr_String(&bm->title),
+                      cstr_String(&bm->tags));
+        writeData_Stream(outs, cstr_String(str), size_String(str));
     }
-    iRelease(f);
     unlock_Mutex(d->mtx);
 }
 
+void save_Bookmarks(const iBookmarks *d, const char *dirPath) {
+    requestSave_Persist("bookmarks",
+                        concatPath_CStr(dirPath, fileName_Bookmarks_),
+                        serialize_Bookmarks_,
+                        d);
+}
+
 uint32_t add_Bookmarks(iBookmarks *d, const iString *url, const iString *title, const iString *tags,
                        iChar icon) {
     lock_Mutex(d->mtx);
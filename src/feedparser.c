@@ -0,0 +1,640 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include "feedparser.h"
+
+#include <the_Foundation/ptrarray.h>
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *findCStr_(const char *start, const char *end, const char *str) {
+    const size_t len = strlen(str);
+    for (const char *pos = start; pos + len <= end; pos++) {
+        if (*pos == *str && !memcmp(pos, str, len)) {
+            return pos;
+        }
+    }
+    return NULL;
+}
+
+static iBool startsWith_(const char *start, const char *end, const char *prefix) {
+    const size_t len = strlen(prefix);
+    return (size_t) (end - start) >= len && !memcmp(start, prefix, len);
+}
+
+static const char *skipSpace_(const char *pos, const char *end) {
+    while (pos < end && isspace((unsigned char) *pos)) {
+        pos++;
+    }
+    return pos;
+}
+
+static const char *skipName_(const char *pos, const char *end) {
+    while (pos < end && !isspace((unsigned char) *pos) && *pos != '=' && *pos != '/' &&
+           *pos != '>') {
+        pos++;
+    }
+    return pos;
+}
+
+void appendDecoded_Xml(iString *d, iRangecc text) {
+    static const struct {
+        const char *name;
+        iChar       ch;
+    } entities_[] = {
+        { "lt", '<' }, { "gt", '>' }, { "amp", '&' }, { "quot", '"' }, { "apos", '\'' },
+    };
+    const char *pos = text.start;
+    while (pos < text.end) {
+        const char *amp = memchr(pos, '&', text.end - pos);
+        if (!amp) {
+            appendCStrN_String(d, pos, text.end - pos);
+            break;
+        }
+        appendCStrN_String(d, pos, amp - pos);
+        pos = amp + 1;
+        const char *semi = memchr(pos, ';', iMin(text.end - pos, 10));
+        iChar       ch   = 0;
+        if (semi) {
+            if (*pos == '#') {
+                char digits[10];
+                memcpy(digits, pos + 1, semi - pos - 1);
+                digits[semi - pos - 1] = 0;
+                ch = (iChar) (digits[0] == 'x' || digits[0] == 'X' ? strtoul(digits + 1, NULL, 16)
+                                                                    : strtoul(digits, NULL, 10));
+            }
+            else {
+                iForIndices(i, entities_) {
+                    if (equal_Rangecc((iRangecc){ pos, semi }, entities_[i].name)) {
+                        ch = entities_[i].ch;
+                        break;
+                    }
+                }
+            }
+        }
+        if (ch && ch <= 0x10ffff && !(ch >= 0xd800 && ch <= 0xdfff)) { /* no surrogates */
+            appendChar_String(d, ch);
+            pos = semi + 1;
+        }
+        else {
+            appendChar_String(d, '&'); /* not an entity we know */
+        }
+    }
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+struct Impl_XmlTokenizer {
+    iBlock       buf;  /* received data that has not been tokenized yet */
+    size_t       scanPos;   /* where to continue looking for the end of the first token */
+    char         scanQuote; /* open quote at scanPos inside a tag */
+    iRangecc     tag;  /* attributes of the start tag being handled */
+    iString      text;
+    void *       context;
+    iXmlTagFunc  startTag;
+    iXmlTagFunc  endTag;
+    iXmlTextFunc textFunc;
+};
+
+iDefineTypeConstruction(XmlTokenizer)
+
+void init_XmlTokenizer(iXmlTokenizer *d) {
+    init_Block(&d->buf, 0);
+    d->scanPos   = 0;
+    d->scanQuote = 0;
+    d->tag      = iNullRange;
+    init_String(&d->text);
+    d->context  = NULL;
+    d->startTag = NULL;
+    d->endTag   = NULL;
+    d->textFunc = NULL;
+}
+
+void deinit_XmlTokenizer(iXmlTokenizer *d) {
+    deinit_String(&d->text);
+    deinit_Block(&d->buf);
+}
+
+void setHandlers_XmlTokenizer(iXmlTokenizer *d, void *context, iXmlTagFunc startTag,
+                              iXmlTagFunc endTag, iXmlTextFunc text) {
+    d->context  = context;
+    d->startTag = startTag;
+    d->endTag   = endTag;
+    d->textFunc = text;
+}
+
+static void emitText_XmlTokenizer_(iXmlTokenizer *d, iRangecc text, iBool isRaw) {
+    if (isEmpty_Range(&text) || !d->textFunc) {
+        return;
+    }
+    clear_String(&d->text);
+    if (isRaw) {
+        appendCStrN_String(&d->text, text.start, size_Range(&text));
+    }
+    else {
+        appendDecoded_Xml(&d->text, text);
+    }
+    d->textFunc(d->context, &d->text);
+}
+
+static void emitTag_XmlTokenizer_(iXmlTokenizer *d, iRangecc tag) {
+    if (*tag.start == '/') {
+        const iRangecc name = { tag.start + 1, skipName_(tag.start + 1, tag.end) };
+        if (d->endTag) {
+            d->endTag(d->context, d, name);
+        }
+        return;
+    }
+    const iBool isEmptyElement = tag.end > tag.start && tag.end[-1] == '/';
+    if (isEmptyElement) {
+        tag.end--;
+    }
+    const iRangecc name = { tag.start, skipName_(tag.start, tag.end) };
+    d->tag = (iRangecc){ name.end, tag.end };
+    if (d->startTag) {
+        d->startTag(d->context, d, name);
+    }
+    d->tag = iNullRange;
+    if (isEmptyElement && d->endTag) {
+        d->endTag(d->context, d, name);
+    }
+}
+
+static const char *tagEnd_(const char *pos, const char *end, char *quote) {
+    for (; pos < end; pos++) {
+        if (*quote) {
+            if (*pos == *quote) {
+                *quote = 0;
+            }
+        }
+        else if (*pos == '"' || *pos == '\'') {
+            *quote = *pos;
+        }
+        else if (*pos == '>') {
+            return pos;
+        }
+    }
+    return NULL;
+}
+
+static const char *scanFrom_XmlTokenizer_(const iXmlTokenizer *d, const char *begin,
+                                          const char *pos, size_t prefixLen) {
+    /* An incomplete token is left at the beginning of the buffer. The part of it that was
+       already searched is not searched again when more data arrives. */
+    if (pos == begin && d->scanPos > prefixLen) {
+        return begin + d->scanPos;
+    }
+    return pos + prefixLen;
+}
+
+static const char *findEnd_XmlTokenizer_(iXmlTokenizer *d, const char *begin, const char *pos,
+                                         const char *end, size_t prefixLen, const char *str) {
+    const char *found = findCStr_(scanFrom_XmlTokenizer_(d, begin, pos, prefixLen), end, str);
+    if (!found) {
+        /* The terminator may be split between writes. */
+        const size_t overlap = strlen(str) - 1;
+        d->scanPos = iMax((size_t) (end - pos), prefixLen + overlap) - overlap;
+    }
+    return found;
+}
+
+static void tokenize_XmlTokenizer_(iXmlTokenizer *d, iBool isFinal) {
+    const char *begin = constData_Block(&d->buf);
+    const char *end   = begin + size_Block(&d->buf);
+    const char *pos   = begin;
+    while (pos < end) {
+        if (*pos != '<') {
+            const char *from = scanFrom_XmlTokenizer_(d, begin, pos, 0);
+            const char *lt   = memchr(from, '<', end - from);
+            if (!lt) {
+                if (!isFinal) {
+                    d->scanPos = end - pos;
+                    break; /* the text may continue */
+                }
+                lt = end;
+            }
+            emitText_XmlTokenizer_(d, (iRangecc){ pos, lt }, iFalse);
+            pos        = lt;
+            d->scanPos = 0;
+            continue;
+        }
+        /* Markup is handled only when it is complete. */
+        const char *markupEnd = NULL;
+        if (startsWith_(pos, end, "<!--")) {
+            markupEnd = findEnd_XmlTokenizer_(d, begin, pos, end, 4, "-->");
+            if (markupEnd) markupEnd += 3;
+        }
+        else if (startsWith_(pos, end, "<![CDATA[")) {
+            markupEnd = findEnd_XmlTokenizer_(d, begin, pos, end, 9, "]]>");
+            if (markupEnd) {
+                emitText_XmlTokenizer_(d, (iRangecc){ pos + 9, markupEnd }, iTrue);
+                markupEnd += 3;
+            }
+        }
+        else if (startsWith_(pos, end, "<?")) {
+            markupEnd = findEnd_XmlTokenizer_(d, begin, pos, end, 2, "?>");
+            if (markupEnd) markupEnd += 2;
+        }
+        else if (startsWith_(pos, end, "<!")) {
+            /* Document type declaration, possibly with an internal subset. It appears once
+               at the start of the document, so it is simply searched again. */
+            char quote = 0;
+            markupEnd = tagEnd_(pos + 2, end, &quote);
+            const char *subset = memchr(pos, '[', (markupEnd ? markupEnd : end) - pos);
+            if (subset) {
+                quote     = 0;
+                markupEnd = findCStr_(subset, end, "]");
+                markupEnd = markupEnd ? tagEnd_(markupEnd, end, &quote) : NULL;
+            }
+            if (markupEnd) markupEnd++;
+        }
+        else {
+            char quote = (pos == begin ? d->scanQuote : 0);
+            markupEnd  = tagEnd_(scanFrom_XmlTokenizer_(d, begin, pos, 1), end, &quote);
+            if (markupEnd) {
+                emitTag_XmlTokenizer_(d, (iRangecc){ pos + 1, markupEnd });
+                markupEnd++;
+            }
+            else {
+                d->scanPos   = end - pos;
+                d->scanQuote = quote;
+            }
+        }
+        if (!markupEnd) {
+            break;
+        }
+        pos          = markupEnd;
+        d->scanPos   = 0;
+        d->scanQuote = 0;
+    }
+    if (isFinal) {
+        clear_Block(&d->buf);
+        d->scanPos   = 0;
+        d->scanQuote = 0;
+    }
+    else {
+        remove_Block(&d->buf, 0, pos - begin);
+    }
+}
+
+void write_XmlTokenizer(iXmlTokenizer *d, const iBlock *data) {
+    append_Block(&d->buf, data);
+    tokenize_XmlTokenizer_(d, iFalse);
+}
+
+void finish_XmlTokenizer(iXmlTokenizer *d) {
+    tokenize_XmlTokenizer_(d, iTrue);
+}
+
+iBool attribute_XmlTokenizer(const iXmlTokenizer *d, const char *name, iString *value_out) {
+    const char *pos = d->tag.start;
+    const char *end = d->tag.end;
+    while (pos && pos < end) {
+        pos = skipSpace_(pos, end);
+        const iRangecc attrib = { pos, skipName_(pos, end) };
+        if (isEmpty_Range(&attrib)) {
+            break;
+        }
+        pos = skipSpace_(attrib.end, end);
+        if (pos == end || *pos != '=') {
+            continue; /* no value */
+        }
+        pos = skipSpace_(pos + 1, end);
+        if (pos == end || (*pos != '"' && *pos != '\'')) {
+            break;
+        }
+        const char *valueEnd = memchr(pos + 1, *pos, end - pos - 1);
+        if (!valueEnd) {
+            break;
+        }
+        if (equal_Rangecc(attrib, name)) {
+            clear_String(value_out);
+            appendDecoded_Xml(value_out, (iRangecc){ pos + 1, valueEnd });
+            return iTrue;
+        }
+        pos = valueEnd + 1;
+    }
+    return iFalse;
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+void init_FeedItem(iFeedItem *d) {
+    init_String(&d->title);
+    init_String(&d->url);
+    iZap(d->date);
+}
+
+void deinit_FeedItem(iFeedItem *d) {
+    deinit_String(&d->url);
+    deinit_String(&d->title);
+}
+
+iDefineTypeConstruction(FeedItem)
+
+/*----------------------------------------------------------------------------------------------*/
+
+struct Impl_FeedParser {
+    iXmlTokenizer *  xml;
+    enum iFeedFormat format;
+    int              depth;
+    int              itemDepth; /* zero when not inside an item */
+    iString          title;
+    iString          subtitle;
+    iString          text;      /* contents of the current element */
+    iString          attrib;
+    iFeedItem *      item;
+    iDate            updated;
+    iDate            published;
+    iPtrArray        items;     /* complete items */
+    size_t           numTaken;
+};
+
+iDefineTypeConstruction(FeedParser)
+
+static void setNormalized_(iString *d, const iString *text) {
+    /* Titles must fit on a single line. */
+    clear_String(d);
+    iBool isSpace = iFalse;
+    iConstForEach(String, i, text) {
+        if (isSpace_Char(i.value)) {
+            isSpace = !isEmpty_String(d);
+            continue;
+        }
+        if (isSpace) {
+            appendChar_String(d, ' ');
+            isSpace = iFalse;
+        }
+        appendChar_String(d, i.value);
+    }
+}
+
+static iBool isValid_Date_(const iDate *date) {
+    return date->year > 0 && date->month >= 1 && date->month <= 12 && date->day >= 1 &&
+           date->day <= 31;
+}
+
+static void parseIsoDate_(iDate *date, const iString *text) {
+    /* Only the date is used: YYYY-MM-DDThh:mm:ss... */
+    int year = 0, month = 0, day = 0;
+    iZap(*date);
+    if (sscanf(cstr_String(text), " %4d-%2d-%2d", &year, &month, &day) == 3) {
+        *date = (iDate){ .year = year, .month = month, .day = day };
+    }
+}
+
+static void parseRfc822Date_(iDate *date, const iString *text) {
+    /* [Day, ]DD Mon YYYY hh:mm:ss zone */
+    static const char *months_[] = { "jan", "feb", "mar", "apr", "may", "jun",
+                                     "jul", "aug", "sep", "oct", "nov", "dec" };
+    const char *str   = cstr_String(text);
+    const char *comma = strchr(str, ',');
+    int         day = 0, year = 0;
+    char        mon[4];
+    iZap(*date);
+    if (sscanf(comma ? comma + 1 : str, " %d %3s %d", &day, mon, &year) != 3) {
+        return;
+    }
+    if (year < 100) {
+        year += (year < 50 ? 2000 : 1900);
+    }
+    iForIndices(i, months_) {
+        if (equalCase_Rangecc((iRangecc){ mon, mon + strlen(mon) }, months_[i])) {
+            *date = (iDate){ .year = year, .month = i + 1, .day = day };
+            break;
+        }
+    }
+}
+
+static void beginItem_FeedParser_(iFeedParser *d) {
+    if (d->item) {
+        delete_FeedItem(d->item);
+    }
+    d->item      = new_FeedItem();
+    d->itemDepth = d->depth;
+    iZap(d->updated);
+    iZap(d->published);
+}
+
+static void endItem_FeedParser_(iFeedParser *d) {
+    iFeedItem *item = d->item;
+    if (d->format == atom_FeedFormat) {
+        item->date = isValid_Date_(&d->updated) ? d->updated : d->published;
+    }
+    if (!isEmpty_String(&item->title) && !isEmpty_String(&item->url) &&
+        isValid_Date_(&item->date)) {
+        pushBack_PtrArray(&d->items, item);
+    }
+    else {
+        delete_FeedItem(item);
+    }
+    d->item      = NULL;
+    d->itemDepth = 0;
+}
+
+static int fieldDepth_FeedParser_(const iFeedParser *d) {
+    /* Elements nested deeper than this are markup inside the text of a field. */
+    if (d->item) {
+        return d->itemDepth + 1;
+    }
+    return d->format == rss_FeedFormat ? 3 : 2;
+}
+
+static void startTag_FeedParser_(void *context, const iXmlTokenizer *xml, iRangecc name) {
+    iFeedParser *d = context;
+    d->depth++;
+    if (d->depth <= fieldDepth_FeedParser_(d)) {
+        clear_String(&d->text);
+    }
+    if (d->depth == 1) {
+        if (equal_Rangecc(name, "feed") && attribute_XmlTokenizer(xml, "xmlns", &d->attrib) &&
+            equal_Rangecc(range_String(&d->attrib), "http://www.w3.org/2005/Atom")) {
+            d->format = atom_FeedFormat;
+        }
+        else if (equal_Rangecc(name, "rss")) {
+            d->format = rss_FeedFormat;
+        }
+        else {
+            d->format = invalid_FeedFormat;
+        }
+        return;
+    }
+    if (d->format == atom_FeedFormat) {
+        if (d->depth == 2 && equal_Rangecc(name, "entry")) {
+            beginItem_FeedParser_(d);
+        }
+        else if (d->item && d->depth == d->itemDepth + 1 && equal_Rangecc(name, "link") &&
+                 attribute_XmlTokenizer(xml, "href", &d->attrib)) {
+            /* We're happy with the first gemini URL. */
+            if (!startsWithCase_String(&d->item->url, "gemini:")) {
+                set_String(&d->item->url, &d->attrib);
+            }
+        }
+    }
+    else if (d->format == rss_FeedFormat) {
+        if (d->depth == 3 && equal_Rangecc(name, "item")) {
+            beginItem_FeedParser_(d);
+        }
+    }
+}
+
+static void endTag_FeedParser_(void *context, const iXmlTokenizer *xml, iRangecc name) {
+    iFeedParser *d = context;
+    iUnused(xml);
+    if (d->format == atom_FeedFormat) {
+        if (d->item && d->depth == d->itemDepth + 1) {
+            if (equal_Rangecc(name, "title")) {
+                setNormalized_(&d->item->title, &d->text);
+            }
+            else if (equal_Rangecc(name, "updated")) {
+                parseIsoDate_(&d->updated, &d->text);
+            }
+            else if (equal_Rangecc(name, "published")) {
+                parseIsoDate_(&d->published, &d->text);
+            }
+        }
+        else if (d->item && d->depth == d->itemDepth) {
+            endItem_FeedParser_(d);
+        }
+        else if (d->depth == 2) {
+            if (equal_Rangecc(name, "title")) {
+                setNormalized_(&d->title, &d->text);
+            }
+            else if (equal_Rangecc(name, "subtitle")) {
+                setNormalized_(&d->subtitle, &d->text);
+            }
+        }
+    }
+    else if (d->format == rss_FeedFormat) {
+        if (d->item && d->depth == d->itemDepth + 1) {
+            if (equal_Rangecc(name, "title")) {
+                setNormalized_(&d->item->title, &d->text);
+            }
+            else if (equal_Rangecc(name, "link")) {
+                set_String(&d->item->url, &d->text);
+                trim_String(&d->item->url);
+            }
+            else if (equal_Rangecc(name, "pubDate")) {
+                parseRfc822Date_(&d->item->date, &d->text);
+            }
+        }
+        else if (d->item && d->depth == d->itemDepth) {
+            endItem_FeedParser_(d);
+        }
+        else if (d->depth == 3) {
+            if (equal_Rangecc(name, "title")) {
+                setNormalized_(&d->title, &d->text);
+            }
+            else if (equal_Rangecc(name, "description")) {
+                setNormalized_(&d->subtitle, &d->text);
+            }
+        }
+    }
+    if (d->depth <= fieldDepth_FeedParser_(d)) {
+        clear_String(&d->text);
+    }
+    d->depth--;
+}
+
+static void text_FeedParser_(void *context, const iString *text) {
+    iFeedParser *d = context;
+    if (d->format == atom_FeedFormat || d->format == rss_FeedFormat) {
+        append_String(&d->text, text);
+    }
+}
+
+void init_FeedParser(iFeedParser *d) {
+    d->xml = new_XmlTokenizer();
+    setHandlers_XmlTokenizer(
+        d->xml, d, startTag_FeedParser_, endTag_FeedParser_, text_FeedParser_);
+    d->format    = unknown_FeedFormat;
+    d->depth     = 0;
+    d->itemDepth = 0;
+    init_String(&d->title);
+    init_String(&d->subtitle);
+    init_String(&d->text);
+    init_String(&d->attrib);
+    d->item = NULL;
+    iZap(d->updated);
+    iZap(d->published);
+    init_PtrArray(&d->items);
+    d->numTaken = 0;
+}
+
+void deinit_FeedParser(iFeedParser *d) {
+    for (size_t i = d->numTaken; i < size_PtrArray(&d->items); i++) {
+        delete_FeedItem(at_PtrArray(&d->items, i));
+    }
+    deinit_PtrArray(&d->items);
+    if (d->item) {
+        delete_FeedItem(d->item);
+    }
+    deinit_String(&d->attrib);
+    deinit_String(&d->text);
+    deinit_String(&d->subtitle);
+    deinit_String(&d->title);
+    delete_XmlTokenizer(d->xml);
+}
+
+void write_FeedParser(iFeedParser *d, const iBlock *data) {
+    if (d->format != invalid_FeedFormat) {
+        write_XmlTokenizer(d->xml, data);
+    }
+}
+
+void finish_FeedParser(iFeedParser *d) {
+    finish_XmlTokenizer(d->xml);
+    if (d->format == unknown_FeedFormat) {
+        d->format = invalid_FeedFormat;
+    }
+}
+
+enum iFeedFormat format_FeedParser(const iFeedParser *d) {
+    return d->format;
+}
+
+const iString *title_FeedParser(const iFeedParser *d) {
+    return &d->title;
+}
+
+const iString *subtitle_FeedParser(const iFeedParser *d) {
+    return &d->subtitle;
+}
+
+iBool hasItems_FeedParser(const iFeedParser *d) {
+    return d->numTaken < size_PtrArray(&d->items);
+}
+
+iFeedItem *takeItem_FeedParser(iFeedParser *d) {
+    if (!hasItems_FeedParser(d)) {
+        return NULL;
+    }
+    iFeedItem *item = at_PtrArray(&d->items, d->numTaken++);
+    if (d->numTaken == size_PtrArray(&d->items)) {
+        clear_PtrArray(&d->items);
+        d->numTaken = 0;
+    }
+    return item;
+}
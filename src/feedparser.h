@@ -0,0 +1,78 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#pragma once
+
+#include <the_Foundation/block.h>
+#include <the_Foundation/range.h>
+#include <the_Foundation/string.h>
+#include <the_Foundation/time.h>
+
+/* Streaming XML tokenizer. Data may be written in pieces as it arrives. Handlers are called
+   for each complete tag and for the entity-decoded text between tags. */
+
+iDeclareType(XmlTokenizer)
+iDeclareTypeConstruction(XmlTokenizer)
+
+typedef void (*iXmlTagFunc) (void *context, const iXmlTokenizer *, iRangecc name);
+typedef void (*iXmlTextFunc)(void *context, const iString *text);
+
+void    setHandlers_XmlTokenizer    (iXmlTokenizer *, void *context, iXmlTagFunc startTag,
+                                     iXmlTagFunc endTag, iXmlTextFunc text);
+void    write_XmlTokenizer          (iXmlTokenizer *, const iBlock *data);
+void    finish_XmlTokenizer         (iXmlTokenizer *); /* end of data */
+iBool   attribute_XmlTokenizer      (const iXmlTokenizer *, const char *name,
+                                     iString *value_out); /* only in the start tag handler */
+
+void    appendDecoded_Xml           (iString *, iRangecc text); /* resolves entities */
+
+/*----------------------------------------------------------------------------------------------*/
+
+/* Parser for Atom and RSS 2.0 feeds. Items can be taken as soon as they are complete. */
+
+iDeclareType(FeedItem)
+iDeclareTypeConstruction(FeedItem)
+
+struct Impl_FeedItem {
+    iString title;
+    iString url;
+    iDate   date;
+};
+
+iDeclareType(FeedParser)
+iDeclareTypeConstruction(FeedParser)
+
+enum iFeedFormat {
+    unknown_FeedFormat, /* not enough data received yet */
+    atom_FeedFormat,
+    rss_FeedFormat,
+    invalid_FeedFormat,
+};
+
+void            write_FeedParser    (iFeedParser *, const iBlock *data);
+void            finish_FeedParser   (iFeedParser *);
+
+enum iFeedFormat format_FeedParser  (const iFeedParser *);
+const iString * title_FeedParser    (const iFeedParser *);
+const iString * subtitle_FeedParser (const iFeedParser *);
+iBool           hasItems_FeedParser (const iFeedParser *);
+iFeedItem *     takeItem_FeedParser (iFeedParser *); /* oldest complete item; caller deletes */
@@ -22,10 +22,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include "feeds.h"
 #include "bookmarks.h"
+#include "feedparser.h"
 #include "gmrequest.h"
 #include "visited.h"
 #include "app.h"
 
+#include <the_Foundation/buffer.h>
+#include <the_Foundation/condition.h>
 #include <the_Foundation/file.h>
 #include <the_Foundation/hash.h>
 #include <the_Foundation/intset.h>
@@ -37,9 +40,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <the_Foundation/thread.h>
 #include <SDL_timer.h>
 #include <ctype.h>
+#include <stdio.h>
+#include <string.h>
 
 iDeclareType(Feeds)
 iDeclareType(FeedJob)
+iDeclareType(FeedSchedule)
 
 iDefineTypeConstruction(FeedEntry)
 
@@ -76,68 +82,201 @@ iBool isUnread_FeedEntry(const iFeedEntry *d) {
 /*----------------------------------------------------------------------------------------------*/
 
 static int requestTimeoutSeconds_FeedJob_ = 10.0f;
+static int maxRedirects_FeedJob_          = 5;
 
 struct Impl_FeedJob {
     iString     url;
+    iString     host; /* for limiting concurrent requests per server */
     uint32_t    bookmarkId;
     iTime       startTime;
     iBool       isFirstUpdate; /* hasn't been checked ever before */
     iBool       checkHeadings;
+    int         redirectCount;
     iGmRequest *request;
     iPtrArray   results;
 };
 
+static void wakeUp_Feeds_(void);
+
 static void init_FeedJob(iFeedJob *d, const iBookmark *bookmark) {
     initCopy_String(&d->url, &bookmark->url);
+    init_String(&d->host);
+    setRange_String(&d->host, urlHost_String(&d->url));
     d->bookmarkId = id_Bookmark(bookmark);
     d->request = NULL;
     init_PtrArray(&d->results);
     iZap(d->startTime);
     d->isFirstUpdate = iFalse;
     d->checkHeadings = hasTag_Bookmark(bookmark, "headings");
+    d->redirectCount = 0;
+}
+
+static void requestFinished_FeedJob_(iFeedJob *d, iGmRequest *req) {
+    iUnused(d, req);
+    wakeUp_Feeds_();
+}
+
+static void releaseRequest_FeedJob_(iFeedJob *d) {
+    if (d->request) {
+        iDisconnect(GmRequest, d->request, finished, d, requestFinished_FeedJob_);
+        iReleasePtr(&d->request);
+    }
 }
 
 static void deinit_FeedJob(iFeedJob *d) {
-    iRelease(d->request);
+    releaseRequest_FeedJob_(d);
     iForEach(PtrArray, i, &d->results) {
         delete_FeedEntry(i.ptr);
     }
     deinit_PtrArray(&d->results);
+    deinit_String(&d->host);
     deinit_String(&d->url);
 }
 
-static iBool isTimedOut_FeedJob_(iFeedJob *d) {
-    return elapsedSeconds_Time(&d->startTime) > requestTimeoutSeconds_FeedJob_;
+static double timeLeft_FeedJob_(const iFeedJob *d) {
+    return requestTimeoutSeconds_FeedJob_ - elapsedSeconds_Time(&d->startTime);
+}
+
+static iBool isTimedOut_FeedJob_(const iFeedJob *d) {
+    return timeLeft_FeedJob_(d) < 0.0;
+}
+
+static void submit_FeedJob_(iFeedJob *d, const iString *url) {
+    releaseRequest_FeedJob_(d);
+    d->request = new_GmRequest(certs_App());
+    iConnect(GmRequest, d->request, finished, d, requestFinished_FeedJob_);
+    /* XML feeds are parsed directly into entries. */
+    enableBuiltinFilters_GmRequest(d->request, iFalse);
+    setUrl_GmRequest(d->request, url);
+    initCurrent_Time(&d->startTime);
+    submit_GmRequest(d->request);
+}
+
+static iBool followRedirect_FeedJob_(iFeedJob *d) {
+    if (category_GmStatusCode(status_GmRequest(d->request)) != categoryRedirect_GmStatusCode ||
+        isEmpty_String(meta_GmRequest(d->request)) || d->redirectCount >= maxRedirects_FeedJob_) {
+        return iFalse;
+    }
+    iBool followed = iFalse;
+    iBeginCollect();
+    const iString *srcUrl = url_GmRequest(d->request);
+    const iString *dstUrl = absoluteUrl_String(srcUrl, meta_GmRequest(d->request));
+    /* Like when browsing, only redirects that keep the same scheme are automatic. */
+    if (equalCase_Rangecc(urlScheme_String(dstUrl), cstr_Rangecc(urlScheme_String(srcUrl)))) {
+        d->redirectCount++;
+        submit_FeedJob_(d, dstUrl);
+        followed = iTrue;
+    }
+    iEndCollect();
+    return followed;
 }
 
 iDefineTypeConstructionArgs(FeedJob, (const iBookmark *bm), bm)
 
 /*----------------------------------------------------------------------------------------------*/
 
-static const char *feedsFilename_Feeds_         = "feeds.txt";
-static const int   updateIntervalSeconds_Feeds_ = 4 * 60 * 60;
+/* Each feed is checked at its own interval, which adapts to how often new entries appear. */
+struct Impl_FeedSchedule {
+    uint32_t bookmarkId;
+    int      interval; /* seconds */
+    iTime    nextCheck;
+};
+
+static int cmp_FeedSchedule_(const void *a, const void *b) {
+    const iFeedSchedule *s1 = a, *s2 = b;
+    return iCmp(s1->bookmarkId, s2->bookmarkId);
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+static const char *textFilename_Feeds_          = "feeds.txt"; /* older versions */
+static const char *fileName_Feeds_              = "feeds.bin";
+static const char *journalFileName_Feeds_       = "feeds.journal";
+static const char *magic_Feeds_                 = "lgFd";
+static const char *journalMagic_Feeds_          = "lgFj";
+static const size_t maxJournalSize_Feeds_       = 256 * 1024; /* then rewrite feeds.bin */
+static const int   checkIntervalSeconds_Feeds_  = 15 * 60; /* look for feeds due for update */
+static const int   updateIntervalSeconds_Feeds_ = 4 * 60 * 60; /* initial interval per feed */
+static const int   minIntervalSeconds_Feeds_    = 60 * 60;
+static const int   maxIntervalSeconds_Feeds_    = 3 * 24 * 60 * 60;
 
 struct Impl_Feeds {
     iMutex *  mtx;
     iString   saveDir;
     iIntSet   previouslyCheckedFeeds; /* bookmark IDs */
+    iSortedArray schedule; /* FeedSchedule for each checked feed, sorted by bookmark ID */
     iTime     lastRefreshedAt;
     int       refreshTimer;
     iThread * worker;
     iBool     stopWorker;
+    iCondition wakeup; /* a request has finished, or the worker should stop */
+    iBool     isWakeupPending;
     iPtrArray jobs; /* pending */
     iSortedArray entries; /* pointers to all discovered feed entries, sorted by entry ID (URL) */
+    iThread * loader;
+    iBool     isLoaded;
+    iBool     isRefreshPending; /* refresh requested while loading */
+    iPtrArray unsavedEntries; /* new or changed since the last save */
+    size_t    journalSize;
+    iBool     needsCompaction; /* entries have been removed, rewrite everything */
+    iSortedArray loadUrls; /* FeedUrl for each subscription, used while loading */
+};
+
+enum iFeedsVersion {
+    initial_FeedsVersion = 1,
+    latest_FeedsVersion  = 1,
 };
 
 static iFeeds feeds_;
 
-#define maxConcurrentRequests_Feeds 4
+static void wakeUp_Feeds_(void) {
+    iFeeds *d = &feeds_;
+    lock_Mutex(d->mtx);
+    d->isWakeupPending = iTrue;
+    signal_Condition(&d->wakeup);
+    unlock_Mutex(d->mtx);
+}
 
-static void submit_FeedJob_(iFeedJob *d) {
-    d->request = new_GmRequest(certs_App());
-    setUrl_GmRequest(d->request, &d->url);
-    initCurrent_Time(&d->startTime);
-    submit_GmRequest(d->request);
+static iFeedSchedule *schedule_Feeds_(iFeeds *d, uint32_t bookmarkId) {
+    const iFeedSchedule key = { .bookmarkId = bookmarkId };
+    size_t pos;
+    if (locate_SortedArray(&d->schedule, &key, &pos)) {
+        return at_SortedArray(&d->schedule, pos);
+    }
+    return NULL;
+}
+
+static iBool isDue_Feeds_(iFeeds *d, uint32_t bookmarkId) {
+    iBool isDue = iTrue;
+    lock_Mutex(d->mtx);
+    const iFeedSchedule *sched = schedule_Feeds_(d, bookmarkId);
+    if (sched && isValid_Time(&sched->nextCheck)) {
+        iTime now;
+        initCurrent_Time(&now);
+        isDue = cmp_Time(&now, &sched->nextCheck) >= 0;
+    }
+    unlock_Mutex(d->mtx);
+    return isDue;
+}
+
+static void reschedule_Feeds_(iFeeds *d, uint32_t bookmarkId, int adjust) {
+    lock_Mutex(d->mtx);
+    iFeedSchedule *sched = schedule_Feeds_(d, bookmarkId);
+    if (!sched) {
+        const iFeedSchedule newSched = { .bookmarkId = bookmarkId,
+                                         .interval   = updateIntervalSeconds_Feeds_ };
+        insert_SortedArray(&d->schedule, &newSched);
+        sched = schedule_Feeds_(d, bookmarkId);
+    }
+    /* Check more often if there was something new, otherwise back off gradually. */
+    if (adjust < 0) {
+        sched->interval = iMax(minIntervalSeconds_Feeds_, sched->interval / 2);
+    }
+    else if (adjust > 0) {
+        sched->interval = iMin(maxIntervalSeconds_Feeds_, sched->interval * 3 / 2);
+    }
+    initTimeout_Time(&sched->nextCheck, sched->interval);
+    unlock_Mutex(d->mtx);
 }
 
 static iBool isSubscribed_(void *context, const iBookmark *bm) {
@@ -155,14 +294,32 @@ static const iPtrArray *listSubscriptions_(void) {
     return list_Bookmarks(bookmarks_App(), NULL, isSubscribed_, NULL);
 }
 
-static iFeedJob *startNextJob_Feeds_(iFeeds *d) {
-    if (isEmpty_PtrArray(&d->jobs)) {
-        return NULL;
+static size_t numOngoing_(const iPtrArray *ongoing, const iString *host) {
+    size_t num = 0;
+    iConstForEach(PtrArray, i, ongoing) {
+        const iFeedJob *job = i.ptr;
+        if (equalCase_String(&job->host, host)) {
+            num++;
+        }
+    }
+    return num;
+}
+
+static void startJobs_Feeds_(iFeeds *d, iPtrArray *ongoing) {
+    const iPrefs *prefs      = prefs_App();
+    const size_t  maxTotal   = iMax(1, prefs->feedConcurrency);
+    const size_t  maxPerHost = iMax(1, prefs->feedConcurrencyPerHost);
+    for (size_t i = 0; i < size_PtrArray(&d->jobs) && size_PtrArray(ongoing) < maxTotal; ) {
+        iFeedJob *job = at_PtrArray(&d->jobs, i);
+        if (numOngoing_(ongoing, &job->host) < maxPerHost) {
+            remove_Array(&d->jobs, i);
+            pushBack_PtrArray(ongoing, job);
+            submit_FeedJob_(job, &job->url);
+        }
+        else {
+            i++;
+        }
     }
-    iFeedJob *job;
-    take_PtrArray(&d->jobs, 0, (void **) &job);
-    submit_FeedJob_(job);
-    return job;
 }
 
 static iBool isTrimmablePunctuation_(iChar c) {
@@ -187,46 +344,65 @@ static void trimTitle_(iString *title) {
     remove_Block(&title->chars, 0, start - constBegin_String(title));
 }
 
+static void parseXmlResult_FeedJob_(iFeedJob *d, const iTime *now) {
+    iFeedParser *feed = new_FeedParser();
+    write_FeedParser(feed, body_GmRequest(d->request));
+    finish_FeedParser(feed);
+    iFeedItem *item;
+    while ((item = takeItem_FeedParser(feed)) != NULL) {
+        iFeedEntry *entry = new_FeedEntry();
+        entry->discovered = *now;
+        entry->bookmarkId = d->bookmarkId;
+        set_String(&entry->url, absoluteUrl_String(url_GmRequest(d->request), &item->url));
+        set_String(&entry->title, &item->title);
+        init_Time(&entry->posted,
+                  &(iDate){ .year  = item->date.year,
+                            .month = item->date.month,
+                            .day   = item->date.day,
+                            .hour  = 12 /* noon UTC */ });
+        pushBack_PtrArray(&d->results, entry);
+        delete_FeedItem(item);
+    }
+    delete_FeedParser(feed);
+}
+
 static void parseResult_FeedJob_(iFeedJob *d) {
     /* TODO: Should tell the user if the request failed. */
-    if (isSuccess_GmStatusCode(status_GmRequest(d->request))) {
+    if (isSuccess_GmStatusCode(status_GmRequest(d->request)) &&
+        indexOfCStr_String(meta_GmRequest(d->request), "xml") != iInvalidPos) {
+        iBeginCollect();
+        iTime now;
+        initCurrent_Time(&now);
+        parseXmlResult_FeedJob_(d, &now);
+        iEndCollect();
+    }
+    else if (isSuccess_GmStatusCode(status_GmRequest(d->request))) {
         iBeginCollect();
         iTime now;
         initCurrent_Time(&now);
-        iRegExp *linkPattern =
-            new_RegExp("^=>\\s*([^\\s]+)\\s+"
-                       "([0-9][0-9][0-9][0-9]-[0-1][0-9]-[0-3][0-9])"
-                       "([^0-9].*)",
-                       0);
         iString src;
         initBlock_String(&src, body_GmRequest(d->request));
         iRangecc srcLine = iNullRange;
         while (nextSplit_Rangecc(range_String(&src), "\n", &srcLine)) {
             iRangecc line = srcLine;
             trimEnd_Rangecc(&line);
-            iRegExpMatch m;
-            init_RegExpMatch(&m);
-            if (matchRange_RegExp(linkPattern, line, &m)) {
-                const iRangecc url   = capturedRange_RegExpMatch(&m, 1);
-                const iRangecc date  = capturedRange_RegExpMatch(&m, 2);
-                const iRangecc title = capturedRange_RegExpMatch(&m, 3);
-                iFeedEntry *   entry = new_FeedEntry();
+            iGmDatedLink link;
+            if (parse_GmDatedLink(&link, line)) {
+                iFeedEntry *entry = new_FeedEntry();
                 entry->discovered = now;
                 entry->bookmarkId = d->bookmarkId;
-                setRange_String(&entry->url, url);
+                setRange_String(&entry->url, link.url);
                 set_String(&entry->url, absoluteUrl_String(url_GmRequest(d->request), &entry->url));
-                setRange_String(&entry->title, title);
+                setRange_String(&entry->title, link.title);
                 trimTitle_(&entry->title);
-                int year, month, day;
-                sscanf(date.start, "%04d-%02d-%02d", &year, &month, &day);
-                init_Time(
-                    &entry->posted,
-                    &(iDate){
-                        .year = year, .month = month, .day = day, .hour = 12 /* noon UTC */ });
+                init_Time(&entry->posted,
+                          &(iDate){ .year  = link.year,
+                                    .month = link.month,
+                                    .day   = link.day,
+                                    .hour  = 12 /* noon UTC */ });
                 pushBack_PtrArray(&d->results, entry);
             }
             if (d->checkHeadings) {
-                init_RegExpMatch(&m);
                 if (startsWith_Rangecc(line, "#")) {
                     while (*line.start == '#' && line.start < line.end) {
                         line.start++;
@@ -249,47 +425,176 @@ static void parseResult_FeedJob_(iFeedJob *d) {
             }
         }
         deinit_String(&src);
-        iRelease(linkPattern);
         iEndCollect();
     }
 }
 
-static void save_Feeds_(iFeeds *d) {
-    iFile *f = new_File(collect_String(concatCStr_Path(&d->saveDir, feedsFilename_Feeds_)));
-    if (open_File(f, write_FileMode | text_FileMode)) {
-        lock_Mutex(d->mtx);
-        iString *str = new_String();
-        format_String(str, "%llu\n# Feeds\n", integralSeconds_Time(&d->lastRefreshedAt));
-        write_File(f, utf8_String(str));
-        /* Index of feeds for IDs. */ {
-            iConstForEach(PtrArray, i, listSubscriptions_()) {
-                const iBookmark *bm = i.ptr;
-                format_String(str, "%08x %s\n", id_Bookmark(bm), cstr_String(&bm->url));
-                write_File(f, utf8_String(str));
-            }
+/* feeds.bin has the full set of entries. After each refresh, the new and changed entries
+   are appended to feeds.journal, and the journal is merged into feeds.bin when it grows
+   large. Both have the same records: the time of the latest refresh, the subscribed feeds,
+   entries, and the update schedule. */
+
+static void writeRecords_Feeds_(iFeeds *d, iStream *outs, const iPtrArray *entries) {
+    const iPtrArray *subs = listSubscriptions_();
+    writeU64_Stream(outs, d->lastRefreshedAt.ts.tv_sec);
+    /* Index of feeds for IDs. */
+    writeU32_Stream(outs, size_PtrArray(subs));
+    iConstForEach(PtrArray, i, subs) {
+        const iBookmark *bm = i.ptr;
+        writeU32_Stream(outs, id_Bookmark(bm));
+        serialize_String(&bm->url, outs);
+    }
+    iTime now;
+    initCurrent_Time(&now);
+    iPtrArray kept;
+    init_PtrArray(&kept);
+    iConstForEach(PtrArray, j, entries) {
+        const iFeedEntry *entry = j.ptr;
+        if (isValid_Time(&entry->discovered) &&
+            secondsSince_Time(&now, &entry->discovered) > maxAge_Visited) {
+            continue; /* Forget entries discovered long ago. */
         }
-        writeData_File(f, "# Entries\n", 10);
-        iTime now;
-        initCurrent_Time(&now);
-        iConstForEach(Array, i, &d->entries.values) {
-            const iFeedEntry *entry = *(const iFeedEntry **) i.value;
-            if (isValid_Time(&entry->discovered) &&
-                secondsSince_Time(&now, &entry->discovered) > maxAge_Visited) {
-                continue; /* Forget entries discovered long ago. */
-            }
-            format_String(str, "%x\n%llu\n%llu\n%s\n%s\n",
-                          entry->bookmarkId,
-                          integralSeconds_Time(&entry->posted),
-                          integralSeconds_Time(&entry->discovered),
-                          cstr_String(&entry->url),
-                          cstr_String(&entry->title));
-            write_File(f, utf8_String(str));
+        pushBack_PtrArray(&kept, entry);
+    }
+    writeU32_Stream(outs, size_PtrArray(&kept));
+    iConstForEach(PtrArray, k, &kept) {
+        const iFeedEntry *entry = k.ptr;
+        writeU32_Stream(outs, entry->bookmarkId);
+        writeU64_Stream(outs, entry->posted.ts.tv_sec);
+        writeU64_Stream(outs, entry->discovered.ts.tv_sec);
+        serialize_String(&entry->url, outs);
+        serialize_String(&entry->title, outs);
+    }
+    deinit_PtrArray(&kept);
+    /* Update schedule of each feed. */
+    iArray scheds;
+    init_Array(&scheds, sizeof(iFeedSchedule));
+    iConstForEach(PtrArray, m, subs) {
+        const iFeedSchedule *sched = schedule_Feeds_(d, id_Bookmark(m.ptr));
+        if (sched) {
+            pushBack_Array(&scheds, sched);
         }
-        delete_String(str);
+    }
+    writeU32_Stream(outs, size_Array(&scheds));
+    iConstForEach(Array, n, &scheds) {
+        const iFeedSchedule *sched = n.value;
+        writeU32_Stream(outs, sched->bookmarkId);
+        write32_Stream(outs, sched->interval);
+        writeU64_Stream(outs, sched->nextCheck.ts.tv_sec);
+    }
+    deinit_Array(&scheds);
+}
+
+static iBlock *serializeSnapshot_Feeds_(iFeeds *d) {
+    /* Called with the mutex locked. */
+    iBuffer *buf = new_Buffer();
+    openEmpty_Buffer(buf);
+    writeData_Stream(stream_Buffer(buf), magic_Feeds_, 4);
+    writeU32_Stream(stream_Buffer(buf), latest_FeedsVersion);
+    writeRecords_Feeds_(d, stream_Buffer(buf), &d->entries.values);
+    iBlock *data = copy_Block(data_Buffer(buf));
+    iRelease(buf);
+    /* Everything will be in the snapshot. */
+    d->journalSize     = 0;
+    d->needsCompaction = iFalse;
+    return data;
+}
+
+static iBlock *serializeJournal_Feeds_(iFeeds *d) {
+    /* Called with the mutex locked. */
+    iBuffer *buf = new_Buffer();
+    openEmpty_Buffer(buf);
+    iStream *outs = stream_Buffer(buf);
+    if (d->journalSize == 0) {
+        writeData_Stream(outs, journalMagic_Feeds_, 4);
+        writeU32_Stream(outs, latest_FeedsVersion);
+    }
+    /* Each batch of records is prefixed with its size so a partially written batch
+       can be ignored when loading. */
+    iBuffer *batch = new_Buffer();
+    openEmpty_Buffer(batch);
+    writeRecords_Feeds_(d, stream_Buffer(batch), &d->unsavedEntries);
+    writeU32_Stream(outs, size_Block(data_Buffer(batch)));
+    writeData_Stream(outs, constData_Block(data_Buffer(batch)), size_Block(data_Buffer(batch)));
+    iBlock *data = copy_Block(data_Buffer(buf));
+    d->journalSize += size_Block(data);
+    iRelease(batch);
+    iRelease(buf);
+    return data;
+}
+
+static iBool writeSnapshot_Feeds_(const iFeeds *d, const iBlock *data) {
+    /* The new snapshot replaces feeds.bin only after it has been fully written, and the
+       journal is emptied only after that. A failure at any point leaves the old snapshot
+       and the journal that goes with it. */
+    const iString *path     = collect_String(concatCStr_Path(&d->saveDir, fileName_Feeds_));
+    const char *   tempPath = format_CStr("%s.tmp", cstr_String(path));
+    iBool          ok       = iFalse;
+    iFile *        f        = newCStr_File(tempPath);
+    if (open_File(f, writeOnly_FileMode)) {
+        write_File(f, data);
         close_File(f);
-        unlock_Mutex(d->mtx);
+        ok = iTrue;
+    }
+    iRelease(f);
+    if (ok) {
+#if defined (iPlatformMsys)
+        remove(cstr_String(path)); /* rename() doesn't replace existing files */
+#endif
+        ok = rename(tempPath, cstr_String(path)) == 0;
+    }
+    if (!ok) {
+        remove(tempPath);
+        return iFalse;
+    }
+    iFile *journal =
+        new_File(collect_String(concatCStr_Path(&d->saveDir, journalFileName_Feeds_)));
+    ok = open_File(journal, writeOnly_FileMode);
+    iRelease(journal);
+    return ok;
+}
+
+static iBool appendJournal_Feeds_(const iFeeds *d, const iBlock *data, iBool isNew) {
+    iFile *f  = new_File(collect_String(concatCStr_Path(&d->saveDir, journalFileName_Feeds_)));
+    iBool  ok = iFalse;
+    /* An unreadable journal is started over. */
+    if (open_File(f, isNew ? writeOnly_FileMode : append_FileMode)) {
+        write_File(f, data);
+        ok = iTrue;
     }
     iRelease(f);
+    return ok;
+}
+
+static void save_Feeds_(iFeeds *d) {
+    /* The records are serialized with the mutex locked but written to disk after unlocking,
+       so the feed entries remain available meanwhile. Only the worker saves, so the writes
+       themselves don't overlap. */
+    iBlock *data         = NULL;
+    iBool   isSnapshot   = iFalse;
+    iBool   isNewJournal = iFalse;
+    lock_Mutex(d->mtx);
+    if (d->isLoaded) {
+        if (d->needsCompaction || d->journalSize >= maxJournalSize_Feeds_) {
+            data       = serializeSnapshot_Feeds_(d);
+            isSnapshot = iTrue;
+        }
+        else {
+            isNewJournal = (d->journalSize == 0);
+            data         = serializeJournal_Feeds_(d);
+        }
+        clear_PtrArray(&d->unsavedEntries);
+    }
+    unlock_Mutex(d->mtx);
+    if (data) {
+        const iBool ok = isSnapshot ? writeSnapshot_Feeds_(d, data)
+                                    : appendJournal_Feeds_(d, data, isNewJournal);
+        if (!ok) {
+            /* Saved state is out of date; rewrite everything next time. */
+            iGuardMutex(d->mtx, d->needsCompaction = iTrue);
+        }
+        delete_Block(data);
+    }
 }
 
 static iBool isHeadingEntry_FeedEntry_(const iFeedEntry *d) {
@@ -317,9 +622,16 @@ static iBool updateEntries_Feeds_(iFeeds *d, iPtrArray *incoming) {
                      newDate.day != oldDate.day)) {
                     changed = iTrue;
                 }
+                /* Only modified entries need to be journaled. */
+                const iBool isModified =
+                    !equal_String(&existing->title, &entry->title) ||
+                    existing->posted.ts.tv_sec != entry->posted.ts.tv_sec;
                 set_String(&existing->title, &entry->title);
                 existing->posted = entry->posted;
                 delete_FeedEntry(entry);
+                if (isModified) {
+                    pushBack_PtrArray(&d->unsavedEntries, existing);
+                }
                 if (changed) {
                     /* TODO: better to use a new flag for read feed entries? */
                     removeUrl_Visited(visited_App(), &existing->url);
@@ -329,6 +641,7 @@ static iBool updateEntries_Feeds_(iFeeds *d, iPtrArray *incoming) {
         }
         else {
             insert_SortedArray(&d->entries, &entry);
+            pushBack_PtrArray(&d->unsavedEntries, entry);
             gotNew = iTrue;
         }
         remove_PtrArrayIterator(&i);
@@ -340,58 +653,82 @@ static iBool updateEntries_Feeds_(iFeeds *d, iPtrArray *incoming) {
 static iThreadResult fetch_Feeds_(iThread *thread) {
     iFeeds *d = &feeds_;
     iUnused(thread);
-    iFeedJob *work[maxConcurrentRequests_Feeds]; /* We'll do a couple of concurrent requests. */
-    iZap(work);
+    iPtrArray ongoing;
+    init_PtrArray(&ongoing);
     iBool gotNew = iFalse;
     postCommand_App("feeds.update.started");
     while (!d->stopWorker) {
-        /* Start new jobs. */
-        iForIndices(i, work) {
-            if (!work[i]) {
-                work[i] = startNextJob_Feeds_(d);
-            }
+        startJobs_Feeds_(d, &ongoing);
+        /* Stop if everything has finished. */
+        if (isEmpty_PtrArray(&ongoing)) {
+            break;
+        }
+        /* Sleep until a request finishes or the next one times out. */
+        double timeout = requestTimeoutSeconds_FeedJob_;
+        iConstForEach(PtrArray, t, &ongoing) {
+            timeout = iMin(timeout, timeLeft_FeedJob_(t.ptr));
         }
-        sleep_Thread(0.5); /* TODO: wait on a Condition so we can exit quickly */
+        lock_Mutex(d->mtx);
+        if (!d->isWakeupPending && !d->stopWorker && timeout > 0.0) {
+            iTime until;
+            initTimeout_Time(&until, timeout);
+            waitTimeout_Condition(&d->wakeup, d->mtx, &until);
+        }
+        d->isWakeupPending = iFalse;
+        unlock_Mutex(d->mtx);
         if (d->stopWorker) break;
-        size_t ongoing = 0;
-        iForIndices(i, work) {
-            if (work[i]) {
-                if (isFinished_GmRequest(work[i]->request)) {
-                    /* TODO: Handle redirects. Need to resubmit the job with new URL. */
-                    parseResult_FeedJob_(work[i]);
-                    gotNew |= updateEntries_Feeds_(d, &work[i]->results);
-                    delete_FeedJob(work[i]);
-                    work[i] = NULL;
+        iForEach(PtrArray, i, &ongoing) {
+            iFeedJob *job = i.ptr;
+            if (isFinished_GmRequest(job->request)) {
+                if (followRedirect_FeedJob_(job)) {
+                    continue;
                 }
-                else if (isTimedOut_FeedJob_(work[i])) {
-                    /* Maybe we'll get it next time! */
-                    delete_FeedJob(work[i]);
-                    work[i] = NULL;
-                }
-                else {
-                    ongoing++;
-                }
-                /* TODO: abort job if it takes too long (> 15 seconds?) */
+                parseResult_FeedJob_(job);
+                const iBool jobGotNew = updateEntries_Feeds_(d, &job->results);
+                reschedule_Feeds_(d,
+                                  job->bookmarkId,
+                                  job->isFirstUpdate ? 0 : jobGotNew ? -1 : +1);
+                gotNew |= jobGotNew;
+                delete_FeedJob(job);
+                remove_PtrArrayIterator(&i);
+            }
+            else if (isTimedOut_FeedJob_(job)) {
+                /* Maybe we'll get it next time! */
+                reschedule_Feeds_(d, job->bookmarkId, 0);
+                delete_FeedJob(job);
+                remove_PtrArrayIterator(&i);
             }
-        }
-        /* Stop if everything has finished. */
-        if (ongoing == 0 && isEmpty_PtrArray(&d->jobs)) {
-            break;
         }
     }
+    iForEach(PtrArray, j, &ongoing) {
+        delete_FeedJob(j.ptr);
+    }
+    deinit_PtrArray(&ongoing);
     initCurrent_Time(&d->lastRefreshedAt);
     save_Feeds_(d);
     postCommandf_App("feeds.update.finished arg:%d", gotNew ? 1 : 0);
     return 0;
 }
 
-static iBool startWorker_Feeds_(iFeeds *d) {
+static iBool startWorker_Feeds_(iFeeds *d, iBool checkAll) {
     if (d->worker) {
         return iFalse; /* Refresh is already ongoing. */
     }
-    /* Queue up all the subscriptions for the worker. */
+    lock_Mutex(d->mtx);
+    const iBool isLoaded = d->isLoaded;
+    if (!isLoaded && checkAll) {
+        d->isRefreshPending = iTrue; /* Done by the loader when finished. */
+    }
+    unlock_Mutex(d->mtx);
+    if (!isLoaded) {
+        return iFalse; /* Entries are still being loaded. */
+    }
+    /* Queue up the subscriptions for the worker. */
     iConstForEach(PtrArray, i, listSubscriptions_()) {
         const iBookmark *bm = i.ptr;
+        if (!checkAll && !isDue_Feeds_(d, id_Bookmark(bm))) {
+            continue;
+        }
         iFeedJob *job = new_FeedJob(bm);
         if (!contains_IntSet(&d->previouslyCheckedFeeds, id_Bookmark(bm))) {
             job->isFirstUpdate = iTrue;
@@ -404,6 +741,7 @@ static iBool startWorker_Feeds_(iFeeds *d) {
     if (!isEmpty_Array(&d->jobs)) {
         d->worker = new_Thread(fetch_Feeds_);
         d->stopWorker = iFalse;
+        d->isWakeupPending = iFalse;
         start_Thread(d->worker);
         return iTrue;
     }
@@ -412,13 +750,14 @@ static iBool startWorker_Feeds_(iFeeds *d) {
 
 static uint32_t refresh_Feeds_(uint32_t interval, void *data) {
     /* Called in the SDL timer thread, so let's start a worker thread for running the update. */
-    startWorker_Feeds_(&feeds_);
-    return 1000 * updateIntervalSeconds_Feeds_;
+    startWorker_Feeds_(&feeds_, iFalse);
+    return 1000 * checkIntervalSeconds_Feeds_;
 }
 
 static void stopWorker_Feeds_(iFeeds *d) {
     if (d->worker) {
         d->stopWorker = iTrue;
+        wakeUp_Feeds_();
         join_Thread(d->worker);
         iReleasePtr(&d->worker);
     }
@@ -441,14 +780,199 @@ struct Impl_FeedHashNode {
     uint32_t  bookmarkId;
 };
 
-static void load_Feeds_(iFeeds *d) {
-    /* TODO: If there are lots of entries, it would make sense to load async. */
-    iFile *f = new_File(collect_String(concatCStr_Path(&d->saveDir, feedsFilename_Feeds_)));
+iDeclareType(FeedUrl)
+
+struct Impl_FeedUrl {
+    iString  url;
+    uint32_t bookmarkId;
+};
+
+static int cmp_FeedUrl_(const void *a, const void *b) {
+    const iFeedUrl *u1 = a, *u2 = b;
+    return cmpString_String(&u1->url, &u2->url);
+}
+
+static uint32_t findUrl_Feeds_(const iFeeds *d, const iString *url) {
+    /* Bookmarks are not accessed in the loader thread. The subscribed URLs are looked up
+       in a sorted copy made beforehand. */
+    size_t pos;
+    if (locate_SortedArray(&d->loadUrls, &(iFeedUrl){ .url = *url }, &pos)) {
+        return ((const iFeedUrl *) constAt_Array(&d->loadUrls.values, pos))->bookmarkId;
+    }
+    return 0;
+}
+
+static void mapFeed_Feeds_(iFeeds *d, iHash *feeds, uint32_t id, const iString *feedUrl) {
+    const uint32_t bookmarkId = findUrl_Feeds_(d, feedUrl);
+    if (bookmarkId && !value_Hash(feeds, id)) {
+        iFeedHashNode *node = iMalloc(FeedHashNode);
+        node->node.key      = id;
+        node->bookmarkId    = bookmarkId;
+        insert_Hash(feeds, &node->node);
+    }
+}
+
+static void deleteFeedMap_(iHash *feeds) {
+    iForEach(Hash, i, feeds) {
+        free(i.value);
+    }
+    delete_Hash(feeds);
+}
+
+static void addEntry_Feeds_(iFeeds *d, iFeedEntry *entry) {
+    /* Later records replace earlier ones. */
+    size_t pos;
+    if (locate_SortedArray(&d->entries, &entry, &pos)) {
+        iFeedEntry **existing = at_Array(&d->entries.values, pos);
+        delete_FeedEntry(*existing);
+        *existing = entry;
+    }
+    else {
+        insert_SortedArray(&d->entries, &entry);
+    }
+}
+
+static void addSchedule_Feeds_(iFeeds *d, const iFeedSchedule *sched) {
+    iFeedSchedule *existing = schedule_Feeds_(d, sched->bookmarkId);
+    if (existing) {
+        *existing = *sched;
+    }
+    else {
+        insert_SortedArray(&d->schedule, sched);
+    }
+}
+
+static void readRecords_Feeds_(iFeeds *d, iStream *ins) {
+    iHash *feeds = new_Hash(); /* mapping from IDs to bookmarks */
+    iTime refreshedAt;
+    iZap(refreshedAt);
+    refreshedAt.ts.tv_sec = readU64_Stream(ins);
+    /* Entries are parsed before taking the lock so the UI isn't kept waiting. */
+    iPtrArray entries;
+    iArray    scheds;
+    init_PtrArray(&entries);
+    init_Array(&scheds, sizeof(iFeedSchedule));
+    iString *feedUrl = new_String();
+    const uint32_t numFeeds = readU32_Stream(ins);
+    for (uint32_t i = 0; i < numFeeds && !atEnd_Stream(ins); i++) {
+        const uint32_t id = readU32_Stream(ins);
+        deserialize_String(feedUrl, ins);
+        mapFeed_Feeds_(d, feeds, id, feedUrl);
+    }
+    delete_String(feedUrl);
+    const uint32_t numEntries = readU32_Stream(ins);
+    for (uint32_t i = 0; i < numEntries && !atEnd_Stream(ins); i++) {
+        iFeedEntry *entry = new_FeedEntry();
+        const uint32_t feedId       = readU32_Stream(ins);
+        entry->posted.ts.tv_sec     = readU64_Stream(ins);
+        entry->discovered.ts.tv_sec = readU64_Stream(ins);
+        deserialize_String(&entry->url, ins);
+        deserialize_String(&entry->title, ins);
+        const iFeedHashNode *node = (iFeedHashNode *) value_Hash(feeds, feedId);
+        if (!node || isEmpty_String(&entry->url)) {
+            delete_FeedEntry(entry); /* Not subscribed any more. */
+            continue;
+        }
+        entry->bookmarkId = node->bookmarkId;
+        pushBack_PtrArray(&entries, entry);
+    }
+    const uint32_t numScheds = readU32_Stream(ins);
+    for (uint32_t i = 0; i < numScheds && !atEnd_Stream(ins); i++) {
+        const uint32_t feedId   = readU32_Stream(ins);
+        const int      interval = read32_Stream(ins);
+        iFeedSchedule  sched    = {
+            .interval = iClamp(interval, minIntervalSeconds_Feeds_, maxIntervalSeconds_Feeds_),
+        };
+        sched.nextCheck.ts.tv_sec = readU64_Stream(ins);
+        const iFeedHashNode *node = (iFeedHashNode *) value_Hash(feeds, feedId);
+        if (node) {
+            sched.bookmarkId = node->bookmarkId;
+            pushBack_Array(&scheds, &sched);
+        }
+    }
+    lock_Mutex(d->mtx);
+    if (cmp_Time(&refreshedAt, &d->lastRefreshedAt) > 0) {
+        d->lastRefreshedAt = refreshedAt;
+    }
+    iConstForEach(Hash, h, feeds) {
+        insert_IntSet(&d->previouslyCheckedFeeds, ((const iFeedHashNode *) h.value)->bookmarkId);
+    }
+    iConstForEach(PtrArray, e, &entries) {
+        addEntry_Feeds_(d, e.ptr);
+    }
+    iConstForEach(Array, c, &scheds) {
+        addSchedule_Feeds_(d, c.value);
+    }
+    unlock_Mutex(d->mtx);
+    deinit_Array(&scheds);
+    deinit_PtrArray(&entries);
+    deleteFeedMap_(feeds);
+}
+
+static iBool loadSnapshot_Feeds_(iFeeds *d) {
+    iBool ok = iFalse;
+    iFile *f = new_File(collect_String(concatCStr_Path(&d->saveDir, fileName_Feeds_)));
+    if (open_File(f, readOnly_FileMode)) {
+        iBuffer *buf = new_Buffer();
+        open_Buffer(buf, collect_Block(readAll_File(f)));
+        iStream *ins = stream_Buffer(buf);
+        char magic[4];
+        readData_Buffer(buf, 4, magic);
+        if (!memcmp(magic, magic_Feeds_, 4) && readU32_Stream(ins) <= latest_FeedsVersion) {
+            readRecords_Feeds_(d, ins);
+            ok = iTrue;
+        }
+        iRelease(buf);
+    }
+    iRelease(f);
+    return ok;
+}
+
+static void loadJournal_Feeds_(iFeeds *d) {
+    iFile *f = new_File(collect_String(concatCStr_Path(&d->saveDir, journalFileName_Feeds_)));
+    if (open_File(f, readOnly_FileMode)) {
+        const iBlock *data = collect_Block(readAll_File(f));
+        iBuffer *buf = new_Buffer();
+        open_Buffer(buf, data);
+        iStream *ins = stream_Buffer(buf);
+        char magic[4];
+        readData_Buffer(buf, 4, magic);
+        if (!memcmp(magic, journalMagic_Feeds_, 4) && readU32_Stream(ins) <= latest_FeedsVersion) {
+            iBool isTorn = iFalse;
+            while (!atEnd_Buffer(buf)) {
+                const size_t batchSize = readU32_Stream(ins);
+                const size_t start     = pos_Stream(ins);
+                if (batchSize == 0 || start + batchSize > size_Block(data)) {
+                    isTorn = iTrue; /* Incomplete write, ignore the rest. */
+                    break;
+                }
+                readRecords_Feeds_(d, ins);
+                seek_Stream(ins, start + batchSize);
+            }
+            lock_Mutex(d->mtx);
+            d->journalSize = size_Block(data);
+            if (isTorn) {
+                /* Batches appended after the torn one would never be read back, so the next
+                   save rewrites feeds.bin and starts a new journal. */
+                d->needsCompaction = iTrue;
+            }
+            unlock_Mutex(d->mtx);
+        }
+        iRelease(buf);
+    }
+    iRelease(f);
+}
+
+static void loadText_Feeds_(iFeeds *d) {
+    /* Feeds were previously saved in a text file. It is only read once, after which
+       everything gets written to feeds.bin. */
+    iFile *f = new_File(collect_String(concatCStr_Path(&d->saveDir, textFilename_Feeds_)));
     if (open_File(f, read_FileMode | text_FileMode)) {
         iBlock * src     = readAll_File(f);
         iRangecc line    = iNullRange;
         int      section = 0;
-        iHash *  feeds   = new_Hash(); /* mapping from IDs to feed URLs */
+        iHash *  feeds   = new_Hash(); /* mapping from IDs to bookmarks */
+        lock_Mutex(d->mtx);
         while (nextSplit_Rangecc(range_Block(src), "\n", &line)) {
             if (equal_Rangecc(line, "# Feeds")) {
                 section = 1;
@@ -458,6 +982,10 @@ static void load_Feeds_(iFeeds *d) {
                 section = 2;
                 continue;
             }
+            else if (equal_Rangecc(line, "# Schedule")) {
+                section = 3;
+                continue;
+            }
             switch (section) {
                 case 0: {
                     unsigned long long ts = 0;
@@ -471,20 +999,15 @@ static void load_Feeds_(iFeeds *d) {
                         sscanf(line.start, "%08x", &id);
                         iString *feedUrl =
                             collect_String(newRange_String((iRangecc){ line.start + 9, line.end }));
-                        const uint32_t bookmarkId = findUrl_Bookmarks(bookmarks_App(), feedUrl);
-                        if (bookmarkId) {
-                            iFeedHashNode *node = iMalloc(FeedHashNode);
-                            node->node.key      = id;
-                            node->bookmarkId    = bookmarkId;
-                            insert_Hash(feeds, &node->node);
-                            insert_IntSet(&d->previouslyCheckedFeeds, bookmarkId);
+                        mapFeed_Feeds_(d, feeds, id, feedUrl);
+                        const iFeedHashNode *node = (iFeedHashNode *) value_Hash(feeds, id);
+                        if (node) {
+                            insert_IntSet(&d->previouslyCheckedFeeds, node->bookmarkId);
                         }
                     }
                     break;
                 }
                 case 2: {
-                    /* TODO: All right, this could maybe use a bit more robust, structured
-                       format. The code below is messy. */
                     const uint32_t feedId = strtoul(line.start, NULL, 16);
                     if (!nextSplit_Rangecc(range_Block(src), "\n", &line)) {
                         goto aborted;
@@ -509,8 +1032,6 @@ static void load_Feeds_(iFeeds *d) {
                         goto aborted;
                     }
                     const iRangecc titleRange = line;
-                    iString *url   = newRange_String(urlRange);
-                    iString *title = newRange_String(titleRange);
                     /* Look it up in the hash. */
                     const iFeedHashNode *node = (iFeedHashNode *) value_Hash(feeds, feedId);
                     if (node) {
@@ -518,28 +1039,73 @@ static void load_Feeds_(iFeeds *d) {
                         entry->bookmarkId           = node->bookmarkId;
                         entry->posted.ts.tv_sec     = posted;
                         entry->discovered.ts.tv_sec = discovered;
-                        set_String(&entry->url, url);
+                        setRange_String(&entry->url, urlRange);
                         stripDefaultUrlPort_String(&entry->url);
-                        set_String(&entry->title, title);
-                        insert_SortedArray(&d->entries, &entry);
+                        setRange_String(&entry->title, titleRange);
+                        addEntry_Feeds_(d, entry);
+                    }
+                    break;
+                }
+                case 3: {
+                    uint32_t feedId = 0;
+                    int interval = 0;
+                    unsigned long long nextCheck = 0;
+                    if (sscanf(line.start, "%08x %d %llu", &feedId, &interval, &nextCheck) == 3) {
+                        const iFeedHashNode *node = (iFeedHashNode *) value_Hash(feeds, feedId);
+                        if (node && !schedule_Feeds_(d, node->bookmarkId)) {
+                            iFeedSchedule sched = {
+                                .bookmarkId = node->bookmarkId,
+                                .interval   = iClamp(interval,
+                                                     minIntervalSeconds_Feeds_,
+                                                     maxIntervalSeconds_Feeds_),
+                            };
+                            sched.nextCheck.ts.tv_sec = nextCheck;
+                            insert_SortedArray(&d->schedule, &sched);
+                        }
                     }
-                    delete_String(title);
-                    delete_String(url);
                     break;
                 }
             }
         }
     aborted:
-        /* Cleanup. */
+        d->needsCompaction = iTrue;
+        unlock_Mutex(d->mtx);
         delete_Block(src);
-        iForEach(Hash, i, feeds) {
-            free(i.value);
-        }
-        delete_Hash(feeds);
+        deleteFeedMap_(feeds);
     }
     iRelease(f);
 }
 
+static iThreadResult load_Feeds_(iThread *thread) {
+    iFeeds *d = &feeds_;
+    iUnused(thread);
+    if (!loadSnapshot_Feeds_(d)) {
+        loadText_Feeds_(d);
+    }
+    loadJournal_Feeds_(d);
+    iForEach(Array, i, &d->loadUrls.values) {
+        deinit_String(&((iFeedUrl *) i.value)->url);
+    }
+    clear_Array(&d->loadUrls.values);
+    lock_Mutex(d->mtx);
+    d->isLoaded = iTrue;
+    /* Check for feeds due for an update if it has been a while. */
+    int intervalSec = checkIntervalSeconds_Feeds_;
+    if (isValid_Time(&d->lastRefreshedAt)) {
+        const double elapsed = elapsedSeconds_Time(&d->lastRefreshedAt);
+        intervalSec = iMax(1, checkIntervalSeconds_Feeds_ - elapsed);
+    }
+    d->refreshTimer = SDL_AddTimer(1000 * intervalSec, refresh_Feeds_, NULL);
+    const iBool isRefreshPending = d->isRefreshPending;
+    d->isRefreshPending = iFalse;
+    unlock_Mutex(d->mtx);
+    postCommand_App("feeds.update.loaded");
+    if (isRefreshPending) {
+        postCommand_App("feeds.refresh");
+    }
+    return 0;
+}
+
 /*----------------------------------------------------------------------------------------------*/
 
 void init_Feeds(const char *saveDir) {
@@ -547,38 +1113,65 @@ void init_Feeds(const char *saveDir) {
     d->mtx = new_Mutex();
     initCStr_String(&d->saveDir, saveDir);
     init_IntSet(&d->previouslyCheckedFeeds);
+    init_SortedArray(&d->schedule, sizeof(iFeedSchedule), cmp_FeedSchedule_);
     iZap(d->lastRefreshedAt);
     d->worker = NULL;
+    d->stopWorker = iFalse;
+    init_Condition(&d->wakeup);
+    d->isWakeupPending = iFalse;
     init_PtrArray(&d->jobs);
     init_SortedArray(&d->entries, sizeof(iFeedEntry *), cmp_FeedEntryPtr_);
-    load_Feeds_(d);
-    /* Update feeds if it has been a while. */
-    int intervalSec = updateIntervalSeconds_Feeds_;
-    if (isValid_Time(&d->lastRefreshedAt)) {
-        const double elapsed = elapsedSeconds_Time(&d->lastRefreshedAt);
-        intervalSec = iMax(1, updateIntervalSeconds_Feeds_ - elapsed);
+    init_PtrArray(&d->unsavedEntries);
+    d->journalSize      = 0;
+    d->needsCompaction  = iFalse;
+    d->isLoaded         = iFalse;
+    d->isRefreshPending = iFalse;
+    d->refreshTimer     = 0;
+    init_SortedArray(&d->loadUrls, sizeof(iFeedUrl), cmp_FeedUrl_);
+    iConstForEach(PtrArray, i, listSubscriptions_()) {
+        const iBookmark *bm = i.ptr;
+        iFeedUrl feedUrl = { .bookmarkId = id_Bookmark(bm) };
+        size_t   pos;
+        if (!locate_SortedArray(&d->loadUrls, &(iFeedUrl){ .url = bm->url }, &pos)) {
+            init_String(&feedUrl.url);
+            set_String(&feedUrl.url, &bm->url);
+            insert_SortedArray(&d->loadUrls, &feedUrl);
+        }
     }
-    d->refreshTimer = SDL_AddTimer(1000 * intervalSec, refresh_Feeds_, NULL);
+    /* Entries are loaded in the background; refreshing starts once they're available. */
+    d->loader = new_Thread(load_Feeds_);
+    start_Thread(d->loader);
 }
 
 void deinit_Feeds(void) {
     iFeeds *d = &feeds_;
+    join_Thread(d->loader);
+    iReleasePtr(&d->loader);
+    deinit_SortedArray(&d->loadUrls);
     SDL_RemoveTimer(d->refreshTimer);
     stopWorker_Feeds_(d);
+    if (d->needsCompaction) {
+        iBlock *data = serializeSnapshot_Feeds_(d);
+        writeSnapshot_Feeds_(d, data);
+        delete_Block(data);
+    }
+    deinit_PtrArray(&d->unsavedEntries);
     iAssert(isEmpty_PtrArray(&d->jobs));
     deinit_PtrArray(&d->jobs);
     deinit_String(&d->saveDir);
+    deinit_Condition(&d->wakeup);
     delete_Mutex(d->mtx);
     iForEach(Array, i, &d->entries.values) {
         iFeedEntry **entry = i.value;
         delete_FeedEntry(*entry);
     }
     deinit_IntSet(&d->previouslyCheckedFeeds);
+    deinit_SortedArray(&d->schedule);
     deinit_SortedArray(&d->entries);
 }
 
 void refresh_Feeds(void) {
-    startWorker_Feeds_(&feeds_);
+    startWorker_Feeds_(&feeds_, iTrue);
 }
 
 void refreshFinished_Feeds(void) {
@@ -587,6 +1180,11 @@ void refreshFinished_Feeds(void) {
 
 void removeEntries_Feeds(uint32_t feedBookmarkId) {
     iFeeds *d = &feeds_;
+    lock_Mutex(d->mtx);
+    /* Entries that haven't been saved yet may be among the removed ones. The next save
+       rewrites everything anyway. */
+    clear_PtrArray(&d->unsavedEntries);
+    d->needsCompaction = iTrue;
     iForEach(Array, i, &d->entries.values) {
         iFeedEntry **entry = i.value;
         if ((*entry)->bookmarkId == feedBookmarkId) {
@@ -594,6 +1192,11 @@ void removeEntries_Feeds(uint32_t feedBookmarkId) {
             remove_ArrayIterator(&i);
         }
     }
+    size_t pos;
+    if (locate_SortedArray(&d->schedule, &(iFeedSchedule){ .bookmarkId = feedBookmarkId }, &pos)) {
+        remove_Array(&d->schedule.values, pos);
+    }
+    unlock_Mutex(d->mtx);
 }
 
 static int cmpTimeDescending_FeedEntryPtr_(const void *a, const void *b) {
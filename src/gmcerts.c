@@ -22,6 +22,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include "gmcerts.h"
 #include "defs.h"
+#include "persist.h"
 
 #include <the_Foundation/file.h>
 #include <the_Foundation/fileinfo.h>
@@ -216,25 +217,30 @@ void saveIdentities_GmCerts(const iGmCerts *d) {
     iRelease(f);
 }
 
-static void save_GmCerts_(const iGmCerts *d) {
-    iBeginCollect();
-    iFile *f = new_File(collect_String(concatCStr_Path(&d->saveDir, filename_GmCerts_)));
-    if (open_File(f, writeOnly_FileMode | text_FileMode)) {
-        iString line;
-        init_String(&line);
-        iConstForEach(StringHash, i, d->trusted) {
-            const iTrustEntry *trust = value_StringHashNode(i.value);
-            format_String(&line,
-                          "%s %ld %s\n",
-                          cstr_String(key_StringHashConstIterator(&i)),
-                          integralSeconds_Time(&trust->validUntil),
-                          cstrCollect_String(hexEncode_Block(&trust->fingerprint)));
-            write_File(f, &line.chars);
-        }
-        deinit_String(&line);
+static void serializeTrusted_GmCerts_(const void *object, iStream *outs) {
+    const iGmCerts *d = object;
+    iString line;
+    init_String(&line);
+    lock_Mutex(d->mtx);
+    iConstForEach(StringHash, i, d->trusted) {
+        const iTrustEntry *trust = value_StringHashNode(i.value);
+        format_String(&line,
+                      "%s %ld %s\n",
+                      cstr_String(key_StringHashConstIterator(&i)),
+                      integralSeconds_Time(&trust->validUntil),
+                      cstrCollect_String(hexEncode_Block(&trust->fingerprint)));
+        writeData_Stream(outs, cstr_String(&line), size_String(&line));
     }
-    iRelease(f);
-    iEndCollect();
+    unlock_Mutex(d->mtx);
+    deinit_String(&line);
+}
+
+static void save_GmCerts_(const iGmCerts *d) {
+    /* Trust is often granted to many hosts in quick succession, e.g., when refreshing feeds.
+       The file is rewritten in the background after things calm down. */
+    iString *path = concatCStr_Path(&d->saveDir, filename_GmCerts_);
+    requestSave_Persist("trusted", cstr_String(path), serializeTrusted_GmCerts_, d);
+    delete_String(path);
 }
 
 static void loadIdentities_GmCerts_(iGmCerts *d) {
@@ -411,8 +417,8 @@ iBool checkTrust_GmCerts(iGmCerts *d, iRangecc domain, const iTlsCertificate *ce
     else {
         insert_StringHash(d->trusted, key, iClob(new_TrustEntry(fingerprint, &until)));
     }
-    save_GmCerts_(d);
     unlock_Mutex(d->mtx);
+    save_GmCerts_(d);
     delete_Block(fingerprint);
     delete_String(key);
     return iTrue;
@@ -430,8 +436,8 @@ void setTrusted_GmCerts(iGmCerts *d, iRangecc domain, const iBlock *fingerprint,
     else {
         insert_StringHash(d->trusted, key, iClob(trust = new_TrustEntry(fingerprint, validUntil)));
     }
-    save_GmCerts_(d);
     unlock_Mutex(d->mtx);
+    save_GmCerts_(d);
 }
 
 iTime domainValidUntil_GmCerts(const iGmCerts *d, iRangecc domain) {
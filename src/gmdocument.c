@@ -21,6 +21,7 @@ ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include "gmdocument.h"
+#include "gmrunindex.h"
 #include "gmutil.h"
 #include "ui/color.h"
 #include "ui/text.h"
@@ -30,8 +31,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "bookmarks.h"
 #include "app.h"
 
+#include <the_Foundation/atomic.h>
 #include <the_Foundation/ptrarray.h>
 #include <the_Foundation/regexp.h>
+#include <the_Foundation/thread.h>
 
 #include <ctype.h>
 
@@ -69,6 +72,66 @@ iDefineTypeConstruction(GmLink)
 
 /*----------------------------------------------------------------------------------------------*/
 
+/* Run index entries. The keys are running maximums over the layout order, so they are
+   monotonic even if individual runs overlap vertically, and can be binary searched.
+   GmRunPos is in gmrunindex.h. */
+
+iDeclareType(GmRunLoc)
+
+struct Impl_GmRunLoc {
+    const char *end; /* running max of source text end */
+    size_t      run; /* index in layout */
+};
+
+/*----------------------------------------------------------------------------------------------*/
+
+enum iGmLineType {
+    text_GmLineType,
+    bullet_GmLineType,
+    preformatted_GmLineType,
+    quote_GmLineType,
+    heading1_GmLineType,
+    heading2_GmLineType,
+    heading3_GmLineType,
+    link_GmLineType,
+    max_GmLineType,
+};
+
+/* Layout state at the start of a source line. When more source is appended to the document,
+   the layout continues from the last line that was complete. */
+
+iDeclareType(GmLayoutState)
+iDeclareType(GmAppendState)
+
+struct Impl_GmLayoutState {
+    size_t           sourcePos; /* start of the line; zero if the layout must start over */
+    int              width;
+    size_t           numRuns;
+    size_t           numLinks;
+    size_t           numHeadings;
+    iBool            hasTitle;
+    iInt2            pos;
+    iBool            isFirstText;
+    iBool            addQuoteIcon;
+    iBool            isPreformat;
+    int              preFont;
+    uint16_t         preId;
+    iBool            enableIndents;
+    iBool            addSiteBanner;
+    enum iGmLineType prevType;
+    enum iGmLineType prevNonBlankType;
+    iBool            followsBlank;
+};
+
+struct Impl_GmAppendState {
+    size_t         rawPos;      /* raw source consumed up to the last complete line */
+    size_t         sourcePos;   /* corresponding position in the (normalized) source */
+    iBool          isPreformat; /* normalizer state at `rawPos` */
+    iGmLayoutState layout;
+};
+
+/*----------------------------------------------------------------------------------------------*/
+
 struct Impl_GmDocument {
     iObject object;
     enum iGmDocumentFormat format;
@@ -77,6 +140,9 @@ struct Impl_GmDocument {
     iString   localHost;
     iInt2     size;
     iArray    layout; /* contents of source, laid out in document space */
+    iArray    visIndex; /* running max of visBounds bottoms, one per run */
+    iArray    posIndex; /* GmRunPos for each non-decoration run */
+    iArray    locIndex; /* GmRunLoc for each non-decoration run with source text */
     iPtrArray links;
     enum iGmDocumentBanner bannerType;
     iString   bannerText;
@@ -85,22 +151,16 @@ struct Impl_GmDocument {
     uint32_t  themeSeed;
     iChar     siteIcon;
     iMedia *  media;
+    iThread * layoutThread; /* background layout in progress */
+    iGmDocument *layoutCopy; /* laid out in the background, swapped in when finished */
+    iGmDocument *layoutOrigin; /* set in a background layout copy */
+    iAtomicInt isLayoutCancelled;
+    iAtomicInt isLayoutFinished;
+    iGmAppendState append; /* for continuing when more source is received */
 };
 
 iDefineObjectConstruction(GmDocument)
 
-enum iGmLineType {
-    text_GmLineType,
-    bullet_GmLineType,
-    preformatted_GmLineType,
-    quote_GmLineType,
-    heading1_GmLineType,
-    heading2_GmLineType,
-    heading3_GmLineType,
-    link_GmLineType,
-    max_GmLineType,
-};
-
 static enum iGmLineType lineType_GmDocument_(const iGmDocument *d, const iRangecc line) {
     if (d->format == plainText_GmDocumentFormat) {
         return text_GmLineType;
@@ -309,7 +369,61 @@ static enum iGmDocumentTheme currentTheme_(void) {
                                                 : prefs_App()->docThemeLight);
 }
 
-static void doLayout_GmDocument_(iGmDocument *d) {
+static void clearRunIndex_GmDocument_(iGmDocument *d) {
+    clear_Array(&d->visIndex);
+    clear_Array(&d->posIndex);
+    clear_Array(&d->locIndex);
+}
+
+static void buildRunIndex_GmDocument_(iGmDocument *d, size_t firstRun) {
+    /* Entries of runs preceding `firstRun` are kept as is. */
+    int         maxVisBottom = 0;
+    const char *maxEnd       = NULL;
+    resize_Array(&d->visIndex, firstRun);
+    updateIndex_GmRunPos(&d->posIndex, &d->layout, firstRun);
+    while (!isEmpty_Array(&d->locIndex) &&
+           ((const iGmRunLoc *) back_Array(&d->locIndex))->run >= firstRun) {
+        popBack_Array(&d->locIndex);
+    }
+    if (firstRun > 0) {
+        maxVisBottom = *(const int *) back_Array(&d->visIndex);
+    }
+    if (!isEmpty_Array(&d->locIndex)) {
+        maxEnd = ((const iGmRunLoc *) back_Array(&d->locIndex))->end;
+    }
+    resize_Array(&d->visIndex, size_Array(&d->layout));
+    for (size_t index = firstRun; index < size_Array(&d->layout); index++) {
+        const iGmRun *run = constAt_Array(&d->layout, index);
+        maxVisBottom = iMax(maxVisBottom, bottom_Rect(run->visBounds));
+        *(int *) at_Array(&d->visIndex, index) = maxVisBottom;
+        if (run->flags & decoration_GmRunFlag) {
+            continue;
+        }
+        if (run->text.start) {
+            if (!maxEnd || run->text.end > maxEnd) {
+                maxEnd = run->text.end;
+            }
+            pushBack_Array(&d->locIndex, &(iGmRunLoc){ .end = maxEnd, .run = index });
+        }
+    }
+}
+
+static const iGmRun *indexedRun_GmDocument_(const iGmDocument *d, size_t index) {
+    return constAt_Array(&d->layout, index);
+}
+
+static void truncateLinks_GmDocument_(iGmDocument *d, size_t count) {
+    while (size_PtrArray(&d->links) > count) {
+        delete_GmLink(take_PtrArray(&d->links, size_PtrArray(&d->links) - 1));
+    }
+}
+
+static void cancelLayout_GmDocument_(iGmDocument *d);
+
+static void doLayoutFrom_GmDocument_(iGmDocument *d, const iGmLayoutState *resume) {
+    /* If `resume` is given, the runs laid out before it are kept and the layout continues
+       from the line where the state was saved. */
+    cancelLayout_GmDocument_(d); /* superseded */
     const iBool isMono = isForcedMonospace_GmDocument_(d);
     const iBool isNarrow = d->size.x < 90 * gap_Text;
     /* TODO: Collect these parameters into a GmTheme. */
@@ -351,15 +465,34 @@ static void doLayout_GmDocument_(iGmDocument *d) {
     static const char *magnifyingGlass = "\U0001f50d";
     static const char *pointingFinger  = "\U0001f449";
     const iPrefs *prefs = prefs_App();
-    clear_Array(&d->layout);
-    clearLinks_GmDocument_(d);
-    clear_Array(&d->headings);
-    clear_String(&d->title);
-    clear_String(&d->bannerText);
+    iGmLayoutState start;
+    if (resume) {
+        start = *resume; /* the saved state gets updated during the layout */
+        resize_Array(&d->layout, start.numRuns);
+        truncateLinks_GmDocument_(d, start.numLinks);
+        resize_Array(&d->headings, start.numHeadings);
+        if (!start.hasTitle) {
+            clear_String(&d->title);
+        }
+        if (start.addSiteBanner) {
+            clear_String(&d->bannerText);
+        }
+    }
+    else {
+        clear_Array(&d->layout);
+        clearRunIndex_GmDocument_(d);
+        clearLinks_GmDocument_(d);
+        clear_Array(&d->headings);
+        clear_String(&d->title);
+        clear_String(&d->bannerText);
+    }
+    iZap(d->append.layout);
     if (d->size.x <= 0 || isEmpty_String(&d->source)) {
         return;
     }
+    const size_t     firstRun      = size_Array(&d->layout);
     const iRangecc   content       = range_String(&d->source);
+    const char *     stableEnd     = content.start + d->append.sourcePos;
     iRangecc         contentLine   = iNullRange;
     iInt2            pos           = zero_I2();
     iBool            isFirstText   = prefs->bigFirstParagraph;
@@ -378,7 +511,48 @@ static void doLayout_GmDocument_(iGmDocument *d) {
         isPreformat = iTrue;
         isFirstText = iFalse;
     }
+    if (resume) {
+        /* Continue from the beginning of the saved line; it follows a newline. */
+        contentLine      = (iRangecc){ content.start + start.sourcePos - 1,
+                                       content.start + start.sourcePos - 1 };
+        pos              = start.pos;
+        isFirstText      = start.isFirstText;
+        addQuoteIcon     = start.addQuoteIcon;
+        isPreformat      = start.isPreformat;
+        preFont          = start.preFont;
+        preId            = start.preId;
+        enableIndents    = start.enableIndents;
+        addSiteBanner    = start.addSiteBanner;
+        prevType         = start.prevType;
+        prevNonBlankType = start.prevNonBlankType;
+        followsBlank     = start.followsBlank;
+    }
     while (nextSplit_Rangecc(content, "\n", &contentLine)) {
+        if (value_Atomic(&d->isLayoutCancelled)) {
+            return; /* the result would be discarded anyway */
+        }
+        if (contentLine.start <= stableEnd) {
+            /* Source up to here will not change when more is appended. */
+            d->append.layout = (iGmLayoutState){
+                .sourcePos        = contentLine.start - content.start,
+                .width            = d->size.x,
+                .numRuns          = size_Array(&d->layout),
+                .numLinks         = size_PtrArray(&d->links),
+                .numHeadings      = size_Array(&d->headings),
+                .hasTitle         = !isEmpty_String(&d->title),
+                .pos              = pos,
+                .isFirstText      = isFirstText,
+                .addQuoteIcon     = addQuoteIcon,
+                .isPreformat      = isPreformat,
+                .preFont          = preFont,
+                .preId            = preId,
+                .enableIndents    = enableIndents,
+                .addSiteBanner    = addSiteBanner,
+                .prevType         = prevType,
+                .prevNonBlankType = prevNonBlankType,
+                .followsBlank     = followsBlank,
+            };
+        }
         iRangecc line = contentLine; /* `line` will be trimmed later; would confuse nextSplit */
         iGmRun run = { .color = white_ColorId };
         enum iGmLineType type;
@@ -713,18 +887,124 @@ static void doLayout_GmDocument_(iGmDocument *d) {
     d->size.y = pos.y;
     /* Go over the preformatted blocks and mark them wide if at least one run is wide. */ {
         /* TODO: Store the dimensions and ranges for later access. */
-        iForEach(Array, i, &d->layout) {
-            iGmRun *run = i.value;
+        size_t index = firstRun;
+        /* A block may continue from the previously laid out runs. */
+        while (index > 0 && index < size_Array(&d->layout) &&
+               ((const iGmRun *) constAt_Array(&d->layout, index))->preId &&
+               ((const iGmRun *) constAt_Array(&d->layout, index - 1))->preId ==
+                   ((const iGmRun *) constAt_Array(&d->layout, index))->preId) {
+            index--;
+        }
+        for (; index < size_Array(&d->layout); index++) {
+            iGmRun *run = at_Array(&d->layout, index);
             if (run->preId && run->flags & wide_GmRunFlag) {
                 iGmRunRange block = findPreformattedRange_GmDocument(d, run);
                 for (const iGmRun *j = block.start; j != block.end; j++) {
                     iConstCast(iGmRun *, j)->flags |= wide_GmRunFlag;
                 }
                 /* Skip to the end of the block. */
-                i.pos = block.end - (const iGmRun *) constData_Array(&d->layout) - 1;
+                index = block.end - (const iGmRun *) constData_Array(&d->layout) - 1;
             }
         }
     }
+    buildRunIndex_GmDocument_(d, firstRun);
+}
+
+static void doLayout_GmDocument_(iGmDocument *d) {
+    doLayoutFrom_GmDocument_(d, NULL);
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+static const size_t minSourceSizeForBackgroundLayout_GmDocument_ = 100000;
+
+static iThreadResult layout_GmDocument_(iThread *thread) {
+    iGmDocument *d = userData_Thread(thread);
+    iBeginCollect();
+    doLayout_GmDocument_(d);
+    iEndCollect();
+    if (!value_Atomic(&d->isLayoutCancelled)) {
+        set_Atomic(&d->isLayoutFinished, iTrue);
+        postCommandf_App("document.layout.finished gmdoc:%p", d->layoutOrigin);
+    }
+    return 0;
+}
+
+static void releaseLayoutCopy_GmDocument_(iGmDocument *d) {
+    iRelease(d->layoutThread);
+    d->layoutThread = NULL;
+    d->layoutCopy->media = NULL; /* borrowed */
+    iRelease(d->layoutCopy);
+    d->layoutCopy = NULL;
+}
+
+static void waitLayout_GmDocument_(iGmDocument *d) {
+    if (d->layoutThread) {
+        join_Thread(d->layoutThread); /* result is taken when notified */
+    }
+}
+
+static void cancelLayout_GmDocument_(iGmDocument *d) {
+    if (d->layoutThread) {
+        set_Atomic(&d->layoutCopy->isLayoutCancelled, iTrue);
+        join_Thread(d->layoutThread);
+        releaseLayoutCopy_GmDocument_(d);
+    }
+}
+
+iBool setWidthInBackground_GmDocument(iGmDocument *d, int width) {
+    if (size_String(&d->source) < minSourceSizeForBackgroundLayout_GmDocument_) {
+        setWidth_GmDocument(d, width);
+        return iFalse;
+    }
+    cancelLayout_GmDocument_(d);
+    d->size.x = width;
+    /* The copy shares the source and media; neither is modified while the layout is
+       in progress. */
+    iGmDocument *copy = new_GmDocument();
+    delete_Media(copy->media);
+    copy->media      = d->media;
+    copy->format     = d->format;
+    copy->bannerType = d->bannerType;
+    copy->size       = d->size;
+    copy->themeSeed  = d->themeSeed;
+    copy->siteIcon   = d->siteIcon;
+    copy->append     = d->append;
+    set_String(&copy->source, &d->source);
+    set_String(&copy->url, &d->url);
+    set_String(&copy->localHost, &d->localHost);
+    copy->layoutOrigin = d;
+    d->layoutCopy   = copy;
+    d->layoutThread = new_Thread(layout_GmDocument_);
+    setUserData_Thread(d->layoutThread, copy);
+    start_Thread(d->layoutThread);
+    return iTrue;
+}
+
+iBool isLayoutPending_GmDocument(const iGmDocument *d) {
+    return d->layoutThread != NULL;
+}
+
+iBool finishLayout_GmDocument(iGmDocument *d) {
+    if (!d->layoutThread || !value_Atomic(&d->layoutCopy->isLayoutFinished)) {
+        return iFalse; /* notification is stale */
+    }
+    iGmDocument *copy = d->layoutCopy;
+    join_Thread(d->layoutThread);
+    /* Runs refer to the copy's source, so the source is swapped along with the results. */
+    iSwap(iString,  d->source,     copy->source);
+    iSwap(iArray,   d->layout,     copy->layout);
+    iSwap(iArray,   d->visIndex,   copy->visIndex);
+    iSwap(iArray,   d->posIndex,   copy->posIndex);
+    iSwap(iArray,   d->locIndex,   copy->locIndex);
+    iSwap(iPtrArray, d->links,     copy->links);
+    iSwap(iArray,   d->headings,   copy->headings);
+    iSwap(iString,  d->title,      copy->title);
+    iSwap(iString,  d->bannerText, copy->bannerText);
+    d->size = copy->size;
+    d->append.layout = copy->append.layout;
+    releaseLayoutCopy_GmDocument_(d);
+    return iTrue;
 }
 
 void init_GmDocument(iGmDocument *d) {
@@ -735,6 +1015,9 @@ void init_GmDocument(iGmDocument *d) {
     d->bannerType = siteDomain_GmDocumentBanner;
     d->size = zero_I2();
     init_Array(&d->layout, sizeof(iGmRun));
+    init_Array(&d->visIndex, sizeof(int));
+    init_Array(&d->posIndex, sizeof(iGmRunPos));
+    init_Array(&d->locIndex, sizeof(iGmRunLoc));
     init_PtrArray(&d->links);
     init_String(&d->bannerText);
     init_String(&d->title);
@@ -742,15 +1025,25 @@ void init_GmDocument(iGmDocument *d) {
     d->themeSeed = 0;
     d->siteIcon = 0;
     d->media = new_Media();
+    d->layoutThread = NULL;
+    d->layoutCopy = NULL;
+    d->layoutOrigin = NULL;
+    set_Atomic(&d->isLayoutCancelled, iFalse);
+    set_Atomic(&d->isLayoutFinished, iFalse);
+    iZap(d->append);
 }
 
 void deinit_GmDocument(iGmDocument *d) {
+    cancelLayout_GmDocument_(d);
     delete_Media(d->media);
     deinit_String(&d->bannerText);
     deinit_String(&d->title);
     clearLinks_GmDocument_(d);
     deinit_PtrArray(&d->links);
     deinit_Array(&d->headings);
+    deinit_Array(&d->locIndex);
+    deinit_Array(&d->posIndex);
+    deinit_Array(&d->visIndex);
     deinit_Array(&d->layout);
     deinit_String(&d->localHost);
     deinit_String(&d->url);
@@ -758,6 +1051,8 @@ void deinit_GmDocument(iGmDocument *d) {
 }
 
 iMedia *media_GmDocument(iGmDocument *d) {
+    /* The background layout reads the media, so it must not be modified meanwhile. */
+    waitLayout_GmDocument_(d);
     return d->media;
 }
 
@@ -766,13 +1061,16 @@ const iMedia *constMedia_GmDocument(const iGmDocument *d) {
 }
 
 void reset_GmDocument(iGmDocument *d) {
+    cancelLayout_GmDocument_(d);
     clear_Media(d->media);
     clearLinks_GmDocument_(d);
     clear_Array(&d->layout);
+    clearRunIndex_GmDocument_(d);
     clear_Array(&d->headings);
     clear_String(&d->url);
     clear_String(&d->localHost);
     d->themeSeed = 0;
+    iZap(d->append);
 }
 
 static void setDerivedThemeColors_(enum iGmDocumentTheme theme) {
@@ -1284,14 +1582,10 @@ iLocalDef iBool isNormalizableSpace_(char ch) {
     return ch == ' ' || ch == '\t';
 }
 
-static void normalize_GmDocument(iGmDocument *d) {
-    iString *normalized = new_String();
-    iRangecc src = range_String(&d->source);
+static void appendNormalized_GmDocument_(iGmDocument *d, const iRangecc src, const char *rawStart) {
+    iString *normalized = &d->source;
     iRangecc line = iNullRange;
-    iBool isPreformat = iFalse;
-    if (d->format == plainText_GmDocumentFormat) {
-        isPreformat = iTrue; /* Cannot be turned off. */
-    }
+    iBool isPreformat = d->append.isPreformat;
     const int preTabWidth = 4; /* TODO: user-configurable parameter */
     while (nextSplit_Rangecc(src, "\n", &line)) {
         if (isPreformat) {
@@ -1312,41 +1606,111 @@ static void normalize_GmDocument(iGmDocument *d) {
             if (lineType_GmDocument_(d, line) == preformatted_GmLineType) {
                 isPreformat = iFalse;
             }
-            continue;
         }
-        if (lineType_GmDocument_(d, line) == preformatted_GmLineType) {
+        else if (lineType_GmDocument_(d, line) == preformatted_GmLineType) {
             isPreformat = iTrue;
             appendRange_String(normalized, line);
             appendCStr_String(normalized, "\n");
-            continue;
         }
-        iBool isPrevSpace = iFalse;
-        int spaceCount = 0;
-        for (const char *ch = line.start; ch != line.end; ch++) {
-            char c = *ch;
-            if (c == '\r') continue;
-            if (isNormalizableSpace_(c)) {
-                if (isPrevSpace) {
-                    if (++spaceCount == 8) {
-                        /* There are several consecutive space characters. The author likely
-                           really wants to have some space here, so normalize to a tab stop. */
-                        popBack_Block(&normalized->chars);
-                        pushBack_Block(&normalized->chars, '\t');
+        else {
+            iBool isPrevSpace = iFalse;
+            int spaceCount = 0;
+            for (const char *ch = line.start; ch != line.end; ch++) {
+                char c = *ch;
+                if (c == '\r') continue;
+                if (isNormalizableSpace_(c)) {
+                    if (isPrevSpace) {
+                        if (++spaceCount == 8) {
+                            /* There are several consecutive space characters. The author likely
+                               really wants to have some space here, so normalize to a tab stop. */
+                            popBack_Block(&normalized->chars);
+                            pushBack_Block(&normalized->chars, '\t');
+                        }
+                        continue; /* skip repeated spaces */
                     }
-                    continue; /* skip repeated spaces */
+                    c = ' ';
+                    isPrevSpace = iTrue;
+                }
+                else {
+                    isPrevSpace = iFalse;
+                    spaceCount = 0;
                 }
-                c = ' ';
-                isPrevSpace = iTrue;
+                appendCStrN_String(normalized, &c, 1);
             }
-            else {
-                isPrevSpace = iFalse;
-                spaceCount = 0;
+            appendCStr_String(normalized, "\n");
+        }
+        if (line.end != src.end) {
+            /* The line is complete, so its normalized form is final. */
+            d->append.rawPos      = line.end + 1 - rawStart;
+            d->append.sourcePos   = size_String(normalized);
+            d->append.isPreformat = isPreformat;
+        }
+    }
+}
+
+static void rebase_Rangecc_(iRangecc *range, const char *oldStart, size_t size, const char *newStart) {
+    if (range->start && range->start >= oldStart && range->start <= oldStart + size) {
+        range->end   = newStart + (range->end - oldStart);
+        range->start = newStart + (range->start - oldStart);
+    }
+}
+
+static void rebaseSource_GmDocument_(iGmDocument *d, const char *oldStart, size_t size) {
+    /* Runs, links, and headings that refer to the first `size` bytes of the source are kept
+       when the source buffer is reallocated. */
+    const char *newStart = constBegin_String(&d->source);
+    if (newStart == oldStart) {
+        return;
+    }
+    iForEach(Array, i, &d->layout) {
+        iGmRun *run = i.value;
+        rebase_Rangecc_(&run->text, oldStart, size, newStart);
+    }
+    iForEach(PtrArray, j, &d->links) {
+        iGmLink *link = j.ptr;
+        rebase_Rangecc_(&link->urlRange, oldStart, size, newStart);
+        rebase_Rangecc_(&link->labelRange, oldStart, size, newStart);
+        rebase_Rangecc_(&link->labelIcon, oldStart, size, newStart);
+    }
+    iForEach(Array, k, &d->headings) {
+        iGmHeading *heading = k.value;
+        rebase_Rangecc_(&heading->text, oldStart, size, newStart);
+    }
+    iForEach(Array, m, &d->locIndex) {
+        iGmRunLoc *loc = m.value;
+        if (loc->end >= oldStart && loc->end <= oldStart + size) {
+            loc->end = newStart + (loc->end - oldStart);
+        }
+    }
+}
+
+static void appendSource_GmDocument_(iGmDocument *d, const iString *source) {
+    /* Everything after the last complete line of the previous source is redone. */
+    const iRangecc tail = { constBegin_String(source) + d->append.rawPos, constEnd_String(source) };
+    if (d->append.sourcePos) {
+        remove_Block(&d->source.chars, d->append.sourcePos, iInvalidSize);
+    }
+    else {
+        clear_String(&d->source);
+    }
+    if (isNormalized_GmDocument_(d)) {
+        appendNormalized_GmDocument_(d, tail, constBegin_String(source));
+    }
+    else {
+        if (d->append.sourcePos == 0) {
+            set_String(&d->source, source); /* shared with the caller */
+        }
+        else {
+            appendRange_String(&d->source, tail);
+        }
+        for (const char *ch = tail.end; ch != tail.start; ch--) {
+            if (ch[-1] == '\n') {
+                d->append.rawPos    = ch - constBegin_String(source);
+                d->append.sourcePos = d->append.rawPos;
+                break;
             }
-            appendCStrN_String(normalized, &c, 1);
         }
-        appendCStr_String(normalized, "\n");
     }
-    set_String(&d->source, collect_String(normalized));
 }
 
 void setUrl_GmDocument(iGmDocument *d, const iString *url) {
@@ -1358,29 +1722,49 @@ void setUrl_GmDocument(iGmDocument *d, const iString *url) {
 }
 
 void setSource_GmDocument(iGmDocument *d, const iString *source, int width) {
-    set_String(&d->source, source);
-    if (isNormalized_GmDocument_(d)) {
-        normalize_GmDocument(d);
-    }
+    cancelLayout_GmDocument_(d);
+    iZap(d->append);
+    /* Cannot be turned off in plain text. */
+    d->append.isPreformat = (d->format == plainText_GmDocumentFormat);
+    appendSource_GmDocument_(d, source);
     setWidth_GmDocument(d, width); /* re-do layout */
 }
 
+void appendSource_GmDocument(iGmDocument *d, const iString *source, int width) {
+    const iGmLayoutState *resume = &d->append.layout;
+    if (!resume->sourcePos || resume->width != width || isLayoutPending_GmDocument(d) ||
+        size_String(source) < d->append.rawPos) {
+        setSource_GmDocument(d, source, width);
+        return;
+    }
+    const char * oldStart = constBegin_String(&d->source);
+    const size_t keptSize = d->append.sourcePos;
+    appendSource_GmDocument_(d, source);
+    rebaseSource_GmDocument_(d, oldStart, keptSize);
+    doLayoutFrom_GmDocument_(d, resume);
+}
+
 void render_GmDocument(const iGmDocument *d, iRangei visRangeY, iGmDocumentRenderFunc render,
                        void *context) {
-    iBool isInside = iFalse;
-    /* TODO: Check lookup table for quick starting position. */
-    iConstForEach(Array, i, &d->layout) {
-        const iGmRun *run = i.value;
-        if (isInside) {
-            if (top_Rect(run->visBounds) > visRangeY.end) {
-                break;
-            }
-            render(context, run);
+    /* Binary search for the first run that reaches the visible range. */
+    const int *bottoms = constData_Array(&d->visIndex);
+    size_t     lo      = 0;
+    size_t     hi      = size_Array(&d->visIndex);
+    while (lo < hi) {
+        const size_t mid = (lo + hi) / 2;
+        if (bottoms[mid] >= visRangeY.start) {
+            hi = mid;
         }
-        else if (bottom_Rect(run->visBounds) >= visRangeY.start) {
-            isInside = iTrue;
-            render(context, run);
+        else {
+            lo = mid + 1;
+        }
+    }
+    for (size_t i = lo; i < size_Array(&d->layout); i++) {
+        const iGmRun *run = indexedRun_GmDocument_(d, i);
+        if (i > lo && top_Rect(run->visBounds) > visRangeY.end) {
+            break;
         }
+        render(context, run);
     }
 }
 
@@ -1419,6 +1803,14 @@ const iString *source_GmDocument(const iGmDocument *d) {
     return &d->source;
 }
 
+size_t memorySize_GmDocument(const iGmDocument *d) {
+    return size_String(&d->source) +
+           size_Array(&d->layout) * sizeof(iGmRun) +
+           size_Array(&d->visIndex) * sizeof(int) +
+           size_Array(&d->posIndex) * sizeof(iGmRunPos) +
+           size_Array(&d->locIndex) * sizeof(iGmRunLoc);
+}
+
 iRangecc findText_GmDocument(const iGmDocument *d, const iString *text, const char *start) {
     const char * src      = constBegin_String(&d->source);
     const size_t startPos = (start ? start - src : 0);
@@ -1461,30 +1853,8 @@ iGmRunRange findPreformattedRange_GmDocument(const iGmDocument *d, const iGmRun
 }
 
 const iGmRun *findRun_GmDocument(const iGmDocument *d, iInt2 pos) {
-    /* TODO: Perf optimization likely needed; use a block map? */
-    const iGmRun *last = NULL;
-    iBool isFirstNonDecoration = iTrue;
-    iConstForEach(Array, i, &d->layout) {
-        const iGmRun *run = i.value;
-        if (run->flags & decoration_GmRunFlag) continue;
-        const iRangei span = ySpan_Rect(run->bounds);
-        if (contains_Range(&span, pos.y)) {
-            last = run;
-            break;
-        }
-        if (isFirstNonDecoration && pos.y < top_Rect(run->bounds)) {
-            last = run;
-            break;
-        }
-        if (top_Rect(run->bounds) > pos.y) break; /* Below the point. */
-        last = run;
-        isFirstNonDecoration = iFalse;
-    }
-//    if (last) {
-//        printf("found run at (%d,%d): %p [%s]\n", pos.x, pos.y, last, cstr_Rangecc(last->text));
-//        fflush(stdout);
-//    }
-    return last;
+    const size_t index = find_GmRunPos(&d->posIndex, &d->layout, pos);
+    return index != iInvalidPos ? indexedRun_GmDocument_(d, index) : NULL;
 }
 
 const char *findLoc_GmDocument(const iGmDocument *d, iInt2 pos) {
@@ -1496,16 +1866,23 @@ const char *findLoc_GmDocument(const iGmDocument *d, iInt2 pos) {
 }
 
 const iGmRun *findRunAtLoc_GmDocument(const iGmDocument *d, const char *textCStr) {
-    iConstForEach(Array, i, &d->layout) {
-        const iGmRun *run = i.value;
-        if (run->flags & decoration_GmRunFlag) {
-            continue;
+    /* The first run that contains the location or is past it. */
+    size_t lo = 0;
+    size_t hi = size_Array(&d->locIndex);
+    while (lo < hi) {
+        const size_t     mid   = (lo + hi) / 2;
+        const iGmRunLoc *entry = constAt_Array(&d->locIndex, mid);
+        if (entry->end > textCStr) {
+            hi = mid;
         }
-        if (contains_Range(&run->text, textCStr) || run->text.start > textCStr /* went past */) {
-            return run;
+        else {
+            lo = mid + 1;
         }
     }
-    return NULL;
+    if (lo == size_Array(&d->locIndex)) {
+        return NULL;
+    }
+    return indexedRun_GmDocument_(d, ((const iGmRunLoc *) constAt_Array(&d->locIndex, lo))->run);
 }
 
 static const iGmLink *link_GmDocument_(const iGmDocument *d, iGmLinkId id) {
@@ -134,6 +134,11 @@ void    setWidth_GmDocument     (iGmDocument *, int width);
 void    redoLayout_GmDocument   (iGmDocument *);
 void    setUrl_GmDocument       (iGmDocument *, const iString *url);
 void    setSource_GmDocument    (iGmDocument *, const iString *source, int width);
+void    appendSource_GmDocument (iGmDocument *, const iString *source, int width); /* extends previous */
+
+iBool   setWidthInBackground_GmDocument (iGmDocument *, int width); /* iTrue if layout is pending */
+iBool   isLayoutPending_GmDocument      (const iGmDocument *);
+iBool   finishLayout_GmDocument         (iGmDocument *); /* when "document.layout.finished" */
 
 void    reset_GmDocument        (iGmDocument *); /* free images */
 
@@ -151,6 +156,7 @@ enum iGmDocumentBanner bannerType_GmDocument(const iGmDocument *);
 const iString * bannerText_GmDocument       (const iGmDocument *);
 const iArray *  headings_GmDocument         (const iGmDocument *); /* array of GmHeadings */
 const iString * source_GmDocument           (const iGmDocument *);
+size_t          memorySize_GmDocument       (const iGmDocument *); /* source and layout, in bytes */
 
 iRangecc        findText_GmDocument                 (const iGmDocument *, const iString *text, const char *start);
 iRangecc        findTextBefore_GmDocument           (const iGmDocument *, const iString *text, const char *before);
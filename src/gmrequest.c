@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "embedded.h"
 #include "defs.h"
 
+#include <the_Foundation/condition.h>
 #include <the_Foundation/file.h>
 #include <the_Foundation/mutex.h>
 #include <the_Foundation/path.h>
@@ -120,6 +121,7 @@ enum iGmRequestState {
     initialized_GmRequestState,
     receivingHeader_GmRequestState,
     receivingBody_GmRequestState,
+    filtering_GmRequestState, /* received everything, running the filters */
     finished_GmRequestState,
     failure_GmRequestState,
 };
@@ -134,8 +136,15 @@ struct Impl_GmRequest {
     iGopher              gopher;
     iGmResponse *        resp;
     iBool                isFilterEnabled;
+    iBool                isBuiltinFilterEnabled;
     iBool                isRespLocked;
     iBool                isRespFiltered;
+    iMimeFilter *        filter;      /* filter hook receiving the body as it arrives */
+    enum iGmRequestState filterState; /* parsing of the filter output */
+    int                  rawStatus;   /* unfiltered response, in case the filter fails */
+    iString              rawMeta;
+    iBlock               rawBody;
+    iCondition           filtered;    /* state is no longer filtering */
     iAtomicInt           allowUpdate;
     iAudience *          updated;
     iAudience *          finished;
@@ -171,6 +180,72 @@ static void checkServerCertificate_GmRequest_(iGmRequest *d) {
     }
 }
 
+static int processIncomingData_GmRequest_(iGmRequest *d, const iBlock *data);
+
+static iBool processFilterOutput_GmRequest_(iGmRequest *d, const iBlock *output) {
+    if (isEmpty_Block(output)) {
+        return iFalse;
+    }
+    /* The filter output is a response of its own that replaces the received one. */
+    iMimeFilter *              filter = d->filter;
+    const enum iGmRequestState state  = d->state;
+    d->filter      = NULL;
+    d->state       = d->filterState;
+    const int ubits = processIncomingData_GmRequest_(d, output);
+    d->filterState = d->state;
+    d->state       = state;
+    d->filter      = filter;
+    return (ubits & 1) != 0 && d->filterState == receivingBody_GmRequestState;
+}
+
+static iBool writeToFilter_GmRequest_(iGmRequest *d, const iBlock *data) {
+    /* Called with the response locked. The filter only queues the data for its pipe thread
+       and picks up the output received so far, so this doesn't wait on the hook process. */
+    iBool   notifyUpdate = iFalse;
+    iBlock *output       = new_Block(0);
+    append_Block(&d->rawBody, data);
+    if (write_MimeFilter(d->filter, data, output)) {
+        notifyUpdate = processFilterOutput_GmRequest_(d, output);
+    }
+    delete_Block(output);
+    return notifyUpdate;
+}
+
+static void startFilter_GmRequest_(iGmRequest *d) {
+    iGmResponse *resp = d->resp;
+    d->filter =
+        newFilter_MimeHooks(mimeHooks_App(), &resp->meta, &d->url, d->isBuiltinFilterEnabled);
+    if (d->filter) {
+        d->filterState = receivingHeader_GmRequestState;
+        d->rawStatus   = resp->statusCode;
+        set_String(&d->rawMeta, &resp->meta);
+        iBlock *received = copy_Block(&resp->body);
+        clear_String(&resp->meta);
+        clear_Block(&resp->body);
+        writeToFilter_GmRequest_(d, received);
+        delete_Block(received);
+    }
+}
+
+static iBool finishFilter_GmRequest_(iGmRequest *d, iBool isOk, const iBlock *output) {
+    /* Called with the response locked, after the streaming filter has been detached from the
+       request. Returns iTrue if the filter failed and the unfiltered response was restored;
+       the remaining filters may then be tried. */
+    iBool isFailed = iFalse;
+    if (isOk) {
+        processFilterOutput_GmRequest_(d, output);
+    }
+    /* A filter that didn't exit in time may have been cut off in the middle of the body. */
+    if (!isOk || d->filterState != receivingBody_GmRequestState) {
+        d->resp->statusCode = d->rawStatus;
+        set_String(&d->resp->meta, &d->rawMeta);
+        set_Block(&d->resp->body, &d->rawBody);
+        isFailed = iTrue;
+    }
+    clear_Block(&d->rawBody);
+    return isFailed;
+}
+
 static int processIncomingData_GmRequest_(iGmRequest *d, const iBlock *data) {
     iBool        notifyUpdate = iFalse;
     iBool        notifyDone   = iFalse;
@@ -186,18 +261,15 @@ static int processIncomingData_GmRequest_(iGmRequest *d, const iBlock *data) {
                           size_String(&resp->meta) - endPos - 2);
             remove_Block(&resp->meta.chars, endPos, iInvalidSize);
             /* Parse and remove the code. */
-            iRegExp *metaPattern = new_RegExp("^([0-9][0-9])(( )(.*))?", 0);
             /* TODO: Empty <META> means no <SPACE>? Not according to the spec? */
-            iRegExpMatch m;
-            init_RegExpMatch(&m);
+            iGmHeader header;
             int code = 0;
-            if (matchString_RegExp(metaPattern, &resp->meta, &m)) {
-                code = atoi(capturedRange_RegExpMatch(&m, 1).start);
+            if (parse_GmHeader(&header, range_String(&resp->meta))) {
+                code = header.code;
                 remove_Block(&resp->meta.chars,
                              0,
-                             capturedRange_RegExpMatch(&m, 1).end -
+                             header.meta.start -
                                  constBegin_String(&resp->meta)); /* leave just the <META> */
-                trimStart_String(&resp->meta);
             }
             if (code == 0) {
                 clear_String(&resp->meta);
@@ -212,17 +284,25 @@ static int processIncomingData_GmRequest_(iGmRequest *d, const iBlock *data) {
                 resp->statusCode = code;
                 d->state         = receivingBody_GmRequestState;
                 notifyUpdate     = iTrue;
-                if (d->isFilterEnabled && willTryFilter_MimeHooks(mimeHooks_App(), &resp->meta)) {
+                if (d->isFilterEnabled && !d->isRespFiltered &&
+                    willTryFilter_MimeHooks(
+                        mimeHooks_App(), &resp->meta, d->isBuiltinFilterEnabled)) {
                     d->isRespFiltered = iTrue;
+                    startFilter_GmRequest_(d);
+                    notifyUpdate = (d->filterState == receivingBody_GmRequestState);
                 }
             }
             checkServerCertificate_GmRequest_(d);
-            iRelease(metaPattern);
         }
     }
     else if (d->state == receivingBody_GmRequestState) {
-        append_Block(&resp->body, data);
-        notifyUpdate = iTrue;
+        if (d->filter) {
+            notifyUpdate = writeToFilter_GmRequest_(d, data);
+        }
+        else {
+            append_Block(&resp->body, data);
+            notifyUpdate = iTrue;
+        }
     }
     return (notifyUpdate ? 1 : 0) | (notifyDone ? 2 : 0);
 }
@@ -243,7 +323,8 @@ static void readIncoming_GmRequest_(iGmRequest *d, iTlsRequest *req) {
     initCurrent_Time(&resp->when);
     delete_Block(data);
     unlock_Mutex(d->mtx);
-    if (notifyUpdate && !d->isRespFiltered) {
+    /* Without a streaming filter, the filtered response is only available when finished. */
+    if (notifyUpdate && (!d->isRespFiltered || d->filter)) {
         const iBool allowed = exchange_Atomic(&d->allowUpdate, iFalse);
         if (allowed) {
             iNotifyAudience(d, updated, GmRequestUpdated);
@@ -270,20 +351,67 @@ static void requestFinished_GmRequest_(iGmRequest *d, iTlsRequest *req) {
         set_String(&d->resp->meta, errorMessage_TlsRequest(req));
     }
     checkServerCertificate_GmRequest_(d);
+    /* The filters may take a while to run, so they do so without the response being locked.
+       The request is not finished until the filtered response is in place, and the stream
+       filter is detached so nothing else will touch it meanwhile. */
+    iMimeFilter *streamFilter = d->filter;
+    iBool        isFiltering  = iFalse;
+    d->filter = NULL;
+    if (d->state == failure_GmRequestState) {
+        delete_MimeFilter(streamFilter);
+        streamFilter = NULL;
+    }
+    else if (d->isRespFiltered) {
+        d->state    = filtering_GmRequestState;
+        isFiltering = iTrue;
+    }
     unlock_Mutex(d->mtx);
     /* Check for mimehooks. */
-    if (d->isRespFiltered && d->state == finished_GmRequestState) {
-        iBlock *xbody =
-            tryFilter_MimeHooks(mimeHooks_App(), &d->resp->meta, &d->resp->body, &d->url);
-        if (xbody) {
+    if (isFiltering) {
+        iBlock *xbody = NULL;
+        iString meta;
+        iBlock  body;
+        init_String(&meta);
+        init_Block(&body, 0);
+        if (streamFilter) {
+            /* Waits for the filter to exit (up to a timeout). */
+            iBlock *    output = new_Block(0);
+            const iBool isOk   = finish_MimeFilter(streamFilter, output);
             lock_Mutex(d->mtx);
+            const iBool isFailed = finishFilter_GmRequest_(d, isOk, output);
+            if (isFailed) {
+                set_Block(&body, &d->resp->body);
+            }
+            unlock_Mutex(d->mtx);
+            if (isFailed) {
+                xbody = fallback_MimeFilter(streamFilter, &body);
+            }
+            delete_MimeFilter(streamFilter);
+            delete_Block(output);
+        }
+        else {
+            lock_Mutex(d->mtx);
+            set_String(&meta, &d->resp->meta);
+            set_Block(&body, &d->resp->body);
+            unlock_Mutex(d->mtx);
+            xbody = tryFilter_MimeHooks(
+                mimeHooks_App(), &meta, &body, &d->url, d->isBuiltinFilterEnabled);
+        }
+        lock_Mutex(d->mtx);
+        if (xbody) {
             clear_String(&d->resp->meta);
             clear_Block(&d->resp->body);
             d->state = receivingHeader_GmRequestState;
             processIncomingData_GmRequest_(d, xbody);
-            d->state = finished_GmRequestState;
-            unlock_Mutex(d->mtx);
         }
+        d->state = finished_GmRequestState;
+        signal_Condition(&d->filtered);
+        unlock_Mutex(d->mtx);
+        if (xbody) {
+            delete_Block(xbody);
+        }
+        deinit_Block(&body);
+        deinit_String(&meta);
     }
     iNotifyAudience(d, finished, GmRequestFinished);
 }
@@ -470,8 +598,15 @@ void init_GmRequest(iGmRequest *d, iGmCerts *certs) {
     d->mtx = new_Mutex();
     d->resp = new_GmResponse();
     d->isFilterEnabled = iTrue;
+    d->isBuiltinFilterEnabled = iTrue;
     d->isRespLocked    = iFalse;
     d->isRespFiltered  = iFalse;
+    d->filter          = NULL;
+    d->filterState     = initialized_GmRequestState;
+    d->rawStatus       = 0;
+    init_String(&d->rawMeta);
+    init_Block(&d->rawBody, 0);
+    init_Condition(&d->filtered);
     set_Atomic(&d->allowUpdate, iTrue);
     init_String(&d->url);
     init_Gopher(&d->gopher);
@@ -488,6 +623,10 @@ void deinit_GmRequest(iGmRequest *d) {
         iDisconnectObject(TlsRequest, d->req, finished, d);
     }
     lock_Mutex(d->mtx);
+    /* Filters of a received response are allowed to finish (up to their timeout). */
+    while (d->state == filtering_GmRequestState) {
+        wait_Condition(&d->filtered, d->mtx);
+    }
     if (!isFinished_GmRequest(d)) {
         unlock_Mutex(d->mtx);
         cancel_GmRequest(d);
@@ -497,6 +636,10 @@ void deinit_GmRequest(iGmRequest *d) {
         unlock_Mutex(d->mtx);
     }
     iReleasePtr(&d->req);
+    delete_MimeFilter(d->filter);
+    deinit_Block(&d->rawBody);
+    deinit_String(&d->rawMeta);
+    deinit_Condition(&d->filtered);
     deinit_Gopher(&d->gopher);
     delete_Audience(d->finished);
     delete_Audience(d->updated);
@@ -509,6 +652,10 @@ void enableFilters_GmRequest(iGmRequest *d, iBool enable) {
     d->isFilterEnabled = enable;
 }
 
+void enableBuiltinFilters_GmRequest(iGmRequest *d, iBool enable) {
+    d->isBuiltinFilterEnabled = enable;
+}
+
 void setUrl_GmRequest(iGmRequest *d, const iString *url) {
     set_String(&d->url, urlFragmentStripped_String(url));
     /* Encode hostname to Punycode here because we want to submit the Punycode domain name
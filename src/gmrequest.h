@@ -66,6 +66,7 @@ iDeclareAudienceGetter(GmRequest, updated)
 iDeclareAudienceGetter(GmRequest, finished)
 
 void                enableFilters_GmRequest     (iGmRequest *, iBool enable);
+void                enableBuiltinFilters_GmRequest (iGmRequest *, iBool enable); /* e.g., feed translation */
 void                setUrl_GmRequest            (iGmRequest *, const iString *url);
 void                submit_GmRequest            (iGmRequest *);
 void                cancel_GmRequest            (iGmRequest *);
@@ -0,0 +1,74 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+
+#include "gmrunindex.h"
+
+void updateIndex_GmRunPos(iArray *d, const iArray *layout, size_t firstRun) {
+    while (!isEmpty_Array(d) && ((const iGmRunPos *) back_Array(d))->run >= firstRun) {
+        popBack_Array(d);
+    }
+    int maxBottom = isEmpty_Array(d) ? 0 : ((const iGmRunPos *) back_Array(d))->bottom;
+    for (size_t index = firstRun; index < size_Array(layout); index++) {
+        const iGmRun *run = constAt_Array(layout, index);
+        if (run->flags & decoration_GmRunFlag) {
+            continue;
+        }
+        maxBottom = iMax(maxBottom, bottom_Rect(run->bounds));
+        pushBack_Array(d, &(iGmRunPos){ .bottom = maxBottom, .run = index });
+    }
+}
+
+static size_t run_GmRunPos_(const iArray *d, size_t pos) {
+    return ((const iGmRunPos *) constAt_Array(d, pos))->run;
+}
+
+size_t find_GmRunPos(const iArray *d, const iArray *layout, iInt2 pos) {
+    const size_t count = size_Array(d);
+    if (count == 0) {
+        return iInvalidPos;
+    }
+    /* Find the first non-decoration run that extends below the point. */
+    size_t lo = 0;
+    size_t hi = count;
+    while (lo < hi) {
+        const size_t     mid   = (lo + hi) / 2;
+        const iGmRunPos *entry = constAt_Array(d, mid);
+        if (entry->bottom > pos.y) {
+            hi = mid;
+        }
+        else {
+            lo = mid + 1;
+        }
+    }
+    if (lo == count) {
+        /* Below all runs; the last one is the closest. */
+        return run_GmRunPos_(d, count - 1);
+    }
+    const size_t  index = run_GmRunPos_(d, lo);
+    const iGmRun *run   = constAt_Array(layout, index);
+    if (lo > 0 && top_Rect(run->bounds) > pos.y) {
+        /* The point is in a gap between runs. */
+        return run_GmRunPos_(d, lo - 1);
+    }
+    return index;
+}
@@ -26,6 +26,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <the_Foundation/object.h>
 #include <the_Foundation/path.h>
 
+#include <ctype.h>
+#include <string.h>
+
 void init_Url(iUrl *d, const iString *text) {
     /* Handle "file:" as a special case since it only has the path part. */
     if (startsWithCase_String(text, "file://")) {
@@ -552,3 +555,88 @@ const iGmError *get_GmError(enum iGmStatusCode code) {
     iAssert(errors_[0].code == unknownStatusCode_GmStatusCode);
     return &errors_[0].err; /* unknown */
 }
+
+/*----------------------------------------------------------------------------------------------*/
+
+static iBool isDigit_(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static const char *skipSpace_(const char *pos, const char *end) {
+    while (pos < end && isspace((unsigned char) *pos)) {
+        pos++;
+    }
+    return pos;
+}
+
+static int digits_(const char *pos, size_t count) {
+    int value = 0;
+    for (size_t i = 0; i < count; i++) {
+        value = value * 10 + (pos[i] - '0');
+    }
+    return value;
+}
+
+iBool parse_GmHeader(iGmHeader *d, iRangecc line) {
+    if (size_Range(&line) < 2 || !isDigit_(line.start[0]) || !isDigit_(line.start[1])) {
+        return iFalse;
+    }
+    d->code = digits_(line.start, 2);
+    d->meta = (iRangecc){ line.start + 2, line.end };
+    trimStart_Rangecc(&d->meta);
+    return iTrue;
+}
+
+iBool parse_GmDatedLink(iGmDatedLink *d, iRangecc line) {
+    const char *pos = line.start;
+    const char *end = line.end;
+    if (end - pos < 2 || pos[0] != '=' || pos[1] != '>') {
+        return iFalse;
+    }
+    pos = skipSpace_(pos + 2, end);
+    d->url.start = pos;
+    while (pos < end && !isspace((unsigned char) *pos)) {
+        pos++;
+    }
+    d->url.end = pos;
+    if (isEmpty_Range(&d->url) || pos == end) {
+        return iFalse;
+    }
+    pos = skipSpace_(pos, end);
+    /* YYYY-MM-DD followed by something else than a digit. */
+    if (end - pos < 11 || !isDigit_(pos[0]) || !isDigit_(pos[1]) || !isDigit_(pos[2]) ||
+        !isDigit_(pos[3]) || pos[4] != '-' || pos[5] < '0' || pos[5] > '1' ||
+        !isDigit_(pos[6]) || pos[7] != '-' || pos[8] < '0' || pos[8] > '3' ||
+        !isDigit_(pos[9]) || isDigit_(pos[10])) {
+        return iFalse;
+    }
+    d->year  = digits_(pos, 4);
+    d->month = digits_(pos + 5, 2);
+    d->day   = digits_(pos + 8, 2);
+    d->title = (iRangecc){ pos + 10, end };
+    return iTrue;
+}
+
+iBool parse_GopherLine(iGopherLine *d, iRangecc line) {
+    /* Type character and the display string, selector, host, and port separated by tabs. */
+    if (isEmpty_Range(&line)) {
+        return iFalse;
+    }
+    iRangecc *fields[] = { &d->text, &d->path, &d->domain };
+    const char *pos = line.start + 1;
+    d->type = *line.start;
+    iForIndices(i, fields) {
+        const char *tab = memchr(pos, '\t', line.end - pos);
+        if (!tab) {
+            return iFalse;
+        }
+        *fields[i] = (iRangecc){ pos, tab };
+        pos = tab + 1;
+    }
+    d->port.start = pos;
+    while (pos < line.end && isDigit_(*pos)) {
+        pos++;
+    }
+    d->port.end = pos;
+    return !isEmpty_Range(&d->port);
+}
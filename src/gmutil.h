@@ -26,6 +26,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <the_Foundation/string.h>
 
 iDeclareType(GmError)
+iDeclareType(GmHeader)
+iDeclareType(GmDatedLink)
+iDeclareType(GopherLine)
 iDeclareType(Url)
 
 /* Response status codes. */
@@ -118,3 +121,28 @@ void            urlEncodeSpaces_String  (iString *);
 const iString * withSpacesEncoded_String(const iString *);
 
 const iString * feedEntryOpenCommand_String (const iString *url, int newTab); /* checks fragment */
+
+/* Scanners for line-based response formats. The results point to the scanned line. */
+
+struct Impl_GmHeader {
+    int      code;
+    iRangecc meta;
+};
+
+struct Impl_GmDatedLink {
+    iRangecc url;
+    int      year, month, day;
+    iRangecc title; /* everything after the date */
+};
+
+struct Impl_GopherLine {
+    char     type;
+    iRangecc text;
+    iRangecc path;
+    iRangecc domain;
+    iRangecc port;
+};
+
+iBool   parse_GmHeader      (iGmHeader *, iRangecc line);     /* <STATUS>[<SPACE><META>] */
+iBool   parse_GmDatedLink   (iGmDatedLink *, iRangecc line);  /* => URL YYYY-MM-DD title */
+iBool   parse_GopherLine    (iGopherLine *, iRangecc line);   /* menu item */
@@ -68,8 +68,6 @@ static void setPre_Gopher_(iGopher *d, iBool pre) {
 static iBool convertSource_Gopher_(iGopher *d) {
     iBool    converted = iFalse;
     iRangecc body      = range_Block(&d->source);
-    iRegExp *pattern   = new_RegExp("(.)([^\t]*)\t([^\t]*)\t([^\t]*)\t([0-9]+)",
-                                    caseInsensitive_RegExpOption);
     for (;;) {
         /* Find the end of the line. */
         iRangecc line = { body.start, body.start };
@@ -81,14 +79,13 @@ static iBool convertSource_Gopher_(iGopher *d) {
             break;
         }
         body.start = line.end + 2;
-        iRegExpMatch m;
-        init_RegExpMatch(&m);
-        if (matchRange_RegExp(pattern, line, &m)) {
-            const char     lineType = *capturedRange_RegExpMatch(&m, 1).start;
-            const iRangecc text     = capturedRange_RegExpMatch(&m, 2);
-            const iRangecc path     = capturedRange_RegExpMatch(&m, 3);
-            const iRangecc domain   = capturedRange_RegExpMatch(&m, 4);
-            const iRangecc port     = capturedRange_RegExpMatch(&m, 5);
+        iGopherLine item;
+        if (parse_GopherLine(&item, line)) {
+            const char     lineType = item.type;
+            const iRangecc text     = item.text;
+            const iRangecc path     = item.path;
+            const iRangecc domain   = item.domain;
+            const iRangecc port     = item.port;
             iString *buf = new_String();
             switch (lineType) {
                 case 'i':
@@ -127,7 +124,6 @@ static iBool convertSource_Gopher_(iGopher *d) {
             delete_String(buf);
         }
     }
-    iRelease(pattern);
     remove_Block(&d->source, 0, body.start - constBegin_Block(&d->source));
     return converted;
 }
@@ -26,7 +26,6 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <the_Foundation/file.h>
 #include <the_Foundation/mutex.h>
 #include <the_Foundation/path.h>
-#include <the_Foundation/stringset.h>
 #include <math.h>
 
 static const size_t maxStack_History_ = 50; /* back/forward navigable items */
@@ -280,18 +279,25 @@ void setCachedResponse_History(iHistory *d, const iGmResponse *response) {
         delete_GmResponse(item->cachedResponse);
         item->cachedResponse = NULL;
         if (category_GmStatusCode(response->statusCode) == categorySuccess_GmStatusCode) {
-            item->cachedResponse = copy_GmResponse(response);
+            item->cachedResponse = copy_GmResponse(response); /* body data is shared */
         }
     }
     unlock_Mutex(d->mtx);
 }
 
-size_t cacheSize_History(const iHistory *d) {
+static iBool isInUse_RecentUrl_(const iRecentUrl *d, const iBlock *inUse) {
+    /* Responses share their body data with the document made from them, so evicting
+       the response would not free anything. */
+    return inUse && d->cachedResponse && size_Block(inUse) > 0 &&
+           constData_Block(&d->cachedResponse->body) == constData_Block(inUse);
+}
+
+size_t cacheSize_History(const iHistory *d, const iBlock *inUse) {
     size_t cached = 0;
     lock_Mutex(d->mtx);
     iConstForEach(Array, i, &d->recent) {
         const iRecentUrl *url = i.value;
-        if (url->cachedResponse) {
+        if (url->cachedResponse && !isInUse_RecentUrl_(url, inUse)) {
             cached += size_Block(&url->cachedResponse->body);
         }
     }
@@ -311,16 +317,15 @@ void clearCache_History(iHistory *d) {
     unlock_Mutex(d->mtx);
 }
 
-size_t pruneLeastImportant_History(iHistory *d) {
-    size_t delta  = 0;
+static size_t findLeastImportant_History_(const iHistory *d, const iBlock *inUse,
+                                          double *score_out) {
     size_t chosen = iInvalidPos;
     double score  = 0.0f;
     iTime now;
     initCurrent_Time(&now);
-    lock_Mutex(d->mtx);
     iConstForEach(Array, i, &d->recent) {
         const iRecentUrl *url = i.value;
-        if (url->cachedResponse) {
+        if (url->cachedResponse && !isInUse_RecentUrl_(url, inUse)) {
             const double urlScore =
                 size_Block(&url->cachedResponse->body) *
                 pow(secondsSince_Time(&now, &url->cachedResponse->when) / 60.0, 1.25);
@@ -330,6 +335,22 @@ size_t pruneLeastImportant_History(iHistory *d) {
             }
         }
     }
+    if (score_out) {
+        *score_out = score;
+    }
+    return chosen;
+}
+
+double leastImportantScore_History(const iHistory *d, const iBlock *inUse) {
+    double score = 0.0;
+    iGuardMutex(d->mtx, findLeastImportant_History_(d, inUse, &score));
+    return score;
+}
+
+size_t pruneLeastImportant_History(iHistory *d, const iBlock *inUse) {
+    size_t delta = 0;
+    lock_Mutex(d->mtx);
+    const size_t chosen = findLeastImportant_History_(d, inUse, NULL);
     if (chosen != iInvalidPos) {
         iRecentUrl *url = at_Array(&d->recent, chosen);
         delta = size_Block(&url->cachedResponse->body);
@@ -339,54 +360,3 @@ size_t pruneLeastImportant_History(iHistory *d) {
     unlock_Mutex(d->mtx);
     return delta;
 }
-
-const iStringArray *searchContents_History(const iHistory *d, const iRegExp *pattern) {
-    iStringArray *urls = iClob(new_StringArray());
-    lock_Mutex(d->mtx);
-    iStringSet inserted;
-    init_StringSet(&inserted);
-    iReverseConstForEach(Array, i, &d->recent) {
-        const iRecentUrl *url = i.value;
-        const iGmResponse *resp = url->cachedResponse;
-        if (resp && category_GmStatusCode(resp->statusCode) == categorySuccess_GmStatusCode) {
-            if (indexOfCStrSc_String(&resp->meta, "text/", &iCaseInsensitive) == iInvalidPos) {
-                continue;
-            }
-            iRegExpMatch m;
-            init_RegExpMatch(&m);
-            if (matchRange_RegExp(pattern, range_Block(&resp->body), &m)) {
-                iString entry;
-                init_String(&entry);
-                iRangei cap = m.range;
-                const int prefix = iMin(10, cap.start);
-                cap.start   = cap.start - prefix;
-                cap.end     = iMin(cap.end + 30, (int) size_Block(&resp->body));
-                const size_t maxLen = 60;
-                if (size_Range(&cap) > maxLen) {
-                    cap.end = cap.start + maxLen;
-                }
-                iString content;
-                initRange_String(&content, (iRangecc){ m.subject + cap.start, m.subject + cap.end });
-                /* This needs cleaning up; highlight the matched word. */
-                replace_Block(&content.chars, '\n', ' ');
-                replace_Block(&content.chars, '\r', ' ');
-                if (prefix + size_Range(&m.range) < size_String(&content)) {
-                    insertData_Block(&content.chars, prefix + size_Range(&m.range), uiText_ColorEscape, 2);
-                }
-                insertData_Block(&content.chars, prefix, uiTextStrong_ColorEscape, 2);
-                format_String(
-                    &entry, "match len:%zu str:%s", size_String(&content), cstr_String(&content));
-                deinit_String(&content);
-                appendFormat_String(&entry, " url:%s", cstr_String(&url->url));
-                if (!contains_StringSet(&inserted, &url->url)) {
-                    pushFront_StringArray(urls, &entry);
-                    insert_StringSet(&inserted, &url->url);
-                }
-                deinit_String(&entry);
-            }
-        }
-    }
-    deinit_StringSet(&inserted);
-    unlock_Mutex(d->mtx);
-    return urls;
-}
@@ -57,9 +57,10 @@ iRecentUrl *recentUrl_History           (iHistory *, size_t pos);
 iRecentUrl *mostRecentUrl_History       (iHistory *);
 iRecentUrl *findUrl_History             (iHistory *, const iString *url);
 void        clearCache_History          (iHistory *);
-size_t      pruneLeastImportant_History (iHistory *);
+/* `inUse` is the source of the current document; a response sharing its data is not pruned. */
+size_t      pruneLeastImportant_History (iHistory *, const iBlock *inUse);
+double      leastImportantScore_History (const iHistory *, const iBlock *inUse); /* zero if nothing to prune */
 
-const iStringArray *   searchContents_History   (const iHistory *, const iRegExp *pattern); /* chronologically ascending */
 
 const iString *
             url_History                 (const iHistory *, size_t pos);
@@ -69,7 +70,7 @@ const iRecentUrl *
             constMostRecentUrl_History  (const iHistory *);
 const iGmResponse *
             cachedResponse_History      (const iHistory *);
-size_t      cacheSize_History           (const iHistory *);
+size_t      cacheSize_History           (const iHistory *, const iBlock *inUse);
 
 iString *   debugInfo_History           (const iHistory *);
 
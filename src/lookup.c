@@ -21,6 +21,13 @@ ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include "lookup.h"
+#include "gmutil.h"
+#include "words.h"
+
+#include <the_Foundation/ptrarray.h>
+#include <the_Foundation/sortedarray.h>
+
+#include <string.h>
 
 iDefineTypeConstruction(LookupResult)
 
@@ -48,5 +55,402 @@ iLookupResult *copy_LookupResult(const iLookupResult *d) {
     set_String(&copy->label, &d->label);
     set_String(&copy->url, &d->url);
     set_String(&copy->meta, &d->meta);
+    copy->when = d->when;
     return copy;
 }
+
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareType(LookupToken)
+
+struct Impl_LookupToken {
+    iString  word;
+    uint32_t entryId;
+};
+
+static int cmp_LookupToken_(const void *a, const void *b) {
+    const iLookupToken *x = a, *y = b;
+    const int cmp = cmpString_String(&x->word, &y->word);
+    return cmp ? cmp : iCmp(x->entryId, y->entryId);
+}
+
+static const char *magic_LookupIndex_ = "lgLk";
+
+enum iLookupIndexVersion {
+    initial_LookupIndexVersion = 1,
+    latest_LookupIndexVersion  = 1,
+};
+
+struct Impl_LookupIndex {
+    iArray       entries;    /* LookupEntries; the position is the ID */
+    iSortedArray tokens;     /* LookupTokens */
+    size_t       numRemoved; /* entries marked removed */
+};
+
+iDefineTypeConstruction(LookupIndex)
+
+void init_LookupIndex(iLookupIndex *d) {
+    init_Array(&d->entries, sizeof(iLookupEntry));
+    init_SortedArray(&d->tokens, sizeof(iLookupToken), cmp_LookupToken_);
+    d->numRemoved = 0;
+}
+
+static void deinit_LookupEntry_(iLookupEntry *d) {
+    deinit_LookupResult(&d->result);
+    deinit_String(&d->title);
+    deinit_String(&d->extra);
+}
+
+void deinit_LookupIndex(iLookupIndex *d) {
+    iForEach(Array, i, &d->tokens.values) {
+        deinit_String(&((iLookupToken *) i.value)->word);
+    }
+    deinit_SortedArray(&d->tokens);
+    iForEach(Array, j, &d->entries) {
+        deinit_LookupEntry_(j.value);
+    }
+    deinit_Array(&d->entries);
+}
+
+void add_LookupIndex(iLookupIndex *d, const iLookupResult *result, const iString *title,
+                     const iString *extra) {
+    iLookupEntry entry;
+    init_LookupResult(&entry.result);
+    entry.result.type = result->type;
+    entry.result.icon = result->icon;
+    entry.result.when = result->when;
+    set_String(&entry.result.label, &result->label);
+    set_String(&entry.result.url, &result->url);
+    set_String(&entry.result.meta, &result->meta);
+    /* Not collected: this may be called in a background thread. */
+    if (title) {
+        initCopy_String(&entry.title, title);
+    }
+    else {
+        init_String(&entry.title);
+    }
+    if (extra) {
+        initCopy_String(&entry.extra, extra);
+    }
+    else {
+        init_String(&entry.extra);
+    }
+    entry.host      = iNullRange;
+    entry.path      = iNullRange;
+    entry.isRemoved = iFalse;
+    pushBack_Array(&d->entries, &entry);
+}
+
+static void setUrlParts_LookupEntry_(iLookupEntry *d) {
+    /* The ranges point to the URL string's buffer, which stays put when the entry is moved. */
+    if (!isEmpty_String(&d->result.url)) {
+        iUrl parts;
+        init_Url(&parts, &d->result.url);
+        d->host = parts.host;
+        d->path = parts.path;
+    }
+}
+
+static void addTokens_LookupIndex_(iArray *tokens, uint32_t id, iRangecc text) {
+    iRangecc word = iNullRange;
+    while (nextWord_Words(text, &word)) {
+        iLookupToken tok;
+        init_String(&tok.word);
+        setLowerWord_Words(&tok.word, word);
+        tok.entryId = id;
+        pushBack_Array(tokens, &tok);
+    }
+}
+
+static void mergeTokens_LookupIndex_(iLookupIndex *d, iArray *tokens) {
+    /* The new tokens are moved into the index. Sorting them separately and merging is much
+       faster than inserting each token in order. */
+    if (isEmpty_Array(tokens)) {
+        return;
+    }
+    sort_Array(tokens, cmp_LookupToken_);
+    const iArray *old = &d->tokens.values;
+    iArray merged;
+    init_Array(&merged, sizeof(iLookupToken));
+    reserve_Array(&merged, size_Array(old) + size_Array(tokens));
+    size_t i = 0, j = 0;
+    while (i < size_Array(old) || j < size_Array(tokens)) {
+        const iLookupToken *a = i < size_Array(old) ? constAt_Array(old, i) : NULL;
+        const iLookupToken *b = j < size_Array(tokens) ? constAt_Array(tokens, j) : NULL;
+        if (a && (!b || cmp_LookupToken_(a, b) <= 0)) {
+            pushBack_Array(&merged, a);
+            i++;
+        }
+        else {
+            pushBack_Array(&merged, b);
+            j++;
+        }
+    }
+    clear_Array(&d->tokens.values);
+    pushBackN_Array(&d->tokens.values, constData_Array(&merged), size_Array(&merged));
+    deinit_Array(&merged);
+    clear_Array(tokens);
+}
+
+static void compact_LookupIndex_(iLookupIndex *d) {
+    /* Removed entries are dropped and the rest are renumbered in the same order, so the
+       tokens remain sorted. */
+    iArray remap; /* old ID => new ID */
+    init_Array(&remap, sizeof(uint32_t));
+    uint32_t next = 0;
+    for (size_t i = 0; i < size_Array(&d->entries); i++) {
+        iLookupEntry  *entry = at_Array(&d->entries, i);
+        const uint32_t newId = entry->isRemoved ? UINT32_MAX : next++;
+        if (entry->isRemoved) {
+            deinit_LookupEntry_(entry);
+        }
+        else if (newId != i) {
+            *(iLookupEntry *) at_Array(&d->entries, newId) = *entry;
+        }
+        pushBack_Array(&remap, &newId);
+    }
+    resize_Array(&d->entries, next);
+    size_t numTokens = 0;
+    for (size_t i = 0; i < size_Array(&d->tokens.values); i++) {
+        iLookupToken  *tok   = at_Array(&d->tokens.values, i);
+        const uint32_t newId = *(const uint32_t *) constAt_Array(&remap, tok->entryId);
+        if (newId == UINT32_MAX) {
+            deinit_String(&tok->word);
+            continue;
+        }
+        tok->entryId = newId;
+        *(iLookupToken *) at_Array(&d->tokens.values, numTokens++) = *tok;
+    }
+    resize_Array(&d->tokens.values, numTokens);
+    deinit_Array(&remap);
+    d->numRemoved = 0;
+}
+
+static int cmp_LookupEntry_(const iLookupEntry *a, const iLookupEntry *b) {
+    int cmp = iCmp(a->result.type, b->result.type);
+    if (!cmp) cmp = cmpString_String(&a->result.url, &b->result.url);
+    if (!cmp) cmp = cmpString_String(&a->result.label, &b->result.label);
+    if (!cmp) cmp = cmpString_String(&a->result.meta, &b->result.meta);
+    if (!cmp) cmp = cmpString_String(&a->title, &b->title);
+    if (!cmp) cmp = cmpString_String(&a->extra, &b->extra);
+    if (!cmp) cmp = iCmp(a->result.icon, b->result.icon);
+    if (!cmp) cmp = cmp_Time(&a->result.when, &b->result.when);
+    return cmp;
+}
+
+static int cmp_LookupEntryPtr_(const void *a, const void *b) {
+    return cmp_LookupEntry_(*(const iLookupEntry **) a, *(const iLookupEntry **) b);
+}
+
+iBool update_LookupIndex(iLookupIndex *d, enum iLookupResultType type,
+                         const iLookupIndex *current) {
+    iPtrArray old, fresh, added;
+    init_PtrArray(&old);
+    init_PtrArray(&fresh);
+    init_PtrArray(&added);
+    iForEach(Array, i, &d->entries) {
+        iLookupEntry *entry = i.value;
+        if (!entry->isRemoved && entry->result.type == type) {
+            pushBack_PtrArray(&old, entry);
+        }
+    }
+    iConstForEach(Array, j, &current->entries) {
+        const iLookupEntry *entry = j.value;
+        if (entry->result.type == type) {
+            pushBack_PtrArray(&fresh, entry);
+        }
+    }
+    sort_Array(&old, cmp_LookupEntryPtr_);
+    sort_Array(&fresh, cmp_LookupEntryPtr_);
+    /* Walk both in order: entries only in the old set are removed, and the ones only in the
+       new set are added. */
+    size_t numRemoved = 0;
+    size_t i = 0, j = 0;
+    while (i < size_PtrArray(&old) || j < size_PtrArray(&fresh)) {
+        const int cmp = i == size_PtrArray(&old)     ? 1
+                        : j == size_PtrArray(&fresh) ? -1
+                        : cmp_LookupEntry_(at_PtrArray(&old, i), at_PtrArray(&fresh, j));
+        if (cmp < 0) {
+            ((iLookupEntry *) at_PtrArray(&old, i++))->isRemoved = iTrue;
+            numRemoved++;
+        }
+        else if (cmp > 0) {
+            pushBack_PtrArray(&added, at_PtrArray(&fresh, j++));
+        }
+        else {
+            i++;
+            j++;
+        }
+    }
+    d->numRemoved += numRemoved;
+    iArray tokens;
+    init_Array(&tokens, sizeof(iLookupToken));
+    iConstForEach(PtrArray, k, &added) {
+        const iLookupEntry *src = k.ptr;
+        const uint32_t      id  = size_Array(&d->entries);
+        add_LookupIndex(d, &src->result, &src->title, &src->extra);
+        iLookupEntry *entry = at_Array(&d->entries, id);
+        setUrlParts_LookupEntry_(entry);
+        addTokens_LookupIndex_(&tokens, id, range_String(&entry->title));
+        addTokens_LookupIndex_(&tokens, id, range_String(&entry->extra));
+        addTokens_LookupIndex_(&tokens, id, entry->host);
+        addTokens_LookupIndex_(&tokens, id, entry->path);
+    }
+    mergeTokens_LookupIndex_(d, &tokens);
+    deinit_Array(&tokens);
+    const iBool isChanged = numRemoved > 0 || !isEmpty_PtrArray(&added);
+    deinit_PtrArray(&added);
+    deinit_PtrArray(&fresh);
+    deinit_PtrArray(&old);
+    if (d->numRemoved > size_Array(&d->entries) / 2) {
+        compact_LookupIndex_(d);
+    }
+    return isChanged;
+}
+
+size_t size_LookupIndex(const iLookupIndex *d) {
+    return size_Array(&d->entries);
+}
+
+const iLookupEntry *entry_LookupIndex(const iLookupIndex *d, size_t id) {
+    return constAt_Array(&d->entries, id);
+}
+
+static void matchWord_LookupIndex_(const iLookupIndex *d, const iString *word, iArray *ids_out) {
+    size_t pos = 0;
+    locate_SortedArray(&d->tokens, &(iLookupToken){ .word = *word, .entryId = 0 }, &pos);
+    clear_Array(ids_out);
+    for (; pos < size_SortedArray(&d->tokens); pos++) {
+        const iLookupToken *tok = constAt_Array(&d->tokens.values, pos);
+        if (!startsWith_String(&tok->word, cstr_String(word))) {
+            break;
+        }
+        if (!entry_LookupIndex(d, tok->entryId)->isRemoved) {
+            pushBack_Array(ids_out, &tok->entryId);
+        }
+    }
+    /* The same entry may have many words with the prefix. */
+    sortUniqueIds_Words(ids_out);
+}
+
+void match_LookupIndex(const iLookupIndex *d, const iString *terms, const iArray *within,
+                       iArray *ids_out) {
+    iArray wordIds;
+    init_Array(&wordIds, sizeof(uint32_t));
+    iString word;
+    init_String(&word);
+    iRangecc range   = iNullRange;
+    iBool    isFirst = iTrue;
+    clear_Array(ids_out);
+    while (nextWord_Words(range_String(terms), &range)) {
+        setLowerWord_Words(&word, range);
+        matchWord_LookupIndex_(d, &word, isFirst ? ids_out : &wordIds);
+        if (!isFirst) {
+            intersectIds_Words(ids_out, &wordIds);
+        }
+        else if (within) {
+            intersectIds_Words(ids_out, within);
+        }
+        isFirst = iFalse;
+        if (isEmpty_Array(ids_out)) {
+            break;
+        }
+    }
+    deinit_String(&word);
+    deinit_Array(&wordIds);
+}
+
+void serialize_LookupIndex(const iLookupIndex *d, iStream *outs) {
+    writeData_Stream(outs, magic_LookupIndex_, 4);
+    writeU32_Stream(outs, latest_LookupIndexVersion);
+    /* Removed entries are left out, so the IDs are renumbered like in compaction. */
+    iArray remap;
+    init_Array(&remap, sizeof(uint32_t));
+    uint32_t next = 0;
+    iConstForEach(Array, i, &d->entries) {
+        const uint32_t newId = ((const iLookupEntry *) i.value)->isRemoved ? UINT32_MAX : next++;
+        pushBack_Array(&remap, &newId);
+    }
+    writeU32_Stream(outs, next);
+    iConstForEach(Array, j, &d->entries) {
+        const iLookupEntry *entry = j.value;
+        if (entry->isRemoved) continue;
+        writeU8_Stream(outs, entry->result.type);
+        writeU32_Stream(outs, entry->result.icon);
+        writeU64_Stream(outs, entry->result.when.ts.tv_sec);
+        writeU32_Stream(outs, entry->result.when.ts.tv_nsec);
+        serialize_String(&entry->result.label, outs);
+        serialize_String(&entry->result.url, outs);
+        serialize_String(&entry->result.meta, outs);
+        serialize_String(&entry->title, outs);
+        serialize_String(&entry->extra, outs);
+    }
+    size_t numTokens = 0;
+    iConstForEach(Array, k, &d->tokens.values) {
+        const iLookupToken *tok = k.value;
+        numTokens += (*(const uint32_t *) constAt_Array(&remap, tok->entryId) != UINT32_MAX);
+    }
+    writeU32_Stream(outs, numTokens);
+    iConstForEach(Array, m, &d->tokens.values) {
+        const iLookupToken *tok   = m.value;
+        const uint32_t      newId = *(const uint32_t *) constAt_Array(&remap, tok->entryId);
+        if (newId != UINT32_MAX) {
+            serialize_String(&tok->word, outs);
+            writeU32_Stream(outs, newId);
+        }
+    }
+    deinit_Array(&remap);
+}
+
+iBool deserialize_LookupIndex(iLookupIndex *d, iStream *ins) {
+    deinit_LookupIndex(d);
+    init_LookupIndex(d);
+    char magic[4];
+    readData_Stream(ins, 4, magic);
+    if (memcmp(magic, magic_LookupIndex_, 4) || readU32_Stream(ins) > latest_LookupIndexVersion) {
+        return iFalse;
+    }
+    iLookupResult res;
+    init_LookupResult(&res);
+    iString title, extra;
+    init_String(&title);
+    init_String(&extra);
+    const size_t numEntries = readU32_Stream(ins);
+    for (size_t i = 0; i < numEntries && !atEnd_Stream(ins); i++) {
+        res.type = readU8_Stream(ins);
+        res.icon = readU32_Stream(ins);
+        iZap(res.when);
+        res.when.ts.tv_sec  = readU64_Stream(ins);
+        res.when.ts.tv_nsec = readU32_Stream(ins);
+        deserialize_String(&res.label, ins);
+        deserialize_String(&res.url, ins);
+        deserialize_String(&res.meta, ins);
+        deserialize_String(&title, ins);
+        deserialize_String(&extra, ins);
+        add_LookupIndex(d, &res, &title, &extra);
+        setUrlParts_LookupEntry_(at_Array(&d->entries, i));
+    }
+    deinit_String(&extra);
+    deinit_String(&title);
+    deinit_LookupResult(&res);
+    iBool ok = (size_Array(&d->entries) == numEntries);
+    const size_t numTokens = ok ? readU32_Stream(ins) : 0;
+    /* The tokens were written in sorted order. */
+    for (size_t i = 0; i < numTokens && ok; i++) {
+        if (atEnd_Stream(ins)) {
+            ok = iFalse; /* truncated */
+            break;
+        }
+        iLookupToken tok;
+        init_String(&tok.word);
+        deserialize_String(&tok.word, ins);
+        tok.entryId = readU32_Stream(ins);
+        pushBack_Array(&d->tokens.values, &tok);
+        ok = (tok.entryId < numEntries);
+    }
+    if (!ok) {
+        deinit_LookupIndex(d);
+        init_LookupIndex(d);
+    }
+    return ok;
+}
@@ -22,6 +22,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #pragma once
 
+#include <the_Foundation/array.h>
+#include <the_Foundation/stream.h>
 #include <the_Foundation/string.h>
 #include <the_Foundation/time.h>
 
@@ -49,3 +51,37 @@ struct Impl_LookupResult {
 iDeclareTypeConstruction(LookupResult)
 
 iLookupResult *     copy_LookupResult   (const iLookupResult *);
+
+/*----------------------------------------------------------------------------------------------*/
+
+/* Index of the items that can be looked up and the words that appear in them. The index is
+   kept up to date one result type at a time: update_LookupIndex() compares the entries of
+   the type with a fresh list of them, and only the ones that have changed are replaced.
+   Replaced entries are marked removed until enough of them have accumulated; then the IDs
+   are renumbered. */
+
+iDeclareType(LookupEntry)
+iDeclareType(LookupIndex)
+iDeclareTypeConstruction(LookupIndex)
+
+struct Impl_LookupEntry {
+    iLookupResult result; /* relevance is determined per lookup */
+    iString       title;
+    iString       extra;  /* bookmark tags, identity notes */
+    iRangecc      host;   /* parts of `result.url` */
+    iRangecc      path;
+    iBool         isRemoved;
+};
+
+void                add_LookupIndex     (iLookupIndex *, const iLookupResult *result,
+                                         const iString *title, const iString *extra);
+iBool               update_LookupIndex  (iLookupIndex *, enum iLookupResultType type,
+                                         const iLookupIndex *current); /* true if changed */
+size_t              size_LookupIndex    (const iLookupIndex *);
+const iLookupEntry *entry_LookupIndex   (const iLookupIndex *, size_t id);
+void                match_LookupIndex   (const iLookupIndex *, const iString *terms,
+                                         const iArray *within, /* sorted IDs, or NULL for all */
+                                         iArray *ids_out); /* has words beginning with each term */
+
+void                serialize_LookupIndex   (const iLookupIndex *, iStream *outs);
+iBool               deserialize_LookupIndex (iLookupIndex *, iStream *ins);
@@ -70,7 +70,12 @@ struct Impl_GmImage {
 
 void init_GmImage(iGmImage *d, const iBlock *data) {
     init_GmMediaProps_(&d->props);
-    initCopy_Block(&d->partialData, data);
+    if (data) {
+        initCopy_Block(&d->partialData, data); /* shared until modified */
+    }
+    else {
+        init_Block(&d->partialData, 0);
+    }
     d->size     = zero_I2();
     d->numBytes = 0;
     d->texture  = NULL;
@@ -295,8 +300,10 @@ iBool setData_Media(iMedia *d, iGmLinkId linkId, const iString *mime, const iBlo
         else {
             img = at_PtrArray(&d->images, existing - 1);
             iAssert(equal_String(&img->props.mime, mime)); /* MIME cannot change */
-            set_Block(&img->partialData, data);
+            /* Partial data is not used, and sharing it would make the source copy itself
+               when appended to. */
             if (!isPartial) {
+                set_Block(&img->partialData, data);
                 makeTexture_GmImage(img);
             }
         }
@@ -310,6 +317,8 @@ iBool setData_Media(iMedia *d, iGmLinkId linkId, const iString *mime, const iBlo
         else {
             audio = at_PtrArray(&d->audio, existing - 1);
             iAssert(equal_String(&audio->props.mime, mime)); /* MIME cannot change */
+            /* Audio is streamed: `data` only contains what was received after the previous
+               update. */
             updateSourceData_Player(audio->player, mime, data, append_PlayerUpdate);
             if (!isStarted_Player(audio->player)) {
                 /* Maybe the previous updates didn't have enough data. */
@@ -343,7 +352,7 @@ iBool setData_Media(iMedia *d, iGmLinkId linkId, const iString *mime, const iBlo
     else if (!isDeleting) {
         if (startsWith_String(mime, "image/")) {
             /* Copy the image to a texture. */
-            iGmImage *img = new_GmImage(data);
+            iGmImage *img = new_GmImage(isPartial ? NULL : data);
             img->props.linkId = linkId; /* TODO: use a hash? */
             img->props.isPermanent = !allowHide;
             set_String(&img->props.mime, mime);
@@ -372,6 +381,20 @@ iBool setData_Media(iMedia *d, iGmLinkId linkId, const iString *mime, const iBlo
     return isNew;
 }
 
+size_t memorySize_Media(const iMedia *d) {
+    size_t size = 0;
+    iConstForEach(PtrArray, i, &d->images) {
+        const iGmImage *img = i.ptr;
+        size += size_Block(&img->partialData);
+        if (img->texture) {
+            int w = 0, h = 0;
+            SDL_QueryTexture(img->texture, NULL, NULL, &w, &h);
+            size += (size_t) w * h * 4;
+        }
+    }
+    return size;
+}
+
 iMediaId findLinkImage_Media(const iMedia *d, iGmLinkId linkId) {
     /* TODO: use a hash */
     iConstForEach(PtrArray, i, &d->images) {
@@ -504,9 +527,10 @@ static void finished_MediaRequest_(iAnyObject *obj) {
 
 void init_MediaRequest(iMediaRequest *d, iDocumentWidget *doc, unsigned int linkId,
                        const iString *url, iBool enableFilters) {
-    d->doc    = doc;
-    d->linkId = linkId;
-    d->req    = new_GmRequest(certs_App());
+    d->doc          = doc;
+    d->linkId       = linkId;
+    d->req          = new_GmRequest(certs_App());
+    d->streamedSize = 0;
     setUrl_GmRequest(d->req, url);
     enableFilters_GmRequest(d->req, enableFilters);
     iConnect(GmRequest, d->req, updated, d, updated_MediaRequest_);
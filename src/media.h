@@ -49,6 +49,7 @@ enum iMediaFlags {
 void    clear_Media             (iMedia *);
 iBool   setDownloadUrl_Media    (iMedia *, uint16_t linkId, const iString *url);
 iBool   setData_Media           (iMedia *, uint16_t linkId, const iString *mime, const iBlock *data, int flags);
+size_t  memorySize_Media        (const iMedia *); /* approximate, in bytes */
 
 iMediaId        findLinkImage_Media (const iMedia *, uint16_t linkId);
 iBool           imageInfo_Media     (const iMedia *, iMediaId imageId, iGmMediaInfo *info_out);
@@ -77,6 +78,7 @@ struct Impl_MediaRequest {
     iDocumentWidget *doc;
     unsigned int     linkId;
     iGmRequest *     req;
+    size_t           streamedSize; /* audio already passed to the player and dropped */
 };
 
 iDeclareObjectConstructionArgs(MediaRequest, iDocumentWidget *doc, unsigned int linkId,
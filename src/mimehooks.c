@@ -1,12 +1,16 @@
 #include "mimehooks.h"
+#include "feedparser.h"
 #include "app.h"
 
+#include <the_Foundation/condition.h>
 #include <the_Foundation/file.h>
 #include <the_Foundation/fileinfo.h>
+#include <the_Foundation/mutex.h>
 #include <the_Foundation/path.h>
 #include <the_Foundation/process.h>
 #include <the_Foundation/stringlist.h>
-#include <the_Foundation/xml.h>
+#include <the_Foundation/thread.h>
+#include <the_Foundation/time.h>
 
 iDefineTypeConstruction(FilterHook)
 
@@ -34,8 +38,8 @@ void setCommand_FilterHook(iFilterHook *d, const iString *command) {
     set_String(&d->command, command);
 }
 
-iBlock *run_FilterHook_(const iFilterHook *d, const iString *mime, const iBlock *body,
-                        const iString *requestUrl) {
+static iProcess *start_FilterHook_(const iFilterHook *d, const iString *mime,
+                                   const iString *requestUrl) {
     iProcess *   proc = new_Process();
     iStringList *args = new_StringList();
     iRangecc     seg  = iNullRange;
@@ -54,18 +58,146 @@ iBlock *run_FilterHook_(const iFilterHook *d, const iString *mime, const iBlock
             iClob(newStrings_StringList(
                 collectNewFormat_String("REQUEST_URL=%s", cstr_String(requestUrl)), NULL)));
     }
-    iBlock *output = NULL;
-    if (start_Process(proc)) {
-        writeInput_Process(proc, body);
-        output = readOutputUntilClosed_Process(proc);
-        if (!startsWith_Rangecc(range_Block(output), "20")) {
-            /* Didn't produce valid output. */
+    if (!start_Process(proc)) {
+        iRelease(proc);
+        return NULL;
+    }
+    return proc;
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+/* Hook process that is fed by a thread of its own. Writing to the process blocks until it has
+   read its input, and reading all of its output blocks until it exits, so other threads only
+   exchange data with the pipe thread and never wait on the process while holding locks. */
+
+iDeclareType(FilterPipe)
+
+static const size_t chunkSize_FilterPipe_ = 4096; /* bytes written between output reads */
+static const double timeout_FilterPipe_   = 30.0; /* seconds to wait for the hook to exit */
+
+struct Impl_FilterPipe {
+    iMutex *   mtx;
+    iCondition changed;
+    iProcess * proc;
+    iThread *  thread;
+    iBlock     input;  /* not yet written to the process */
+    iBlock     output; /* received from the process but not taken yet */
+    iBool      isInputEnded;
+    iBool      isFinished; /* process has exited */
+};
+
+static iThreadResult run_FilterPipe_(iThread *thread) {
+    iFilterPipe *d     = userData_Thread(thread);
+    iBlock *     chunk = new_Block(0);
+    lock_Mutex(d->mtx);
+    for (;;) {
+        while (size_Block(&d->input) == 0 && !d->isInputEnded) {
+            wait_Condition(&d->changed, d->mtx);
+        }
+        if (size_Block(&d->input) == 0) {
+            break; /* all input written */
+        }
+        /* The output is drained between small writes so the process doesn't stall on a full
+           output pipe while we are waiting for it to read more input. */
+        const size_t n = iMin(size_Block(&d->input), chunkSize_FilterPipe_);
+        setData_Block(chunk, constData_Block(&d->input), n);
+        remove_Block(&d->input, 0, n);
+        unlock_Mutex(d->mtx);
+        writeInput_Process(d->proc, chunk);
+        iBlock *output = readOutput_Process(d->proc);
+        lock_Mutex(d->mtx);
+        if (output) {
+            append_Block(&d->output, output);
             delete_Block(output);
-            output = NULL;
         }
     }
-    iRelease(proc);
-    return output;
+    unlock_Mutex(d->mtx);
+    iBlock *output = readOutputUntilClosed_Process(d->proc); /* closes the input */
+    lock_Mutex(d->mtx);
+    append_Block(&d->output, output);
+    d->isFinished = iTrue;
+    signal_Condition(&d->changed);
+    unlock_Mutex(d->mtx);
+    delete_Block(output);
+    delete_Block(chunk);
+    return 0;
+}
+
+static iFilterPipe *new_FilterPipe_(iProcess *proc) {
+    iFilterPipe *d = iMalloc(FilterPipe);
+    d->mtx = new_Mutex();
+    init_Condition(&d->changed);
+    d->proc = proc; /* takes ownership */
+    init_Block(&d->input, 0);
+    init_Block(&d->output, 0);
+    d->isInputEnded = iFalse;
+    d->isFinished   = iFalse;
+    d->thread       = new_Thread(run_FilterPipe_);
+    setUserData_Thread(d->thread, d);
+    start_Thread(d->thread);
+    return d;
+}
+
+static void delete_FilterPipe_(iFilterPipe *d) {
+    iAssert(d->isFinished);
+    join_Thread(d->thread);
+    iRelease(d->thread);
+    iRelease(d->proc);
+    deinit_Block(&d->output);
+    deinit_Block(&d->input);
+    deinit_Condition(&d->changed);
+    delete_Mutex(d->mtx);
+    free(d);
+}
+
+static void write_FilterPipe_(iFilterPipe *d, const iBlock *data) {
+    iGuardMutex(d->mtx, {
+        append_Block(&d->input, data);
+        signal_Condition(&d->changed);
+    });
+}
+
+static void endInput_FilterPipe_(iFilterPipe *d) {
+    iGuardMutex(d->mtx, {
+        d->isInputEnded = iTrue;
+        signal_Condition(&d->changed);
+    });
+}
+
+static void takeOutput_FilterPipe_(iFilterPipe *d, iBlock *output_out) {
+    iGuardMutex(d->mtx, {
+        append_Block(output_out, &d->output);
+        clear_Block(&d->output);
+    });
+}
+
+static iBool isFinished_FilterPipe_(iFilterPipe *d) {
+    iBool isFinished;
+    iGuardMutex(d->mtx, isFinished = d->isFinished);
+    return isFinished;
+}
+
+static iBool finish_FilterPipe_(iFilterPipe *d, iBlock *output_out) {
+    /* Returns iFalse if the process didn't exit in time. */
+    iTime until;
+    initTimeout_Time(&until, timeout_FilterPipe_);
+    lock_Mutex(d->mtx);
+    d->isInputEnded = iTrue;
+    signal_Condition(&d->changed);
+    while (!d->isFinished) {
+        iTime now;
+        initCurrent_Time(&now);
+        if (cmp_Time(&now, &until) >= 0) {
+            break;
+        }
+        waitTimeout_Condition(&d->changed, d->mtx, &until);
+    }
+    const iBool isFinished = d->isFinished;
+    append_Block(output_out, &d->output);
+    clear_Block(&d->output);
+    unlock_Mutex(d->mtx);
+    return isFinished;
 }
 
 /*----------------------------------------------------------------------------------------------*/
@@ -73,107 +205,77 @@ iBlock *run_FilterHook_(const iFilterHook *d, const iString *mime, const iBlock
 static iRegExp *xmlMimePattern_(void) {
     static iRegExp *xmlMime_;
     if (!xmlMime_) {
-        xmlMime_ = new_RegExp("(application|text)/(atom\\+)?xml", caseInsensitive_RegExpOption);
+        xmlMime_ = new_RegExp("(application|text)/((atom|rss)\\+)?xml", caseInsensitive_RegExpOption);
     }
     return xmlMime_;
 }
 
-static iBlock *translateAtomXmlToGeminiFeed_(const iString *mime, const iBlock *source,
-                                             const iString *requestUrl) {
-    iUnused(requestUrl); /* TODO: Use for what? */
+static iBool isXmlFeedMime_(const iString *mime) {
     iRegExpMatch m;
     init_RegExpMatch(&m);
-    if (!matchString_RegExp(xmlMimePattern_(), mime, &m)) {
-        return NULL;
-    }
-    iBlock *      output = NULL;
-    iXmlDocument *doc    = new_XmlDocument();
-    iString       src;
-    initBlock_String(&src, source); /* assume it's UTF-8 */
-    if (!parse_XmlDocument(doc, &src)) {
-        goto finished;
-    }
-    const iXmlElement *feed = &doc->root;
-    if (!equal_Rangecc(feed->name, "feed")) {
-        goto finished;
-    }
-    if (!equal_Rangecc(attribute_XmlElement(feed, "xmlns"), "http://www.w3.org/2005/Atom")) {
-        goto finished;
-    }
-    iString *title = collect_String(decodedContent_XmlElement(child_XmlElement(feed, "title")));
-    if (isEmpty_String(title)) {
-        goto finished;
+    return matchString_RegExp(xmlMimePattern_(), mime, &m);
+}
+
+static iBool appendGeminiFeed_(iFeedParser *feed, iBool isFinal, iBool *isHeaderWritten,
+                               iBlock *output) {
+    /* Returns iFalse if the data is not a feed. */
+    const enum iFeedFormat format = format_FeedParser(feed);
+    if (format == invalid_FeedFormat) {
+        return iFalse;
     }
-    iString *subtitle = collect_String(decodedContent_XmlElement(child_XmlElement(feed, "subtitle")));
     iString out;
     init_String(&out);
-    format_String(&out,
-                  "20 text/gemini\r\n"
-                  "# %s\n\n", cstr_String(title));
-    if (!isEmpty_String(subtitle)) {
-        appendFormat_String(&out, "## %s\n\n", cstr_String(subtitle));
-    }
-    appendCStr_String(&out,
-                      "This Atom XML document has been automatically translated to a Gemini feed "
-                      "to allow subscribing to it.\n\n");
-    iRegExp *datePattern =
-        iClob(new_RegExp("^([0-9][0-9][0-9][0-9]-[0-1][0-9]-[0-3][0-9])T.*", caseSensitive_RegExpOption));
-    iBeginCollect();
-    iConstForEach(PtrArray, i, &feed->children) {
-        iEndCollect();
-        iBeginCollect();
-        const iXmlElement *entry = i.ptr;
-        if (!equal_Rangecc(entry->name, "entry")) {
-            continue;
+    if (!*isHeaderWritten) {
+        /* The feed title precedes the entries. */
+        if (!hasItems_FeedParser(feed) && !isFinal) {
+            deinit_String(&out);
+            return iTrue;
         }
-        title = collect_String(decodedContent_XmlElement(child_XmlElement(entry, "title")));
-        if (isEmpty_String(title)) {
-            continue;
+        if (isEmpty_String(title_FeedParser(feed))) {
+            deinit_String(&out);
+            return iFalse;
         }
-        const iString *published =
-            collect_String(decodedContent_XmlElement(child_XmlElement(entry, "published")));
-        const iString *updated =
-            collect_String(decodedContent_XmlElement(child_XmlElement(entry, "updated")));
-        iRegExpMatch m;
-        init_RegExpMatch(&m);
-        if (!matchString_RegExp(datePattern, updated, &m)) {
-            init_RegExpMatch(&m);
-            if (!matchString_RegExp(datePattern, published, &m)) {
-                continue;
-            }
+        format_String(&out,
+                      "20 text/gemini\r\n"
+                      "# %s\n\n", cstr_String(title_FeedParser(feed)));
+        if (!isEmpty_String(subtitle_FeedParser(feed))) {
+            appendFormat_String(&out, "## %s\n\n", cstr_String(subtitle_FeedParser(feed)));
         }
-        iRangecc url = iNullRange;
-        iConstForEach(PtrArray, j, &entry->children) {
-            const iXmlElement *link = j.ptr;
-            if (!equal_Rangecc(link->name, "link")) {
-                continue;
-            }
-            const iRangecc href = attribute_XmlElement(link, "href");
-            const iRangecc rel  = attribute_XmlElement(link, "rel");
-            const iRangecc type = attribute_XmlElement(link, "type");
-            if (startsWithCase_Rangecc(href, "gemini:")) {
-                url = href;
-                /* We're happy with the first gemini URL. */
-                /* TODO: Are we? */
-                break;
-            }
-            url = href;
-            iUnused(rel, type);
-        }
-        if (isEmpty_Range(&url)) {
-            continue;
-        }
-        appendFormat_String(&out, "=> %s %s - %s\n",
-                            cstr_Rangecc(url),
-                            cstr_Rangecc(capturedRange_RegExpMatch(&m, 1)),
-                            cstr_String(title));
+        appendFormat_String(&out,
+                            "This %s document has been automatically translated to a Gemini feed "
+                            "to allow subscribing to it.\n\n",
+                            format == atom_FeedFormat ? "Atom XML" : "RSS");
+        *isHeaderWritten = iTrue;
     }
-    iEndCollect();
-    output = copy_Block(utf8_String(&out));
+    iFeedItem *item;
+    while ((item = takeItem_FeedParser(feed)) != NULL) {
+        appendFormat_String(&out, "=> %s %04d-%02d-%02d - %s\n",
+                            cstr_String(&item->url),
+                            item->date.year,
+                            item->date.month,
+                            item->date.day,
+                            cstr_String(&item->title));
+        delete_FeedItem(item);
+    }
+    append_Block(output, utf8_String(&out));
     deinit_String(&out);
-finished:
-    delete_XmlDocument(doc);
-    deinit_String(&src);
+    return iTrue;
+}
+
+static iBlock *translateXmlFeedToGeminiFeed_(const iString *mime, const iBlock *source) {
+    if (!isXmlFeedMime_(mime)) {
+        return NULL;
+    }
+    iBlock *     output          = new_Block(0);
+    iBool        isHeaderWritten = iFalse;
+    iFeedParser *feed            = new_FeedParser();
+    write_FeedParser(feed, source);
+    finish_FeedParser(feed);
+    if (!appendGeminiFeed_(feed, iTrue, &isHeaderWritten, output)) {
+        delete_Block(output);
+        output = NULL;
+    }
+    delete_FeedParser(feed);
     return output;
 }
 
@@ -181,22 +283,67 @@ finished:
 
 struct Impl_MimeHooks {
     iPtrArray filters;
+    iMutex *  mtx;
+    iPtrArray orphanPipes; /* FilterPipes whose process is still running */
 };
 
 iDefineTypeConstruction(MimeHooks)
 
 void init_MimeHooks(iMimeHooks *d) {
     init_PtrArray(&d->filters);
+    d->mtx = new_Mutex();
+    init_PtrArray(&d->orphanPipes);
+}
+
+static void disposePipe_MimeHooks_(const iMimeHooks *d, iFilterPipe *pipe) {
+    /* A pipe is deleted only after its process has exited. Until then, the pipe is kept
+       aside, and checked again when the next pipe is disposed of. */
+    iMimeHooks *hooks = iConstCast(iMimeHooks *, d);
+    lock_Mutex(hooks->mtx);
+    if (pipe) {
+        endInput_FilterPipe_(pipe);
+        pushBack_PtrArray(&hooks->orphanPipes, pipe);
+    }
+    iForEach(PtrArray, i, &hooks->orphanPipes) {
+        if (isFinished_FilterPipe_(i.ptr)) {
+            delete_FilterPipe_(i.ptr);
+            remove_PtrArrayIterator(&i);
+        }
+    }
+    unlock_Mutex(hooks->mtx);
 }
 
 void deinit_MimeHooks(iMimeHooks *d) {
+    /* Hooks that never exit are left running; the pipes are not deleted under them. */
+    disposePipe_MimeHooks_(d, NULL);
+    deinit_PtrArray(&d->orphanPipes);
+    delete_Mutex(d->mtx);
     iForEach(PtrArray, i, &d->filters) {
         delete_FilterHook(i.ptr);
     }
     deinit_PtrArray(&d->filters);
 }
 
-iBool willTryFilter_MimeHooks(const iMimeHooks *d, const iString *mime) {
+static iBlock *run_FilterHook_(const iMimeHooks *hooks, const iFilterHook *d,
+                               const iString *mime, const iBlock *body,
+                               const iString *requestUrl) {
+    iProcess *proc   = start_FilterHook_(d, mime, requestUrl);
+    iBlock *  output = NULL;
+    if (proc) {
+        iFilterPipe *pipe = new_FilterPipe_(proc);
+        write_FilterPipe_(pipe, body);
+        output = new_Block(0);
+        if (!finish_FilterPipe_(pipe, output) || !startsWith_Rangecc(range_Block(output), "20")) {
+            /* Didn't produce valid output in time. */
+            delete_Block(output);
+            output = NULL;
+        }
+        disposePipe_MimeHooks_(hooks, pipe);
+    }
+    return output;
+}
+
+iBool willTryFilter_MimeHooks(const iMimeHooks *d, const iString *mime, iBool allowBuiltin) {
     /* TODO: Combine this function with tryFilter_MimeHooks! */
     iRegExpMatch m;
     iConstForEach(PtrArray, i, &d->filters) {
@@ -207,30 +354,26 @@ iBool willTryFilter_MimeHooks(const iMimeHooks *d, const iString *mime) {
         }
     }
     /* Built-in filters. */
-    init_RegExpMatch(&m);
-    if (matchString_RegExp(xmlMimePattern_(), mime, &m)) {
-        return iTrue;
-    }
-    return iFalse;
+    return allowBuiltin && isXmlFeedMime_(mime);
 }
 
-iBlock *tryFilter_MimeHooks(const iMimeHooks *d, const iString *mime, const iBlock *body,
-                            const iString *requestUrl) {
+static iBlock *tryFilters_MimeHooks_(const iMimeHooks *d, size_t firstHook, iBool allowBuiltin,
+                                     const iString *mime, const iBlock *body,
+                                     const iString *requestUrl) {
     iRegExpMatch m;
-    iConstForEach(PtrArray, i, &d->filters) {
-        const iFilterHook *xc = i.ptr;
+    for (size_t i = firstHook; i < size_PtrArray(&d->filters); i++) {
+        const iFilterHook *xc = constAt_PtrArray(&d->filters, i);
         init_RegExpMatch(&m);
         if (matchString_RegExp(xc->mimeRegex, mime, &m)) {
-            iBlock *result = run_FilterHook_(xc, mime, body, requestUrl);
+            iBlock *result = run_FilterHook_(d, xc, mime, body, requestUrl);
             if (result) {
                 return result;
             }
         }
     }
     /* Built-in filters. */
-    init_RegExpMatch(&m);
-    if (matchString_RegExp(xmlMimePattern_(), mime, &m)) {
-        iBlock *result = translateAtomXmlToGeminiFeed_(mime, body, requestUrl);
+    if (allowBuiltin) {
+        iBlock *result = translateXmlFeedToGeminiFeed_(mime, body);
         if (result) {
             return result;
         }
@@ -238,6 +381,154 @@ iBlock *tryFilter_MimeHooks(const iMimeHooks *d, const iString *mime, const iBlo
     return NULL;
 }
 
+iBlock *tryFilter_MimeHooks(const iMimeHooks *d, const iString *mime, const iBlock *body,
+                            const iString *requestUrl, iBool allowBuiltin) {
+    return tryFilters_MimeHooks_(d, 0, allowBuiltin, mime, body, requestUrl);
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+struct Impl_MimeFilter {
+    const iMimeHooks *hooks;
+    size_t            hookIndex; /* the hook that is running */
+    iBool             allowBuiltin;
+    iString           mime;
+    iString           requestUrl;
+    iFilterPipe *     pipe;
+    iFeedParser *     feed;      /* built-in translation instead of a hook */
+    iBool             isValid;  /* output begins with a success header */
+    iBool             isFailed;
+    iBool             isTimedOut;
+    iBlock            pending;  /* output held back until it is known to be valid */
+};
+
+static iMimeFilter *new_MimeFilter_(const iMimeHooks *hooks, size_t hookIndex,
+                                    iBool allowBuiltin, const iString *mime,
+                                    const iString *requestUrl) {
+    iMimeFilter *d = iMalloc(MimeFilter);
+    d->hooks        = hooks;
+    d->hookIndex    = hookIndex;
+    d->allowBuiltin = allowBuiltin;
+    initCopy_String(&d->mime, mime);
+    initCopy_String(&d->requestUrl, requestUrl);
+    d->pipe         = NULL;
+    d->feed         = NULL;
+    d->isValid      = iFalse;
+    d->isFailed     = iFalse;
+    d->isTimedOut   = iFalse;
+    init_Block(&d->pending, 0);
+    return d;
+}
+
+iMimeFilter *newFilter_MimeHooks(const iMimeHooks *d, const iString *mime,
+                                 const iString *requestUrl, iBool allowBuiltin) {
+    iRegExpMatch m;
+    for (size_t i = 0; i < size_PtrArray(&d->filters); i++) {
+        const iFilterHook *xc = constAt_PtrArray(&d->filters, i);
+        init_RegExpMatch(&m);
+        if (matchString_RegExp(xc->mimeRegex, mime, &m)) {
+            iProcess *proc = start_FilterHook_(xc, mime, requestUrl);
+            if (!proc) {
+                continue;
+            }
+            iMimeFilter *filter = new_MimeFilter_(d, i, allowBuiltin, mime, requestUrl);
+            filter->pipe = new_FilterPipe_(proc);
+            return filter;
+        }
+    }
+    /* Built-in filters. */
+    if (allowBuiltin && isXmlFeedMime_(mime)) {
+        iMimeFilter *filter =
+            new_MimeFilter_(d, size_PtrArray(&d->filters), allowBuiltin, mime, requestUrl);
+        filter->feed = new_FeedParser();
+        return filter;
+    }
+    return NULL;
+}
+
+void delete_MimeFilter(iMimeFilter *d) {
+    if (d) {
+        if (d->pipe) {
+            disposePipe_MimeHooks_(d->hooks, d->pipe);
+        }
+        if (d->feed) {
+            delete_FeedParser(d->feed);
+        }
+        deinit_Block(&d->pending);
+        deinit_String(&d->requestUrl);
+        deinit_String(&d->mime);
+        free(d);
+    }
+}
+
+static void takeOutput_MimeFilter_(iMimeFilter *d, const iBlock *output, iBlock *output_out) {
+    if (d->isValid) {
+        append_Block(output_out, output);
+        return;
+    }
+    append_Block(&d->pending, output);
+    if (size_Block(&d->pending) >= 2) {
+        if (startsWith_Rangecc(range_Block(&d->pending), "20")) {
+            d->isValid = iTrue;
+            append_Block(output_out, &d->pending);
+            clear_Block(&d->pending);
+        }
+        else {
+            /* Didn't produce valid output. */
+            d->isFailed = iTrue;
+        }
+    }
+}
+
+iBool write_MimeFilter(iMimeFilter *d, const iBlock *data, iBlock *output_out) {
+    if (d->isFailed) {
+        return iFalse;
+    }
+    if (d->feed) {
+        write_FeedParser(d->feed, data);
+        d->isFailed = !appendGeminiFeed_(d->feed, iFalse, &d->isValid, output_out);
+        return !d->isFailed;
+    }
+    /* The pipe thread writes the data to the hook. Whatever it has received so far is taken
+       without waiting for more. */
+    write_FilterPipe_(d->pipe, data);
+    iBlock *output = new_Block(0);
+    takeOutput_FilterPipe_(d->pipe, output);
+    takeOutput_MimeFilter_(d, output, output_out);
+    delete_Block(output);
+    return !d->isFailed;
+}
+
+iBool finish_MimeFilter(iMimeFilter *d, iBlock *output_out) {
+    if (!d->isFailed && d->feed) {
+        finish_FeedParser(d->feed);
+        d->isFailed = !appendGeminiFeed_(d->feed, iTrue, &d->isValid, output_out);
+    }
+    else if (!d->isFailed) {
+        iBlock *output = new_Block(0);
+        if (finish_FilterPipe_(d->pipe, output)) {
+            takeOutput_MimeFilter_(d, output, output_out);
+        }
+        else {
+            d->isTimedOut = iTrue;
+            d->isFailed   = iTrue;
+        }
+        delete_Block(output);
+    }
+    return d->isValid && !d->isFailed;
+}
+
+iBlock *fallback_MimeFilter(const iMimeFilter *d, const iBlock *body) {
+    if (d->feed) {
+        return NULL; /* nothing left to try */
+    }
+    if (d->isTimedOut) {
+        return NULL; /* the unfiltered response is used without waiting any longer */
+    }
+    return tryFilters_MimeHooks_(
+        d->hooks, d->hookIndex + 1, d->allowBuiltin, &d->mime, body, &d->requestUrl);
+}
+
 static const char *mimeHooksFilename_MimeHooks_ = "mimehooks.txt";
 
 void load_MimeHooks(iMimeHooks *d, const char *saveDir) {
@@ -23,11 +23,27 @@ void    setCommand_FilterHook       (iFilterHook *, const iString *command);
 iDeclareType(MimeHooks)
 iDeclareTypeConstruction(MimeHooks)
 
-iBool       willTryFilter_MimeHooks (const iMimeHooks *, const iString *mime);
+iBool       willTryFilter_MimeHooks (const iMimeHooks *, const iString *mime, iBool allowBuiltin);
 iBlock *    tryFilter_MimeHooks     (const iMimeHooks *, const iString *mime,
-                                     const iBlock *body, const iString *requestUrl);
+                                     const iBlock *body, const iString *requestUrl,
+                                     iBool allowBuiltin);
 
 void        load_MimeHooks          (iMimeHooks *, const char *saveDir);
 void        save_MimeHooks          (const iMimeHooks *);
 
 const iString *debugInfo_MimeHooks  (const iMimeHooks *);
+
+/*----------------------------------------------------------------------------------------------*/
+
+/* Filter hook or built-in translation that is given the response body while it is still
+   being received. */
+iDeclareType(MimeFilter)
+
+iMimeFilter *   newFilter_MimeHooks (const iMimeHooks *, const iString *mime,
+                                     const iString *requestUrl,
+                                     iBool allowBuiltin); /* NULL if no filter applies */
+void            delete_MimeFilter   (iMimeFilter *);
+
+iBool   write_MimeFilter    (iMimeFilter *, const iBlock *data, iBlock *output_out);
+iBool   finish_MimeFilter   (iMimeFilter *, iBlock *output_out); /* iFalse if output was invalid */
+iBlock *fallback_MimeFilter (const iMimeFilter *, const iBlock *body); /* remaining filters */
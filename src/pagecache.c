@@ -0,0 +1,358 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include "pagecache.h"
+#include "app.h"
+#include "defs.h"
+#include "gmcerts.h"
+#include "gmutil.h"
+#include "persist.h"
+
+#include <the_Foundation/file.h>
+#include <the_Foundation/fileinfo.h>
+#include <the_Foundation/mutex.h>
+#include <the_Foundation/path.h>
+#include <the_Foundation/sortedarray.h>
+#include <the_Foundation/stringset.h>
+#include <math.h>
+#include <stdio.h>
+
+static const char * cacheDirName_PageCache_   = "cache";
+static const char * indexFileName_PageCache_  = "index.txt";
+static const char * magic_PageCache_          = "lgPC";
+static const size_t maxSize_PageCache_        = 100 * 1000000; /* bytes */
+
+iDeclareType(PageCacheEntry)
+
+struct Impl_PageCacheEntry {
+    iString  url; /* normalized */
+    uint32_t crc; /* of the URL; names the file */
+    size_t   size;
+    iTime    used;
+};
+
+static void init_PageCacheEntry(iPageCacheEntry *d, const iString *url) {
+    /* Scheme and host are case-insensitive. */
+    const iString *stripped = urlFragmentStripped_String(url);
+    iUrl parts;
+    init_Url(&parts, stripped);
+    if (isEmpty_Range(&parts.scheme) || isEmpty_Range(&parts.host)) {
+        initCopy_String(&d->url, stripped);
+    }
+    else {
+        iString *scheme = newRange_String(parts.scheme);
+        iString *host   = newRange_String(parts.host);
+        init_String(&d->url);
+        append_String(&d->url, collect_String(lower_String(scheme)));
+        appendRange_String(&d->url, (iRangecc){ parts.scheme.end, parts.host.start });
+        append_String(&d->url, collect_String(lower_String(host)));
+        appendRange_String(&d->url, (iRangecc){ parts.host.end, constEnd_String(stripped) });
+        delete_String(host);
+        delete_String(scheme);
+    }
+    d->crc  = crc32_Block(&d->url.chars);
+    d->size = 0;
+    initCurrent_Time(&d->used);
+}
+
+static void deinit_PageCacheEntry(iPageCacheEntry *d) {
+    deinit_String(&d->url);
+}
+
+static int cmpUrl_PageCacheEntry_(const void *a, const void *b) {
+    return cmpString_String(&((const iPageCacheEntry *) a)->url,
+                            &((const iPageCacheEntry *) b)->url);
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+struct Impl_PageCache {
+    iMutex *     mtx;
+    iString      dir;
+    iSortedArray entries;
+    size_t       totalSize;
+};
+
+iDefineTypeConstruction(PageCache)
+
+void init_PageCache(iPageCache *d) {
+    d->mtx = new_Mutex();
+    init_String(&d->dir);
+    init_SortedArray(&d->entries, sizeof(iPageCacheEntry), cmpUrl_PageCacheEntry_);
+    d->totalSize = 0;
+}
+
+void deinit_PageCache(iPageCache *d) {
+    iGuardMutex(d->mtx, {
+        iForEach(Array, i, &d->entries.values) {
+            deinit_PageCacheEntry(i.value);
+        }
+        deinit_SortedArray(&d->entries);
+    });
+    deinit_String(&d->dir);
+    delete_Mutex(d->mtx);
+}
+
+static const char *entryFileName_(uint32_t crc) {
+    return format_CStr("%08x.page", crc);
+}
+
+static const char *entryPath_PageCache_(const iPageCache *d, uint32_t crc) {
+    return cstr_String(collect_String(concatCStr_Path(&d->dir, entryFileName_(crc))));
+}
+
+static void removeEntry_PageCache_(iPageCache *d, size_t pos, iBool removeFile) {
+    iPageCacheEntry *entry = at_SortedArray(&d->entries, pos);
+    if (removeFile) {
+        remove(entryPath_PageCache_(d, entry->crc));
+    }
+    d->totalSize -= entry->size;
+    deinit_PageCacheEntry(entry);
+    remove_Array(&d->entries.values, pos);
+}
+
+static void evict_PageCache_(iPageCache *d) {
+    /* Same scoring as the in-memory cache of History: large and old entries go first. */
+    iTime now;
+    initCurrent_Time(&now);
+    while (d->totalSize > maxSize_PageCache_ && size_SortedArray(&d->entries) > 0) {
+        size_t chosen = iInvalidPos;
+        size_t oldest = 0;
+        double score  = 0.0;
+        iConstForEach(Array, i, &d->entries.values) {
+            const iPageCacheEntry *entry = i.value;
+            const double entryScore =
+                entry->size * pow(secondsSince_Time(&now, &entry->used) / 60.0, 1.25);
+            if (entryScore > score) {
+                chosen = index_ArrayConstIterator(&i);
+                score  = entryScore;
+            }
+            if (cmp_Time(&entry->used, &((const iPageCacheEntry *) at_SortedArray(
+                                             &d->entries, oldest))->used) < 0) {
+                oldest = index_ArrayConstIterator(&i);
+            }
+        }
+        /* Everything was used just now, so the scores are all zero. */
+        removeEntry_PageCache_(d, chosen != iInvalidPos ? chosen : oldest, iTrue);
+    }
+}
+
+void load_PageCache(iPageCache *d, const char *dirPath) {
+    lock_Mutex(d->mtx);
+    setCStr_String(&d->dir, concatPath_CStr(dirPath, cacheDirName_PageCache_));
+    if (!fileExists_FileInfo(&d->dir)) {
+        makeDirs_Path(&d->dir);
+    }
+    iStringSet fileNames;
+    init_StringSet(&fileNames);
+    iFile *f = new_File(collect_String(concatCStr_Path(&d->dir, indexFileName_PageCache_)));
+    if (open_File(f, readOnly_FileMode | text_FileMode)) {
+        const iRangecc src  = range_Block(collect_Block(readAll_File(f)));
+        iRangecc       line = iNullRange;
+        while (nextSplit_Rangecc(src, "\n", &line)) {
+            char *endp = NULL;
+            const unsigned long long ts = strtoull(line.start, &endp, 10);
+            if (ts == 0) continue;
+            const size_t size = strtoull(skipSpace_CStr(endp), &endp, 10);
+            const char *urlStart = skipSpace_CStr(endp);
+            if (urlStart >= line.end) continue;
+            iPageCacheEntry entry;
+            init_PageCacheEntry(&entry,
+                                collect_String(newRange_String((iRangecc){ urlStart, line.end })));
+            entry.size    = size;
+            entry.used.ts = (struct timespec){ .tv_sec = ts };
+            const iString *fileName = collectNewCStr_String(entryFileName_(entry.crc));
+            if (contains_StringSet(&fileNames, fileName) ||
+                !fileExistsCStr_FileInfo(entryPath_PageCache_(d, entry.crc))) {
+                deinit_PageCacheEntry(&entry);
+                continue;
+            }
+            insert_StringSet(&fileNames, fileName);
+            d->totalSize += entry.size;
+            insert_SortedArray(&d->entries, &entry);
+        }
+    }
+    iRelease(f);
+    /* Remove files that aren't indexed, for example if the index wasn't saved. */
+    iForEach(DirFileInfo, i, iClob(directoryContents_FileInfo(iClob(new_FileInfo(&d->dir))))) {
+        const iFileInfo *info     = i.value;
+        const iString *  fileName = collectNewRange_String(baseName_Path(path_FileInfo(info)));
+        if ((endsWithCase_String(fileName, ".page") &&
+             !contains_StringSet(&fileNames, fileName)) ||
+            endsWithCase_String(fileName, ".page.tmp")) {
+            remove(cstr_String(path_FileInfo(info)));
+        }
+    }
+    deinit_StringSet(&fileNames);
+    evict_PageCache_(d);
+    unlock_Mutex(d->mtx);
+}
+
+void save_PageCache(const iPageCache *d) {
+    if (isEmpty_String(&d->dir)) {
+        return;
+    }
+    iString *line = new_String();
+    iFile *f = new_File(collect_String(concatCStr_Path(&d->dir, indexFileName_PageCache_)));
+    if (open_File(f, writeOnly_FileMode | text_FileMode)) {
+        lock_Mutex(d->mtx);
+        iConstForEach(Array, i, &d->entries.values) {
+            const iPageCacheEntry *entry = i.value;
+            format_String(line,
+                          "%llu %zu %s\n",
+                          (unsigned long long) integralSeconds_Time(&entry->used),
+                          entry->size,
+                          cstr_String(&entry->url));
+            writeData_File(f, cstr_String(line), size_String(line));
+        }
+        unlock_Mutex(d->mtx);
+    }
+    iRelease(f);
+    delete_String(line);
+}
+
+iDeclareType(PageCacheWrite)
+
+/* A page file being written in the background. */
+struct Impl_PageCacheWrite {
+    iPageCache * cache;
+    iString      url;
+    uint32_t     crc;
+    iGmResponse *response; /* a copy; shares the body */
+};
+
+static void serialize_PageCacheWrite_(const void *object, iStream *outs) {
+    const iPageCacheWrite *d = object;
+    setVersion_Stream(outs, latest_FileVersion);
+    writeData_Stream(outs, magic_PageCache_, 4);
+    writeU32_Stream(outs, latest_FileVersion);
+    serialize_String(&d->url, outs);
+    serialize_GmResponse(d->response, outs);
+}
+
+static void delete_PageCacheWrite_(void *object) {
+    iPageCacheWrite *d     = object;
+    iPageCache *     cache = d->cache;
+    /* The entry may have been evicted or the cache cleared while the file was being
+       written. */
+    iPageCacheEntry key;
+    init_PageCacheEntry(&key, &d->url);
+    size_t pos;
+    lock_Mutex(cache->mtx);
+    if (!locate_SortedArray(&cache->entries, &key, &pos)) {
+        remove(entryPath_PageCache_(cache, d->crc));
+    }
+    unlock_Mutex(cache->mtx);
+    deinit_PageCacheEntry(&key);
+    delete_GmResponse(d->response);
+    deinit_String(&d->url);
+    free(d);
+}
+
+void add_PageCache(iPageCache *d, const iString *url, const iGmResponse *response) {
+    if (isEmpty_String(&d->dir) ||
+        category_GmStatusCode(response->statusCode) != categorySuccess_GmStatusCode) {
+        return;
+    }
+    if (identityForUrl_GmCerts(certs_App(), url)) {
+        return; /* pages requested with a client certificate are not written on disk */
+    }
+    iPageCacheEntry entry;
+    init_PageCacheEntry(&entry, url);
+    entry.size = size_Block(&response->body);
+    if (entry.size > maxSize_PageCache_ / 4) {
+        deinit_PageCacheEntry(&entry);
+        return; /* would push out too much else */
+    }
+    /* The file is written in the background. Until then, reading the entry fails and it
+       gets removed. */
+    iPageCacheWrite *write = iMalloc(PageCacheWrite);
+    write->cache    = d;
+    write->crc      = entry.crc;
+    write->response = copy_GmResponse(response);
+    initCopy_String(&write->url, &entry.url);
+    const iString *path = collectNewCStr_String(entryPath_PageCache_(d, entry.crc));
+    lock_Mutex(d->mtx);
+    /* The file replaces any previous entry with the same name. */
+    for (size_t i = 0; i < size_SortedArray(&d->entries); i++) {
+        if (((const iPageCacheEntry *) at_SortedArray(&d->entries, i))->crc == entry.crc) {
+            removeEntry_PageCache_(d, i--, iFalse);
+        }
+    }
+    d->totalSize += entry.size;
+    insert_SortedArray(&d->entries, &entry);
+    evict_PageCache_(d);
+    unlock_Mutex(d->mtx);
+    writeOnce_Persist("cache", cstr_String(path), serialize_PageCacheWrite_, write,
+                      delete_PageCacheWrite_);
+}
+
+void clear_PageCache(iPageCache *d) {
+    lock_Mutex(d->mtx);
+    while (size_SortedArray(&d->entries) > 0) {
+        removeEntry_PageCache_(d, size_SortedArray(&d->entries) - 1, iTrue);
+    }
+    unlock_Mutex(d->mtx);
+    save_PageCache(d);
+}
+
+iGmResponse *newResponse_PageCache(iPageCache *d, const iString *url) {
+    iPageCacheEntry key;
+    init_PageCacheEntry(&key, url);
+    iGmResponse *resp = NULL;
+    size_t pos;
+    lock_Mutex(d->mtx);
+    if (locate_SortedArray(&d->entries, &key, &pos)) {
+        iPageCacheEntry *entry = at_SortedArray(&d->entries, pos);
+        iFile *f = newCStr_File(entryPath_PageCache_(d, entry->crc));
+        if (open_File(f, readOnly_FileMode)) {
+            char magic[4];
+            readData_File(f, 4, magic);
+            const uint32_t version = readU32_File(f);
+            if (!memcmp(magic, magic_PageCache_, 4) && version <= latest_FileVersion) {
+                setVersion_Stream(stream_File(f), version);
+                iString storedUrl;
+                init_String(&storedUrl);
+                deserialize_String(&storedUrl, stream_File(f));
+                if (equal_String(&storedUrl, &entry->url)) {
+                    resp = new_GmResponse();
+                    deserialize_GmResponse(resp, stream_File(f));
+                    if (size_Block(&resp->body) != entry->size) {
+                        delete_GmResponse(resp); /* damaged */
+                        resp = NULL;
+                    }
+                }
+                deinit_String(&storedUrl);
+            }
+        }
+        iRelease(f);
+        if (resp) {
+            initCurrent_Time(&entry->used);
+        }
+        else {
+            removeEntry_PageCache_(d, pos, iTrue);
+        }
+    }
+    unlock_Mutex(d->mtx);
+    deinit_PageCacheEntry(&key);
+    return resp;
+}
@@ -0,0 +1,359 @@
+/* Copyright 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include "persist.h"
+
+#include <the_Foundation/buffer.h>
+#include <the_Foundation/condition.h>
+#include <the_Foundation/file.h>
+#include <the_Foundation/mutex.h>
+#include <the_Foundation/ptrarray.h>
+#include <the_Foundation/thread.h>
+#include <the_Foundation/time.h>
+#include <stdio.h>
+#include <string.h>
+
+static const double delaySeconds_Persist_ = 2.0;
+
+iDeclareType(PersistFile)
+
+struct Impl_PersistFile {
+    iString      name;
+    iString      path;
+    iPersistFunc serialize;
+    const void * object;
+    iBool        isPending;
+    iTime        dueAt;
+    /* Statistics. */
+    int          numRequests;
+    int          numWrites;
+    int          numFailures;
+    size_t       lastSize;
+    double       lastWriteSeconds;
+    double       totalWriteSeconds;
+};
+
+static iPersistFile *new_PersistFile_(const char *name) {
+    iPersistFile *d = iMalloc(PersistFile);
+    iZap(*d);
+    initCStr_String(&d->name, name);
+    init_String(&d->path);
+    return d;
+}
+
+static void delete_PersistFile_(iPersistFile *d) {
+    deinit_String(&d->name);
+    deinit_String(&d->path);
+    free(d);
+}
+
+iDeclareType(Persist)
+
+iDeclareType(PersistJob)
+
+/* A one-time write of an object owned by the job. */
+struct Impl_PersistJob {
+    iString            path;
+    iPersistFunc       serialize;
+    void *             object;
+    iPersistDeleteFunc deleteObject;
+    iPersistFile *     stats;
+};
+
+struct Impl_Persist {
+    iMutex *   mtx;
+    iCondition wakeup; /* a save was requested, or the worker should stop */
+    iThread *  worker;
+    iBool      stopWorker;
+    iPtrArray  files;
+    iPtrArray  jobs; /* written in the order they were added */
+};
+
+static iPersist persist_;
+
+static iBool write_PersistFile_(const iString *path, iPersistFunc serialize, const void *object,
+                                size_t *size_out) {
+    iBool ok = iFalse;
+    iBuffer *buf = new_Buffer();
+    openEmpty_Buffer(buf);
+    serialize(object, stream_Buffer(buf));
+    *size_out = size_Block(data_Buffer(buf));
+    const char *tempPath = format_CStr("%s.tmp", cstr_String(path));
+    iFile *f = newCStr_File(tempPath);
+    if (open_File(f, writeOnly_FileMode)) {
+        write_File(f, data_Buffer(buf));
+        close_File(f);
+        ok = iTrue;
+    }
+    iRelease(f);
+    iRelease(buf);
+    if (ok) {
+#if defined (iPlatformMsys)
+        remove(cstr_String(path)); /* rename() doesn't replace existing files */
+#endif
+        ok = rename(tempPath, cstr_String(path)) == 0;
+    }
+    if (!ok) {
+        remove(tempPath);
+    }
+    return ok;
+}
+
+static void timedWrite_PersistFile_(iPersistFile *d, iMutex *mtx, const iString *path,
+                                    iPersistFunc serialize, const void *object) {
+    /* Called with `mtx` locked. The mutex is released while writing. */
+    if (mtx) unlock_Mutex(mtx);
+    iTime startTime;
+    initCurrent_Time(&startTime);
+    size_t size = 0;
+    iBeginCollect();
+    const iBool ok = write_PersistFile_(path, serialize, object, &size);
+    iEndCollect();
+    const double elapsed = elapsedSeconds_Time(&startTime);
+    if (mtx) lock_Mutex(mtx);
+    if (d) {
+        d->numWrites++;
+        d->numFailures += (ok ? 0 : 1);
+        d->lastSize = size;
+        d->lastWriteSeconds = elapsed;
+        d->totalWriteSeconds += elapsed;
+    }
+}
+
+static void save_PersistFile_(iPersistFile *d, iMutex *mtx) {
+    iString path;
+    initCopy_String(&path, &d->path);
+    d->isPending = iFalse;
+    timedWrite_PersistFile_(d, mtx, &path, d->serialize, d->object);
+    deinit_String(&path);
+}
+
+static void run_PersistJob_(iPersistJob *d, iMutex *mtx) {
+    /* The job has already been removed from the queue. */
+    timedWrite_PersistFile_(d->stats, mtx, &d->path, d->serialize, d->object);
+    if (d->deleteObject) {
+        if (mtx) unlock_Mutex(mtx); /* may lock the owner's mutex */
+        d->deleteObject(d->object);
+        if (mtx) lock_Mutex(mtx);
+    }
+    deinit_String(&d->path);
+    free(d);
+}
+
+static iThreadResult run_Persist_(iThread *thread) {
+    iPersist *d = &persist_;
+    iUnused(thread);
+    lock_Mutex(d->mtx);
+    while (!d->stopWorker) {
+        if (!isEmpty_PtrArray(&d->jobs)) {
+            iPersistJob *job = at_PtrArray(&d->jobs, 0);
+            remove_Array(&d->jobs, 0);
+            run_PersistJob_(job, d->mtx);
+            continue;
+        }
+        iPersistFile *next = NULL;
+        iConstForEach(PtrArray, i, &d->files) {
+            iPersistFile *file = i.ptr;
+            if (file->isPending && (!next || cmp_Time(&file->dueAt, &next->dueAt) < 0)) {
+                next = file;
+            }
+        }
+        if (!next) {
+            wait_Condition(&d->wakeup, d->mtx);
+        }
+        else if (elapsedSeconds_Time(&next->dueAt) < 0) {
+            waitTimeout_Condition(&d->wakeup, d->mtx, &next->dueAt);
+        }
+        else {
+            save_PersistFile_(next, d->mtx);
+        }
+    }
+    unlock_Mutex(d->mtx);
+    return 0;
+}
+
+void init_Persist(void) {
+    iPersist *d = &persist_;
+    d->mtx = new_Mutex();
+    init_Condition(&d->wakeup);
+    init_PtrArray(&d->files);
+    init_PtrArray(&d->jobs);
+    d->stopWorker = iFalse;
+    d->worker = new_Thread(run_Persist_);
+    start_Thread(d->worker);
+}
+
+static iPersistFile *nextPending_Persist_(iPersist *d) {
+    iConstForEach(PtrArray, i, &d->files) {
+        iPersistFile *file = i.ptr;
+        if (file->isPending) {
+            return file;
+        }
+    }
+    return NULL;
+}
+
+void deinit_Persist(void) {
+    /* The mutex remains valid afterwards. Other threads may still request saves, and they
+       check under the mutex whether the worker is running. */
+    iPersist *d = &persist_;
+    if (!d->mtx) return;
+    lock_Mutex(d->mtx);
+    if (!d->worker) {
+        unlock_Mutex(d->mtx);
+        return;
+    }
+    d->stopWorker = iTrue;
+    signal_Condition(&d->wakeup);
+    unlock_Mutex(d->mtx);
+    join_Thread(d->worker);
+    lock_Mutex(d->mtx);
+    /* Write everything that is still pending. Requests made meanwhile are queued and
+       written here as well, so there is only one writer at a time. */
+    for (;;) {
+        if (!isEmpty_PtrArray(&d->jobs)) {
+            iPersistJob *job = at_PtrArray(&d->jobs, 0);
+            remove_Array(&d->jobs, 0);
+            run_PersistJob_(job, d->mtx);
+            continue;
+        }
+        iPersistFile *file = nextPending_Persist_(d);
+        if (!file) {
+            break;
+        }
+        save_PersistFile_(file, d->mtx);
+    }
+    /* Saves requested from now on are written immediately. */
+    iThread *worker = d->worker;
+    d->worker = NULL;
+    iForEach(PtrArray, i, &d->files) {
+        delete_PersistFile_(i.ptr);
+    }
+    clear_PtrArray(&d->files);
+    unlock_Mutex(d->mtx);
+    iRelease(worker);
+}
+
+static iPersistFile *file_Persist_(iPersist *d, const char *name) {
+    iConstForEach(PtrArray, i, &d->files) {
+        iPersistFile *file = i.ptr;
+        if (!strcmp(cstr_String(&file->name), name)) {
+            return file;
+        }
+    }
+    iPersistFile *file = new_PersistFile_(name);
+    pushBack_PtrArray(&d->files, file);
+    return file;
+}
+
+void requestSave_Persist(const char *name, const char *path, iPersistFunc serialize,
+                         const void *object) {
+    iPersist *d = &persist_;
+    if (d->mtx) {
+        lock_Mutex(d->mtx);
+        if (d->worker) {
+            iPersistFile *file = file_Persist_(d, name);
+            setCStr_String(&file->path, path);
+            file->serialize = serialize;
+            file->object    = object;
+            file->numRequests++;
+            if (!file->isPending) {
+                /* Further requests until the deadline are included in the same write. */
+                file->isPending = iTrue;
+                initTimeout_Time(&file->dueAt, delaySeconds_Persist_);
+                signal_Condition(&d->wakeup);
+            }
+            unlock_Mutex(d->mtx);
+            return;
+        }
+        unlock_Mutex(d->mtx);
+    }
+    /* Not running; save immediately. */
+    iPersistFile file;
+    iZap(file);
+    initCStr_String(&file.path, path);
+    file.serialize = serialize;
+    file.object    = object;
+    save_PersistFile_(&file, NULL);
+    deinit_String(&file.path);
+}
+
+void writeOnce_Persist(const char *name, const char *path, iPersistFunc serialize, void *object,
+                       iPersistDeleteFunc deleteObject) {
+    iPersist *   d   = &persist_;
+    iPersistJob *job = iMalloc(PersistJob);
+    initCStr_String(&job->path, path);
+    job->serialize    = serialize;
+    job->object       = object;
+    job->deleteObject = deleteObject;
+    job->stats        = NULL;
+    if (d->mtx) {
+        lock_Mutex(d->mtx);
+        if (d->worker) {
+            job->stats = file_Persist_(d, name);
+            job->stats->numRequests++;
+            pushBack_PtrArray(&d->jobs, job);
+            signal_Condition(&d->wakeup);
+            unlock_Mutex(d->mtx);
+            return;
+        }
+        unlock_Mutex(d->mtx);
+    }
+    /* Not running; write immediately. */
+    run_PersistJob_(job, NULL);
+}
+
+static void serializeBlock_Persist_(const void *object, iStream *outs) {
+    writeData_Stream(outs, constData_Block(object), size_Block(object));
+}
+
+static void deleteBlock_Persist_(void *object) {
+    delete_Block(object);
+}
+
+void writeBlock_Persist(const char *name, const char *path, iBlock *data) {
+    writeOnce_Persist(name, path, serializeBlock_Persist_, data, deleteBlock_Persist_);
+}
+
+iString *debugInfo_Persist(void) {
+    iPersist *d = &persist_;
+    iString *str = new_String();
+    if (!d->mtx) return str;
+    lock_Mutex(d->mtx);
+    iConstForEach(PtrArray, i, &d->files) {
+        const iPersistFile *file = i.ptr;
+        appendFormat_String(str,
+                            "* %s: %d requests, %d writes (%d failed), last %zu bytes in %.1f ms, "
+                            "%.1f ms average%s\n",
+                            cstr_String(&file->name),
+                            file->numRequests,
+                            file->numWrites,
+                            file->numFailures,
+                            file->lastSize,
+                            file->lastWriteSeconds * 1000.0,
+                            file->numWrites ? file->totalWriteSeconds * 1000.0 / file->numWrites
+                                            : 0.0,
+                            file->isPending ? ", pending" : "");
+    }
+    unlock_Mutex(d->mtx);
+    return str;
+}
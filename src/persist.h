@@ -0,0 +1,47 @@
+/* Copyright 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#pragma once
+
+#include <the_Foundation/stream.h>
+#include <the_Foundation/string.h>
+
+/* Writes data files in a background thread. Saves are delayed briefly so that a burst of
+   changes results in a single write. Each file is first written to a temporary file that
+   then replaces the original, so an interrupted write never leaves a partial file.
+   writeOnce_Persist() queues a write of an object that is deleted afterwards; these are done
+   in order, without delay. writeBlock_Persist() does the same for data that has already been
+   serialized. */
+
+typedef void (*iPersistFunc)(const void *object, iStream *outs);
+typedef void (*iPersistDeleteFunc)(void *object);
+
+void        init_Persist        (void);
+void        deinit_Persist      (void); /* pending saves are written before returning */
+
+void        requestSave_Persist (const char *name, const char *path, iPersistFunc serialize,
+                                 const void *object);
+void        writeOnce_Persist   (const char *name, const char *path, iPersistFunc serialize,
+                                 void *object, iPersistDeleteFunc deleteObject);
+void        writeBlock_Persist  (const char *name, const char *path,
+                                 iBlock *data); /* takes ownership */
+iString *   debugInfo_Persist   (void);
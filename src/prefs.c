@@ -39,6 +39,8 @@ void init_Prefs(iPrefs *d) {
     d->loadImageInsteadOfScrolling = iFalse;
     d->decodeUserVisibleURLs = iTrue;
     d->maxCacheSize      = 10;
+    d->feedConcurrency   = 4;
+    d->feedConcurrencyPerHost = 2;
     d->font              = nunito_TextFont;
     d->headingFont       = nunito_TextFont;
     d->monospaceGemini   = iFalse;
@@ -55,6 +55,8 @@ struct Impl_Prefs {
     iString          caPath;
     iBool            decodeUserVisibleURLs;
     int              maxCacheSize; /* MB */
+    int              feedConcurrency; /* simultaneous feed requests */
+    int              feedConcurrencyPerHost;
     iString          geminiProxy;
     iString          gopherProxy;
     iString          httpProxy;
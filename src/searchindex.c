@@ -0,0 +1,677 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+
+#include "searchindex.h"
+#include "app.h"
+#include "gmcerts.h"
+#include "persist.h"
+#include "words.h"
+
+#include <the_Foundation/buffer.h>
+#include <the_Foundation/condition.h>
+#include <the_Foundation/file.h>
+#include <the_Foundation/mutex.h>
+#include <the_Foundation/path.h>
+#include <the_Foundation/sortedarray.h>
+#include <the_Foundation/stringset.h>
+#include <the_Foundation/thread.h>
+
+static const char * fileName_SearchIndex_  = "searchindex.bin";
+static const char * magic_SearchIndex_     = "lgSx";
+static const size_t maxPages_SearchIndex_  = 20000;
+static const size_t maxBodySize_SearchIndex_ = 512 * 1024; /* only the start of larger pages */
+static const size_t minWordSize_SearchIndex_ = 2;  /* bytes */
+static const size_t maxWordSize_SearchIndex_ = 40;
+static const size_t maxTitleSize_SearchIndex_ = 100;
+static const uint32_t invalidId_SearchIndex_   = 0xffffffff;
+static const double saveIntervalSeconds_SearchIndex_ = 5 * 60;
+
+enum iSearchIndexVersion {
+    initial_SearchIndexVersion = 1,
+    latest_SearchIndexVersion  = 1,
+};
+
+void init_SearchHit(iSearchHit *d) {
+    init_String(&d->url);
+    init_String(&d->title);
+    iZap(d->when);
+}
+
+void deinit_SearchHit(iSearchHit *d) {
+    deinit_String(&d->title);
+    deinit_String(&d->url);
+}
+
+iDefineTypeConstruction(SearchHit)
+
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareType(IndexPage)
+iDeclareType(IndexUrl)
+iDeclareType(IndexWord)
+iDeclareType(IndexJob)
+
+struct Impl_IndexPage {
+    iString url;
+    iString title;
+    iTime   when;
+    iBool   isRemoved; /* replaced or evicted; dropped from the index when saved */
+};
+
+struct Impl_IndexUrl {
+    iString  url;
+    uint32_t pageId;
+};
+
+struct Impl_IndexWord {
+    iString word;
+    iArray  pages; /* uint32_t page IDs, ascending */
+};
+
+struct Impl_IndexJob {
+    iString url;
+    iString mime;
+    iBlock  body;
+    iBool   isClear; /* erase the index instead of adding a page */
+};
+
+static int cmp_IndexUrl_(const void *a, const void *b) {
+    return cmpString_String(&((const iIndexUrl *) a)->url, &((const iIndexUrl *) b)->url);
+}
+
+static int cmp_IndexWord_(const void *a, const void *b) {
+    return cmpString_String(&((const iIndexWord *) a)->word, &((const iIndexWord *) b)->word);
+}
+
+static void deinit_IndexJob_(iIndexJob *d) {
+    deinit_String(&d->url);
+    deinit_String(&d->mime);
+    deinit_Block(&d->body);
+}
+
+struct Impl_SearchIndex {
+    iMutex *     mtx;
+    iArray       pages; /* IndexPages; the position is the page ID */
+    size_t       numLivePages;
+    size_t       oldestLive; /* first page that may not be removed */
+    iSortedArray urls;  /* IndexUrls of the live pages */
+    iSortedArray words; /* IndexWords */
+    iString      loadPath;
+    iBool        isLoaded;
+    iTime        lastSaved; /* time of the latest save request */
+    iBool        isModified; /* changed since the latest save request */
+    iArray       jobs;  /* IndexJobs */
+    iCondition   jobAvailable;
+    iThread *    worker;
+    iBool        isStopping;
+};
+
+iDefineTypeConstruction(SearchIndex)
+
+void init_SearchIndex(iSearchIndex *d) {
+    d->mtx = new_Mutex();
+    init_Array(&d->pages, sizeof(iIndexPage));
+    d->numLivePages = 0;
+    d->oldestLive   = 0;
+    init_SortedArray(&d->urls, sizeof(iIndexUrl), cmp_IndexUrl_);
+    init_SortedArray(&d->words, sizeof(iIndexWord), cmp_IndexWord_);
+    init_String(&d->loadPath);
+    d->isLoaded = iFalse;
+    iZap(d->lastSaved);
+    d->isModified = iFalse;
+    init_Array(&d->jobs, sizeof(iIndexJob));
+    init_Condition(&d->jobAvailable);
+    d->worker     = NULL;
+    d->isStopping = iFalse;
+}
+
+static void stopWorker_SearchIndex_(iSearchIndex *d) {
+    if (d->worker) {
+        iGuardMutex(d->mtx, {
+            d->isStopping = iTrue;
+            signal_Condition(&d->jobAvailable);
+        });
+        join_Thread(d->worker);
+        iReleasePtr(&d->worker);
+    }
+}
+
+static void clear_SearchIndex_(iSearchIndex *d) {
+    iForEach(Array, i, &d->pages) {
+        iIndexPage *page = i.value;
+        deinit_String(&page->url);
+        deinit_String(&page->title);
+    }
+    clear_Array(&d->pages);
+    iForEach(Array, j, &d->urls.values) {
+        deinit_String(&((iIndexUrl *) j.value)->url);
+    }
+    clear_SortedArray(&d->urls);
+    iForEach(Array, k, &d->words.values) {
+        iIndexWord *word = k.value;
+        deinit_String(&word->word);
+        deinit_Array(&word->pages);
+    }
+    clear_SortedArray(&d->words);
+    d->numLivePages = 0;
+    d->oldestLive   = 0;
+}
+
+void deinit_SearchIndex(iSearchIndex *d) {
+    stopWorker_SearchIndex_(d);
+    clear_SearchIndex_(d);
+    iForEach(Array, i, &d->jobs) {
+        deinit_IndexJob_(i.value);
+    }
+    deinit_Array(&d->jobs);
+    deinit_Condition(&d->jobAvailable);
+    deinit_String(&d->loadPath);
+    deinit_SortedArray(&d->words);
+    deinit_SortedArray(&d->urls);
+    deinit_Array(&d->pages);
+    delete_Mutex(d->mtx);
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+static iBool nextWord_(iRangecc text, iRangecc *word) {
+    /* Very short and very long words are not indexed. */
+    while (nextWord_Words(text, word)) {
+        const size_t len = size_Range(word);
+        if (len >= minWordSize_SearchIndex_ && len <= maxWordSize_SearchIndex_) {
+            return iTrue;
+        }
+    }
+    return iFalse;
+}
+
+static void title_(iString *d, const iString *mime, iRangecc body) {
+    /* The first heading of a Gemini page, or the first nonempty line of any text. */
+    const iBool isGemini = startsWithCase_String(mime, "text/gemini");
+    iRangecc    line     = iNullRange;
+    iRangecc    first    = iNullRange;
+    while (nextSplit_Rangecc(body, "\n", &line)) {
+        iRangecc text = line;
+        trim_Rangecc(&text);
+        if (isEmpty_Range(&text)) {
+            continue;
+        }
+        if (!first.start) {
+            first = text;
+            if (!isGemini) break;
+        }
+        if (*text.start == '#') {
+            while (text.start < text.end && *text.start == '#') {
+                text.start++;
+            }
+            trimStart_Rangecc(&text);
+            if (!isEmpty_Range(&text)) {
+                first = text;
+                break;
+            }
+        }
+    }
+    if (size_Range(&first) > maxTitleSize_SearchIndex_) {
+        first.end = first.start + maxTitleSize_SearchIndex_;
+        while (first.end > first.start && ((uint8_t) *first.end & 0xc0) == 0x80) {
+            first.end--; /* don't cut a multibyte character */
+        }
+    }
+    setRange_String(d, first);
+}
+
+static iIndexWord *word_SearchIndex_(iSearchIndex *d, const iString *word) {
+    iIndexWord key = { .word = *word };
+    size_t pos;
+    if (!locate_SortedArray(&d->words, &key, &pos)) {
+        iIndexWord newWord;
+        initCopy_String(&newWord.word, word);
+        init_Array(&newWord.pages, sizeof(uint32_t));
+        insert_Array(&d->words.values, pos, &newWord);
+    }
+    return at_SortedArray(&d->words, pos);
+}
+
+static void removeUrl_SearchIndex_(iSearchIndex *d, const iString *url) {
+    size_t pos;
+    if (locate_SortedArray(&d->urls, &(iIndexUrl){ .url = *url }, &pos)) {
+        iIndexUrl *entry = at_SortedArray(&d->urls, pos);
+        ((iIndexPage *) at_Array(&d->pages, entry->pageId))->isRemoved = iTrue;
+        d->numLivePages--;
+        deinit_String(&entry->url);
+        remove_Array(&d->urls.values, pos);
+    }
+}
+
+static void evictOldest_SearchIndex_(iSearchIndex *d) {
+    while (d->numLivePages > maxPages_SearchIndex_ && d->oldestLive < size_Array(&d->pages)) {
+        const iIndexPage *page = constAt_Array(&d->pages, d->oldestLive++);
+        if (!page->isRemoved) {
+            removeUrl_SearchIndex_(d, &page->url);
+        }
+    }
+}
+
+static void compact_SearchIndex_(iSearchIndex *d) {
+    /* Removed pages are dropped from the page array once they are more numerous than the
+       live ones. The remaining pages are renumbered. */
+    const size_t numRemoved = size_Array(&d->pages) - d->numLivePages;
+    if (numRemoved <= d->numLivePages) {
+        return;
+    }
+    iArray idMap; /* old page IDs to new ones */
+    init_Array(&idMap, sizeof(uint32_t));
+    iArray live;
+    init_Array(&live, sizeof(iIndexPage));
+    iForEach(Array, i, &d->pages) {
+        iIndexPage *page = i.value;
+        uint32_t    id   = invalidId_SearchIndex_;
+        if (page->isRemoved) {
+            deinit_String(&page->url);
+            deinit_String(&page->title);
+        }
+        else {
+            id = size_Array(&live);
+            pushBack_Array(&live, page);
+        }
+        pushBack_Array(&idMap, &id);
+    }
+    clear_Array(&d->pages);
+    pushBackN_Array(&d->pages, constData_Array(&live), size_Array(&live));
+    deinit_Array(&live);
+    const uint32_t *newIds = constData_Array(&idMap);
+    iForEach(Array, j, &d->urls.values) {
+        iIndexUrl *entry = j.value;
+        entry->pageId = newIds[entry->pageId];
+    }
+    iForEach(Array, k, &d->words.values) {
+        iIndexWord *word = k.value;
+        uint32_t *  ids  = data_Array(&word->pages);
+        size_t      out  = 0;
+        for (size_t n = 0; n < size_Array(&word->pages); n++) {
+            if (newIds[ids[n]] != invalidId_SearchIndex_) {
+                ids[out++] = newIds[ids[n]]; /* order is unchanged */
+            }
+        }
+        resize_Array(&word->pages, out);
+        if (out == 0) {
+            deinit_String(&word->word);
+            deinit_Array(&word->pages);
+            remove_ArrayIterator(&k);
+        }
+    }
+    deinit_Array(&idMap);
+    d->oldestLive = 0;
+}
+
+static uint32_t addPage_SearchIndex_(iSearchIndex *d, const iString *url, const iString *title,
+                                     const iTime *when) {
+    /* Any earlier version of the page becomes obsolete. */
+    removeUrl_SearchIndex_(d, url);
+    const uint32_t id = size_Array(&d->pages);
+    iIndexPage page;
+    initCopy_String(&page.url, url);
+    initCopy_String(&page.title, title);
+    page.when      = *when;
+    page.isRemoved = iFalse;
+    pushBack_Array(&d->pages, &page);
+    iIndexUrl entry;
+    initCopy_String(&entry.url, url);
+    entry.pageId = id;
+    insert_SortedArray(&d->urls, &entry);
+    d->numLivePages++;
+    return id;
+}
+
+static void index_SearchIndex_(iSearchIndex *d, const iIndexJob *job) {
+    /* Collect the unique words outside the lock. */
+    iRangecc body = range_Block(&job->body);
+    if (size_Range(&body) > maxBodySize_SearchIndex_) {
+        body.end = body.start + maxBodySize_SearchIndex_;
+    }
+    iStringSet *words = new_StringSet();
+    iString     title;
+    iString     word;
+    init_String(&title);
+    init_String(&word);
+    title_(&title, &job->mime, body);
+    iRangecc range = iNullRange;
+    while (nextWord_(body, &range)) {
+        setLowerWord_Words(&word, range);
+        insert_StringSet(words, &word);
+    }
+    iTime now;
+    initCurrent_Time(&now);
+    lock_Mutex(d->mtx);
+    const uint32_t id = addPage_SearchIndex_(d, &job->url, &title, &now);
+    iConstForEach(StringSet, i, words) {
+        iIndexWord *entry = word_SearchIndex_(d, i.value);
+        pushBack_Array(&entry->pages, &id); /* IDs are always increasing */
+    }
+    evictOldest_SearchIndex_(d);
+    compact_SearchIndex_(d);
+    d->isModified = iTrue;
+    unlock_Mutex(d->mtx);
+    deinit_String(&word);
+    deinit_String(&title);
+    iRelease(words);
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+static void load_SearchIndex_(iSearchIndex *d) {
+    iFile *f = new_File(&d->loadPath);
+    if (open_File(f, readOnly_FileMode)) {
+        iBuffer *buf = new_Buffer();
+        open_Buffer(buf, collect_Block(readAll_File(f)));
+        iStream *ins = stream_Buffer(buf);
+        char magic[4];
+        readData_Buffer(buf, 4, magic);
+        if (!memcmp(magic, magic_SearchIndex_, 4) &&
+            readU32_Stream(ins) <= latest_SearchIndexVersion) {
+            lock_Mutex(d->mtx);
+            /* The worker loads the index before indexing any new pages. */
+            const uint32_t numPages = readU32_Stream(ins);
+            iArray idMap; /* loaded page IDs to current ones */
+            init_Array(&idMap, sizeof(uint32_t));
+            iString url, title;
+            init_String(&url);
+            init_String(&title);
+            for (uint32_t i = 0; i < numPages && !atEnd_Buffer(buf); i++) {
+                iTime when;
+                iZap(when);
+                deserialize_String(&url, ins);
+                deserialize_String(&title, ins);
+                when.ts.tv_sec = readU64_Stream(ins);
+                uint32_t id = invalidId_SearchIndex_;
+                size_t pos;
+                if (!locate_SortedArray(&d->urls, &(iIndexUrl){ .url = url }, &pos)) {
+                    id = addPage_SearchIndex_(d, &url, &title, &when);
+                }
+                pushBack_Array(&idMap, &id);
+            }
+            const uint32_t numWords = readU32_Stream(ins);
+            iString word;
+            init_String(&word);
+            iArray ids;
+            init_Array(&ids, sizeof(uint32_t));
+            for (uint32_t i = 0; i < numWords && !atEnd_Buffer(buf); i++) {
+                deserialize_String(&word, ins);
+                const uint32_t count = readU32_Stream(ins);
+                clear_Array(&ids);
+                for (uint32_t j = 0; j < count; j++) {
+                    const uint32_t loaded = readU32_Stream(ins);
+                    if (loaded < size_Array(&idMap)) {
+                        const uint32_t id = *(const uint32_t *) constAt_Array(&idMap, loaded);
+                        if (id != invalidId_SearchIndex_) {
+                            pushBack_Array(&ids, &id);
+                        }
+                    }
+                }
+                if (!isEmpty_Array(&ids)) {
+                    iIndexWord *entry = word_SearchIndex_(d, &word);
+                    pushBackN_Array(&entry->pages, constData_Array(&ids), size_Array(&ids));
+                }
+            }
+            deinit_Array(&ids);
+            deinit_String(&word);
+            deinit_String(&title);
+            deinit_String(&url);
+            deinit_Array(&idMap);
+            evictOldest_SearchIndex_(d);
+            compact_SearchIndex_(d);
+            unlock_Mutex(d->mtx);
+        }
+        iRelease(buf);
+    }
+    iRelease(f);
+}
+
+static void requestSave_SearchIndex_(iSearchIndex *d);
+
+static iThreadResult run_SearchIndex_(iThread *thread) {
+    iSearchIndex *d = userData_Thread(thread);
+    load_SearchIndex_(d);
+    lock_Mutex(d->mtx);
+    d->isLoaded = iTrue;
+    initCurrent_Time(&d->lastSaved);
+    for (;;) {
+        while (!d->isStopping && isEmpty_Array(&d->jobs)) {
+            wait_Condition(&d->jobAvailable, d->mtx);
+        }
+        if (isEmpty_Array(&d->jobs)) {
+            break; /* stopping, and all pending pages have been indexed */
+        }
+        iIndexJob job = *(const iIndexJob *) constFront_Array(&d->jobs);
+        popFront_Array(&d->jobs);
+        if (job.isClear) {
+            /* Any pages loaded or indexed before this point are discarded. */
+            clear_SearchIndex_(d);
+            remove(cstr_String(&d->loadPath));
+            deinit_IndexJob_(&job);
+            continue;
+        }
+        unlock_Mutex(d->mtx);
+        index_SearchIndex_(d, &job);
+        deinit_IndexJob_(&job);
+        lock_Mutex(d->mtx);
+        /* Saved every now and then so that little is lost if the app doesn't exit cleanly. */
+        if (elapsedSeconds_Time(&d->lastSaved) >= saveIntervalSeconds_SearchIndex_) {
+            requestSave_SearchIndex_(d);
+        }
+    }
+    unlock_Mutex(d->mtx);
+    return 0;
+}
+
+void load_SearchIndex(iSearchIndex *d, const char *dirPath) {
+    setCStr_String(&d->loadPath, concatPath_CStr(dirPath, fileName_SearchIndex_));
+    d->worker = new_Thread(run_SearchIndex_);
+    setUserData_Thread(d->worker, d);
+    start_Thread(d->worker);
+}
+
+static void serialize_SearchIndex_(const void *object, iStream *outs) {
+    const iSearchIndex *d = object;
+    writeData_Stream(outs, magic_SearchIndex_, 4);
+    writeU32_Stream(outs, latest_SearchIndexVersion);
+    lock_Mutex(d->mtx);
+    /* Removed pages are dropped and the remaining ones renumbered. */
+    iArray idMap;
+    init_Array(&idMap, sizeof(uint32_t));
+    writeU32_Stream(outs, d->numLivePages);
+    uint32_t numWritten = 0;
+    iConstForEach(Array, i, &d->pages) {
+        const iIndexPage *page = i.value;
+        const uint32_t    id   = page->isRemoved ? invalidId_SearchIndex_ : numWritten++;
+        pushBack_Array(&idMap, &id);
+        if (!page->isRemoved) {
+            serialize_String(&page->url, outs);
+            serialize_String(&page->title, outs);
+            writeU64_Stream(outs, page->when.ts.tv_sec);
+        }
+    }
+    iAssert(numWritten == d->numLivePages);
+    iArray ids;
+    init_Array(&ids, sizeof(uint32_t));
+    iBuffer *words = new_Buffer();
+    openEmpty_Buffer(words);
+    uint32_t numWords = 0;
+    iConstForEach(Array, j, &d->words.values) {
+        const iIndexWord *word = j.value;
+        clear_Array(&ids);
+        iConstForEach(Array, k, &word->pages) {
+            const uint32_t id = *(const uint32_t *) constAt_Array(&idMap,
+                                                                  *(const uint32_t *) k.value);
+            if (id != invalidId_SearchIndex_) {
+                pushBack_Array(&ids, &id);
+            }
+        }
+        if (!isEmpty_Array(&ids)) {
+            serialize_String(&word->word, stream_Buffer(words));
+            writeU32_Stream(stream_Buffer(words), size_Array(&ids));
+            iConstForEach(Array, m, &ids) {
+                writeU32_Stream(stream_Buffer(words), *(const uint32_t *) m.value);
+            }
+            numWords++;
+        }
+    }
+    unlock_Mutex(d->mtx);
+    writeU32_Stream(outs, numWords);
+    writeData_Stream(outs, constData_Block(data_Buffer(words)), size_Block(data_Buffer(words)));
+    iRelease(words);
+    deinit_Array(&ids);
+    deinit_Array(&idMap);
+}
+
+static void requestSave_SearchIndex_(iSearchIndex *d) {
+    /* Called with the mutex locked. The index is serialized when the file gets written. */
+    if (d->isModified) {
+        requestSave_Persist(
+            "searchindex", cstr_String(&d->loadPath), serialize_SearchIndex_, d);
+        d->isModified = iFalse;
+    }
+    initCurrent_Time(&d->lastSaved);
+}
+
+void save_SearchIndex(iSearchIndex *d) {
+    /* The worker finishes indexing the pending pages before stopping. */
+    stopWorker_SearchIndex_(d);
+    lock_Mutex(d->mtx);
+    if (d->isLoaded) { /* otherwise would lose the saved index */
+        requestSave_SearchIndex_(d);
+    }
+    unlock_Mutex(d->mtx);
+}
+
+void add_SearchIndex(iSearchIndex *d, const iString *url, const iGmResponse *response) {
+    if (category_GmStatusCode(response->statusCode) != categorySuccess_GmStatusCode ||
+        !startsWithCase_String(&response->meta, "text/")) {
+        return;
+    }
+    if (identityForUrl_GmCerts(certs_App(), url)) {
+        return; /* pages requested with a client certificate are not written on disk */
+    }
+    iIndexJob job;
+    initCopy_String(&job.url, url);
+    initCopy_String(&job.mime, &response->meta);
+    initCopy_Block(&job.body, &response->body); /* shared data */
+    job.isClear = iFalse;
+    iGuardMutex(d->mtx, {
+        pushBack_Array(&d->jobs, &job);
+        signal_Condition(&d->jobAvailable);
+    });
+}
+
+void clear_SearchIndex(iSearchIndex *d) {
+    lock_Mutex(d->mtx);
+    iForEach(Array, i, &d->jobs) {
+        deinit_IndexJob_(i.value);
+    }
+    clear_Array(&d->jobs);
+    if (d->worker) {
+        /* The worker may still be loading the saved index or indexing a page, so it clears
+           the index once it is done with them. */
+        iIndexJob job;
+        init_String(&job.url);
+        init_String(&job.mime);
+        init_Block(&job.body, 0);
+        job.isClear = iTrue;
+        pushBack_Array(&d->jobs, &job);
+        signal_Condition(&d->jobAvailable);
+    }
+    else {
+        clear_SearchIndex_(d);
+        remove(cstr_String(&d->loadPath));
+    }
+    unlock_Mutex(d->mtx);
+}
+
+static void matchingPages_SearchIndex_(const iSearchIndex *d, const iString *term,
+                                       iArray *ids_out) {
+    /* Pages containing words that begin with `term`. */
+    size_t pos = 0;
+    locate_SortedArray(&d->words, &(iIndexWord){ .word = *term }, &pos);
+    clear_Array(ids_out);
+    size_t numWords = 0;
+    for (; pos < size_SortedArray(&d->words); pos++) {
+        const iIndexWord *word = constAt_Array(&d->words.values, pos);
+        if (!startsWith_String(&word->word, cstr_String(term))) {
+            break;
+        }
+        pushBackN_Array(ids_out, constData_Array(&word->pages), size_Array(&word->pages));
+        numWords++;
+    }
+    if (numWords > 1) {
+        /* Merge the lists of the different words. */
+        sortUniqueIds_Words(ids_out);
+    }
+}
+
+iPtrArray *query_SearchIndex(iSearchIndex *d, const iString *terms, size_t maxHits) {
+    iPtrArray *hits = new_PtrArray();
+    iArray     found, termFound;
+    init_Array(&found, sizeof(uint32_t));
+    init_Array(&termFound, sizeof(uint32_t));
+    iString term;
+    init_String(&term);
+    lock_Mutex(d->mtx);
+    iRangecc range   = iNullRange;
+    iBool    isFirst = iTrue;
+    while (nextWord_(range_String(terms), &range)) {
+        setLowerWord_Words(&term, range);
+        matchingPages_SearchIndex_(d, &term, isFirst ? &found : &termFound);
+        if (!isFirst) {
+            intersectIds_Words(&found, &termFound);
+        }
+        isFirst = iFalse;
+        if (isEmpty_Array(&found)) {
+            break;
+        }
+    }
+    iReverseConstForEach(Array, i, &found) {
+        const iIndexPage *page = constAt_Array(&d->pages, *(const uint32_t *) i.value);
+        if (page->isRemoved) {
+            continue;
+        }
+        iSearchHit *hit = new_SearchHit();
+        set_String(&hit->url, &page->url);
+        set_String(&hit->title, &page->title);
+        hit->when = page->when;
+        pushBack_PtrArray(hits, hit);
+        if (size_PtrArray(hits) == maxHits) {
+            break;
+        }
+    }
+    unlock_Mutex(d->mtx);
+    deinit_String(&term);
+    deinit_Array(&termFound);
+    deinit_Array(&found);
+    return hits;
+}
+
+size_t numPages_SearchIndex(const iSearchIndex *d) {
+    size_t num;
+    iGuardMutex(d->mtx, num = d->numLivePages);
+    return num;
+}
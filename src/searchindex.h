@@ -0,0 +1,54 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#pragma once
+
+#include "gmrequest.h"
+
+#include <the_Foundation/ptrarray.h>
+#include <the_Foundation/string.h>
+#include <the_Foundation/time.h>
+
+/* Inverted index of the words on visited pages. Successfully loaded text responses are
+   indexed in a background thread, and the index is saved on disk, so the contents of pages
+   can be searched even after they have been dropped from memory. Pages requested with a
+   client certificate are not indexed. */
+
+iDeclareType(SearchHit)
+iDeclareTypeConstruction(SearchHit)
+
+struct Impl_SearchHit {
+    iString url;
+    iString title; /* first heading or line of the page */
+    iTime   when;  /* when the page was indexed */
+};
+
+iDeclareType(SearchIndex)
+iDeclareTypeConstruction(SearchIndex)
+
+void        load_SearchIndex    (iSearchIndex *, const char *dirPath); /* in the background */
+void        save_SearchIndex    (iSearchIndex *); /* stops indexing; written by Persist */
+
+void        add_SearchIndex     (iSearchIndex *, const iString *url, const iGmResponse *response);
+void        clear_SearchIndex   (iSearchIndex *); /* also deletes the saved index */
+iPtrArray * query_SearchIndex   (iSearchIndex *, const iString *terms, size_t maxHits); /* new SearchHits, most recent first */
+size_t      numPages_SearchIndex(const iSearchIndex *);
@@ -42,6 +42,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "media.h"
 #include "paint.h"
 #include "mediaui.h"
+#include "pagecache.h"
+#include "searchindex.h"
 #include "scrollwidget.h"
 #include "util.h"
 #include "visbuf.h"
@@ -160,6 +162,8 @@ enum iDocumentWidgetFlag {
     setHoverViaKeys_DocumentWidgetFlag       = iBit(4),
     newTabViaHomeKeys_DocumentWidgetFlag     = iBit(5),
     centerVertically_DocumentWidgetFlag      = iBit(6),
+    current_DocumentWidgetFlag               = iBit(7), /* the shown tab */
+    layoutDiscarded_DocumentWidgetFlag       = iBit(8), /* restore when shown */
 };
 
 enum iDocumentLinkOrdinalMode {
@@ -183,7 +187,11 @@ struct Impl_DocumentWidget {
     iString        sourceMime;
     iBlock         sourceContent; /* original content as received, for saving */
     iTime          sourceTime;
+    iTime          lastShown; /* when the tab was last switched to or away from */
     iGmDocument *  doc;
+    size_t         layoutAnchorPos; /* source position kept in view after relayout */
+    int            layoutAnchorOffset;
+    iBool          layoutAnchorCenter;
     int            certFlags;
     iBlock *       certFingerprint;
     iDate          certExpiry;
@@ -229,6 +237,7 @@ void init_DocumentWidget(iDocumentWidget *d) {
     setFlags_Widget(w, hover_WidgetFlag, iTrue);
     init_PersistentDocumentState(&d->mod);
     d->flags = 0;
+    initCurrent_Time(&d->lastShown);
     iZap(d->certExpiry);
     d->certFingerprint  = new_Block(0);
     d->certFlags        = 0;
@@ -239,6 +248,7 @@ void init_DocumentWidget(iDocumentWidget *d) {
     d->isRequestUpdated = iFalse;
     d->media            = new_ObjectList();
     d->doc              = new_GmDocument();
+    d->layoutAnchorPos  = iInvalidPos;
     d->redirectCount    = 0;
     d->ordinalBase      = 0;
     d->initNormScrollY  = 0;
@@ -544,7 +554,7 @@ static uint32_t mediaUpdateInterval_DocumentWidget_(const iDocumentWidget *d) {
     iConstForEach(PtrArray, i, &d->visibleMedia) {
         const iGmRun *run = i.ptr;
         if (run->mediaType == audio_GmRunMediaType) {
-            iPlayer *plr = audioPlayer_Media(media_GmDocument(d->doc), run->mediaId);
+            iPlayer *plr = audioPlayer_Media(constMedia_GmDocument(d->doc), run->mediaId);
             if (flags_Player(plr) & adjustingVolume_PlayerFlag ||
                 (isStarted_Player(plr) && !isPaused_Player(plr))) {
                 interval = iMin(interval, 1000 / 15);
@@ -570,7 +580,7 @@ static void updateMedia_DocumentWidget_(iDocumentWidget *d) {
         iConstForEach(PtrArray, i, &d->visibleMedia) {
             const iGmRun *run = i.ptr;
             if (run->mediaType == audio_GmRunMediaType) {
-                iPlayer *plr = audioPlayer_Media(media_GmDocument(d->doc), run->mediaId);
+                iPlayer *plr = audioPlayer_Media(constMedia_GmDocument(d->doc), run->mediaId);
                 if (idleTimeMs_Player(plr) > 3000 && ~flags_Player(plr) & volumeGrabbed_PlayerFlag &&
                     flags_Player(plr) & adjustingVolume_PlayerFlag) {
                     setFlags_Player(plr, adjustingVolume_PlayerFlag, iFalse);
@@ -751,9 +761,7 @@ static void documentRunsInvalidated_DocumentWidget_(iDocumentWidget *d) {
     d->lastVisibleRun  = NULL;
 }
 
-static void setSource_DocumentWidget_(iDocumentWidget *d, const iString *source) {
-    setUrl_GmDocument(d->doc, d->mod.url);
-    setSource_GmDocument(d->doc, source, documentWidth_DocumentWidget_(d));
+static void sourceUpdated_DocumentWidget_(iDocumentWidget *d) {
     documentRunsInvalidated_DocumentWidget_(d);
     updateWindowTitle_DocumentWidget_(d);
     updateVisible_DocumentWidget_(d);
@@ -762,6 +770,18 @@ static void setSource_DocumentWidget_(iDocumentWidget *d, const iString *source)
     refresh_Widget(as_Widget(d));
 }
 
+static void setSource_DocumentWidget_(iDocumentWidget *d, const iString *source) {
+    setUrl_GmDocument(d->doc, d->mod.url);
+    setSource_GmDocument(d->doc, source, documentWidth_DocumentWidget_(d));
+    sourceUpdated_DocumentWidget_(d);
+}
+
+static void appendSource_DocumentWidget_(iDocumentWidget *d, const iString *source) {
+    /* Only the newly received lines are laid out. */
+    appendSource_GmDocument(d->doc, source, documentWidth_DocumentWidget_(d));
+    sourceUpdated_DocumentWidget_(d);
+}
+
 static void updateTheme_DocumentWidget_(iDocumentWidget *d) {
     if (isEmpty_String(d->titleUser)) {
         setThemeSeed_GmDocument(d->doc,
@@ -853,11 +873,12 @@ static void updateDocument_DocumentWidget_(iDocumentWidget *d, const iGmResponse
         return;
     }
     const iBool isRequestFinished = !d->request || isFinished_GmRequest(d->request);
-    /* TODO: Do document update in the background. However, that requires a text metrics calculator
-       that does not try to cache the glyph bitmaps. */
     const enum iGmStatusCode statusCode = response->statusCode;
     if (category_GmStatusCode(statusCode) != categoryInput_GmStatusCode) {
         iBool setSource = iTrue;
+        /* Partial content is appended to what has already been laid out. The final update
+           lays out the complete document. */
+        iBool isAppend = !isInitialUpdate && !isRequestFinished;
         iString str;
         invalidate_DocumentWidget_(d);
         if (document_App() == d) {
@@ -866,7 +887,7 @@ static void updateDocument_DocumentWidget_(iDocumentWidget *d, const iGmResponse
         clear_String(&d->sourceMime);
         d->sourceTime = response->when;
         updateTimestampBuf_DocumentWidget_(d);
-        initBlock_String(&str, &response->body);
+        initBlock_String(&str, &response->body); /* shared, not copied */
         if (isSuccess_GmStatusCode(statusCode)) {
             /* Check the MIME type. */
             iRangecc charset = range_CStr("utf-8");
@@ -890,6 +911,7 @@ static void updateDocument_DocumentWidget_(iDocumentWidget *d, const iGmResponse
                 else if (startsWith_Rangecc(param, "image/") ||
                          startsWith_Rangecc(param, "audio/")) {
                     const iBool isAudio = startsWith_Rangecc(param, "audio/");
+                    isAppend = iFalse;
                     /* Make a simple document with an image or audio player. */
                     docFormat = gemini_GmDocumentFormat;
                     setRange_String(&d->sourceMime, param);
@@ -947,7 +969,12 @@ static void updateDocument_DocumentWidget_(iDocumentWidget *d, const iGmResponse
             }
         }
         if (setSource) {
-            setSource_DocumentWidget_(d, &str);
+            if (isAppend) {
+                appendSource_DocumentWidget_(d, &str);
+            }
+            else {
+                setSource_DocumentWidget_(d, &str);
+            }
         }
         deinit_String(&str);
     }
@@ -1006,8 +1033,13 @@ static void parseUser_DocumentWidget_(iDocumentWidget *d) {
 
 static iBool updateFromHistory_DocumentWidget_(iDocumentWidget *d) {
     const iRecentUrl *recent = findUrl_History(d->mod.history, d->mod.url);
-    if (recent && recent->cachedResponse) {
-        const iGmResponse *resp = recent->cachedResponse;
+    iGmResponse *stored = NULL;
+    if (recent && !recent->cachedResponse) {
+        /* Not in memory any more, but may have been saved on disk. */
+        stored = newResponse_PageCache(pageCache_App(), d->mod.url);
+    }
+    if (recent && (recent->cachedResponse || stored)) {
+        const iGmResponse *resp = stored ? stored : recent->cachedResponse;
         clear_ObjectList(d->media);
         reset_GmDocument(d->doc);
         d->state = fetching_RequestState;
@@ -1027,6 +1059,7 @@ static iBool updateFromHistory_DocumentWidget_(iDocumentWidget *d) {
         updateSideIconBuf_DocumentWidget_(d);
         updateVisible_DocumentWidget_(d);
         postCommandf_App("document.changed doc:%p url:%s", d, cstr_String(d->mod.url));
+        delete_GmResponse(stored);
         return iTrue;
     }
     else if (!isEmpty_String(d->mod.url)) {
@@ -1035,6 +1068,17 @@ static iBool updateFromHistory_DocumentWidget_(iDocumentWidget *d) {
     return iFalse;
 }
 
+static void restoreLayout_DocumentWidget_(iDocumentWidget *d) {
+    /* Lay out the page again from the cached response, like when navigating back. The
+       response header is still the same, though. */
+    iString *header = copy_String(&d->sourceHeader);
+    d->flags &= ~layoutDiscarded_DocumentWidgetFlag;
+    updateFromHistory_DocumentWidget_(d);
+    set_String(&d->sourceHeader, header);
+    delete_String(header);
+    updateTimestampBuf_DocumentWidget_(d);
+}
+
 static void refreshWhileScrolling_DocumentWidget_(iAny *ptr) {
     iDocumentWidget *d = ptr;
     updateVisible_DocumentWidget_(d);
@@ -1323,6 +1367,24 @@ static iBool isDownloadRequest_DocumentWidget(const iDocumentWidget *d, const iM
     return findLinkDownload_Media(constMedia_GmDocument(d->doc), req->linkId) != 0;
 }
 
+static void refetchMedia_DocumentWidget_(iDocumentWidget *d, iGmLinkId linkId) {
+    /* Streamed audio is not kept in full, so playing it again from the beginning requires
+       fetching it again. */
+    setData_Media(media_GmDocument(d->doc), linkId, NULL, NULL, allowHide_MediaFlag);
+    iMediaRequest *req = findMediaRequest_DocumentWidget_(d, linkId);
+    if (req) {
+        if (!isFinished_GmRequest(req->req)) {
+            cancel_GmRequest(req->req);
+        }
+        removeMediaRequest_DocumentWidget_(d, linkId);
+    }
+    requestMedia_DocumentWidget_(d, linkId, iTrue);
+    redoLayout_GmDocument(d->doc);
+    d->hoverLink = NULL;
+    updateVisible_DocumentWidget_(d);
+    invalidate_DocumentWidget_(d);
+}
+
 static iBool handleMediaCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd) {
     iMediaRequest *req = pointerLabel_Command(cmd, "request");
     iBool isOurRequest = iFalse;
@@ -1341,8 +1403,8 @@ static iBool handleMediaCommand_DocumentWidget_(iDocumentWidget *d, const char *
         const enum iGmStatusCode code = status_GmRequest(req->req);
         if (isSuccess_GmStatusCode(code)) {
             iGmResponse *resp = lockResponse_GmRequest(req->req);
-            if (isDownloadRequest_DocumentWidget(d, req) ||
-                startsWith_String(&resp->meta, "audio/")) {
+            const iBool isDownload = isDownloadRequest_DocumentWidget(d, req);
+            if (isDownload || startsWith_String(&resp->meta, "audio/")) {
                 /* TODO: Use a helper? This is same as below except for the partialData flag. */
                 if (setData_Media(media_GmDocument(d->doc),
                                   req->linkId,
@@ -1351,6 +1413,11 @@ static iBool handleMediaCommand_DocumentWidget_(iDocumentWidget *d, const char *
                                   partialData_MediaFlag | allowHide_MediaFlag)) {
                     redoLayout_GmDocument(d->doc);
                 }
+                if (!isDownload) {
+                    /* The player has its own copy of the audio stream. */
+                    req->streamedSize += size_Block(&resp->body);
+                    clear_Block(&resp->body);
+                }
                 updateVisible_DocumentWidget_(d);
                 invalidate_DocumentWidget_(d);
                 refresh_Widget(as_Widget(d));
@@ -1395,6 +1462,11 @@ static void allocVisBuffer_DocumentWidget_(const iDocumentWidget *d) {
     const iBool    isVisible = isVisible_Widget(w);
     const iInt2    size      = bounds_Widget(w).size;
     if (isVisible) {
+        /* SDL cannot tell how much video memory is available, so the number of buffers
+           is chosen to fit a fixed budget. Small windows get more buffers for prefetching. */
+        const size_t budget   = 48 * 1024 * 1024;
+        const size_t bufBytes = 4 * (size_t) iMax(1, size.x) * (size_t) (size.y / 2 + 1);
+        setNumBuffers_VisBuf(d->visBuf, budget / bufBytes);
         alloc_VisBuf(d->visBuf, size, 1);
     }
     else {
@@ -1476,35 +1548,51 @@ static const int homeRowKeys_[] = {
     't', 'y',
 };
 
+static void scrollToLayoutAnchor_DocumentWidget_(iDocumentWidget *d) {
+    const iString *source = source_GmDocument(d->doc);
+    if (d->layoutAnchorPos == iInvalidPos || d->layoutAnchorPos > size_String(source)) {
+        return;
+    }
+    const iGmRun *run =
+        findRunAtLoc_GmDocument(d->doc, constBegin_String(source) + d->layoutAnchorPos);
+    if (run) {
+        if (d->layoutAnchorCenter) {
+            scrollTo_DocumentWidget_(d, mid_Rect(run->bounds).y, iTrue);
+        }
+        else {
+            scrollTo_DocumentWidget_(d,
+                                     top_Rect(run->visBounds) +
+                                         lineHeight_Text(paragraph_FontId) + d->layoutAnchorOffset,
+                                     iFalse);
+        }
+    }
+    d->layoutAnchorPos = iInvalidPos;
+}
+
 static void updateDocumentWidthRetainingScrollPosition_DocumentWidget_(iDocumentWidget *d,
                                                                        iBool keepCenter) {
     /* Font changes (i.e., zooming) will keep the view centered, otherwise keep the top
        of the visible area fixed. */
-    const iGmRun *run     = keepCenter ? middleRun_DocumentWidget_(d) : d->firstVisibleRun;
-    const char *  runLoc  = (run ? run->text.start : NULL);
-    int           voffset = 0;
+    const iGmRun * run    = keepCenter ? middleRun_DocumentWidget_(d) : d->firstVisibleRun;
+    const char *   runLoc = (run ? run->text.start : NULL);
+    const iString *source = source_GmDocument(d->doc);
+    /* The position is remembered as an offset because the source may be swapped. */
+    d->layoutAnchorPos    = iInvalidPos;
+    d->layoutAnchorCenter = keepCenter;
+    d->layoutAnchorOffset = 0;
+    if (runLoc >= constBegin_String(source) && runLoc <= constEnd_String(source)) {
+        d->layoutAnchorPos = runLoc - constBegin_String(source);
+    }
     if (!keepCenter && run) {
         /* Keep the first visible run visible at the same position. */
         /* TODO: First *fully* visible run? */
-        voffset = visibleRange_DocumentWidget_(d).start - top_Rect(run->visBounds);
+        d->layoutAnchorOffset = visibleRange_DocumentWidget_(d).start - top_Rect(run->visBounds);
     }
-    setWidth_GmDocument(d->doc, documentWidth_DocumentWidget_(d));
-    documentRunsInvalidated_DocumentWidget_(d);
-    if (runLoc && !keepCenter) {
-        run = findRunAtLoc_GmDocument(d->doc, runLoc);
-        if (run) {
-            scrollTo_DocumentWidget_(d,
-                                     top_Rect(run->visBounds) +
-                                         lineHeight_Text(paragraph_FontId) + voffset,
-                                     iFalse);
-        }
-    }
-    else if (runLoc && keepCenter) {
-        run = findRunAtLoc_GmDocument(d->doc, runLoc);
-        if (run) {
-            scrollTo_DocumentWidget_(d, mid_Rect(run->bounds).y, iTrue);
-        }
+    if (setWidthInBackground_GmDocument(d->doc, documentWidth_DocumentWidget_(d))) {
+        return; /* old layout remains visible until "document.layout.finished" */
     }
+    documentRunsInvalidated_DocumentWidget_(d);
+    scrollToLayoutAnchor_DocumentWidget_(d);
 }
 
 static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd) {
@@ -1520,6 +1608,17 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         updateWindowTitle_DocumentWidget_(d);
         refresh_Widget(w);
     }
+    else if (equal_Command(cmd, "document.layout.finished") &&
+             pointerLabel_Command(cmd, "gmdoc") == d->doc) {
+        if (finishLayout_GmDocument(d->doc)) {
+            documentRunsInvalidated_DocumentWidget_(d);
+            scrollToLayoutAnchor_DocumentWidget_(d);
+            updateVisible_DocumentWidget_(d);
+            invalidate_DocumentWidget_(d);
+            refresh_Widget(w);
+        }
+        return iTrue;
+    }
     else if (equal_Command(cmd, "window.focus.lost")) {
         if (d->flags & showLinkNumbers_DocumentWidgetFlag) {
             d->flags &= ~showLinkNumbers_DocumentWidgetFlag;
@@ -1544,7 +1643,15 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
     }
     else if (equal_Command(cmd, "tabs.changed")) {
         iChangeFlags(d->flags, showLinkNumbers_DocumentWidgetFlag, iFalse);
-        if (cmp_String(id_Widget(w), suffixPtr_Command(cmd, "id")) == 0) {
+        const iBool isCurrent = (cmp_String(id_Widget(w), suffixPtr_Command(cmd, "id")) == 0);
+        if (isCurrent || d->flags & current_DocumentWidgetFlag) {
+            initCurrent_Time(&d->lastShown);
+        }
+        iChangeFlags(d->flags, current_DocumentWidgetFlag, isCurrent);
+        if (isCurrent && d->flags & layoutDiscarded_DocumentWidgetFlag) {
+            restoreLayout_DocumentWidget_(d);
+        }
+        if (isCurrent) {
             /* Set palette for our document. */
             updateTheme_DocumentWidget_(d);
             updateTrust_DocumentWidget_(d, NULL);
@@ -1575,14 +1682,16 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         if (recent && recent->cachedResponse) {
             meta = &recent->cachedResponse->meta;
         }
+        const size_t sourceSize =
+            d->request ? bodySize_GmRequest(d->request) : size_Block(&d->sourceContent);
         iString *msg = collectNew_String();
         if (isEmpty_String(&d->sourceHeader)) {
-            appendFormat_String(msg, "%s\n%zu bytes\n", cstr_String(meta), size_Block(&d->sourceContent));
+            appendFormat_String(msg, "%s\n%zu bytes\n", cstr_String(meta), sourceSize);
         }
         else {
             appendFormat_String(msg, "%s\n", cstr_String(&d->sourceHeader));
-            if (size_Block(&d->sourceContent)) {
-                appendFormat_String(msg, "%zu bytes\n", size_Block(&d->sourceContent));
+            if (sourceSize) {
+                appendFormat_String(msg, "%zu bytes\n", sourceSize);
             }
         }
         appendFormat_String(msg,
@@ -1721,8 +1830,8 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
     }
     else if (equalWidget_Command(cmd, w, "document.request.updated") &&
              d->request && pointerLabel_Command(cmd, "request") == d->request) {
-        set_Block(&d->sourceContent, &lockResponse_GmRequest(d->request)->body);
-        unlockResponse_GmRequest(d->request);
+        /* The body is not shared until the request finishes. A shared block would be copied
+           in full each time more data is appended to it. */
         if (document_App() == d) {
             updateFetchProgress_DocumentWidget_(d);
         }
@@ -1749,7 +1858,10 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         /* The response may be cached. */ {
             if (!equal_Rangecc(urlScheme_String(d->mod.url), "about") &&
                 startsWithCase_String(meta_GmRequest(d->request), "text/")) {
-                setCachedResponse_History(d->mod.history, lockResponse_GmRequest(d->request));
+                const iGmResponse *resp = lockResponse_GmRequest(d->request);
+                setCachedResponse_History(d->mod.history, resp);
+                add_PageCache(pageCache_App(), d->mod.url, resp);
+                add_SearchIndex(searchIndex_App(), d->mod.url, resp);
                 unlockResponse_GmRequest(d->request);
             }
         }
@@ -1770,7 +1882,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
     else if (equal_Command(cmd, "media.player.started")) {
         /* When one media player starts, pause the others that may be playing. */
         const iPlayer *startedPlr = pointerLabel_Command(cmd, "player");
-        const iMedia * media  = media_GmDocument(d->doc);
+        const iMedia * media  = constMedia_GmDocument(d->doc);
         const size_t   num    = numAudio_Media(media);
         for (size_t id = 1; id <= num; id++) {
             iPlayer *plr = audioPlayer_Media(media, id);
@@ -2080,7 +2192,7 @@ static iRect runRect_DocumentWidget_(const iDocumentWidget *d, const iGmRun *run
 
 static void setGrabbedPlayer_DocumentWidget_(iDocumentWidget *d, const iGmRun *run) {
     if (run && run->mediaType == audio_GmRunMediaType) {
-        iPlayer *plr = audioPlayer_Media(media_GmDocument(d->doc), run->mediaId);
+        iPlayer *plr = audioPlayer_Media(constMedia_GmDocument(d->doc), run->mediaId);
         setFlags_Player(plr, volumeGrabbed_PlayerFlag, iTrue);
         d->grabbedStartVolume = volume_Player(plr);
         d->grabbedPlayer      = run;
@@ -2088,7 +2200,7 @@ static void setGrabbedPlayer_DocumentWidget_(iDocumentWidget *d, const iGmRun *r
     }
     else if (d->grabbedPlayer) {
         setFlags_Player(
-            audioPlayer_Media(media_GmDocument(d->doc), d->grabbedPlayer->mediaId),
+            audioPlayer_Media(constMedia_GmDocument(d->doc), d->grabbedPlayer->mediaId),
             volumeGrabbed_PlayerFlag,
             iFalse);
         d->grabbedPlayer = NULL;
@@ -2120,7 +2232,7 @@ static iBool processMediaEvents_DocumentWidget_(iDocumentWidget *d, const SDL_Ev
             continue;
         }
         const iRect rect = runRect_DocumentWidget_(d, run);
-        iPlayer *   plr  = audioPlayer_Media(media_GmDocument(d->doc), run->mediaId);
+        iPlayer *   plr  = audioPlayer_Media(constMedia_GmDocument(d->doc), run->mediaId);
         if (contains_Rect(rect, mouse)) {
             iPlayerUI ui;
             init_PlayerUI(&ui, plr, rect);
@@ -2147,8 +2259,16 @@ static iBool processMediaEvents_DocumentWidget_(iDocumentWidget *d, const SDL_Ev
             else if (contains_Rect(ui.rewindRect, mouse)) {
                 if (isStarted_Player(plr) && time_Player(plr) > 0.5f) {
                     stop_Player(plr);
-                    start_Player(plr);
-                    setPaused_Player(plr, iTrue);
+                    if (isRestartable_Player(plr)) {
+                        start_Player(plr);
+                        setPaused_Player(plr, iTrue);
+                    }
+                    else {
+                        /* The beginning of the stream has already been dropped. */
+                        refetchMedia_DocumentWidget_(d, run->linkId);
+                        refresh_Widget(d);
+                        return iTrue;
+                    }
                 }
                 refresh_Widget(d);
                 return iTrue;
@@ -2472,7 +2592,7 @@ static iBool processEvent_DocumentWidget_(iDocumentWidget *d, const SDL_Event *e
                     iMediaRequest *mediaReq;
                     if ((mediaReq = findMediaRequest_DocumentWidget_(d, d->contextLink->linkId)) != NULL &&
                         d->contextLink->mediaType != download_GmRunMediaType) {
-                        if (isFinished_GmRequest(mediaReq->req)) {
+                        if (isFinished_GmRequest(mediaReq->req) && !mediaReq->streamedSize) {
                             pushBack_Array(&items,
                                            &(iMenuItem){ download_Icon " Save to Downloads",
                                                          0,
@@ -2539,7 +2659,7 @@ static iBool processEvent_DocumentWidget_(iDocumentWidget *d, const SDL_Event *e
         case drag_ClickResult: {
             if (d->grabbedPlayer) {
                 iPlayer *plr =
-                    audioPlayer_Media(media_GmDocument(d->doc), d->grabbedPlayer->mediaId);
+                    audioPlayer_Media(constMedia_GmDocument(d->doc), d->grabbedPlayer->mediaId);
                 iPlayerUI ui;
                 init_PlayerUI(&ui, plr, runRect_DocumentWidget_(d, d->grabbedPlayer));
                 float off = (float) delta_Click(&d->click).x / (float) width_Rect(ui.volumeSlider);
@@ -2599,10 +2719,14 @@ static iBool processEvent_DocumentWidget_(iDocumentWidget *d, const SDL_Event *e
                                               NULL,
                                               NULL,
                                               allowHide_MediaFlag);
-                                /* Cancel a partially received request. */ {
+                                /* Cancel a partially received request. Streamed audio isn't
+                                   kept either, so it will be fetched again. */ {
                                     iMediaRequest *req = findMediaRequest_DocumentWidget_(d, linkId);
-                                    if (!isFinished_GmRequest(req->req)) {
+                                    const iBool isPartial = !isFinished_GmRequest(req->req);
+                                    if (isPartial) {
                                         cancel_GmRequest(req->req);
+                                    }
+                                    if (isPartial || req->streamedSize) {
                                         removeMediaRequest_DocumentWidget_(d, linkId);
                                         /* Note: Some of the audio IDs have changed now, layout must
                                            be redone. */
@@ -2846,7 +2970,7 @@ static void drawRun_DrawContext_(void *context, const iGmRun *run) {
     iDrawContext *d      = context;
     const iInt2   origin = d->viewPos;
     if (run->mediaType == image_GmRunMediaType) {
-        SDL_Texture *tex = imageTexture_Media(media_GmDocument(d->widget->doc), run->mediaId);
+        SDL_Texture *tex = imageTexture_Media(constMedia_GmDocument(d->widget->doc), run->mediaId);
         const iRect dst = moved_Rect(run->visBounds, origin);
         if (tex) {
             fillRect_Paint(&d->paint, dst, tmBackground_ColorId); /* in case the image has alpha */
@@ -2973,7 +3097,7 @@ static void drawRun_DrawContext_(void *context, const iGmRun *run) {
                           topRight_Rect(linkRect),
                           tmInlineContentMetadata_ColorId,
                           " \u2014 Fetching\u2026 (%.1f MB)",
-                          (float) bodySize_GmRequest(mr->req) / 1.0e6f);
+                          (float) (bodySize_GmRequest(mr->req) + mr->streamedSize) / 1.0e6f);
             }
         }
         else if (isHover) {
@@ -3165,7 +3289,7 @@ static void drawMedia_DocumentWidget_(const iDocumentWidget *d, iPaint *p) {
         if (run->mediaType == audio_GmRunMediaType) {
             iPlayerUI ui;
             init_PlayerUI(&ui,
-                          audioPlayer_Media(media_GmDocument(d->doc), run->mediaId),
+                          audioPlayer_Media(constMedia_GmDocument(d->doc), run->mediaId),
                           runRect_DocumentWidget_(d, run));
             draw_PlayerUI(&ui, p);
         }
@@ -3197,12 +3321,14 @@ static void draw_DocumentWidget_(const iDocumentWidget *d) {
     const iRangei vis  = visibleRange_DocumentWidget_(d);
     const iRangei full = { 0, size_GmDocument(d->doc).y };
     reposition_VisBuf(visBuf, vis);
-    iRangei invalidRange[3];
+    iRangei invalidRange[maxBuffers_VisBuf];
     invalidRanges_VisBuf(visBuf, full, invalidRange);
     /* Redraw the invalid ranges. */ {
         iPaint *p = &ctx.paint;
         init_Paint(p);
-        iForIndices(i, visBuf->buffers) {
+        const uint64_t startTime = SDL_GetPerformanceCounter();
+        int numRedrawn = 0;
+        for (size_t i = 0; i < visBuf->numAllocated; i++) {
             iVisBufTexture *buf = &visBuf->buffers[i];
             ctx.widgetBounds = moved_Rect(ctxWidgetBounds, init_I2(0, -buf->origin));
             ctx.viewPos      = init_I2(left_Rect(docBounds) - left_Rect(bounds), -buf->origin);
@@ -3212,6 +3338,7 @@ static void draw_DocumentWidget_(const iDocumentWidget *d) {
                     fillRect_Paint(p, (iRect){ zero_I2(), visBuf->texSize }, tmBackground_ColorId);
                 }
                 render_GmDocument(d->doc, invalidRange[i], drawRun_DrawContext_, &ctx);
+                numRedrawn += size_Range(&invalidRange[i]);
             }
             /* Draw any invalidated runs that fall within this buffer. */ {
                 const iRangei bufRange = { buf->origin, buf->origin + visBuf->texSize.y };
@@ -3241,6 +3368,34 @@ static void draw_DocumentWidget_(const iDocumentWidget *d) {
         }
         validate_VisBuf(visBuf);
         clear_PtrSet(d->invalidRuns);
+        double elapsed = (double) (SDL_GetPerformanceCounter() - startTime) /
+                         (double) SDL_GetPerformanceFrequency();
+        addRedrawCost_VisBuf(visBuf, numRedrawn, elapsed);
+        /* Draw ahead in the scroll direction if there is time left in this frame. Link numbers
+           only apply to the visible links. */
+        iRangei prefetchRange;
+        iVisBufTexture *buf;
+        if (!ctx.showLinkNumbers && !isLayoutPending_GmDocument(d->doc) &&
+            (buf = prefetch_VisBuf(visBuf, full, prefetchRows_VisBuf(visBuf, elapsed),
+                                   &prefetchRange)) != NULL) {
+            const uint64_t prefetchStart = SDL_GetPerformanceCounter();
+            ctx.widgetBounds = moved_Rect(ctxWidgetBounds, init_I2(0, -buf->origin));
+            ctx.viewPos      = init_I2(left_Rect(docBounds) - left_Rect(bounds), -buf->origin);
+            beginTarget_Paint(p, buf->texture);
+            fillRect_Paint(p,
+                           init_Rect(0,
+                                     prefetchRange.start - buf->origin,
+                                     visBuf->texSize.x,
+                                     size_Range(&prefetchRange)),
+                           tmBackground_ColorId);
+            render_GmDocument(d->doc, prefetchRange, drawRun_DrawContext_, &ctx);
+            endTarget_Paint(p);
+            addRedrawCost_VisBuf(visBuf,
+                                 size_Range(&prefetchRange),
+                                 (double) (SDL_GetPerformanceCounter() - prefetchStart) /
+                                     (double) SDL_GetPerformanceFrequency());
+            refresh_Widget(w); /* continue in the next frame */
+        }
     }
     setClip_Paint(&ctx.paint, bounds);
     const int yTop = docBounds.pos.y - value_Anim(&d->scrollY);
@@ -3405,3 +3560,40 @@ iBeginDefineSubclass(DocumentWidget, Widget)
     .processEvent = (iAny *) processEvent_DocumentWidget_,
     .draw         = (iAny *) draw_DocumentWidget_,
 iEndDefineSubclass(DocumentWidget)
+
+size_t discardableSize_DocumentWidget(const iDocumentWidget *d) {
+    if (d->flags & (current_DocumentWidgetFlag | layoutDiscarded_DocumentWidgetFlag) ||
+        d->state != ready_RequestState || d == document_App()) {
+        return 0;
+    }
+    const iMedia *media = constMedia_GmDocument(d->doc);
+    if (numAudio_Media(media)) {
+        return 0; /* may be playing */
+    }
+    /* Only the cached response of the current page can be used for restoring it. The
+       response shares its data with the document source, so the source is not discarded. */
+    const iRecentUrl *recent = findUrl_History(d->mod.history, d->mod.url);
+    if (!recent || !recent->cachedResponse) {
+        return 0;
+    }
+    return memorySize_GmDocument(d->doc) - size_String(source_GmDocument(d->doc)) +
+           memorySize_Media(media);
+}
+
+double hiddenSeconds_DocumentWidget(const iDocumentWidget *d) {
+    return d->flags & current_DocumentWidgetFlag ? 0.0 : elapsedSeconds_Time(&d->lastShown);
+}
+
+void discardLayout_DocumentWidget(iDocumentWidget *d) {
+    if (!discardableSize_DocumentWidget(d)) {
+        return;
+    }
+    clear_ObjectList(d->media);
+    reset_GmDocument(d->doc); /* the source is kept */
+    d->grabbedPlayer   = NULL;
+    d->hoverLink       = NULL;
+    d->contextLink     = NULL;
+    d->firstVisibleRun = NULL;
+    d->lastVisibleRun  = NULL;
+    d->flags |= layoutDiscarded_DocumentWidgetFlag;
+}
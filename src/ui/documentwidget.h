@@ -51,3 +51,9 @@ void    setInitialScroll_DocumentWidget (iDocumentWidget *, float normScrollY);
 void    setRedirectCount_DocumentWidget (iDocumentWidget *, int count);
 
 void    updateSize_DocumentWidget       (iDocumentWidget *);
+
+/* Memory budget: the layout and decoded images of a background tab can be discarded. They
+   are restored from the cached response when the tab is shown again. */
+size_t  discardableSize_DocumentWidget  (const iDocumentWidget *); /* zero if not possible */
+double  hiddenSeconds_DocumentWidget    (const iDocumentWidget *);
+void    discardLayout_DocumentWidget    (iDocumentWidget *);
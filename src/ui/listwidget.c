@@ -46,12 +46,24 @@ iDefineClass(ListItem)
 
 iDefineObjectConstruction(ListWidget)
 
+iDeclareType(PooledItem)
+
+struct Impl_PooledItem {
+    size_t   index;
+    uint32_t lastUsed;
+};
+
 struct Impl_ListWidget {
     iWidget widget;
     iScrollWidget *scroll;
     int scrollY;
     int itemHeight;
     iPtrArray items;
+    iListItemSource source; /* items are provided by the source if it has a count function */
+    size_t sourceCount;
+    iPtrArray pool;         /* reused item objects for the source */
+    iArray poolItems;       /* PooledItems, matching `pool` */
+    uint32_t poolCounter;
     size_t hoverItem;
     iClick click;
     iIntSet invalidItems;
@@ -69,6 +81,11 @@ void init_ListWidget(iListWidget *d) {
     d->scrollY = 0;
     d->itemHeight = 0;
     init_PtrArray(&d->items);
+    iZap(d->source);
+    d->sourceCount = 0;
+    init_PtrArray(&d->pool);
+    init_Array(&d->poolItems, sizeof(iPooledItem));
+    d->poolCounter = 0;
     d->hoverItem = iInvalidPos;
     init_Click(&d->click, d, SDL_BUTTON_LEFT);
     init_IntSet(&d->invalidItems);
@@ -77,6 +94,8 @@ void init_ListWidget(iListWidget *d) {
 
 void deinit_ListWidget(iListWidget *d) {
     clear_ListWidget(d);
+    deinit_Array(&d->poolItems);
+    deinit_PtrArray(&d->pool);
     deinit_PtrArray(&d->items);
     delete_VisBuf(d->visBuf);
 }
@@ -92,34 +111,90 @@ void invalidateItem_ListWidget(iListWidget *d, size_t index) {
     refresh_Widget(d);
 }
 
+static iBool hasSource_ListWidget_(const iListWidget *d) {
+    return d->source.count != NULL;
+}
+
+static void clearPool_ListWidget_(iListWidget *d) {
+    iForEach(PtrArray, i, &d->pool) {
+        deref_Object(i.ptr);
+    }
+    clear_PtrArray(&d->pool);
+    clear_Array(&d->poolItems);
+}
+
 void clear_ListWidget(iListWidget *d) {
     iForEach(PtrArray, i, &d->items) {
         deref_Object(i.ptr);
     }
     clear_PtrArray(&d->items);
+    clearPool_ListWidget_(d);
+    iZap(d->source);
+    d->sourceCount = 0;
     d->hoverItem = iInvalidPos;
 }
 
 void addItem_ListWidget(iListWidget *d, iAnyObject *item) {
+    iAssert(!hasSource_ListWidget_(d));
     pushBack_PtrArray(&d->items, ref_Object(item));
 }
 
+void setSource_ListWidget(iListWidget *d, const iListItemSource *source) {
+    clear_ListWidget(d);
+    if (source) {
+        d->source      = *source;
+        d->sourceCount = source->count(source->context);
+    }
+}
+
+static iAnyObject *sourceItem_ListWidget_(iListWidget *d, size_t index) {
+    /* Enough items are kept for the visible ones and a few others, like the one under the
+       mouse or the cursor. The least recently used item is updated to show a new index. */
+    const size_t maxPooled = 2 * (height_Rect(innerBounds_Widget(as_Widget(d))) /
+                                  iMax(1, d->itemHeight)) + 16;
+    size_t oldest = iInvalidPos;
+    for (size_t i = 0; i < size_Array(&d->poolItems); i++) {
+        iPooledItem *pooled = at_Array(&d->poolItems, i);
+        if (pooled->index == index) {
+            pooled->lastUsed = ++d->poolCounter;
+            return at_PtrArray(&d->pool, i);
+        }
+        if (oldest == iInvalidPos ||
+            pooled->lastUsed < ((const iPooledItem *) at_Array(&d->poolItems, oldest))->lastUsed) {
+            oldest = i;
+        }
+    }
+    if (oldest == iInvalidPos || size_PtrArray(&d->pool) < maxPooled) {
+        pushBack_PtrArray(&d->pool, d->source.newItem(d->source.context));
+        pushBack_Array(&d->poolItems, &(iPooledItem){ iInvalidPos, 0 });
+        oldest = size_PtrArray(&d->pool) - 1;
+    }
+    iPooledItem *pooled = at_Array(&d->poolItems, oldest);
+    iListItem *  item   = at_PtrArray(&d->pool, oldest);
+    pooled->index    = index;
+    pooled->lastUsed = ++d->poolCounter;
+    item->isSeparator = iFalse;
+    item->isSelected  = iFalse;
+    d->source.updateItem(d->source.context, index, item);
+    return item;
+}
+
 iScrollWidget *scroll_ListWidget(iListWidget *d) {
     return d->scroll;
 }
 
 size_t numItems_ListWidget(const iListWidget *d) {
-    return size_PtrArray(&d->items);
+    return hasSource_ListWidget_(d) ? d->sourceCount : size_PtrArray(&d->items);
 }
 
 static int scrollMax_ListWidget_(const iListWidget *d) {
     return iMax(0,
-                (int) size_PtrArray(&d->items) * d->itemHeight -
+                (int) numItems_ListWidget(d) * d->itemHeight -
                     height_Rect(innerBounds_Widget(constAs_Widget(d))));
 }
 
 void updateVisible_ListWidget(iListWidget *d) {
-    const int   contentSize = size_PtrArray(&d->items) * d->itemHeight;
+    const int   contentSize = numItems_ListWidget(d) * d->itemHeight;
     const iRect bounds      = innerBounds_Widget(as_Widget(d));
     const iBool wasVisible  = isVisible_Widget(d->scroll);
     if (area_Rect(bounds) == 0) {
@@ -196,7 +271,7 @@ void scrollToItem_ListWidget(iListWidget *d, size_t index) {
 
 int visCount_ListWidget(const iListWidget *d) {
     return iMin(height_Rect(innerBounds_Widget(constAs_Widget(d))) / d->itemHeight,
-                (int) size_PtrArray(&d->items));
+                (int) numItems_ListWidget(d));
 }
 
 static iRanges visRange_ListWidget_(const iListWidget *d) {
@@ -204,7 +279,7 @@ static iRanges visRange_ListWidget_(const iListWidget *d) {
         return (iRanges){ 0, 0 };
     }
     iRanges vis = { d->scrollY / d->itemHeight, 0 };
-    vis.end = iMin(size_PtrArray(&d->items), vis.start + visCount_ListWidget(d) + 1);
+    vis.end = iMin(numItems_ListWidget(d), vis.start + visCount_ListWidget(d) + 1);
     return vis;
 }
 
@@ -213,15 +288,12 @@ size_t itemIndex_ListWidget(const iListWidget *d, iInt2 pos) {
     pos.y -= top_Rect(bounds) - d->scrollY;
     if (pos.y < 0 || !d->itemHeight) return iInvalidPos;
     size_t index = pos.y / d->itemHeight;
-    if (index >= size_Array(&d->items)) return iInvalidPos;
+    if (index >= numItems_ListWidget(d)) return iInvalidPos;
     return index;
 }
 
 const iAnyObject *constItem_ListWidget(const iListWidget *d, size_t index) {
-    if (index < size_PtrArray(&d->items)) {
-        return constAt_PtrArray(&d->items, index);
-    }
-    return NULL;
+    return item_ListWidget(iConstCast(iListWidget *, d), index);
 }
 
 const iAnyObject *constHoverItem_ListWidget(const iListWidget *d) {
@@ -229,8 +301,9 @@ const iAnyObject *constHoverItem_ListWidget(const iListWidget *d) {
 }
 
 iAnyObject *item_ListWidget(iListWidget *d, size_t index) {
-    if (index < size_PtrArray(&d->items)) {
-        return at_PtrArray(&d->items, index);
+    if (index < numItems_ListWidget(d)) {
+        return hasSource_ListWidget_(d) ? sourceItem_ListWidget_(d, index)
+                                        : at_PtrArray(&d->items, index);
     }
     return NULL;
 }
@@ -244,8 +317,8 @@ size_t hoverItemIndex_ListWidget(const iListWidget *d) {
 }
 
 static void setHoverItem_ListWidget_(iListWidget *d, size_t index) {
-    if (index < size_PtrArray(&d->items)) {
-        const iListItem *item = at_PtrArray(&d->items, index);
+    if (index < numItems_ListWidget(d)) {
+        const iListItem *item = item_ListWidget(d, index);
         if (item->isSeparator) {
             index = iInvalidPos;
         }
@@ -264,6 +337,7 @@ void updateMouseHover_ListWidget(iListWidget *d) {
 }
 
 void sort_ListWidget(iListWidget *d, int (*cmp)(const iListItem **item1, const iListItem **item2)) {
+    iAssert(!hasSource_ListWidget_(d));
     sort_Array(&d->items, (iSortedArrayCompareElemFunc) cmp);
 }
 
@@ -341,10 +415,6 @@ static void drawItem_ListWidget_(const iListWidget *d, iPaint *p, size_t index,
 }
 #endif
 
-static const iListItem *item_ListWidget_(const iListWidget *d, size_t pos) {
-    return constAt_PtrArray(&d->items, pos);
-}
-
 static void draw_ListWidget_(const iListWidget *d) {
     const iWidget *w      = constAs_Widget(d);
     const iRect    bounds = innerBounds_Widget(w);
@@ -356,28 +426,22 @@ static void draw_ListWidget_(const iListWidget *d) {
     drawBackground_Widget(w);
     alloc_VisBuf(d->visBuf, bounds.size, d->itemHeight);
     /* Update invalid regions/items. */ {
-        /* TODO: This seems to draw two items per each shift of the visible region, even though
-           one should be enough. Probably an off-by-one error in the calculation of the
-           invalid range. */
-        iAssert(d->visBuf->buffers[0].texture);
-        iAssert(d->visBuf->buffers[1].texture);
-        iAssert(d->visBuf->buffers[2].texture);
-        const int bg[3] = { w->bgColor, w->bgColor, w->bgColor };
-//        const int bg[3] = { red_ColorId, magenta_ColorId, blue_ColorId };
+        iAssert(d->visBuf->numAllocated >= minBuffers_VisBuf);
+        const int bg = w->bgColor;
         const int bottom = numItems_ListWidget(d) * d->itemHeight;
         const iRangei vis = { d->scrollY / d->itemHeight * d->itemHeight,
                              ((d->scrollY + bounds.size.y) / d->itemHeight + 1) * d->itemHeight };
         reposition_VisBuf(d->visBuf, vis);
         /* Check which parts are invalid. */
-        iRangei invalidRange[3];
+        iRangei invalidRange[maxBuffers_VisBuf];
         invalidRanges_VisBuf(d->visBuf, (iRangei){ 0, bottom }, invalidRange);
-        iForIndices(i, d->visBuf->buffers) {
+        for (size_t i = 0; i < d->visBuf->numAllocated; i++) {
             iVisBufTexture *buf = &d->visBuf->buffers[i];
             iRanges drawItems = { iMax(0, buf->origin) / d->itemHeight,
                                   iMax(0, buf->origin + d->visBuf->texSize.y) / d->itemHeight };
             if (isEmpty_Rangei(buf->validRange)) {
                 beginTarget_Paint(&p, buf->texture);
-                fillRect_Paint(&p, (iRect){ zero_I2(), d->visBuf->texSize }, bg[i]);
+                fillRect_Paint(&p, (iRect){ zero_I2(), d->visBuf->texSize }, bg);
             }
             const iRect sbBlankRect =
                 { init_I2(d->visBuf->texSize.x - scrollBarWidth_ListWidget(d), 0),
@@ -385,27 +449,27 @@ static void draw_ListWidget_(const iListWidget *d) {
             iConstForEach(IntSet, v, &d->invalidItems) {
                 const size_t index = *v.value;
                 if (contains_Range(&drawItems, index)) {
-                    const iListItem *item = constAt_PtrArray(&d->items, index);
+                    const iListItem *item = constItem_ListWidget(d, index);
                     const iRect      itemRect = { init_I2(0, index * d->itemHeight - buf->origin),
                                                   init_I2(d->visBuf->texSize.x, d->itemHeight) };
                     beginTarget_Paint(&p, buf->texture);
-                    fillRect_Paint(&p, itemRect, bg[i]);
+                    fillRect_Paint(&p, itemRect, bg);
                     class_ListItem(item)->draw(item, &p, itemRect, d);
-                    fillRect_Paint(&p, moved_Rect(sbBlankRect, init_I2(0, top_Rect(itemRect))), bg[i]);
+                    fillRect_Paint(&p, moved_Rect(sbBlankRect, init_I2(0, top_Rect(itemRect))), bg);
                 }
             }
             /* Visible range is not fully covered. Fill in the new items. */
             if (!isEmpty_Rangei(invalidRange[i])) {
                 beginTarget_Paint(&p, buf->texture);
                 drawItems.start = invalidRange[i].start / d->itemHeight;
-                drawItems.end   = invalidRange[i].end   / d->itemHeight + 1;
-                for (size_t j = drawItems.start; j < drawItems.end && j < size_PtrArray(&d->items); j++) {
-                    const iListItem *item     = constAt_PtrArray(&d->items, j);
+                drawItems.end   = (invalidRange[i].end + d->itemHeight - 1) / d->itemHeight;
+                for (size_t j = drawItems.start; j < drawItems.end && j < numItems_ListWidget(d); j++) {
+                    const iListItem *item     = constItem_ListWidget(d, j);
                     const iRect      itemRect = { init_I2(0, j * d->itemHeight - buf->origin),
                                                   init_I2(d->visBuf->texSize.x, d->itemHeight) };
-                    fillRect_Paint(&p, itemRect, bg[i]);
+                    fillRect_Paint(&p, itemRect, bg);
                     class_ListItem(item)->draw(item, &p, itemRect, d);
-                    fillRect_Paint(&p, moved_Rect(sbBlankRect, init_I2(0, top_Rect(itemRect))), bg[i]);
+                    fillRect_Paint(&p, moved_Rect(sbBlankRect, init_I2(0, top_Rect(itemRect))), bg);
                 }
             }
             endTarget_Paint(&p);
@@ -43,6 +43,18 @@ struct Impl_ListItem {
 
 iDeclareObjectConstruction(ListItem)
 
+/* Provides the items of a large list on demand. The list only keeps a small number of item
+   objects, which are updated to show whichever items are currently needed. */
+
+iDeclareType(ListItemSource)
+
+struct Impl_ListItemSource {
+    void *      context;
+    size_t      (*count)     (void *context);
+    iAnyObject *(*newItem)   (void *context);
+    void        (*updateItem)(void *context, size_t index, iAnyObject *item);
+};
+
 iDeclareWidgetClass(ListWidget)
 iDeclareObjectConstruction(ListWidget)
 
@@ -52,6 +64,7 @@ void    invalidate_ListWidget       (iListWidget *);
 void    invalidateItem_ListWidget   (iListWidget *, size_t index);
 void    clear_ListWidget            (iListWidget *);
 void    addItem_ListWidget          (iListWidget *, iAnyObject *item);
+void    setSource_ListWidget        (iListWidget *, const iListItemSource *source); /* replaces items */
 
 iScrollWidget * scroll_ListWidget   (iListWidget *);
 
@@ -29,10 +29,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "feeds.h"
 #include "gmcerts.h"
 #include "gmutil.h"
-#include "history.h"
 #include "inputwidget.h"
 #include "listwidget.h"
 #include "lookup.h"
+#include "persist.h"
+#include "searchindex.h"
 #include "util.h"
 #include "visited.h"
 
@@ -40,23 +41,31 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #   include "../ios.h"
 #endif
 
+#include <the_Foundation/buffer.h>
+#include <the_Foundation/file.h>
 #include <the_Foundation/mutex.h>
+#include <the_Foundation/path.h>
 #include <the_Foundation/thread.h>
 #include <the_Foundation/regexp.h>
 
+static const char *fileName_LookupWidget_           = "lookup.bin";
+static const int   saveIntervalSeconds_LookupWidget_ = 5 * 60;
+
 iDeclareType(LookupJob)
 
 struct Impl_LookupJob {
     iRegExp *term;
+    iString terms; /* as entered */
     iTime now;
-    iObjectList *docs;
+    iAtomicInt *isCancelled;
     iPtrArray results;
 };
 
 static void init_LookupJob(iLookupJob *d) {
     d->term = NULL;
+    init_String(&d->terms);
+    d->isCancelled = NULL;
     initCurrent_Time(&d->now);
-    d->docs = NULL;
     init_PtrArray(&d->results);
 }
 
@@ -65,12 +74,16 @@ static void deinit_LookupJob(iLookupJob *d) {
         delete_LookupResult(i.ptr);
     }
     deinit_PtrArray(&d->results);
-    iRelease(d->docs);
+    deinit_String(&d->terms);
     iRelease(d->term);
 }
 
 iDefineTypeConstruction(LookupJob)
 
+static iBool isCancelled_LookupJob_(const iLookupJob *d) {
+    return value_Atomic(d->isCancelled) != 0;
+}
+
 /*----------------------------------------------------------------------------------------------*/
 
 iDeclareType(LookupItem)
@@ -145,6 +158,19 @@ iDefineObjectConstructionArgs(LookupItem, (const iLookupResult *res), res)
 
 /*----------------------------------------------------------------------------------------------*/
 
+iDeclareType(LookupSection)
+
+struct Impl_LookupSection {
+    enum iLookupResultType type;
+    iLookupIndex *         current; /* all items of the type, not indexed */
+};
+
+static int sectionBit_(enum iLookupResultType type) {
+    return 1 << type;
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
 struct Impl_LookupWidget {
     iWidget      widget;
     iListWidget *list;
@@ -153,8 +179,19 @@ struct Impl_LookupWidget {
     iCondition   jobAvailable; /* wakes up the work thread */
     iMutex *     mtx;
     iString      pendingTerm;
-    iObjectList *pendingDocs;
+    iArray       pendingSections; /* LookupSections for the work thread to apply */
+    int          staleSections; /* section bits; copied again before the next lookup */
+    iBool        isQuitting;
+    iAtomicInt   isCancelled; /* a newer term makes the running job obsolete */
     iLookupJob * finishedJob;
+    iString      savePath;
+    /* Only accessed in the work thread: */
+    iLookupIndex *index; /* kept up to date and saved, so it isn't rebuilt from scratch */
+    uint32_t     historyGeneration; /* of the visited URLs in the index */
+    iBool        isIndexModified;
+    iTime        lastSaved;
+    iString      prevTerm;
+    iArray       prevMatches; /* entry IDs */
 };
 
 static float scoreMatch_(const iRegExp *pattern, iRangecc text) {
@@ -168,159 +205,243 @@ static float scoreMatch_(const iRegExp *pattern, iRangecc text) {
     return score;
 }
 
-static float bookmarkRelevance_LookupJob_(const iLookupJob *d, const iBookmark *bm) {
-    iUrl parts;
-    init_Url(&parts, &bm->url);
-    const float t = scoreMatch_(d->term, range_String(&bm->title));
-    const float h = scoreMatch_(d->term, parts.host);
-    const float p = scoreMatch_(d->term, parts.path);
-    const float g = scoreMatch_(d->term, range_String(&bm->tags));
-    return h + iMax(p, t) + 2 * g; /* extra weight for tags */
-}
-
-static float feedEntryRelevance_LookupJob_(const iLookupJob *d, const iFeedEntry *entry) {
-    iUrl parts;
-    init_Url(&parts, &entry->url);
-    const float t = scoreMatch_(d->term, range_String(&entry->title));
-    const float h = scoreMatch_(d->term, parts.host);
-    const float p = scoreMatch_(d->term, parts.path);
-    const double age = secondsSince_Time(&d->now, &entry->posted) / 3600.0 / 24.0; /* days */
-    return (t * 3 + h + p) / (age + 1); /* extra weight for title, recency */
+static float relevance_LookupJob_(const iLookupJob *d, const iLookupEntry *entry) {
+    switch (entry->result.type) {
+        case bookmark_LookupResultType: {
+            const float t = scoreMatch_(d->term, range_String(&entry->title));
+            const float h = scoreMatch_(d->term, entry->host);
+            const float p = scoreMatch_(d->term, entry->path);
+            const float g = scoreMatch_(d->term, range_String(&entry->extra));
+            return h + iMax(p, t) + 2 * g; /* extra weight for tags */
+        }
+        case feedEntry_LookupResultType: {
+            const float t = scoreMatch_(d->term, range_String(&entry->title));
+            const float h = scoreMatch_(d->term, entry->host);
+            const float p = scoreMatch_(d->term, entry->path);
+            const double age = secondsSince_Time(&d->now, &entry->result.when) / 3600.0 / 24.0; /* days */
+            return (t * 3 + h + p) / (age + 1); /* extra weight for title, recency */
+        }
+        case history_LookupResultType: {
+            const float h = scoreMatch_(d->term, entry->host);
+            const float p = scoreMatch_(d->term, entry->path);
+            const double age = secondsSince_Time(&d->now, &entry->result.when) / 3600.0 / 24.0; /* days */
+            return iMax(h, p) / (age + 1); /* extra weight for recency */
+        }
+        case identity_LookupResultType: {
+            const float c = scoreMatch_(d->term, range_String(&entry->title));
+            const float n = scoreMatch_(d->term, range_String(&entry->extra));
+            return c + 2 * n; /* extra weight for notes */
+        }
+        default:
+            return 0.0f;
+    }
 }
 
-static float identityRelevance_LookupJob_(const iLookupJob *d, const iGmIdentity *identity) {
-    iString *cn = subject_TlsCertificate(identity->cert);
-    const float c = scoreMatch_(d->term, range_String(cn));
-    const float n = scoreMatch_(d->term, range_String(&identity->notes));
-    delete_String(cn);
-    return c + 2 * n; /* extra weight for notes */
+static iLookupIndex *newSection_LookupWidget_(enum iLookupResultType type) {
+    /* Note: Called in the main thread. Everything is copied so the work thread doesn't need
+       to access the bookmarks, feeds, or identities while they may change. This is only done
+       when the data has changed. */
+    iLookupIndex *section = new_LookupIndex();
+    iLookupResult res;
+    init_LookupResult(&res);
+    res.type = type;
+    if (type == bookmark_LookupResultType) {
+        iConstForEach(PtrArray, i, list_Bookmarks(bookmarks_App(), NULL, NULL, NULL)) {
+            const iBookmark *bm = i.ptr;
+            res.when = bm->when;
+            res.icon = bm->icon;
+            set_String(&res.label, &bm->title);
+            set_String(&res.url, &bm->url);
+            clear_String(&res.meta);
+            add_LookupIndex(section, &res, &bm->title, &bm->tags);
+        }
+    }
+    else if (type == feedEntry_LookupResultType) {
+        iConstForEach(PtrArray, j, listEntries_Feeds()) {
+            const iFeedEntry *entry = j.ptr;
+            const iBookmark *bm = get_Bookmarks(bookmarks_App(), entry->bookmarkId);
+            if (!bm) {
+                continue;
+            }
+            res.when = entry->posted;
+            res.icon = bm->icon;
+            set_String(&res.label, &entry->title);
+            set_String(&res.url, &entry->url);
+            set_String(&res.meta, &bm->title);
+            add_LookupIndex(section, &res, &entry->title, NULL);
+        }
+    }
+    else if (type == identity_LookupResultType) {
+        iConstForEach(PtrArray, m, listIdentities_GmCerts(certs_App(), NULL, NULL)) {
+            const iGmIdentity *identity = m.ptr;
+            iString *cn = subject_TlsCertificate(identity->cert);
+            iZap(res.when);
+            res.icon = identity->icon;
+            set_String(&res.label, cn);
+            clear_String(&res.url);
+            set_String(&res.meta,
+                       collect_String(hexEncode_Block(
+                           collect_Block(fingerprint_TlsCertificate(identity->cert)))));
+            add_LookupIndex(section, &res, cn, &identity->notes);
+            delete_String(cn);
+        }
+    }
+    deinit_LookupResult(&res);
+    return section;
 }
 
-static float visitedRelevance_LookupJob_(const iLookupJob *d, const iVisitedUrl *vis) {
-    iUrl parts;
-    init_Url(&parts, &vis->url);
-    const float h = scoreMatch_(d->term, parts.host);
-    const float p = scoreMatch_(d->term, parts.path);
-    const double age = secondsSince_Time(&d->now, &vis->when) / 3600.0 / 24.0; /* days */
-    return iMax(h, p) / (age + 1); /* extra weight for recency */
+static void addVisited_LookupWidget_(void *context, const iVisitedUrl *vis) {
+    /* Note: Called in the work thread, with the visited URLs locked. */
+    if (vis->flags & transient_VisitedUrlFlag) {
+        return;
+    }
+    iLookupResult res;
+    init_LookupResult(&res);
+    res.type = history_LookupResultType;
+    res.when = vis->when;
+    set_String(&res.label, &vis->url);
+    set_String(&res.url, &vis->url);
+    add_LookupIndex(context, &res, NULL, NULL);
+    deinit_LookupResult(&res);
 }
 
-static iBool matchBookmark_LookupJob_(void *context, const iBookmark *bm) {
-    return bookmarkRelevance_LookupJob_(context, bm) > 0;
+static void loadIndex_LookupWidget_(iLookupWidget *d) {
+    /* Note: Called in the work thread. */
+    iFile *f = new_File(&d->savePath);
+    if (open_File(f, readOnly_FileMode)) {
+        iBuffer *buf = new_Buffer();
+        open_Buffer(buf, collect_Block(readAll_File(f)));
+        deserialize_LookupIndex(d->index, stream_Buffer(buf));
+        iRelease(buf);
+    }
+    iRelease(f);
+    initCurrent_Time(&d->lastSaved);
 }
 
-static iBool matchIdentity_LookupJob_(void *context, const iGmIdentity *identity) {
-    return identityRelevance_LookupJob_(context, identity) > 0;
+static void saveIndex_LookupWidget_(iLookupWidget *d) {
+    /* Note: Called in the work thread, or after it has stopped. The data is serialized here
+       because the index keeps changing while the file is being written. */
+    iBuffer *buf = new_Buffer();
+    openEmpty_Buffer(buf);
+    serialize_LookupIndex(d->index, stream_Buffer(buf));
+    writeBlock_Persist("lookup", cstr_String(&d->savePath), copy_Block(data_Buffer(buf)));
+    iRelease(buf);
+    d->isIndexModified = iFalse;
+    initCurrent_Time(&d->lastSaved);
 }
 
-static void searchBookmarks_LookupJob_(iLookupJob *d) {
-    /* Note: Called in a background thread. */
-    /* TODO: Thread safety! What if a bookmark gets deleted while its being accessed here? */
-    iConstForEach(PtrArray, i, list_Bookmarks(bookmarks_App(), NULL, matchBookmark_LookupJob_, d)) {
-        const iBookmark *bm  = i.ptr;
-        iLookupResult *  res = new_LookupResult();
-        res->type            = bookmark_LookupResultType;
-        res->when            = bm->when;
-        res->relevance       = bookmarkRelevance_LookupJob_(d, bm);
-        res->icon            = bm->icon;
-        set_String(&res->label, &bm->title);
-        set_String(&res->url, &bm->url);
-        pushBack_PtrArray(&d->results, res);
+static void updateIndex_LookupWidget_(iLookupWidget *d, iArray *sections) {
+    /* Note: Called in the work thread. Only the entries that have changed are indexed. */
+    iBool isChanged = iFalse;
+    iForEach(Array, i, sections) {
+        iLookupSection *sect = i.value;
+        isChanged |= update_LookupIndex(d->index, sect->type, sect->current);
+        delete_LookupIndex(sect->current);
     }
-}
-
-static void searchFeeds_LookupJob_(iLookupJob *d) {
-    iConstForEach(PtrArray, i, listEntries_Feeds()) {
-        const iFeedEntry *entry = i.ptr;
-        const iBookmark *bm = get_Bookmarks(bookmarks_App(), entry->bookmarkId);
-        if (!bm) {
-            continue;
-        }
-        const float relevance = feedEntryRelevance_LookupJob_(d, entry);
-        if (relevance > 0) {
-            iLookupResult *res = new_LookupResult();
-            res->type          = feedEntry_LookupResultType;
-            res->when          = entry->posted;
-            res->relevance     = relevance;
-            set_String(&res->url, &entry->url);
-            set_String(&res->meta, &bm->title);
-            set_String(&res->label, &entry->title);
-            res->icon = bm->icon;
-            pushBack_PtrArray(&d->results, res);
-        }
+    clear_Array(sections);
+    /* History changes with every page that is opened, so instead of waiting for a
+       notification it is checked before each lookup. */
+    const uint32_t historyGen = generation_Visited(visited_App());
+    if (historyGen != d->historyGeneration) {
+        iLookupIndex *history = new_LookupIndex();
+        forEach_Visited(visited_App(), addVisited_LookupWidget_, history);
+        isChanged |= update_LookupIndex(d->index, history_LookupResultType, history);
+        delete_LookupIndex(history);
+        d->historyGeneration = historyGen;
+    }
+    if (isChanged) {
+        /* The IDs of the previous matches may no longer be valid. */
+        clear_String(&d->prevTerm);
+        clear_Array(&d->prevMatches);
+        d->isIndexModified = iTrue;
+    }
+    if (d->isIndexModified &&
+        elapsedSeconds_Time(&d->lastSaved) >= saveIntervalSeconds_LookupWidget_) {
+        saveIndex_LookupWidget_(d);
     }
 }
 
-static void searchVisited_LookupJob_(iLookupJob *d) {
-    /* Note: Called in a background thread. */
-    /* TODO: Thread safety! Visited URLs may be deleted while being accessed here. */
-    iConstForEach(PtrArray, i, list_Visited(visited_App(), 0)) {
-        const iVisitedUrl *vis = i.ptr;
-        const float relevance = visitedRelevance_LookupJob_(d, vis);
+static iBool search_LookupWidget_(iLookupWidget *d, iLookupJob *job) {
+    /* Note: Called in the work thread. */
+    iArray candidates;
+    init_Array(&candidates, sizeof(uint32_t));
+    /* If the term was extended, only the previous matches may still match. */
+    const iBool isNarrowed = !isEmpty_String(&d->prevTerm) &&
+                             startsWith_String(&job->terms, cstr_String(&d->prevTerm));
+    match_LookupIndex(d->index, &job->terms, isNarrowed ? &d->prevMatches : NULL, &candidates);
+    clear_String(&d->prevTerm);
+    clear_Array(&d->prevMatches);
+    size_t counter = 0;
+    iConstForEach(Array, i, &candidates) {
+        if (++counter % 256 == 0 && isCancelled_LookupJob_(job)) {
+            break;
+        }
+        const uint32_t      id    = *(const uint32_t *) i.value;
+        const iLookupEntry *entry = entry_LookupIndex(d->index, id);
+        const float relevance = relevance_LookupJob_(job, entry);
         if (relevance > 0) {
-            iLookupResult *res = new_LookupResult();
-            res->type = history_LookupResultType;
+            iLookupResult *res = copy_LookupResult(&entry->result);
             res->relevance = relevance;
-            set_String(&res->label, &vis->url);
-            set_String(&res->url, &vis->url);
-            res->when = vis->when;
-            pushBack_PtrArray(&d->results, res);
+            pushBack_PtrArray(&job->results, res);
+            pushBack_Array(&d->prevMatches, &id);
         }
     }
-}
-
-static void searchHistory_LookupJob_(iLookupJob *d) {
-    /* Note: Called in a background thread. */
-    size_t index = 0;
-    iForEach(ObjectList, i, d->docs) {
-        iConstForEach(StringArray, j,
-                      searchContents_History(history_DocumentWidget(i.object), d->term)) {
-            const char *match = cstr_String(j.value);
-            const size_t matchLen = argLabel_Command(match, "len");
-            iRangecc text;
-            text.start = strstr(match, " str:") + 5;
-            text.end = text.start + matchLen;
-            const char *url = strstr(text.end, " url:") + 5;
-            iLookupResult *res = new_LookupResult();
-            res->type = content_LookupResultType;
-            res->relevance = ++index; /* most recent comes last */
-            setCStr_String(&res->label, "\"");
-            appendRange_String(&res->label, text);
-            appendCStr_String(&res->label, "\"");
-            setCStr_String(&res->url, url);
-            pushBack_PtrArray(&d->results, res);
-        }
+    deinit_Array(&candidates);
+    if (isCancelled_LookupJob_(job)) {
+        clear_Array(&d->prevMatches);
+        return iFalse;
     }
+    set_String(&d->prevTerm, &job->terms);
+    return iTrue;
 }
 
-static void searchIdentities_LookupJob_(iLookupJob *d) {
+static void searchContents_LookupJob_(iLookupJob *d) {
     /* Note: Called in a background thread. */
-    iConstForEach(PtrArray, i, listIdentities_GmCerts(certs_App(), matchIdentity_LookupJob_, d)) {
-        const iGmIdentity *identity = i.ptr;
+    const size_t maxHits = 50;
+    iPtrArray *hits = query_SearchIndex(searchIndex_App(), &d->terms, maxHits);
+    size_t index = 0;
+    iForEach(PtrArray, i, hits) {
+        iSearchHit *hit = i.ptr;
         iLookupResult *res = new_LookupResult();
-        res->type = identity_LookupResultType;
-        res->relevance = identityRelevance_LookupJob_(d, identity);
-        res->icon = identity->icon;
-        iString *cn = subject_TlsCertificate(identity->cert);
-        set_String(&res->label, cn);
-        delete_String(cn);
-        set_String(&res->meta,
-                   collect_String(
-                       hexEncode_Block(collect_Block(fingerprint_TlsCertificate(identity->cert)))));
+        res->type = content_LookupResultType;
+        res->relevance = size_PtrArray(hits) - index++; /* most recent first */
+        res->when = hit->when;
+        setCStr_String(&res->label, "\"");
+        append_String(&res->label, isEmpty_String(&hit->title) ? &hit->url : &hit->title);
+        appendCStr_String(&res->label, "\"");
+        set_String(&res->url, &hit->url);
         pushBack_PtrArray(&d->results, res);
+        delete_SearchHit(hit);
     }
+    delete_PtrArray(hits);
 }
 
 static iThreadResult worker_LookupWidget_(iThread *thread) {
     iLookupWidget *d = userData_Thread(thread);
 //    printf("[LookupWidget] worker is running\n"); fflush(stdout);
+    loadIndex_LookupWidget_(d);
+    iArray sections;
+    init_Array(&sections, sizeof(iLookupSection));
     lock_Mutex(d->mtx);
     for (;;) {
-        wait_Condition(&d->jobAvailable, d->mtx);
-        if (isEmpty_String(&d->pendingTerm)) {
+        while (!d->isQuitting && isEmpty_String(&d->pendingTerm)) {
+            wait_Condition(&d->jobAvailable, d->mtx);
+        }
+        if (d->isQuitting) {
             break; /* Time to quit. */
         }
+        set_Atomic(&d->isCancelled, iFalse);
+        /* Bring the index up to date. */ {
+            pushBackN_Array(&sections,
+                            constData_Array(&d->pendingSections),
+                            size_Array(&d->pendingSections));
+            clear_Array(&d->pendingSections);
+            unlock_Mutex(d->mtx);
+            updateIndex_LookupWidget_(d, &sections);
+            lock_Mutex(d->mtx);
+        }
         iLookupJob *job = new_LookupJob();
+        job->isCancelled = &d->isCancelled;
         /* Make a regular expression to search for multiple alternative words. */ {
             iString *pattern = new_String();
             iRangecc word = iNullRange;
@@ -346,21 +467,21 @@ static iThreadResult worker_LookupWidget_(iThread *thread) {
             delete_String(pattern);
         }
         const size_t termLen = length_String(&d->pendingTerm); /* characters */
+        set_String(&job->terms, &d->pendingTerm);
         clear_String(&d->pendingTerm);
-        job->docs = d->pendingDocs;
-        d->pendingDocs = NULL;
         unlock_Mutex(d->mtx);
         /* Do the lookup. */ {
-            searchBookmarks_LookupJob_(job);
-            searchFeeds_LookupJob_(job);
-            searchVisited_LookupJob_(job);
-            if (termLen >= 3) {
-                searchHistory_LookupJob_(job);
+            if (search_LookupWidget_(d, job) && termLen >= 3) {
+                searchContents_LookupJob_(job);
             }
-            searchIdentities_LookupJob_(job);
         }
         /* Submit the result. */
         lock_Mutex(d->mtx);
+        if (isCancelled_LookupJob_(job)) {
+            /* A newer term is already pending. */
+            delete_LookupJob(job);
+            continue;
+        }
         if (d->finishedJob) {
             /* Previous results haven't been taken yet. */
             delete_LookupJob(d->finishedJob);
@@ -371,6 +492,7 @@ static iThreadResult worker_LookupWidget_(iThread *thread) {
         postCommand_Widget(as_Widget(d), "lookup.ready");
     }
     unlock_Mutex(d->mtx);
+    deinit_Array(&sections);
 //    printf("[LookupWidget] worker has quit\n"); fflush(stdout);
     return 0;
 }
@@ -398,8 +520,22 @@ void init_LookupWidget(iLookupWidget *d) {
     init_Condition(&d->jobAvailable);
     d->mtx = new_Mutex();
     init_String(&d->pendingTerm);
-    d->pendingDocs = NULL;
+    init_Array(&d->pendingSections, sizeof(iLookupSection));
+    /* History is checked by the work thread. */
+    d->staleSections = sectionBit_(bookmark_LookupResultType) |
+                       sectionBit_(feedEntry_LookupResultType) |
+                       sectionBit_(identity_LookupResultType);
+    d->isQuitting = iFalse;
+    set_Atomic(&d->isCancelled, iFalse);
     d->finishedJob = NULL;
+    initCStr_String(&d->savePath, concatPath_CStr(cstr_String(dataDir_App()),
+                                                  fileName_LookupWidget_));
+    d->index = new_LookupIndex();
+    d->historyGeneration = 0;
+    d->isIndexModified = iFalse;
+    iZap(d->lastSaved);
+    init_String(&d->prevTerm);
+    init_Array(&d->prevMatches, sizeof(uint32_t));
     updateMetrics_LookupWidget_(d);
     start_Thread(d->work);
 }
@@ -407,32 +543,64 @@ void init_LookupWidget(iLookupWidget *d) {
 void deinit_LookupWidget(iLookupWidget *d) {
     /* Stop the worker. */ {
         iGuardMutex(d->mtx, {
-            iReleasePtr(&d->pendingDocs);
-            clear_String(&d->pendingTerm);
+            d->isQuitting = iTrue;
+            set_Atomic(&d->isCancelled, iTrue);
             signal_Condition(&d->jobAvailable);
         });
         join_Thread(d->work);
         iRelease(d->work);
     }
     delete_LookupJob(d->finishedJob);
+    iForEach(Array, i, &d->pendingSections) {
+        delete_LookupIndex(((iLookupSection *) i.value)->current);
+    }
+    deinit_Array(&d->pendingSections);
+    if (d->isIndexModified) {
+        saveIndex_LookupWidget_(d);
+    }
+    delete_LookupIndex(d->index);
+    deinit_String(&d->savePath);
+    deinit_Array(&d->prevMatches);
+    deinit_String(&d->prevTerm);
     deinit_String(&d->pendingTerm);
     delete_Mutex(d->mtx);
     deinit_Condition(&d->jobAvailable);
 }
 
+static void close_LookupWidget_(iLookupWidget *d) {
+    showCollapsed_Widget(as_Widget(d), iFalse);
+}
+
 void submit_LookupWidget(iLookupWidget *d, const iString *term) {
+    /* Only the kinds of data that have changed are copied, and the work thread replaces just
+       the entries that differ. */
+    iArray sections;
+    init_Array(&sections, sizeof(iLookupSection));
+    if (d->staleSections && !isEmpty_String(term)) {
+        const enum iLookupResultType types[] = {
+            bookmark_LookupResultType, feedEntry_LookupResultType, identity_LookupResultType
+        };
+        iForIndices(i, types) {
+            if (d->staleSections & sectionBit_(types[i])) {
+                iLookupSection sect = { types[i], newSection_LookupWidget_(types[i]) };
+                pushBack_Array(&sections, &sect);
+            }
+        }
+        d->staleSections = 0;
+    }
     iGuardMutex(d->mtx, {
         set_String(&d->pendingTerm, term);
         trim_String(&d->pendingTerm);
-        iReleasePtr(&d->pendingDocs);
+        set_Atomic(&d->isCancelled, iTrue);
+        pushBackN_Array(&d->pendingSections, constData_Array(&sections), size_Array(&sections));
         if (!isEmpty_String(&d->pendingTerm)) {
-            d->pendingDocs = listDocuments_App(); /* holds reference to all open tabs */
             signal_Condition(&d->jobAvailable);
         }
         else {
-            showCollapsed_Widget(as_Widget(d), iFalse);
+            close_LookupWidget_(d);
         }
     });
+    deinit_Array(&sections);
 }
 
 static void draw_LookupWidget_(const iLookupWidget *d) {
@@ -676,7 +844,25 @@ static iBool processEvent_LookupWidget_(iLookupWidget *d, const SDL_Event *ev) {
     }
     if (equal_Command(cmd, "input.ended") && equal_Rangecc(range_Command(cmd, "id"), "url") &&
         !isFocused_Widget(w)) {
-        showCollapsed_Widget(w, iFalse);
+        close_LookupWidget_(d);
+    }
+    if (equal_Command(cmd, "bookmarks.changed") || equal_Command(cmd, "idents.changed") ||
+        equal_Command(cmd, "visited.changed") || equal_Command(cmd, "feeds.update.finished")) {
+        if (equal_Command(cmd, "bookmarks.changed")) {
+            /* Feed entries show the titles and icons of their bookmarks. */
+            d->staleSections |= sectionBit_(bookmark_LookupResultType) |
+                                sectionBit_(feedEntry_LookupResultType);
+        }
+        else if (equal_Command(cmd, "idents.changed")) {
+            d->staleSections |= sectionBit_(identity_LookupResultType);
+        }
+        else if (equal_Command(cmd, "feeds.update.finished")) {
+            d->staleSections |= sectionBit_(feedEntry_LookupResultType);
+        }
+        if (isVisible_Widget(w)) {
+            /* Redo the open lookup with the new data. */
+            submit_LookupWidget(d, text_InputWidget(findWidget_App("url")));
+        }
     }
     if (isCommand_Widget(w, ev, "focus.lost")) {
         setCursor_LookupWidget_(d, iInvalidPos);
@@ -691,7 +877,7 @@ static iBool processEvent_LookupWidget_(iLookupWidget *d, const SDL_Event *ev) {
         const iLookupItem *item = constItem_ListWidget(d->list, arg_Command(cmd));
         if (item && !isEmpty_String(&item->command)) {
             setText_InputWidget(url, url_DocumentWidget(document_App()));
-            showCollapsed_Widget(w, iFalse);
+            close_LookupWidget_(d);
             setCursor_LookupWidget_(d, iInvalidPos);
             postCommandString_App(&item->command);
             postCommand_App("focus.set id:"); /* unfocus */
@@ -705,7 +891,7 @@ static iBool processEvent_LookupWidget_(iLookupWidget *d, const SDL_Event *ev) {
             iWidget *url = findWidget_App("url");
             switch (key) {
                 case SDLK_ESCAPE:
-                    showCollapsed_Widget(w, iFalse);
+                    close_LookupWidget_(d);
                     setCursor_LookupWidget_(d, iInvalidPos);
                     setFocus_Widget(url);
                     return iTrue;
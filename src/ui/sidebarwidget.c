@@ -35,8 +35,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "labelwidget.h"
 #include "listwidget.h"
 #include "keys.h"
+#include "pagecache.h"
 #include "paint.h"
 #include "scrollwidget.h"
+#include "searchindex.h"
 #include "util.h"
 #include "visited.h"
 
@@ -45,6 +47,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <the_Foundation/stringarray.h>
 #include <SDL_clipboard.h>
 #include <SDL_mouse.h>
+#include <errno.h>
 
 iDeclareType(SidebarItem)
 typedef iListItemClass iSidebarItemClass;
@@ -87,6 +90,27 @@ iDefineObjectConstruction(SidebarItem)
 
 /*----------------------------------------------------------------------------------------------*/
 
+iDeclareType(SidebarRow)
+
+enum iSidebarRowText {
+    url_SidebarRowText,
+    label_SidebarRowText,
+    meta_SidebarRowText,
+    max_SidebarRowText,
+};
+
+/* Compact version of a SidebarItem for long lists. Items are only made for the visible rows. */
+struct Impl_SidebarRow {
+    uint32_t id;
+    int      indent;
+    iChar    icon;
+    iBool    isSeparator;
+    iBool    isSelected;
+    uint32_t text[max_SidebarRowText + 1]; /* offsets in `rowText` */
+};
+
+/*----------------------------------------------------------------------------------------------*/
+
 struct Impl_SidebarWidget {
     iWidget           widget;
     enum iSidebarSide side;
@@ -101,7 +125,11 @@ struct Impl_SidebarWidget {
     int               itemFonts[2];
     iWidget *         resizer;
     iWidget *         menu;
-    iSidebarItem *    contextItem; /* list item accessed in the context menu */
+    size_t            contextIndex; /* list item accessed in the context menu */
+    uint32_t          contextId;
+    iString           contextUrl;
+    iArray            rows;        /* SidebarRows of the history and feeds lists */
+    iBlock            rowText;
 };
 
 iDefineObjectConstructionArgs(SidebarWidget, (enum iSidebarSide side), side)
@@ -130,8 +158,62 @@ static int cmpTitle_Bookmark_(const iBookmark **a, const iBookmark **b) {
     return cmpStringCase_String(&bm1->title, &bm2->title);
 }
 
+static void addRow_SidebarWidget_(iSidebarWidget *d, iSidebarRow *row, const iString *url,
+                                  const iString *label, const iString *meta) {
+    const iString *texts[max_SidebarRowText] = { url, label, meta };
+    for (size_t i = 0; i < max_SidebarRowText; i++) {
+        row->text[i] = size_Block(&d->rowText);
+        if (texts[i]) {
+            append_Block(&d->rowText, &texts[i]->chars);
+        }
+    }
+    row->text[max_SidebarRowText] = size_Block(&d->rowText);
+    pushBack_Array(&d->rows, row);
+}
+
+static iRangecc rowText_SidebarWidget_(const iSidebarWidget *d, const iSidebarRow *row,
+                                       enum iSidebarRowText text) {
+    const char *chars = constData_Block(&d->rowText);
+    return (iRangecc){ chars + row->text[text], chars + row->text[text + 1] };
+}
+
+static size_t numRows_SidebarWidget_(void *context) {
+    return size_Array(&((const iSidebarWidget *) context)->rows);
+}
+
+static iAnyObject *newRowItem_SidebarWidget_(void *context) {
+    iUnused(context);
+    return new_SidebarItem();
+}
+
+static void updateRowItem_SidebarWidget_(void *context, size_t index, iAnyObject *obj) {
+    const iSidebarWidget *d    = context;
+    const iSidebarRow *   row  = constAt_Array(&d->rows, index);
+    iSidebarItem *        item = obj;
+    item->id                   = row->id;
+    item->indent               = row->indent;
+    item->icon                 = row->icon;
+    item->isBold               = iFalse;
+    item->listItem.isSeparator = row->isSeparator;
+    item->listItem.isSelected  = row->isSelected;
+    setRange_String(&item->url, rowText_SidebarWidget_(d, row, url_SidebarRowText));
+    setRange_String(&item->label, rowText_SidebarWidget_(d, row, label_SidebarRowText));
+    setRange_String(&item->meta, rowText_SidebarWidget_(d, row, meta_SidebarRowText));
+    if (d->mode == history_SidebarMode && !row->isSeparator) {
+        set_String(&item->label, &item->url);
+        if (prefs_App()->decodeUserVisibleURLs) {
+            urlDecodePath_String(&item->label);
+        }
+        else {
+            urlEncodePath_String(&item->label);
+        }
+    }
+}
+
 static void updateItems_SidebarWidget_(iSidebarWidget *d) {
     clear_ListWidget(d->list);
+    clear_Array(&d->rows);
+    clear_Block(&d->rowText);
     releaseChildren_Widget(d->blank);
     destroy_Widget(d->menu);
     d->menu = NULL;
@@ -145,7 +227,6 @@ static void updateItems_SidebarWidget_(iSidebarWidget *d) {
             init_Date(&on, &now);
             const int thisYear = on.year;
             iZap(on);
-            size_t numItems = 0;
             iConstForEach(PtrArray, i, listEntries_Feeds()) {
                 const iFeedEntry *entry = i.ptr;
                 if (isHidden_FeedEntry(entry)) {
@@ -165,35 +246,20 @@ static void updateItems_SidebarWidget_(iSidebarWidget *d) {
                     if (on.year != entryDate.year || on.month != entryDate.month ||
                         on.day != entryDate.day) {
                         on = entryDate;
-                        iSidebarItem *sep = new_SidebarItem();
-                        sep->listItem.isSeparator = iTrue;
                         iString *text = format_Date(&on, on.year == thisYear ? "%b. %d" : "%b. %d, %Y");
-                        set_String(&sep->meta, text);
+                        addRow_SidebarWidget_(
+                            d, &(iSidebarRow){ .isSeparator = iTrue }, NULL, NULL, text);
                         delete_String(text);
-                        addItem_ListWidget(d->list, sep);
-                        iRelease(sep);
                     }
                 }
-                iSidebarItem *item = new_SidebarItem();
-                if (equal_String(docUrl, &entry->url)) {
-                    item->listItem.isSelected = iTrue; /* currently being viewed */
-                }
-                item->indent = isUnread_FeedEntry(entry);
-                set_String(&item->url, &entry->url);
-                set_String(&item->label, &entry->title);
+                iSidebarRow row = { .isSelected = equal_String(docUrl, &entry->url), /* being viewed */
+                                    .indent     = isUnread_FeedEntry(entry) };
                 const iBookmark *bm = get_Bookmarks(bookmarks_App(), entry->bookmarkId);
                 if (bm) {
-                    item->id = entry->bookmarkId;
-                    item->icon = bm->icon;
-                    append_String(&item->meta, &bm->title);
-                }
-                addItem_ListWidget(d->list, item);
-                iRelease(item);
-                if (++numItems == 100) {
-                    /* For more items, one can always see "about:feeds". A large number of items
-                       is a bit difficult to navigate in the sidebar. */
-                    break;
+                    row.id   = entry->bookmarkId;
+                    row.icon = bm->icon;
                 }
+                addRow_SidebarWidget_(d, &row, &entry->url, &entry->title, bm ? &bm->title : NULL);
             }
             d->menu = makeMenu_Widget(
                 as_Widget(d),
@@ -277,41 +343,26 @@ static void updateItems_SidebarWidget_(iSidebarWidget *d) {
             iDate on;
             initCurrent_Date(&on);
             const int thisYear = on.year;
-            iConstForEach(PtrArray, i, list_Visited(visited_App(), 200)) {
+            iConstForEach(PtrArray, i, list_Visited(visited_App(), 0)) {
                 const iVisitedUrl *visit = i.ptr;
-                iSidebarItem *item = new_SidebarItem();
-                set_String(&item->url, &visit->url);
-                set_String(&item->label, &visit->url);
-                if (prefs_App()->decodeUserVisibleURLs) {
-                    urlDecodePath_String(&item->label);
-                }
-                else {
-                    urlEncodePath_String(&item->label);
-                }
                 iDate date;
                 init_Date(&date, &visit->when);
                 if (date.day != on.day || date.month != on.month || date.year != on.year) {
                     on = date;
                     /* Date separator. */
-                    iSidebarItem *sep = new_SidebarItem();
-                    sep->listItem.isSeparator = iTrue;
-                    const iString *text = collect_String(format_Date(
-                        &date, date.year != thisYear ? "%b. %d, %Y" : "%b. %d"));
-                    set_String(&sep->meta, text);
+                    iString *text = format_Date(&date, date.year != thisYear ? "%b. %d, %Y" : "%b. %d");
                     const int yOffset = itemHeight_ListWidget(d->list) * 2 / 3;
-                    sep->id = yOffset;
-                    addItem_ListWidget(d->list, sep);
-                    iRelease(sep);
+                    addRow_SidebarWidget_(
+                        d, &(iSidebarRow){ .isSeparator = iTrue, .id = yOffset }, NULL, NULL, text);
                     /* Date separators are two items tall. */
-                    sep = new_SidebarItem();
-                    sep->listItem.isSeparator = iTrue;
-                    sep->id = -itemHeight_ListWidget(d->list) + yOffset;
-                    set_String(&sep->meta, text);
-                    addItem_ListWidget(d->list, sep);
-                    iRelease(sep);
+                    addRow_SidebarWidget_(d,
+                                          &(iSidebarRow){ .isSeparator = iTrue,
+                                                          .id = -itemHeight_ListWidget(d->list) + yOffset },
+                                          NULL, NULL, text);
+                    delete_String(text);
                 }
-                addItem_ListWidget(d->list, item);
-                iRelease(item);
+                /* The label is made of the URL when the item is needed. */
+                addRow_SidebarWidget_(d, &(iSidebarRow){ 0 }, &visit->url, NULL, NULL);
             }
             d->menu = makeMenu_Widget(
                 as_Widget(d),
@@ -321,8 +372,9 @@ static void updateItems_SidebarWidget_(iSidebarWidget *d) {
                     { "---", 0, 0, NULL },
                     { close_Icon " Forget URL", 0, 0, "history.delete" },
                     { "---", 0, 0, NULL },
+                    { "Export History", 0, 0, "history.export" },
                     { delete_Icon " " uiTextCaution_ColorEscape "Clear History...", 0, 0, "history.clear confirm:1" },
-                }, 6);
+                }, 7);
             break;
         }
         case identities_SidebarMode: {
@@ -380,6 +432,13 @@ static void updateItems_SidebarWidget_(iSidebarWidget *d) {
         default:
             break;
     }
+    if (!isEmpty_Array(&d->rows)) {
+        setSource_ListWidget(d->list,
+                             &(iListItemSource){ .context    = d,
+                                                 .count      = numRows_SidebarWidget_,
+                                                 .newItem    = newRowItem_SidebarWidget_,
+                                                 .updateItem = updateRowItem_SidebarWidget_ });
+    }
     updateVisible_ListWidget(d->list);
     invalidate_ListWidget(d->list);
     /* Content for a blank tab. */
@@ -498,6 +557,8 @@ void init_SidebarWidget(iSidebarWidget *d, enum iSidebarSide side) {
                     iTrue);
     iZap(d->modeScroll);
     d->side = side;
+    init_Array(&d->rows, sizeof(iSidebarRow));
+    init_Block(&d->rowText, 0);
     d->mode = -1;
     d->itemFonts[0] = uiContent_FontId;
     d->itemFonts[1] = uiContentBold_FontId;
@@ -557,7 +618,9 @@ void init_SidebarWidget(iSidebarWidget *d, enum iSidebarSide side) {
     d->list = new_ListWidget();
     setPadding_Widget(as_Widget(d->list), 0, gap_UI, 0, gap_UI);
     addChildFlags_Widget(content, iClob(d->list), drawBackgroundToHorizontalSafeArea_WidgetFlag);
-    d->contextItem = NULL;
+    d->contextIndex = iInvalidPos;
+    d->contextId    = 0;
+    init_String(&d->contextUrl);
     d->blank = new_Widget();
     addChildFlags_Widget(content, iClob(d->blank), resizeChildren_WidgetFlag);
     addChildFlags_Widget(vdiv, iClob(content), expand_WidgetFlag);
@@ -582,6 +645,9 @@ void init_SidebarWidget(iSidebarWidget *d, enum iSidebarSide side) {
 }
 
 void deinit_SidebarWidget(iSidebarWidget *d) {
+    deinit_String(&d->contextUrl);
+    deinit_Block(&d->rowText);
+    deinit_Array(&d->rows);
     deinit_String(&d->cmdPrefix);
 }
 
@@ -604,10 +670,28 @@ static const iGmIdentity *constHoverIdentity_SidebarWidget_(const iSidebarWidget
     return NULL;
 }
 
+static void setContextItem_SidebarWidget_(iSidebarWidget *d, size_t index) {
+    const iSidebarItem *item = constItem_ListWidget(d->list, index);
+    d->contextIndex = item ? index : iInvalidPos;
+    d->contextId    = item ? item->id : 0;
+    set_String(&d->contextUrl, item ? &item->url : collectNew_String());
+}
+
+static const iSidebarItem *contextItem_SidebarWidget_(const iSidebarWidget *d) {
+    /* List items are reused for other rows, and the list may have been updated since the
+       menu was opened, so the item is looked up again and checked to be the same one. */
+    const iSidebarItem *item = constItem_ListWidget(d->list, d->contextIndex);
+    if (item && item->id == d->contextId && equal_String(&item->url, &d->contextUrl)) {
+        return item;
+    }
+    return NULL;
+}
+
 static iGmIdentity *menuIdentity_SidebarWidget_(const iSidebarWidget *d) {
     if (d->mode == identities_SidebarMode) {
-        if (d->contextItem) {
-            return identity_GmCerts(certs_App(), d->contextItem->id);
+        const iSidebarItem *item = contextItem_SidebarWidget_(d);
+        if (item) {
+            return identity_GmCerts(certs_App(), item->id);
         }
     }
     return NULL;
@@ -721,23 +805,24 @@ iBool handleBookmarkEditorCommands_SidebarWidget_(iWidget *editor, const char *c
             const iString *tags  = text_InputWidget(findChild_Widget(editor, "bmed.tags"));
             const iString *icon  = collect_String(trimmed_String(
                                         text_InputWidget(findChild_Widget(editor, "bmed.icon"))));
-            const iSidebarItem *item = d->contextItem;
-            iAssert(item); /* hover item cannot have been changed */
-            iBookmark *bm = get_Bookmarks(bookmarks_App(), item->id);
-            set_String(&bm->title, title);
-            set_String(&bm->url, url);
-            set_String(&bm->tags, tags);
-            if (isEmpty_String(icon)) {
-                removeTag_Bookmark(bm, "usericon");
-                bm->icon = 0;
-            }
-            else {
-                if (!hasTag_Bookmark(bm, "usericon")) {
-                    addTag_Bookmark(bm, "usericon");
+            /* The list may have been updated while editing, but the bookmark ID remains. */
+            iBookmark *bm = get_Bookmarks(bookmarks_App(), d->contextId);
+            if (bm) {
+                set_String(&bm->title, title);
+                set_String(&bm->url, url);
+                set_String(&bm->tags, tags);
+                if (isEmpty_String(icon)) {
+                    removeTag_Bookmark(bm, "usericon");
+                    bm->icon = 0;
                 }
-                bm->icon = first_String(icon);
+                else {
+                    if (!hasTag_Bookmark(bm, "usericon")) {
+                        addTag_Bookmark(bm, "usericon");
+                    }
+                    bm->icon = first_String(icon);
+                }
+                postCommand_App("bookmarks.changed");
             }
-            postCommand_App("bookmarks.changed");
         }
         setFlags_Widget(as_Widget(d), disabled_WidgetFlag, iFalse);
         destroy_Widget(editor);
@@ -858,7 +943,11 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
             return iTrue;
         }
         else if (isCommand_Widget(w, ev, "list.clicked")) {
-            itemClicked_SidebarWidget_(d, pointerLabel_Command(cmd, "item"));
+            /* Items may be reused for other rows, so look it up by index. */
+            const iSidebarItem *item = constItem_ListWidget(d->list, arg_Command(cmd));
+            if (item) {
+                itemClicked_SidebarWidget_(d, item);
+            }
             return iTrue;
         }
         else if (isCommand_Widget(w, ev, "menu.opened")) {
@@ -868,7 +957,7 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
             setFlags_Widget(as_Widget(d->list), disabled_WidgetFlag, iFalse);
         }
         else if (isCommand_Widget(w, ev, "bookmark.open")) {
-            const iSidebarItem *item = d->contextItem;
+            const iSidebarItem *item = contextItem_SidebarWidget_(d);
             if (d->mode == bookmarks_SidebarMode && item) {
                 postCommandf_App("open newtab:%d url:%s",
                                  argLabel_Command(cmd, "newtab"),
@@ -877,14 +966,14 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
             return iTrue;
         }
         else if (isCommand_Widget(w, ev, "bookmark.copy")) {
-            const iSidebarItem *item = d->contextItem;
+            const iSidebarItem *item = contextItem_SidebarWidget_(d);
             if (d->mode == bookmarks_SidebarMode && item) {
                 SDL_SetClipboardText(cstr_String(withSpacesEncoded_String(&item->url)));
             }
             return iTrue;
         }
         else if (isCommand_Widget(w, ev, "bookmark.edit")) {
-            const iSidebarItem *item = d->contextItem;
+            const iSidebarItem *item = contextItem_SidebarWidget_(d);
             if (d->mode == bookmarks_SidebarMode && item) {
                 setFlags_Widget(w, disabled_WidgetFlag, iTrue);
                 iWidget *dlg = makeBookmarkEditor_Widget();
@@ -903,7 +992,7 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
             return iTrue;
         }
         else if (isCommand_Widget(w, ev, "bookmark.dup")) {
-            const iSidebarItem *item = d->contextItem;
+            const iSidebarItem *item = contextItem_SidebarWidget_(d);
             if (d->mode == bookmarks_SidebarMode && item) {
                 setFlags_Widget(w, disabled_WidgetFlag, iTrue);
                 iBookmark *bm = get_Bookmarks(bookmarks_App(), item->id);
@@ -919,7 +1008,7 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
             return iTrue;
         }
         else if (isCommand_Widget(w, ev, "bookmark.tag")) {
-            const iSidebarItem *item = d->contextItem;
+            const iSidebarItem *item = contextItem_SidebarWidget_(d);
             if (d->mode == bookmarks_SidebarMode && item) {
                 const char *tag = cstr_String(string_Command(cmd, "tag"));
                 iBookmark *bm = get_Bookmarks(bookmarks_App(), item->id);
@@ -937,14 +1026,16 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
             return iTrue;
         }
         else if (isCommand_Widget(w, ev, "bookmark.delete")) {
-            const iSidebarItem *item = d->contextItem;
+            const iSidebarItem *item = contextItem_SidebarWidget_(d);
             if (d->mode == bookmarks_SidebarMode && item && remove_Bookmarks(bookmarks_App(), item->id)) {
                 removeEntries_Feeds(item->id);
                 postCommand_App("bookmarks.changed");
             }
             return iTrue;
         }
-        else if (equal_Command(cmd, "feeds.update.finished") && d->mode == feeds_SidebarMode) {
+        else if ((equal_Command(cmd, "feeds.update.finished") ||
+                  equal_Command(cmd, "feeds.update.loaded")) &&
+                 d->mode == feeds_SidebarMode) {
             updateItems_SidebarWidget_(d);
         }
         else if (equal_Command(cmd, "feeds.markallread") && d->mode == feeds_SidebarMode) {
@@ -959,7 +1050,7 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
             return iTrue;
         }
         else if (startsWith_CStr(cmd, "feed.entry.") && d->mode == feeds_SidebarMode) {
-            const iSidebarItem *item = d->contextItem;
+            const iSidebarItem *item = contextItem_SidebarWidget_(d);
             if (item) {
                 if (isCommand_Widget(w, ev, "feed.entry.opentab")) {
                     postCommandString_App(feedEntryOpenCommand_String(&item->url, 1));
@@ -1086,7 +1177,10 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
             return iTrue;
         }
         else if (isCommand_Widget(w, ev, "ident.delete")) {
-            iSidebarItem *item = d->contextItem;
+            const iSidebarItem *item = contextItem_SidebarWidget_(d);
+            if (!item) {
+                return iTrue;
+            }
             if (argLabel_Command(cmd, "confirm")) {
                 makeQuestion_Widget(
                     uiTextCaution_ColorEscape "DELETE IDENTITY",
@@ -1101,28 +1195,29 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
                     2);
                 return iTrue;
             }
-            deleteIdentity_GmCerts(certs_App(), hoverIdentity_SidebarWidget_(d));
+            deleteIdentity_GmCerts(certs_App(), menuIdentity_SidebarWidget_(d));
             postCommand_App("idents.changed");
             return iTrue;
         }
         else if (isCommand_Widget(w, ev, "history.delete")) {
-            if (d->contextItem && !isEmpty_String(&d->contextItem->url)) {
-                removeUrl_Visited(visited_App(), &d->contextItem->url);
+            const iSidebarItem *item = contextItem_SidebarWidget_(d);
+            if (item && !isEmpty_String(&item->url)) {
+                removeUrl_Visited(visited_App(), &item->url);
                 updateItems_SidebarWidget_(d);
                 scrollOffset_ListWidget(d->list, 0);
             }
             return iTrue;
         }
         else if (isCommand_Widget(w, ev, "history.copy")) {
-            const iSidebarItem *item = d->contextItem;
+            const iSidebarItem *item = contextItem_SidebarWidget_(d);
             if (item && !isEmpty_String(&item->url)) {
                 SDL_SetClipboardText(cstr_String(withSpacesEncoded_String(&item->url)));
             }
             return iTrue;
         }
         else if (isCommand_Widget(w, ev, "history.addbookmark")) {
-            const iSidebarItem *item = d->contextItem;
-            if (!isEmpty_String(&item->url)) {
+            const iSidebarItem *item = contextItem_SidebarWidget_(d);
+            if (item && !isEmpty_String(&item->url)) {
                 makeBookmarkCreation_Widget(
                     &item->url,
                     collect_String(newRange_String(urlHost_String(&item->url))),
@@ -1130,6 +1225,17 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
                 postCommand_App("focus.set id:bmed.title");
             }
         }
+        else if (isCommand_Widget(w, ev, "history.export")) {
+            const iString *path = downloadPathForUrl_App(collectNewCStr_String("about:visited"),
+                                                         collectNewCStr_String("text/plain"));
+            if (exportText_Visited(visited_App(), path)) {
+                makeMessage_Widget(uiHeading_ColorEscape "HISTORY EXPORTED", cstr_String(path));
+            }
+            else {
+                makeMessage_Widget(uiTextCaution_ColorEscape "ERROR SAVING FILE", strerror(errno));
+            }
+            return iTrue;
+        }
         else if (equal_Command(cmd, "history.clear")) {
             if (argLabel_Command(cmd, "confirm")) {
                 makeQuestion_Widget(uiTextCaution_ColorEscape "CLEAR HISTORY",
@@ -1141,6 +1247,8 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
             }
             else {
                 clear_Visited(visited_App());
+                clear_PageCache(pageCache_App());
+                clear_SearchIndex(searchIndex_App());
                 updateItems_SidebarWidget_(d);
                 scrollOffset_ListWidget(d->list, 0);
             }
@@ -1167,17 +1275,18 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
     }
     if (d->menu && ev->type == SDL_MOUSEBUTTONDOWN) {
         if (ev->button.button == SDL_BUTTON_RIGHT) {
-            d->contextItem = NULL;
+            setContextItem_SidebarWidget_(d, iInvalidPos);
             if (!isVisible_Widget(d->menu)) {
                 updateMouseHover_ListWidget(d->list);
             }
             if (constHoverItem_ListWidget(d->list) || isVisible_Widget(d->menu)) {
-                d->contextItem = hoverItem_ListWidget(d->list);
+                setContextItem_SidebarWidget_(d, hoverItemIndex_ListWidget(d->list));
+                const iSidebarItem *contextItem = contextItem_SidebarWidget_(d);
                 /* Update menu items. */
                 /* TODO: Some callback-based mechanism would be nice for updating menus right
                    before they open? */
-                if (d->mode == bookmarks_SidebarMode && d->contextItem) {
-                    const iBookmark *bm = get_Bookmarks(bookmarks_App(), d->contextItem->id);
+                if (d->mode == bookmarks_SidebarMode && contextItem) {
+                    const iBookmark *bm = get_Bookmarks(bookmarks_App(), contextItem->id);
                     if (bm) {
                         iLabelWidget *menuItem = findMenuItem_Widget(d->menu,
                                                                      "bookmark.tag tag:homepage");
@@ -1206,9 +1315,9 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
                         }
                     }
                 }
-                else if (d->mode == feeds_SidebarMode && d->contextItem) {
+                else if (d->mode == feeds_SidebarMode && contextItem) {
                     iLabelWidget *menuItem = findMenuItem_Widget(d->menu, "feed.entry.toggleread");
-                    const iBool   isRead   = d->contextItem->indent == 0;
+                    const iBool   isRead   = contextItem->indent == 0;
                     setTextCStr_LabelWidget(menuItem,
                                             isRead ? circle_Icon " Mark as Unread"
                                                    : circleWhite_Icon " Mark as Read");
@@ -25,20 +25,26 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "metrics.h"
 #include "embedded.h"
 #include "app.h"
+#include "persist.h"
 
 #define STB_TRUETYPE_IMPLEMENTATION
 #include "../stb_truetype.h"
 
 #include <the_Foundation/array.h>
+#include <the_Foundation/buffer.h>
+#include <the_Foundation/condition.h>
 #include <the_Foundation/file.h>
 #include <the_Foundation/hash.h>
 #include <the_Foundation/math.h>
+#include <the_Foundation/mutex.h>
 #include <the_Foundation/stringlist.h>
 #include <the_Foundation/regexp.h>
 #include <the_Foundation/path.h>
-#include <the_Foundation/ptrset.h>
+#include <the_Foundation/ptrarray.h>
+#include <the_Foundation/thread.h>
 #include <the_Foundation/vec2.h>
 
+#include <SDL_cpuinfo.h>
 #include <SDL_surface.h>
 #include <SDL_hints.h>
 #include <stdarg.h>
@@ -53,11 +59,11 @@ int gap_Text;                           /* cf. gap_UI in metrics.h */
 int enableHalfPixelGlyphs_Text = iTrue; /* debug setting */
 int enableKerning_Text         = iTrue; /* looking up kern pairs is slow */
 
-static iBool enableRaster_Text_ = iTrue;
-
 enum iGlyphFlag {
     rasterized0_GlyphFlag = iBit(1),    /* zero offset */
     rasterized1_GlyphFlag = iBit(2),    /* half-pixel offset */
+    cached_GlyphFlag      = iBit(3),    /* position reserved in the cache texture */
+    evicted_GlyphFlag     = iBit(4),    /* was cached before but its page was reused */
 };
 
 struct Impl_Glyph {
@@ -65,6 +71,7 @@ struct Impl_Glyph {
     int flags;
     uint32_t glyphIndex;
     const iFont *font; /* may come from symbols/emoji */
+    int page; /* index of the cache page */
     iRect rect[2]; /* zero and half pixel offset */
     iInt2 d[2];
     float advance; /* scaled */
@@ -75,6 +82,7 @@ void init_Glyph(iGlyph *d, iChar ch) {
     d->flags      = 0;
     d->glyphIndex = 0;
     d->font       = NULL;
+    d->page       = 0;
     d->rect[0]    = zero_Rect();
     d->rect[1]    = zero_Rect();
     d->advance    = 0.0f;
@@ -101,6 +109,10 @@ iLocalDef void setRasterized_Glyph_(iGlyph *d, int hoff) {
     d->flags |= rasterized0_GlyphFlag << hoff;
 }
 
+iLocalDef iBool isCached_Glyph_(const iGlyph *d) {
+    return (d->flags & cached_GlyphFlag) != 0;
+}
+
 iDefineTypeConstructionArgs(Glyph, (iChar ch), ch)
 
 /*-----------------------------------------------------------------------------------------------*/
@@ -119,10 +131,29 @@ struct Impl_Font {
     enum iFontId   japaneseFont; /* font to use for Japanese glyphs */
     enum iFontId   koreanFont;   /* font to use for Korean glyphs */
     uint32_t       indexTable[128 - 32];
+    uint32_t       metricsKey; /* identifies the font data and glyph scaling */
 };
 
 static iFont *font_Text_(enum iFontId id);
 
+static uint32_t metricsKey_Font_(const iFont *d, const iBlock *data) {
+    /* Only a sample of the font data is hashed. The embedded fonts only change between
+       app versions, and then the size is likely to change as well. */
+    const uint8_t *bytes = constData_Block(data);
+    const size_t   size  = size_Block(data);
+    uint32_t       hash  = 2166136261u; /* FNV-1a */
+    for (size_t i = 0; i < size; i += 997) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    const float scales[2] = { d->xScale, d->yScale };
+    uint32_t    values[5] = { size, d->height, d->vertOffset };
+    memcpy(values + 3, scales, sizeof(scales));
+    iForIndices(i, values) {
+        hash = (hash ^ values[i]) * 16777619u;
+    }
+    return hash;
+}
+
 static void init_Font(iFont *d, const iBlock *data, int height, float scale,
                       enum iFontId symbolsFont, iBool isMonospaced) {
     init_Hash(&d->glyphs);
@@ -151,6 +182,7 @@ static void init_Font(iFont *d, const iBlock *data, int height, float scale,
     d->japaneseFont = regularJapanese_FontId;
     d->koreanFont   = regularKorean_FontId;
     memset(d->indexTable, 0xff, sizeof(d->indexTable));
+    d->metricsKey   = metricsKey_Font_(d, data);
 }
 
 static void clearGlyphs_Font_(iFont *d) {
@@ -181,26 +213,106 @@ static uint32_t glyphIndex_Font_(iFont *d, iChar ch) {
 
 iDeclareType(Text)
 iDeclareType(CacheRow)
+iDeclareType(CachePage)
+iDeclareType(RasterJob)
+iDeclareType(SavedMetrics)
 
 struct Impl_CacheRow {
     int   height;
     iInt2 pos;
 };
 
+/* The glyph cache consists of a number of equally sized pages. When all of them are full,
+   the least recently used page is cleared and reused. */
+struct Impl_CachePage {
+    SDL_Texture *texture;
+    uint16_t *   pixels; /* copy of the texture contents (RGBA4444) */
+    iRect        dirty;  /* pixels not yet uploaded to the texture */
+    iArray       rows;   /* one open shelf for each row height */
+    int          bottom;
+    uint32_t     lastUsed;
+};
+
+/* Glyphs are rasterized into 8-bit coverage bitmaps by worker threads. The main thread copies
+   finished bitmaps into the cache pages and uploads the changed areas in batches. */
+struct Impl_RasterJob {
+    iGlyph * glyph;
+    uint32_t generation; /* jobs from before a font reset are discarded */
+    uint8_t *coverage[2];
+    iInt2    size[2];
+};
+
+/* Glyph metrics are saved on exit so they don't need to be recomputed from the font data
+   on the next launch. */
+struct Impl_SavedMetrics {
+    iHashNode node;   /* key is the font's metrics key */
+    iBlock    glyphs; /* serialized metrics of the glyphs used in a font */
+};
+
+static const char *metricsFileName_Text_ = "glyphmetrics.bin";
+static const char *metricsMagic_Text_    = "lgGm";
+static const size_t maxSavedMetrics_Text_ = 256; /* fonts */
+
+#define maxCachePages_Text_    4
+#define maxRasterWorkers_Text_ 4
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+/* Glyph quads are collected into a vertex batch that is submitted with a single geometry call.
+   The vertex color replaces texture color modulation, so color escapes don't interrupt the
+   batch. Older SDL versions draw each glyph with a separate copy. */
+#   define LAGRANGE_GLYPH_BATCHING
+#endif
+
+iDeclareType(CachedRun)
+
 struct Impl_Text {
     enum iTextFont contentFont;
     enum iTextFont headingFont;
     float          contentFontSize;
     iFont          fonts[max_FontId];
     SDL_Renderer * render;
-    SDL_Texture *  cache;
-    iInt2          cacheSize;
+    iInt2          cacheSize; /* of each page */
     int            cacheRowAllocStep;
-    int            cacheBottom;
-    iArray         cacheRows;
-    SDL_Palette *  grayscale;
+    iCachePage     cachePages[maxCachePages_Text_];
+    int            numCachePages;
+    uint32_t       cacheUseCounter;
+    iColor         cacheColorMod;
+    uint8_t        cacheAlphaMod;
+    size_t         numGlyphHits;
+    size_t         numGlyphMisses;
+    size_t         numRerasterized;
+    size_t         numPageEvictions;
+    iHash          runCache; /* CachedRuns */
+    iCachedRun *   runCacheFront; /* most recently used */
+    iCachedRun *   runCacheBack;  /* evicted first */
+    size_t         numRunHits;
+    size_t         numRunMisses;
+#if defined (LAGRANGE_GLYPH_BATCHING)
+    iArray         batchVertices; /* SDL_Vertex */
+    iArray         batchIndices;  /* int */
+    SDL_Texture *  batchTexture;
+#endif
+    size_t         numDrawCalls;  /* during the current frame */
+    size_t         numDrawnGlyphs;
+    size_t         numFrameDrawCalls; /* during the previous frame */
+    size_t         numFrameGlyphs;
     iRegExp *      ansiEscape;
-    iPtrSet *      pendingRaster; /* glyphs */
+    iMutex         mtx; /* glyph metrics are also looked up by layout threads */
+    uint32_t       fontGeneration; /* incremented when fonts (and glyphs) are recreated */
+    iMutex         rasterMtx;
+    iCondition     rasterAvailable;
+    iCondition     rasterIdle;
+    iArray         rasterQueue; /* RasterJobs waiting for a worker */
+    iArray         rasterDone;  /* RasterJobs waiting to be uploaded */
+    iThread *      rasterWorkers[maxRasterWorkers_Text_];
+    int            numRasterWorkers;
+    int            numActiveRaster;
+    uint32_t       rasterGeneration;
+    iBool          isStoppingRaster;
+    size_t         numAsyncRasterized;
+    size_t         numUploads;
+    iHash          savedMetrics; /* SavedMetrics */
+    size_t         numRestoredGlyphs;
 };
 
 static iText text_;
@@ -403,12 +515,64 @@ static void deinitFonts_Text_(iText *d) {
     }
 }
 
-static int maxGlyphHeight_Text_(const iText *d) {
-    return 2 * d->contentFontSize * fontSize_UI;
+static void clearRows_CachePage_(iCachePage *d) {
+    /* Rows will be assigned actual locations in the page once at least one glyph is stored. */
+    iForEach(Array, i, &d->rows) {
+        ((iCacheRow *) i.value)->height = 0;
+    }
+    d->bottom = 0;
+}
+
+static void initCachePage_Text_(iText *d, iCachePage *page) {
+    const int textSize = d->contentFontSize * fontSize_UI;
+    init_Array(&page->rows, sizeof(iCacheRow));
+    for (int h = d->cacheRowAllocStep; h <= 2 * textSize + d->cacheRowAllocStep;
+         h += d->cacheRowAllocStep) {
+        pushBack_Array(&page->rows, &(iCacheRow){ .height = 0 });
+    }
+    page->bottom   = 0;
+    page->lastUsed = d->cacheUseCounter;
+    page->pixels   = calloc(d->cacheSize.x * d->cacheSize.y, sizeof(uint16_t));
+    page->dirty    = zero_Rect();
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
+    page->texture = SDL_CreateTexture(d->render,
+                                      SDL_PIXELFORMAT_RGBA4444,
+                                      SDL_TEXTUREACCESS_STATIC,
+                                      d->cacheSize.x,
+                                      d->cacheSize.y);
+    SDL_SetTextureBlendMode(page->texture, SDL_BLENDMODE_BLEND);
+#if !defined (LAGRANGE_GLYPH_BATCHING)
+    SDL_SetTextureColorMod(
+        page->texture, d->cacheColorMod.r, d->cacheColorMod.g, d->cacheColorMod.b);
+    SDL_SetTextureAlphaMod(page->texture, d->cacheAlphaMod);
+#endif
+}
+
+static void deinitCachePage_Text_(iCachePage *page) {
+    deinit_Array(&page->rows);
+    SDL_DestroyTexture(page->texture);
+    free(page->pixels);
+}
+
+static void uploadCachePage_Text_(iText *d, iCachePage *page) {
+    if (!isEmpty_Rect(page->dirty)) {
+        const iRect r = page->dirty;
+        SDL_UpdateTexture(page->texture,
+                          &(SDL_Rect){ r.pos.x, r.pos.y, r.size.x, r.size.y },
+                          page->pixels + r.pos.y * d->cacheSize.x + r.pos.x,
+                          d->cacheSize.x * sizeof(uint16_t));
+        page->dirty = zero_Rect();
+        d->numUploads++;
+    }
+}
+
+static void uploadCache_Text_(iText *d) {
+    for (int i = 0; i < d->numCachePages; i++) {
+        uploadCachePage_Text_(d, &d->cachePages[i]);
+    }
 }
 
 static void initCache_Text_(iText *d) {
-    init_Array(&d->cacheRows, sizeof(iCacheRow));
     const int textSize = d->contentFontSize * fontSize_UI;
     iAssert(textSize > 0);
     const iInt2 cacheDims = init_I2(16, 40);
@@ -420,25 +584,150 @@ static void initCache_Text_(iText *d) {
         d->cacheSize.x = renderInfo.max_texture_width;
     }
     d->cacheRowAllocStep = iMax(2, textSize / 6);
-    /* Allocate initial (empty) rows. These will be assigned actual locations in the cache
-       once at least one glyph is stored. */
-    for (int h = d->cacheRowAllocStep; h <= 2 * textSize + d->cacheRowAllocStep; h += d->cacheRowAllocStep) {
-        pushBack_Array(&d->cacheRows, &(iCacheRow){ .height = 0 });
-    }
-    d->cacheBottom = 0;
-    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
-    d->cache = SDL_CreateTexture(d->render,
-                                 SDL_PIXELFORMAT_RGBA4444,
-                                 SDL_TEXTUREACCESS_STATIC | SDL_TEXTUREACCESS_TARGET,
-                                 d->cacheSize.x,
-                                 d->cacheSize.y);
-    SDL_SetTextureBlendMode(d->cache, SDL_BLENDMODE_BLEND);
+    d->numCachePages = 1;
+    initCachePage_Text_(d, &d->cachePages[0]);
 }
 
 static void deinitCache_Text_(iText *d) {
-    deinit_Array(&d->cacheRows);
-    SDL_DestroyTexture(d->cache);
-    clear_PtrSet(text_.pendingRaster);
+    for (int i = 0; i < d->numCachePages; i++) {
+        deinitCachePage_Text_(&d->cachePages[i]);
+    }
+    d->numCachePages = 0;
+}
+
+static void setCacheColorMod_Text_(iText *d, iColor color) {
+    d->cacheColorMod = color;
+#if !defined (LAGRANGE_GLYPH_BATCHING)
+    for (int i = 0; i < d->numCachePages; i++) {
+        SDL_SetTextureColorMod(d->cachePages[i].texture, color.r, color.g, color.b);
+    }
+#endif
+}
+
+static void flushGlyphs_Text_(iText *d) {
+#if defined (LAGRANGE_GLYPH_BATCHING)
+    if (!isEmpty_Array(&d->batchIndices)) {
+        uploadCache_Text_(d);
+        SDL_RenderGeometry(d->render,
+                           d->batchTexture,
+                           constData_Array(&d->batchVertices),
+                           size_Array(&d->batchVertices),
+                           constData_Array(&d->batchIndices),
+                           size_Array(&d->batchIndices));
+        d->numDrawCalls++;
+        clear_Array(&d->batchVertices);
+        clear_Array(&d->batchIndices);
+    }
+    d->batchTexture = NULL;
+#else
+    iUnused(d);
+#endif
+}
+
+static void drawGlyph_Text_(iText *d, const iGlyph *glyph, const SDL_Rect *src,
+                            const SDL_Rect *dst) {
+    SDL_Texture *tex = d->cachePages[glyph->page].texture;
+    d->numDrawnGlyphs++;
+#if defined (LAGRANGE_GLYPH_BATCHING)
+    if (tex != d->batchTexture) {
+        flushGlyphs_Text_(d);
+        d->batchTexture = tex;
+    }
+    const SDL_Color color = {
+        d->cacheColorMod.r, d->cacheColorMod.g, d->cacheColorMod.b, d->cacheAlphaMod
+    };
+    const float u0 = (float) src->x / d->cacheSize.x;
+    const float v0 = (float) src->y / d->cacheSize.y;
+    const float u1 = (float) (src->x + src->w) / d->cacheSize.x;
+    const float v1 = (float) (src->y + src->h) / d->cacheSize.y;
+    const float x0 = dst->x, y0 = dst->y, x1 = dst->x + dst->w, y1 = dst->y + dst->h;
+    const int   base = (int) size_Array(&d->batchVertices);
+    const SDL_Vertex quad[4] = {
+        { { x0, y0 }, color, { u0, v0 } },
+        { { x1, y0 }, color, { u1, v0 } },
+        { { x1, y1 }, color, { u1, v1 } },
+        { { x0, y1 }, color, { u0, v1 } },
+    };
+    const int indices[6] = { base, base + 1, base + 2, base, base + 2, base + 3 };
+    pushBackN_Array(&d->batchVertices, quad, 4);
+    pushBackN_Array(&d->batchIndices, indices, 6);
+#else
+    uploadCachePage_Text_(d, &d->cachePages[glyph->page]);
+    SDL_RenderCopy(d->render, tex, src, dst);
+    d->numDrawCalls++;
+#endif
+}
+
+static void setCacheBlendMode_Text_(iText *d, SDL_BlendMode mode) {
+    for (int i = 0; i < d->numCachePages; i++) {
+        SDL_SetTextureBlendMode(d->cachePages[i].texture, mode);
+    }
+}
+
+static void clearRunCache_Text_(iText *d);
+static iThreadResult rasterWorker_Text_(iThread *);
+static void loadMetrics_Text_(iText *d);
+static void saveMetrics_Text_(iText *d);
+static void storeMetrics_Text_(iText *d);
+static void restoreMetrics_Text_(iText *d);
+
+static void freeCoverage_RasterJob_(iRasterJob *d) {
+    for (int hoff = 0; hoff < 2; hoff++) {
+        stbtt_FreeBitmap(d->coverage[hoff], NULL);
+        d->coverage[hoff] = NULL;
+    }
+}
+
+static void startRasterWorkers_Text_(iText *d) {
+    init_Mutex(&d->rasterMtx);
+    init_Condition(&d->rasterAvailable);
+    init_Condition(&d->rasterIdle);
+    init_Array(&d->rasterQueue, sizeof(iRasterJob));
+    init_Array(&d->rasterDone, sizeof(iRasterJob));
+    d->numActiveRaster    = 0;
+    d->rasterGeneration   = 0;
+    d->isStoppingRaster   = iFalse;
+    d->numAsyncRasterized = 0;
+    d->numUploads         = 0;
+    d->numRasterWorkers   = iClamp(SDL_GetCPUCount() - 1, 1, maxRasterWorkers_Text_);
+    for (int i = 0; i < d->numRasterWorkers; i++) {
+        d->rasterWorkers[i] = new_Thread(rasterWorker_Text_);
+        setUserData_Thread(d->rasterWorkers[i], d);
+        start_Thread(d->rasterWorkers[i]);
+    }
+}
+
+static void cancelRaster_Text_(iText *d) {
+    /* Pending jobs refer to glyphs that are about to be deleted. */
+    lock_Mutex(&d->rasterMtx);
+    d->rasterGeneration++;
+    clear_Array(&d->rasterQueue);
+    while (d->numActiveRaster > 0) {
+        wait_Condition(&d->rasterIdle, &d->rasterMtx);
+    }
+    iForEach(Array, i, &d->rasterDone) {
+        freeCoverage_RasterJob_(i.value);
+    }
+    clear_Array(&d->rasterDone);
+    unlock_Mutex(&d->rasterMtx);
+}
+
+static void stopRasterWorkers_Text_(iText *d) {
+    cancelRaster_Text_(d);
+    iGuardMutex(&d->rasterMtx, {
+        d->isStoppingRaster = iTrue;
+        signal_Condition(&d->rasterAvailable);
+    });
+    for (int i = 0; i < d->numRasterWorkers; i++) {
+        join_Thread(d->rasterWorkers[i]);
+        iRelease(d->rasterWorkers[i]);
+    }
+    d->numRasterWorkers = 0;
+    deinit_Array(&d->rasterDone);
+    deinit_Array(&d->rasterQueue);
+    deinit_Condition(&d->rasterIdle);
+    deinit_Condition(&d->rasterAvailable);
+    deinit_Mutex(&d->rasterMtx);
 }
 
 void init_Text(SDL_Renderer *render) {
@@ -448,31 +737,74 @@ void init_Text(SDL_Renderer *render) {
     d->contentFontSize = contentScale_Text_;
     d->ansiEscape      = new_RegExp("[[()]([0-9;AB]*)m", 0);
     d->render          = render;
-    /* A grayscale palette for rasterized glyphs. */ {
-        SDL_Color colors[256];
-        for (int i = 0; i < 256; ++i) {
-            colors[i] = (SDL_Color){ 255, 255, 255, i };
-        }
-        d->grayscale = SDL_AllocPalette(256);
-        SDL_SetPaletteColors(d->grayscale, colors, 0, 256);
-    }
-    d->pendingRaster = new_PtrSet();
+    d->cacheColorMod   = (iColor){ 255, 255, 255, 255 };
+    d->cacheAlphaMod   = 255;
+    d->cacheUseCounter = 0;
+    d->numCachePages   = 0;
+    d->numGlyphHits    = 0;
+    d->numGlyphMisses  = 0;
+    d->numRerasterized = 0;
+    d->numPageEvictions = 0;
+    d->numRunHits      = 0;
+    d->numRunMisses    = 0;
+    init_Hash(&d->runCache);
+    d->runCacheFront = NULL;
+    d->runCacheBack  = NULL;
+#if defined (LAGRANGE_GLYPH_BATCHING)
+    init_Array(&d->batchVertices, sizeof(SDL_Vertex));
+    init_Array(&d->batchIndices, sizeof(int));
+    d->batchTexture    = NULL;
+#endif
+    d->numDrawCalls      = 0;
+    d->numDrawnGlyphs    = 0;
+    d->numFrameDrawCalls = 0;
+    d->numFrameGlyphs    = 0;
+    init_Hash(&d->savedMetrics);
+    d->numRestoredGlyphs = 0;
+    init_Mutex(&d->mtx);
+    d->fontGeneration = 0;
+    startRasterWorkers_Text_(d);
     initCache_Text_(d);
     initFonts_Text_(d);
+    loadMetrics_Text_(d);
+    restoreMetrics_Text_(d);
+    traceStartup_App("fonts ready");
 }
 
 void deinit_Text(void) {
     iText *d = &text_;
-    SDL_FreePalette(d->grayscale);
+    stopRasterWorkers_Text_(d);
+    saveMetrics_Text_(d);
+    deinit_Hash(&d->savedMetrics);
+    clearRunCache_Text_(d);
+    deinit_Hash(&d->runCache);
+#if defined (LAGRANGE_GLYPH_BATCHING)
+    deinit_Array(&d->batchVertices);
+    deinit_Array(&d->batchIndices);
+#endif
     deinitFonts_Text_(d);
     deinitCache_Text_(d);
     d->render = NULL;
     iRelease(d->ansiEscape);
-    delete_PtrSet(d->pendingRaster);
+    deinit_Mutex(&d->mtx);
 }
 
 void setOpacity_Text(float opacity) {
-    SDL_SetTextureAlphaMod(text_.cache, iClamp(opacity, 0.0f, 1.0f) * 255 + 0.5f);
+    iText *d = &text_;
+    d->cacheAlphaMod = iClamp(opacity, 0.0f, 1.0f) * 255 + 0.5f;
+#if !defined (LAGRANGE_GLYPH_BATCHING)
+    for (int i = 0; i < d->numCachePages; i++) {
+        SDL_SetTextureAlphaMod(d->cachePages[i].texture, d->cacheAlphaMod);
+    }
+#endif
+}
+
+void endFrame_Text(void) {
+    iText *d = &text_;
+    d->numFrameDrawCalls = d->numDrawCalls;
+    d->numFrameGlyphs    = d->numDrawnGlyphs;
+    d->numDrawCalls      = 0;
+    d->numDrawnGlyphs    = 0;
 }
 
 void setContentFont_Text(enum iTextFont font) {
@@ -498,84 +830,128 @@ void setContentFontSize_Text(float fontSizeFactor) {
     }
 }
 
-static void resetCache_Text_(iText *d) {
-    deinitCache_Text_(d);
-    for (int i = 0; i < max_FontId; i++) {
-        clearGlyphs_Font_(&d->fonts[i]);
-    }
-    initCache_Text_(d);
-}
-
 void resetFonts_Text(void) {
     iText *d = &text_;
+    lock_Mutex(&d->mtx);
+    clearRunCache_Text_(d); /* glyphs are owned by the fonts */
+    cancelRaster_Text_(d);
+    storeMetrics_Text_(d); /* in case the same fonts are used again */
     deinitFonts_Text_(d);
     deinitCache_Text_(d);
     initCache_Text_(d);
     initFonts_Text_(d);
+    restoreMetrics_Text_(d);
+    d->fontGeneration++;
+    unlock_Mutex(&d->mtx);
 }
 
 size_t numPendingGlyphs_Text(void) {
-    return size_PtrSet(text_.pendingRaster);
+    iText *d = &text_;
+    size_t num;
+    iGuardMutex(&d->rasterMtx,
+                num = size_Array(&d->rasterQueue) + size_Array(&d->rasterDone) +
+                      d->numActiveRaster);
+    return num;
 }
 
 iLocalDef iFont *font_Text_(enum iFontId id) {
     return &text_.fonts[id & mask_FontId];
 }
 
-static SDL_Surface *rasterizeGlyph_Font_(const iFont *d, uint32_t glyphIndex, float xShift) {
-    int w, h;
-    uint8_t *bmp = stbtt_GetGlyphBitmapSubpixel(
-        &d->font, d->xScale, d->yScale, xShift, 0.0f, glyphIndex, &w, &h, 0, 0);
-    SDL_Surface *surface8 =
-        SDL_CreateRGBSurfaceWithFormatFrom(bmp, w, h, 8, w, SDL_PIXELFORMAT_INDEX8);
-    SDL_SetSurfacePalette(surface8, text_.grayscale);
-    SDL_PixelFormat *fmt = SDL_AllocFormat(SDL_PIXELFORMAT_RGBA8888);
-    SDL_Surface *surface = SDL_ConvertSurface(surface8, fmt, 0);
-    SDL_FreeFormat(fmt);
-    SDL_FreeSurface(surface8);
-    stbtt_FreeBitmap(bmp, NULL);
-    return surface;
-}
-
-iLocalDef SDL_Rect sdlRect_(const iRect rect) {
-    return (SDL_Rect){ rect.pos.x, rect.pos.y, rect.size.x, rect.size.y };
+static uint8_t *rasterizeCoverage_Font_(const iFont *d, uint32_t glyphIndex, int hoff,
+                                       iInt2 *size_out) {
+    /* Only reads the font data, so this can be done in any thread. */
+    return stbtt_GetGlyphBitmapSubpixel(&d->font, d->xScale, d->yScale, hoff * 0.5f, 0.0f,
+                                        glyphIndex, &size_out->x, &size_out->y, 0, 0);
 }
 
-iLocalDef iCacheRow *cacheRow_Text_(iText *d, int height) {
-    return at_Array(&d->cacheRows, (height - 1) / d->cacheRowAllocStep);
+static iThreadResult rasterWorker_Text_(iThread *thread) {
+    iText *d = userData_Thread(thread);
+    lock_Mutex(&d->rasterMtx);
+    for (;;) {
+        while (!d->isStoppingRaster && isEmpty_Array(&d->rasterQueue)) {
+            wait_Condition(&d->rasterAvailable, &d->rasterMtx);
+        }
+        if (d->isStoppingRaster) {
+            signal_Condition(&d->rasterAvailable); /* wake up the next worker */
+            break;
+        }
+        iRasterJob job = *(const iRasterJob *) constFront_Array(&d->rasterQueue);
+        popFront_Array(&d->rasterQueue);
+        d->numActiveRaster++;
+        unlock_Mutex(&d->rasterMtx);
+        /* The glyph and its font remain valid while the job is active. */
+        for (int hoff = 0; hoff < 2; hoff++) {
+            job.coverage[hoff] = rasterizeCoverage_Font_(
+                job.glyph->font, job.glyph->glyphIndex, hoff, &job.size[hoff]);
+        }
+        lock_Mutex(&d->rasterMtx);
+        d->numActiveRaster--;
+        if (job.generation == d->rasterGeneration) {
+            pushBack_Array(&d->rasterDone, &job);
+        }
+        else {
+            freeCoverage_RasterJob_(&job);
+        }
+        signal_Condition(&d->rasterIdle);
+    }
+    unlock_Mutex(&d->rasterMtx);
+    return 0;
+}
+
+static void queueRaster_Text_(iText *d, iGlyph *glyph) {
+    iGuardMutex(&d->rasterMtx, {
+        pushBack_Array(&d->rasterQueue,
+                       &(iRasterJob){ .glyph = glyph, .generation = d->rasterGeneration });
+        signal_Condition(&d->rasterAvailable);
+    });
+}
+
+static void storeCoverage_Text_(iText *d, iGlyph *glyph, int hoff, const uint8_t *coverage,
+                                iInt2 size) {
+    /* Copies a rasterized glyph to its reserved place in the cache page. The texture is
+       updated later, when glyphs are about to be drawn. */
+    iAssert(isCached_Glyph_(glyph));
+    iAssert(isEqual_I2(glyph->rect[hoff].size, size));
+    iCachePage *page = &d->cachePages[glyph->page];
+    const iRect rect = glyph->rect[hoff];
+    for (int y = 0; y < size.y; y++) {
+        uint16_t *     dst = page->pixels + (rect.pos.y + y) * d->cacheSize.x + rect.pos.x;
+        const uint8_t *src = coverage + y * size.x;
+        for (int x = 0; x < size.x; x++) {
+            dst[x] = 0xfff0 | (src[x] >> 4); /* white with coverage as alpha */
+        }
+    }
+    if (!isEmpty_Rect(rect)) {
+        page->dirty = isEmpty_Rect(page->dirty) ? rect : union_Rect(page->dirty, rect);
+    }
+    setRasterized_Glyph_(glyph, hoff);
 }
 
-static iInt2 assignCachePos_Text_(iText *d, iInt2 size) {
-    iCacheRow *cur = cacheRow_Text_(d, size.y);
-    if (cur->height == 0) {
-        /* Begin a new row height. */
-        cur->height = (1 + (size.y - 1) / d->cacheRowAllocStep) * d->cacheRowAllocStep;
-        cur->pos.y = d->cacheBottom;
-        d->cacheBottom = cur->pos.y + cur->height;
+static iBool assignCachePos_Text_(const iText *d, iCachePage *page, iInt2 size, iInt2 *pos_out) {
+    const int  rowHeight = (1 + (iMax(1, size.y) - 1) / d->cacheRowAllocStep) * d->cacheRowAllocStep;
+    iCacheRow *cur       = at_Array(&page->rows, (rowHeight - 1) / d->cacheRowAllocStep);
+    if (cur->height == 0 || cur->pos.x + size.x > d->cacheSize.x) {
+        /* Begin a new row of this height, if there is room left on the page. */
+        if (page->bottom + rowHeight > d->cacheSize.y) {
+            return iFalse;
+        }
+        cur->height = rowHeight;
+        cur->pos    = init_I2(0, page->bottom);
+        page->bottom += rowHeight;
     }
     iAssert(cur->height >= size.y);
-    /* TODO: Automatically enlarge the cache if running out of space?
-       Maybe make it paged, but beware of texture swapping too often inside a text string. */
-    if (cur->pos.x + size.x > d->cacheSize.x) {
-        /* Does not fit on this row, advance to a new location in the cache. */
-        cur->pos.y = d->cacheBottom;
-        cur->pos.x = 0;
-        d->cacheBottom += cur->height;
-        iAssert(d->cacheBottom <= d->cacheSize.y);
-    }
-    const iInt2 assigned = cur->pos;
+    *pos_out = cur->pos;
     cur->pos.x += size.x;
-    return assigned;
+    return iTrue;
 }
 
-static void allocate_Font_(iFont *d, iGlyph *glyph, int hoff) {
-    iRect *glRect = &glyph->rect[hoff];
-    int    x0, y0, x1, y1;
+static void measure_Font_(const iFont *d, iGlyph *glyph, int hoff) {
+    /* Only reads the font data, so this can be done in any thread. */
+    int x0, y0, x1, y1;
     stbtt_GetGlyphBitmapBoxSubpixel(
         &d->font, glyph->glyphIndex, d->xScale, d->yScale, hoff * 0.5f, 0.0f, &x0, &y0, &x1, &y1);
-    glRect->size = init_I2(x1 - x0, y1 - y0);
-    /* Determine placement in the glyph cache texture, advancing in rows. */
-    glRect->pos    = assignCachePos_Text_(&text_, glRect->size);
+    glyph->rect[hoff].size = init_I2(x1 - x0, y1 - y0);
     glyph->d[hoff] = init_I2(x0, y0);
     glyph->d[hoff].y += d->vertOffset;
     if (hoff == 0) { /* hoff==1 uses same metrics as `glyph` */
@@ -586,28 +962,67 @@ static void allocate_Font_(iFont *d, iGlyph *glyph, int hoff) {
     }
 }
 
-static iBool cache_Font_(const iFont *d, iGlyph *glyph, int hoff) {
-    iText *       txt     = &text_;
-    SDL_Renderer *render  = txt->render;
-    SDL_Texture * tex     = NULL;
-    SDL_Surface * surface = NULL;
-    iRect *       glRect  = &glyph->rect[hoff];
-    /* Rasterize the glyph using stbtt. */
-    iAssert(!isRasterized_Glyph_(glyph, hoff));
-    surface = rasterizeGlyph_Font_(d, glyph->glyphIndex, hoff * 0.5f);
-    tex = SDL_CreateTextureFromSurface(render, surface);
-    iAssert(isEqual_I2(glRect->size, init_I2(surface->w, surface->h)));
-    if (tex) {
-        SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_NONE);
-        const SDL_Rect dstRect = sdlRect_(*glRect);
-        SDL_RenderCopy(render, tex, &(SDL_Rect){ 0, 0, dstRect.w, dstRect.h }, &dstRect);
-        SDL_DestroyTexture(tex);
-        setRasterized_Glyph_(glyph, hoff);
+static iBool allocateOnPage_Text_(iText *d, int pageIndex, iGlyph *glyph) {
+    /* Both offset variants are placed side by side in the same slot. */
+    const iInt2 size = init_I2(glyph->rect[0].size.x + glyph->rect[1].size.x,
+                               iMax(glyph->rect[0].size.y, glyph->rect[1].size.y));
+    iInt2 pos;
+    if (!assignCachePos_Text_(d, &d->cachePages[pageIndex], size, &pos)) {
+        return iFalse;
     }
-    if (surface) {
-        SDL_FreeSurface(surface);
+    glyph->page        = pageIndex;
+    glyph->rect[0].pos = pos;
+    glyph->rect[1].pos = init_I2(pos.x + glyph->rect[0].size.x, pos.y);
+    glyph->flags |= cached_GlyphFlag;
+    if (glyph->flags & evicted_GlyphFlag) {
+        glyph->flags &= ~evicted_GlyphFlag;
+        d->numRerasterized++;
+    }
+    return iTrue;
+}
+
+static void evictPage_Text_(iText *d, int pageIndex) {
+    /* Glyph metrics remain valid, only the cached bitmaps are lost. */
+    flushGlyphs_Text_(d); /* queued glyphs may be on this page */
+    for (int i = 0; i < max_FontId; i++) {
+        iForEach(Hash, j, &d->fonts[i].glyphs) {
+            iGlyph *glyph = (iGlyph *) j.value;
+            if (isCached_Glyph_(glyph) && glyph->page == pageIndex) {
+                glyph->flags &= ~(cached_GlyphFlag | rasterized0_GlyphFlag | rasterized1_GlyphFlag);
+                glyph->flags |= evicted_GlyphFlag;
+            }
+        }
     }
-    return isRasterized_Glyph_(glyph, hoff);
+    clearRows_CachePage_(&d->cachePages[pageIndex]);
+    d->numPageEvictions++;
+}
+
+static iBool allocate_Text_(iText *d, iGlyph *glyph, iBool allowEvict) {
+    /* Determine placement in the glyph cache, advancing in rows. Pages are tried starting with
+       the newest one, because the older ones have likely been filled up already. */
+    for (int i = d->numCachePages - 1; i >= 0; i--) {
+        if (allocateOnPage_Text_(d, i, glyph)) {
+            return iTrue;
+        }
+    }
+    if (d->numCachePages < maxCachePages_Text_) {
+        initCachePage_Text_(d, &d->cachePages[d->numCachePages++]);
+        return allocateOnPage_Text_(d, d->numCachePages - 1, glyph);
+    }
+    if (!allowEvict) {
+        return iFalse;
+    }
+    int oldest = 0;
+    for (int i = 1; i < d->numCachePages; i++) {
+        if (d->cachePages[i].lastUsed < d->cachePages[oldest].lastUsed) {
+            oldest = i;
+        }
+    }
+#if !defined (NDEBUG)
+    printf("[Text] glyph cache is full, reusing page %d\n", oldest); fflush(stdout);
+#endif
+    evictPage_Text_(d, oldest);
+    return allocateOnPage_Text_(d, oldest, glyph);
 }
 
 iLocalDef iFont *characterFont_Font_(iFont *d, iChar ch, uint32_t *glyphIndex) {
@@ -652,67 +1067,299 @@ iLocalDef iFont *characterFont_Font_(iFont *d, iChar ch, uint32_t *glyphIndex) {
     return font;
 }
 
-static void doRaster_Font_(const iFont *font, iGlyph *glyph) {
-    SDL_Texture *oldTarget = SDL_GetRenderTarget(text_.render);
-    SDL_SetRenderTarget(text_.render, text_.cache);
-    if (!isRasterized_Glyph_(glyph, 0)) {
-        if (cache_Font_(font, glyph, 0)) {
-            if (isFullyRasterized_Glyph_(glyph)) {
-                remove_PtrSet(text_.pendingRaster, glyph);
-            }
+static void rasterize_Text_(iText *d, iGlyph *glyph) {
+    /* The glyph is needed right away, so rasterize it in this thread. */
+    for (int hoff = 0; hoff < 2; hoff++) {
+        if (!isRasterized_Glyph_(glyph, hoff)) {
+            iInt2    size;
+            uint8_t *coverage =
+                rasterizeCoverage_Font_(glyph->font, glyph->glyphIndex, hoff, &size);
+            storeCoverage_Text_(d, glyph, hoff, coverage, size);
+            stbtt_FreeBitmap(coverage, NULL);
         }
     }
-    if (!isRasterized_Glyph_(glyph, 1)) {
-        if (cache_Font_(font, glyph, 1)) { /* half-pixel offset */
-            if (isFullyRasterized_Glyph_(glyph)) {
-                remove_PtrSet(text_.pendingRaster, glyph);
+}
+
+static void storeFinishedRaster_Text_(iText *d) {
+    /* Called with the text mutex locked. */
+    iArray done;
+    init_Array(&done, sizeof(iRasterJob));
+    iGuardMutex(&d->rasterMtx, {
+        setCopy_Array(&done, &d->rasterDone);
+        clear_Array(&d->rasterDone);
+    });
+    iForEach(Array, i, &done) {
+        iRasterJob *job   = i.value;
+        iGlyph *    glyph = job->glyph;
+        if (!isFullyRasterized_Glyph_(glyph) &&
+            (isCached_Glyph_(glyph) || allocate_Text_(d, glyph, iFalse))) {
+            for (int hoff = 0; hoff < 2; hoff++) {
+                if (!isRasterized_Glyph_(glyph, hoff)) {
+                    storeCoverage_Text_(d, glyph, hoff, job->coverage[hoff], job->size[hoff]);
+                }
             }
+            d->numAsyncRasterized++;
         }
+        /* Otherwise, it will be rasterized when actually drawn. */
+        freeCoverage_RasterJob_(job);
     }
-    SDL_SetRenderTarget(text_.render, oldTarget);
+    deinit_Array(&done);
 }
 
-static const iGlyph *glyph_Font_(iFont *d, iChar ch) {
-    iGlyph * glyph;
+static const iGlyph *glyphMetrics_Font_(iFont *d, iChar ch) {
+    /* Metrics are enough for measuring text. This does not touch the cache texture. */
     uint32_t glyphIndex = 0;
     /* The glyph may actually come from a different font; look up the right font. */
     iFont *font = characterFont_Font_(d, ch, &glyphIndex);
     void * node = value_Hash(&font->glyphs, ch);
     if (node) {
-        glyph = node;
+        return node;
+    }
+    iGlyph *glyph     = new_Glyph(ch);
+    glyph->glyphIndex = glyphIndex;
+    glyph->font       = font;
+    measure_Font_(font, glyph, 0);
+    measure_Font_(font, glyph, 1);
+    insert_Hash(&font->glyphs, &glyph->node);
+    /* Rasterize it in the background so it's ready to be drawn. */
+    queueRaster_Text_(&text_, glyph);
+    return glyph;
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+static void serialize_Glyph_(const iGlyph *d, iStream *outs) {
+    writeU32_Stream(outs, codepoint_Glyph_(d));
+    writeU32_Stream(outs, d->glyphIndex);
+    for (int hoff = 0; hoff < 2; hoff++) {
+        writeU16_Stream(outs, (uint16_t) d->rect[hoff].size.x);
+        writeU16_Stream(outs, (uint16_t) d->rect[hoff].size.y);
+        writeU16_Stream(outs, (uint16_t) d->d[hoff].x);
+        writeU16_Stream(outs, (uint16_t) d->d[hoff].y);
+    }
+    uint32_t advance;
+    memcpy(&advance, &d->advance, sizeof(advance));
+    writeU32_Stream(outs, advance);
+}
+
+static void deserialize_Glyph_(iGlyph *d, iStream *ins) {
+    d->node.key   = readU32_Stream(ins);
+    d->glyphIndex = readU32_Stream(ins);
+    for (int hoff = 0; hoff < 2; hoff++) {
+        d->rect[hoff].size.x = (int16_t) readU16_Stream(ins);
+        d->rect[hoff].size.y = (int16_t) readU16_Stream(ins);
+        d->d[hoff].x         = (int16_t) readU16_Stream(ins);
+        d->d[hoff].y         = (int16_t) readU16_Stream(ins);
+    }
+    const uint32_t advance = readU32_Stream(ins);
+    memcpy(&d->advance, &advance, sizeof(advance));
+}
+
+static void delete_SavedMetrics_(iSavedMetrics *d) {
+    deinit_Block(&d->glyphs);
+    free(d);
+}
+
+static iSavedMetrics *new_SavedMetrics_(uint32_t key) {
+    iSavedMetrics *d = iMalloc(SavedMetrics);
+    d->node.key = key;
+    init_Block(&d->glyphs, 0);
+    return d;
+}
+
+static void replaceSavedMetrics_Text_(iText *d, iSavedMetrics *metrics) {
+    iSavedMetrics *old = (iSavedMetrics *) remove_Hash(&d->savedMetrics, metrics->node.key);
+    if (old) {
+        delete_SavedMetrics_(old);
+    }
+    insert_Hash(&d->savedMetrics, &metrics->node);
+}
+
+static void storeMetrics_Text_(iText *d) {
+    /* Serialize the glyphs of the current fonts. Fonts using the same data at the same size
+       share one set of metrics. */
+    for (int i = 0; i < max_FontId; i++) {
+        const iFont *font    = &d->fonts[i];
+        iBool        isFirst = iTrue;
+        for (int j = 0; j < i; j++) {
+            if (d->fonts[j].metricsKey == font->metricsKey) {
+                isFirst = iFalse;
+                break;
+            }
+        }
+        if (!isFirst) {
+            continue;
+        }
+        iBuffer *buf = new_Buffer();
+        openEmpty_Buffer(buf);
+        for (int j = i; j < max_FontId; j++) {
+            if (d->fonts[j].metricsKey != font->metricsKey) {
+                continue;
+            }
+            iConstForEach(Hash, g, &d->fonts[j].glyphs) {
+                const iGlyph *glyph = (const iGlyph *) g.value;
+                iBool isDuplicate = iFalse;
+                for (int k = i; k < j && !isDuplicate; k++) {
+                    isDuplicate = d->fonts[k].metricsKey == font->metricsKey &&
+                                  value_Hash(&d->fonts[k].glyphs, codepoint_Glyph_(glyph));
+                }
+                if (!isDuplicate) {
+                    serialize_Glyph_(glyph, stream_Buffer(buf));
+                }
+            }
+        }
+        if (!isEmpty_Block(data_Buffer(buf))) {
+            iSavedMetrics *metrics = new_SavedMetrics_(font->metricsKey);
+            set_Block(&metrics->glyphs, data_Buffer(buf));
+            replaceSavedMetrics_Text_(d, metrics);
+        }
+        iRelease(buf);
+    }
+}
+
+static void restoreMetrics_Text_(iText *d) {
+    /* Glyphs whose metrics are known are created up front and rasterized in the background,
+       so they'll likely be ready when first drawn. */
+    for (int i = 0; i < max_FontId; i++) {
+        iFont *              font    = &d->fonts[i];
+        const iSavedMetrics *metrics = (const iSavedMetrics *) value_Hash(&d->savedMetrics,
+                                                                           font->metricsKey);
+        if (!metrics) {
+            continue;
+        }
+        iBuffer *buf = new_Buffer();
+        open_Buffer(buf, &metrics->glyphs);
+        while (!atEnd_Buffer(buf)) {
+            iGlyph *glyph = new_Glyph(0);
+            deserialize_Glyph_(glyph, stream_Buffer(buf));
+            glyph->font = font;
+            if (value_Hash(&font->glyphs, glyph->node.key)) {
+                delete_Glyph(glyph);
+                continue;
+            }
+            insert_Hash(&font->glyphs, &glyph->node);
+            queueRaster_Text_(d, glyph);
+            d->numRestoredGlyphs++;
+        }
+        iRelease(buf);
+    }
+}
+
+static void loadMetrics_Text_(iText *d) {
+    iFile *f = newCStr_File(concatPath_CStr(cstr_String(dataDir_App()), metricsFileName_Text_));
+    if (open_File(f, readOnly_FileMode)) {
+        iBuffer *buf = new_Buffer();
+        open_Buffer(buf, collect_Block(readAll_File(f)));
+        iStream *ins = stream_Buffer(buf);
+        char magic[4];
+        readData_Buffer(buf, 4, magic);
+        if (!memcmp(magic, metricsMagic_Text_, 4) && readU32_Stream(ins) == 1 /* version */) {
+            const size_t count = readU32_Stream(ins);
+            for (size_t i = 0; i < count && !atEnd_Buffer(buf); i++) {
+                iSavedMetrics *metrics = new_SavedMetrics_(readU32_Stream(ins));
+                resize_Block(&metrics->glyphs, readU32_Stream(ins));
+                if (readData_Buffer(buf, size_Block(&metrics->glyphs),
+                                    data_Block(&metrics->glyphs)) !=
+                    size_Block(&metrics->glyphs)) {
+                    delete_SavedMetrics_(metrics);
+                    break;
+                }
+                replaceSavedMetrics_Text_(d, metrics);
+            }
+        }
+        iRelease(buf);
+    }
+    iRelease(f);
+}
+
+static void saveMetrics_Text_(iText *d) {
+    storeMetrics_Text_(d);
+    /* Metrics of the current fonts are always kept; others only while there is room. */
+    iPtrArray kept;
+    init_PtrArray(&kept);
+    for (int i = 0; i < max_FontId; i++) {
+        const iSavedMetrics *metrics = (const iSavedMetrics *) value_Hash(&d->savedMetrics,
+                                                                           d->fonts[i].metricsKey);
+        if (metrics && indexOf_PtrArray(&kept, metrics) == iInvalidPos) {
+            pushBack_PtrArray(&kept, metrics);
+        }
+    }
+    iConstForEach(Hash, i, &d->savedMetrics) {
+        if (size_PtrArray(&kept) >= maxSavedMetrics_Text_) {
+            break;
+        }
+        if (indexOf_PtrArray(&kept, i.value) == iInvalidPos) {
+            pushBack_PtrArray(&kept, i.value);
+        }
+    }
+    /* Written in the background, replacing the previous file only once complete. */
+    iBuffer *buf = new_Buffer();
+    openEmpty_Buffer(buf);
+    iStream *outs = stream_Buffer(buf);
+    writeData_Stream(outs, metricsMagic_Text_, 4);
+    writeU32_Stream(outs, 1); /* version */
+    writeU32_Stream(outs, size_PtrArray(&kept));
+    iConstForEach(PtrArray, i, &kept) {
+        const iSavedMetrics *metrics = i.ptr;
+        writeU32_Stream(outs, metrics->node.key);
+        writeU32_Stream(outs, size_Block(&metrics->glyphs));
+        writeData_Stream(outs, constData_Block(&metrics->glyphs), size_Block(&metrics->glyphs));
+    }
+    writeBlock_Persist("glyphmetrics",
+                       concatPath_CStr(cstr_String(dataDir_App()), metricsFileName_Text_),
+                       copy_Block(data_Buffer(buf)));
+    iRelease(buf);
+    deinit_PtrArray(&kept);
+    iForEach(Hash, j, &d->savedMetrics) {
+        delete_SavedMetrics_((iSavedMetrics *) j.value);
+    }
+    clear_Hash(&d->savedMetrics);
+}
+
+static void prepareGlyph_Text_(iText *d, iGlyph *glyph) {
+    /* Make sure the glyph is in the cache so it can be drawn. */
+    if (isCached_Glyph_(glyph) && isFullyRasterized_Glyph_(glyph)) {
+        d->numGlyphHits++;
     }
     else {
-        /* If the cache is running out of space, clear it and we'll recache what's needed currently. */
-        if (text_.cacheBottom > text_.cacheSize.y - maxGlyphHeight_Text_(&text_)) {
-#if !defined (NDEBUG)
-            printf("[Text] glyph cache is full, clearing!\n"); fflush(stdout);
-#endif
-            resetCache_Text_(&text_);
+        d->numGlyphMisses++;
+    }
+    if (!isCached_Glyph_(glyph)) {
+        allocate_Text_(d, glyph, iTrue);
+    }
+    if (!isFullyRasterized_Glyph_(glyph)) {
+        storeFinishedRaster_Text_(d); /* maybe a worker has already done it */
+        if (!isFullyRasterized_Glyph_(glyph)) {
+            rasterize_Text_(d, glyph);
         }
-        glyph             = new_Glyph(ch);
-        glyph->glyphIndex = glyphIndex;
-        glyph->font       = font;
-        /* New glyphs are always allocated at least. This reserves a position in the cache
-           and updates the glyph metrics. */
-        allocate_Font_(font, glyph, 0);
-        allocate_Font_(font, glyph, 1);
-        insert_Hash(&font->glyphs, &glyph->node);
-        insert_PtrSet(text_.pendingRaster, glyph);
-    }
-    if (enableRaster_Text_ && !isFullyRasterized_Glyph_(glyph)) {
-        doRaster_Font_(font, glyph);
     }
+    d->cachePages[glyph->page].lastUsed = d->cacheUseCounter;
+}
+
+static const iGlyph *glyph_Font_(iFont *d, iChar ch) {
+    iGlyph *glyph = iConstCast(iGlyph *, glyphMetrics_Font_(d, ch));
+    prepareGlyph_Text_(&text_, glyph);
+    return glyph;
+}
+
+static const iGlyph *lockedGlyph_Font_(iFont *d, iChar ch, iBool isMeasuring, iGlyph *copy_out) {
+    /* The text mutex is only held while accessing the glyph hash and the cache. Measuring
+       threads work with a copy of the metrics; the returned pointer is only valid until the
+       fonts are reset, which happens in the main thread. */
+    lock_Mutex(&text_.mtx);
+    const iGlyph *glyph = isMeasuring ? glyphMetrics_Font_(d, ch) : glyph_Font_(d, ch);
+    *copy_out = *glyph;
+    unlock_Mutex(&text_.mtx);
     return glyph;
 }
 
 void rasterizeSomePendingGlyphs_Text(void) {
-    size_t count = 5;
-    iForEach(PtrSet, i, text_.pendingRaster) {
-        iGlyph *glyph = *i.value;
-        remove_PtrSet(text_.pendingRaster, glyph);
-        doRaster_Font_(glyph->font, glyph);
-        if (!count--) break;
-    }
+    /* Glyphs finished by the workers are uploaded in one batch per cache page. */
+    iText *d = &text_;
+    lock_Mutex(&d->mtx);
+    storeFinishedRaster_Text_(d);
+    uploadCache_Text_(d);
+    unlock_Mutex(&d->mtx);
 }
 
 enum iRunMode {
@@ -784,6 +1431,207 @@ struct Impl_RunArgs {
     int *         runAdvance_out;
 };
 
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareType(RunGlyph)
+
+struct Impl_RunGlyph {
+    iGlyph * glyph;
+    int      hoff;
+    SDL_Rect dst;    /* relative to the run origin, clipped to the line */
+    int      srcTop; /* pixels clipped from the top */
+};
+
+/* Laid out glyphs of a short piece of text. Measuring and drawing the same text with the same
+   parameters reuses the layout. Glyph pointers remain valid until the fonts are reset. */
+struct Impl_CachedRun {
+    iHashNode    node;
+    iCachedRun * prev; /* more recently used */
+    iCachedRun * next;
+    const iFont *font;
+    int          flags;
+    int          xposLimit; /* relative to the origin */
+    size_t       maxLen;
+    iBlock       text;
+    iBool        hasColorEscapes;
+    iRect        bounds; /* relative to the origin */
+    int          advance;
+    size_t       continuePos; /* offset in the text */
+    iArray       glyphs;
+};
+
+static const size_t maxCachedRunLength_Text_ = 160; /* bytes */
+static const size_t maxCachedRuns_Text_      = 4096;
+
+enum iCachedRunFlag {
+    layoutFlagsMask_CachedRun = noWrapFlag_RunMode | visualFlag_RunMode |
+                                alwaysVariableWidthFlag_RunMode,
+    hasLimit_CachedRun        = iBit(16),
+    halfPixel_CachedRun       = iBit(17),
+    kerning_CachedRun         = iBit(18),
+};
+
+static void delete_CachedRun_(iCachedRun *d) {
+    deinit_Block(&d->text);
+    deinit_Array(&d->glyphs);
+    free(d);
+}
+
+static void clearRunCache_Text_(iText *d) {
+    iForEach(Hash, i, &d->runCache) {
+        delete_CachedRun_((iCachedRun *) i.value);
+    }
+    clear_Hash(&d->runCache);
+    d->runCacheFront = NULL;
+    d->runCacheBack  = NULL;
+}
+
+static void unlinkCachedRun_Text_(iText *d, iCachedRun *run) {
+    if (run->prev) {
+        run->prev->next = run->next;
+    }
+    else {
+        d->runCacheFront = run->next;
+    }
+    if (run->next) {
+        run->next->prev = run->prev;
+    }
+    else {
+        d->runCacheBack = run->prev;
+    }
+    run->prev = run->next = NULL;
+}
+
+static void pushFrontCachedRun_Text_(iText *d, iCachedRun *run) {
+    run->prev = NULL;
+    run->next = d->runCacheFront;
+    if (d->runCacheFront) {
+        d->runCacheFront->prev = run;
+    }
+    else {
+        d->runCacheBack = run;
+    }
+    d->runCacheFront = run;
+}
+
+static void touchCachedRun_Text_(iText *d, iCachedRun *run) {
+    if (d->runCacheFront != run) {
+        unlinkCachedRun_Text_(d, run);
+        pushFrontCachedRun_Text_(d, run);
+    }
+}
+
+static iBool isCacheable_RunArgs_(const iRunArgs *d) {
+    const size_t len = size_Range(&d->text);
+    if (len == 0 || len > maxCachedRunLength_Text_) {
+        return iFalse;
+    }
+    /* Tab stops depend on the absolute position, and soft hyphens are handled differently when
+       measuring and drawing. */
+    for (const char *ch = d->text.start; ch < d->text.end; ch++) {
+        if (*ch == '\t' || (*ch == '\xc2' && ch + 1 < d->text.end && ch[1] == '\xad')) {
+            return iFalse;
+        }
+    }
+    return iTrue;
+}
+
+static int cacheFlags_RunArgs_(const iRunArgs *d) {
+    return (d->mode & layoutFlagsMask_CachedRun) |
+           (d->xposLimit > 0 ? hasLimit_CachedRun : 0) |
+           (enableHalfPixelGlyphs_Text ? halfPixel_CachedRun : 0) |
+           (enableKerning_Text ? kerning_CachedRun : 0);
+}
+
+static int cacheLimit_RunArgs_(const iRunArgs *d) {
+    return d->xposLimit > 0 ? d->xposLimit - d->pos.x : 0;
+}
+
+static uint32_t cacheKey_RunArgs_(const iFont *font, const iRunArgs *d) {
+    uint32_t hash = 2166136261u; /* FNV-1a */
+    for (const char *ch = d->text.start; ch < d->text.end; ch++) {
+        hash = (hash ^ (uint8_t) *ch) * 16777619u;
+    }
+    hash = (hash ^ (uint32_t) fontId_Text_(font)) * 16777619u;
+    hash = (hash ^ (uint32_t) cacheFlags_RunArgs_(d)) * 16777619u;
+    hash = (hash ^ (uint32_t) cacheLimit_RunArgs_(d)) * 16777619u;
+    hash = (hash ^ (uint32_t) d->maxLen) * 16777619u;
+    return hash;
+}
+
+static iCachedRun *findCachedRun_Text_(iText *d, const iFont *font, const iRunArgs *args) {
+    iCachedRun *run =
+        (iCachedRun *) value_Hash(&d->runCache, cacheKey_RunArgs_(font, args));
+    if (run && run->font == font && run->flags == cacheFlags_RunArgs_(args) &&
+        run->xposLimit == cacheLimit_RunArgs_(args) && run->maxLen == args->maxLen &&
+        size_Block(&run->text) == size_Range(&args->text) &&
+        memcmp(constData_Block(&run->text), args->text.start, size_Range(&args->text)) == 0) {
+        return run;
+    }
+    return NULL;
+}
+
+static void insertCachedRun_Text_(iText *d, const iFont *font, const iRunArgs *args,
+                                  iRect bounds, int advance, const char *continueFrom,
+                                  iBool hasColorEscapes, iArray *glyphs) {
+    /* Evict the least recently used runs. Both the UI and the layout thread share the cache,
+       so clearing it wholesale would throw away the visible page's runs as well. */
+    while (size_Hash(&d->runCache) >= maxCachedRuns_Text_ && d->runCacheBack) {
+        iCachedRun *lru = d->runCacheBack;
+        unlinkCachedRun_Text_(d, lru);
+        remove_Hash(&d->runCache, lru->node.key);
+        delete_CachedRun_(lru);
+    }
+    iCachedRun *run = iMalloc(CachedRun);
+    run->node.key        = cacheKey_RunArgs_(font, args);
+    run->font            = font;
+    run->flags           = cacheFlags_RunArgs_(args);
+    run->xposLimit       = cacheLimit_RunArgs_(args);
+    run->maxLen          = args->maxLen;
+    initData_Block(&run->text, args->text.start, size_Range(&args->text));
+    run->hasColorEscapes = hasColorEscapes;
+    run->bounds          = bounds;
+    if ((args->mode & visualFlag_RunMode) && !isEmpty_Rect(bounds)) {
+        run->bounds.pos = sub_I2(bounds.pos, args->pos);
+    }
+    run->advance     = advance;
+    run->continuePos = continueFrom - args->text.start;
+    initCopy_Array(&run->glyphs, glyphs);
+    iCachedRun *old = (iCachedRun *) remove_Hash(&d->runCache, run->node.key);
+    if (old) {
+        unlinkCachedRun_Text_(d, old);
+        delete_CachedRun_(old);
+    }
+    insert_Hash(&d->runCache, &run->node);
+    pushFrontCachedRun_Text_(d, run);
+}
+
+static iRect replay_CachedRun_(const iCachedRun *d, const iRunArgs *args) {
+    const iInt2 orig = args->pos;
+    if (!isMeasuring_(args->mode)) {
+        iConstForEach(Array, i, &d->glyphs) {
+            const iRunGlyph *rg = i.value;
+            prepareGlyph_Text_(&text_, rg->glyph);
+            const iRect *rect = &rg->glyph->rect[rg->hoff];
+            SDL_Rect src = { rect->pos.x, rect->pos.y + rg->srcTop, rect->size.x, rg->dst.h };
+            SDL_Rect dst = { orig.x + rg->dst.x, orig.y + rg->dst.y, rg->dst.w, rg->dst.h };
+            drawGlyph_Text_(&text_, rg->glyph, &src, &dst);
+        }
+        flushGlyphs_Text_(&text_);
+    }
+    if (args->continueFrom_out) {
+        *args->continueFrom_out = args->text.start + d->continuePos;
+    }
+    if (args->runAdvance_out) {
+        *args->runAdvance_out = d->advance;
+    }
+    iRect bounds = d->bounds;
+    if ((args->mode & visualFlag_RunMode) && !isEmpty_Rect(bounds)) {
+        bounds.pos = add_I2(bounds.pos, orig);
+    }
+    return bounds;
+}
+
 static iRect run_Font_(iFont *d, const iRunArgs *args) {
     iRect       bounds      = zero_Rect();
     const iInt2 orig        = args->pos;
@@ -795,17 +1643,38 @@ static iRect run_Font_(iFont *d, const iRunArgs *args) {
     float       xposExtend  = orig.x; /* allows wide glyphs to use more space; restored by whitespace */
     const enum iRunMode mode        = args->mode;
     const char *        lastWordEnd = args->text.start;
+    const char *        breakPos    = args->text.end;
     iAssert(args->xposLimit == 0 || isMeasuring_(mode));
-    if (args->continueFrom_out) {
-        *args->continueFrom_out = args->text.end;
-    }
     iChar prevCh = 0;
+    /* Measuring only needs glyph metrics, so it can be done outside the main thread. */
+    const iBool isMeasuring = isMeasuring_(mode);
+    iGlyph      glyphCopy;
+    lock_Mutex(&text_.mtx);
+    const uint32_t fontGeneration = text_.fontGeneration;
+    if (!isMeasuring) {
+        text_.cacheUseCounter++;
+    }
+    /* Maybe the same text has already been laid out? */
+    iArray *recorded = NULL;
+    if (isCacheable_RunArgs_(args)) {
+        iCachedRun *cached = findCachedRun_Text_(&text_, d, args);
+        if (cached && (isMeasuring || !cached->hasColorEscapes)) {
+            text_.numRunHits++;
+            touchCachedRun_Text_(&text_, cached);
+            bounds = replay_CachedRun_(cached, args);
+            unlock_Mutex(&text_.mtx);
+            return bounds;
+        }
+        text_.numRunMisses++;
+        recorded = new_Array(sizeof(iRunGlyph));
+    }
+    unlock_Mutex(&text_.mtx);
+    iBool hasColorEscapes = iFalse;
     const iBool isMonospaced = d->isMonospaced && !(mode & alwaysVariableWidthFlag_RunMode);
     if (isMonospaced) {
-        monoAdvance = glyph_Font_(d, 'M')->advance;
+        lockedGlyph_Font_(d, 'M', isMeasuring, &glyphCopy);
+        monoAdvance = glyphCopy.advance;
     }
-    /* Global flag that allows glyph rasterization. */
-    enableRaster_Text_ = !isMeasuring_(mode);
     for (const char *chPos = args->text.start; chPos != args->text.end; ) {
         iAssert(chPos < args->text.end);
         const char *currentPos = chPos;
@@ -814,11 +1683,12 @@ static iRect run_Font_(iFont *d, const iRunArgs *args) {
             iRegExpMatch m;
             init_RegExpMatch(&m);
             if (match_RegExp(text_.ansiEscape, chPos, args->text.end - chPos, &m)) {
+                hasColorEscapes = iTrue;
                 if (mode & draw_RunMode && ~mode & permanentColorFlag_RunMode) {
                     /* Change the color. */
-                    const iColor clr =
-                        ansiForeground_Color(capturedRange_RegExpMatch(&m, 1), tmParagraph_ColorId);
-                    SDL_SetTextureColorMod(text_.cache, clr.r, clr.g, clr.b);
+                    setCacheColorMod_Text_(&text_,
+                                           ansiForeground_Color(capturedRange_RegExpMatch(&m, 1),
+                                                                tmParagraph_ColorId));
                 }
                 chPos = end_RegExpMatch(&m);
                 continue;
@@ -844,8 +1714,11 @@ static iRect run_Font_(iFont *d, const iRunArgs *args) {
                     if (args->xposLimit > 0) {
                         const char *postHyphen = chPos;
                         iChar       nextCh     = nextChar_(&postHyphen, args->text.end);
-                        if ((int) xpos + glyph_Font_(d, ch)->rect[0].size.x +
-                            glyph_Font_(d, nextCh)->rect[0].size.x > args->xposLimit) {
+                        lockedGlyph_Font_(d, ch, isMeasuring, &glyphCopy);
+                        const int hyphenWidth = glyphCopy.rect[0].size.x;
+                        lockedGlyph_Font_(d, nextCh, isMeasuring, &glyphCopy);
+                        if ((int) xpos + hyphenWidth + glyphCopy.rect[0].size.x >
+                            args->xposLimit) {
                             /* Wraps after hyphen, should show it. */
                         }
                         else continue;
@@ -893,9 +1766,9 @@ static iRect run_Font_(iFont *d, const iRunArgs *args) {
                     esc = nextChar_(&chPos, args->text.end) + asciiExtended_ColorEscape;
                     colorNum = esc - asciiBase_ColorEscape;
                 }
+                hasColorEscapes = iTrue;
                 if (mode & draw_RunMode && ~mode & permanentColorFlag_RunMode) {
-                    const iColor clr = get_Color(colorNum);
-                    SDL_SetTextureColorMod(text_.cache, clr.r, clr.g, clr.b);
+                    setCacheColorMod_Text_(&text_, get_Color(colorNum));
                 }
                 prevCh = 0;
                 continue;
@@ -904,19 +1777,20 @@ static iRect run_Font_(iFont *d, const iRunArgs *args) {
                 continue;
             }
         }
-        const iGlyph *glyph = glyph_Font_(d, ch);
+        /* Metrics are read from the copy. The shared glyph is only referenced for drawing and
+           for the run cache. */
+        const iGlyph *sharedGlyph = lockedGlyph_Font_(d, ch, isMeasuring, &glyphCopy);
+        const iGlyph *glyph       = &glyphCopy;
         int x1 = iMax(xpos, xposExtend);
         const int hoff = enableHalfPixelGlyphs_Text ? (xpos - x1 > 0.5f ? 1 : 0) : 0;
         int x2 = x1 + glyph->rect[hoff].size.x;
         /* Out of the allotted space? */
         if (args->xposLimit > 0 && x2 > args->xposLimit) {
-            if (args->continueFrom_out) {
-                if (lastWordEnd != args->text.start) {
-                    *args->continueFrom_out = lastWordEnd;
-                }
-                else {
-                    *args->continueFrom_out = currentPos; /* forced break */
-                }
+            if (lastWordEnd != args->text.start) {
+                breakPos = lastWordEnd;
+            }
+            else {
+                breakPos = currentPos; /* forced break */
             }
             break;
         }
@@ -949,7 +1823,7 @@ static iRect run_Font_(iFont *d, const iRunArgs *args) {
         const iBool useMonoAdvance =
             monoAdvance > 0 && !isJapanese_FontId(fontId_Text_(glyph->font));
         const float advance = (useMonoAdvance ? monoAdvance : glyph->advance);
-        if (!isMeasuring_(mode)) {
+        if (!isMeasuring_(mode) || recorded) {
             if (useMonoAdvance && dst.w > advance && glyph->font != d && !isEmoji) {
                 /* Glyphs from a different font may need recentering to look better. */
                 dst.x -= (dst.w - advance) / 2;
@@ -970,7 +1844,16 @@ static iRect run_Font_(iFont *d, const iRunArgs *args) {
                 src.y += over;
                 src.h -= over;
             }
-            SDL_RenderCopy(text_.render, text_.cache, &src, &dst);
+            if (recorded) {
+                pushBack_Array(recorded,
+                               &(iRunGlyph){ iConstCast(iGlyph *, sharedGlyph),
+                                             hoff,
+                                             { dst.x - orig.x, dst.y - orig.y, dst.w, dst.h },
+                                             src.y - glyph->rect[hoff].pos.y });
+            }
+            if (!isMeasuring_(mode)) {
+                drawGlyph_Text_(&text_, glyph, &src, &dst);
+            }
         }
         xpos += advance;
         if (!isSpace_Char(ch)) {
@@ -978,7 +1861,7 @@ static iRect run_Font_(iFont *d, const iRunArgs *args) {
         }
         xposExtend = iMax(xposExtend, xpos);
         xposMax    = iMax(xposMax, xposExtend);
-        if (args->continueFrom_out && ((mode & noWrapFlag_RunMode) || isWrapBoundary_(prevCh, ch))) {
+        if ((mode & noWrapFlag_RunMode) || isWrapBoundary_(prevCh, ch)) {
             lastWordEnd = chPos;
         }
 #if defined (LAGRANGE_ENABLE_KERNING)
@@ -997,6 +1880,22 @@ static iRect run_Font_(iFont *d, const iRunArgs *args) {
             break;
         }
     }
+    if (!isMeasuring_(mode)) {
+        flushGlyphs_Text_(&text_);
+    }
+    if (recorded) {
+        lock_Mutex(&text_.mtx);
+        /* The recorded glyphs are gone if the fonts were reset in the meantime. */
+        if (text_.fontGeneration == fontGeneration) {
+            insertCachedRun_Text_(&text_, d, args, bounds, xposMax - orig.x, breakPos,
+                                  hasColorEscapes, recorded);
+        }
+        unlock_Mutex(&text_.mtx);
+        delete_Array(recorded);
+    }
+    if (args->continueFrom_out) {
+        *args->continueFrom_out = breakPos;
+    }
     if (args->runAdvance_out) {
         *args->runAdvance_out = xposMax - orig.x;
     }
@@ -1088,8 +1987,7 @@ iInt2 advanceN_Text(int fontId, const char *text, size_t n) {
 
 static void drawBounded_Text_(int fontId, iInt2 pos, int xposBound, int color, iRangecc text) {
     iText *d = &text_;
-    const iColor clr = get_Color(color & mask_ColorId);
-    SDL_SetTextureColorMod(d->cache, clr.r, clr.g, clr.b);
+    setCacheColorMod_Text_(d, get_Color(color & mask_ColorId));
     run_Font_(font_Text_(fontId),
               &(iRunArgs){ .mode = draw_RunMode |
                                    (color & permanent_ColorId ? permanentColorFlag_RunMode : 0) |
@@ -1189,7 +2087,36 @@ void drawCentered_Text(int fontId, iRect rect, iBool alignVisual, int color, con
 }
 
 SDL_Texture *glyphCache_Text(void) {
-    return text_.cache;
+    return text_.cachePages[0].texture;
+}
+
+const iString *debugInfo_Text(void) {
+    const iText *d = &text_;
+    iString *str = collectNew_String();
+    const size_t numLookups = d->numGlyphHits + d->numGlyphMisses;
+    appendFormat_String(str, "* Pages: %d / %d (%dx%d)\n",
+                        d->numCachePages, maxCachePages_Text_, d->cacheSize.x, d->cacheSize.y);
+    appendFormat_String(str, "* Hit rate: %.1f%% of %zu glyph lookups\n",
+                        numLookups ? 100.0 * d->numGlyphHits / numLookups : 0.0, numLookups);
+    appendFormat_String(str, "* Re-rasterized glyphs: %zu\n", d->numRerasterized);
+    appendFormat_String(str, "* Evicted pages: %zu\n", d->numPageEvictions);
+    appendFormat_String(str, "* Glyph draw calls in last frame: %zu (%zu glyphs%s)\n",
+                        d->numFrameDrawCalls, d->numFrameGlyphs,
+#if defined (LAGRANGE_GLYPH_BATCHING)
+                        ", batched"
+#else
+                        ""
+#endif
+                        );
+    appendFormat_String(str, "* Background rasterized: %zu glyphs (%d workers, %zu uploads)\n",
+                        d->numAsyncRasterized, d->numRasterWorkers, d->numUploads);
+    appendFormat_String(str, "* Glyph metrics restored from the previous session: %zu\n",
+                        d->numRestoredGlyphs);
+    const size_t numRuns = d->numRunHits + d->numRunMisses;
+    appendFormat_String(str, "* Cached runs: %zu (hit rate %.1f%% of %zu)\n",
+                        size_Hash(&d->runCache),
+                        numRuns ? 100.0 * d->numRunHits / numRuns : 0.0, numRuns);
+    return str;
 }
 
 static void freeBitmap_(void *ptr) {
@@ -1312,11 +2239,11 @@ void init_TextBuf(iTextBuf *d, int font, const char *text) {
                                    d->size.y);
     SDL_Texture *oldTarget = SDL_GetRenderTarget(render);
     SDL_SetRenderTarget(render, d->texture);
-    SDL_SetTextureBlendMode(text_.cache, SDL_BLENDMODE_NONE); /* blended when TextBuf is drawn */
+    setCacheBlendMode_Text_(&text_, SDL_BLENDMODE_NONE); /* blended when TextBuf is drawn */
     SDL_SetRenderDrawColor(text_.render, 255, 255, 255, 0);
     SDL_RenderClear(text_.render);
     draw_Text_(font, zero_I2(), white_ColorId, range_CStr(text));
-    SDL_SetTextureBlendMode(text_.cache, SDL_BLENDMODE_BLEND);
+    setCacheBlendMode_Text_(&text_, SDL_BLENDMODE_BLEND);
     SDL_SetRenderTarget(render, oldTarget);
     SDL_SetTextureBlendMode(d->texture, SDL_BLENDMODE_BLEND);
 }
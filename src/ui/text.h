@@ -203,6 +203,8 @@ void    drawBoundRange_Text (int fontId, iInt2 pos, int boundWidth, int color, i
 int     drawWrapRange_Text  (int fontId, iInt2 pos, int maxWidth, int color, iRangecc text); /* returns new Y */
 
 SDL_Texture *   glyphCache_Text     (void);
+const iString * debugInfo_Text      (void);
+void            endFrame_Text       (void); /* updates per-frame statistics */
 
 enum iTextBlockMode { quadrants_TextBlockMode, shading_TextBlockMode };
 
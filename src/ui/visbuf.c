@@ -27,7 +27,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 iDefineTypeConstruction(VisBuf)
 
 void init_VisBuf(iVisBuf *d) {
-    d->texSize = zero_I2();
+    d->texSize      = zero_I2();
+    d->vis          = (iRangei){ 0, 0 };
+    d->scrollDir    = +1;
+    d->numBuffers   = minBuffers_VisBuf;
+    d->numAllocated = 0;
+    d->rowCost      = 0.0f;
     iZap(d->buffers);
 }
 
@@ -35,8 +40,12 @@ void deinit_VisBuf(iVisBuf *d) {
     dealloc_VisBuf(d);
 }
 
+void setNumBuffers_VisBuf(iVisBuf *d, size_t count) {
+    d->numBuffers = iClamp(count, (size_t) minBuffers_VisBuf, (size_t) maxBuffers_VisBuf);
+}
+
 void invalidate_VisBuf(iVisBuf *d) {
-    iForIndices(i, d->buffers) {
+    for (size_t i = 0; i < d->numAllocated; i++) {
         d->buffers[i].origin = i * d->texSize.y;
         iZap(d->buffers[i].validRange);
     }
@@ -44,13 +53,12 @@ void invalidate_VisBuf(iVisBuf *d) {
 
 void alloc_VisBuf(iVisBuf *d, const iInt2 size, int granularity) {
     const iInt2 texSize = init_I2(size.x, (size.y / 2 / granularity + 1) * granularity);
-    if (!d->buffers[0].texture || !isEqual_I2(texSize, d->texSize)) {
+    if (!d->buffers[0].texture || !isEqual_I2(texSize, d->texSize) ||
+        d->numAllocated != d->numBuffers) {
+        dealloc_VisBuf(d);
         d->texSize = texSize;
-        iForIndices(i, d->buffers) {
+        for (size_t i = 0; i < d->numBuffers; i++) {
             iVisBufTexture *tex = &d->buffers[i];
-            if (tex->texture) {
-                SDL_DestroyTexture(tex->texture);
-            }
             tex->texture =
                 SDL_CreateTexture(renderer_Window(get_Window()),
                                   SDL_PIXELFORMAT_RGBA8888,
@@ -61,62 +69,93 @@ void alloc_VisBuf(iVisBuf *d, const iInt2 size, int granularity) {
             tex->origin = i * texSize.y;
             iZap(tex->validRange);
         }
+        d->numAllocated = d->numBuffers;
     }
 }
 
 void dealloc_VisBuf(iVisBuf *d) {
     d->texSize = zero_I2();
-    iForIndices(i, d->buffers) {
+    for (size_t i = 0; i < d->numAllocated; i++) {
         SDL_DestroyTexture(d->buffers[i].texture);
         d->buffers[i].texture = NULL;
     }
+    d->numAllocated = 0;
 }
 
-void reposition_VisBuf(iVisBuf *d, const iRangei vis) {
-    d->vis = vis;
-    iRangei good = { 0, 0 };
-    size_t avail[3], numAvail = 0;
-    /* Check which buffers are available for reuse. */ {
-        iForIndices(i, d->buffers) {
-            iVisBufTexture *buf = d->buffers + i;
-            const iRangei region = { buf->origin, buf->origin + d->texSize.y };
-            if (region.start >= vis.end || region.end <= vis.start) {
-                avail[numAvail++] = i;
-                iZap(buf->validRange);
-            }
-            else {
-                good = union_Rangei(good, region);
-            }
+static int slotOrigin_VisBuf_(const iVisBuf *d, int y) {
+    /* Rounds down, also for negative positions. */
+    const int h = d->texSize.y;
+    return (y >= 0 ? y / h : -((-y + h - 1) / h)) * h;
+}
+
+static iRangei region_VisBuf_(const iVisBuf *d, const iVisBufTexture *buf) {
+    return (iRangei){ buf->origin, buf->origin + d->texSize.y };
+}
+
+static iRangei slots_VisBuf_(const iVisBuf *d, const iRangei range) {
+    return (iRangei){ slotOrigin_VisBuf_(d, range.start),
+                      slotOrigin_VisBuf_(d, range.end - 1) + d->texSize.y };
+}
+
+static size_t find_VisBuf_(const iVisBuf *d, int origin) {
+    for (size_t i = 0; i < d->numAllocated; i++) {
+        if (d->buffers[i].origin == origin) {
+            return i;
         }
     }
-    if (numAvail == iElemCount(d->buffers)) {
-        /* All buffers are outside the visible range, do a reset. */
-        d->buffers[0].origin = vis.start;
-        d->buffers[1].origin = vis.start + d->texSize.y;
-        d->buffers[2].origin = vis.start + 2 * d->texSize.y;
-    }
-    else {
-        /* Extend to cover the visible range. */
-        while (vis.start < good.start) {
-            iAssert(numAvail > 0);
-            d->buffers[avail[--numAvail]].origin = good.start - d->texSize.y;
-            good.start -= d->texSize.y;
+    return iInvalidPos;
+}
+
+static size_t takeFarthest_VisBuf_(iVisBuf *d, const iRangei keep) {
+    /* The buffer farthest away from the visible range is the least likely to be needed. */
+    const int mid   = (d->vis.start + d->vis.end) / 2;
+    size_t    found = iInvalidPos;
+    int       dist  = -1;
+    for (size_t i = 0; i < d->numAllocated; i++) {
+        const iRangei region = region_VisBuf_(d, &d->buffers[i]);
+        if (region.start < keep.end && region.end > keep.start) {
+            continue;
         }
-        while (vis.end > good.end) {
-            iAssert(numAvail > 0);
-            d->buffers[avail[--numAvail]].origin = good.end;
-            good.end += d->texSize.y;
+        const int bufDist = iAbs((region.start + region.end) / 2 - mid);
+        if (bufDist > dist) {
+            found = i;
+            dist  = bufDist;
+        }
+    }
+    if (found != iInvalidPos) {
+        iZap(d->buffers[found].validRange);
+    }
+    return found;
+}
+
+void reposition_VisBuf(iVisBuf *d, const iRangei vis) {
+    if (vis.start != d->vis.start) {
+        d->scrollDir = vis.start > d->vis.start ? +1 : -1;
+    }
+    d->vis = vis;
+    if (d->texSize.y <= 0 || isEmpty_Rangei(vis)) {
+        return;
+    }
+    /* Buffers are positioned on a grid, so ones that were drawn earlier can be reused
+       as-is when the visible range moves back over them. */
+    const iRangei needed = slots_VisBuf_(d, vis);
+    for (int origin = needed.start; origin < needed.end; origin += d->texSize.y) {
+        if (find_VisBuf_(d, origin) == iInvalidPos) {
+            const size_t avail = takeFarthest_VisBuf_(d, needed);
+            if (avail == iInvalidPos) {
+                break;
+            }
+            d->buffers[avail].origin = origin;
         }
     }
 }
 
 void invalidRanges_VisBuf(const iVisBuf *d, const iRangei full, iRangei *out_invalidRanges) {
-    iForIndices(i, d->buffers) {
+    for (size_t i = 0; i < d->numAllocated; i++) {
         const iVisBufTexture *buf = d->buffers + i;
         const iRangei before = { full.start, buf->validRange.start };
         const iRangei after  = { buf->validRange.end, full.end };
-        const iRangei region = intersect_Rangei(d->vis, (iRangei){ buf->origin,
-                                                                   buf->origin + d->texSize.y });
+        const iRangei region = intersect_Rangei(d->vis, region_VisBuf_(d, buf));
         out_invalidRanges[i] = intersect_Rangei(before, region);
         if (isEmpty_Rangei(out_invalidRanges[i])) {
             out_invalidRanges[i] = intersect_Rangei(after, region);
@@ -125,17 +164,29 @@ void invalidRanges_VisBuf(const iVisBuf *d, const iRangei full, iRangei *out_inv
 }
 
 void validate_VisBuf(iVisBuf *d) {
-    iForIndices(i, d->buffers) {
+    for (size_t i = 0; i < d->numAllocated; i++) {
         iVisBufTexture *buf = &d->buffers[i];
-        buf->validRange =
-            intersect_Rangei(d->vis, (iRangei){ buf->origin, buf->origin + d->texSize.y });
+        const iRangei drawn = intersect_Rangei(d->vis, region_VisBuf_(d, buf));
+        if (isEmpty_Rangei(drawn)) {
+            continue; /* offscreen contents remain valid */
+        }
+        if (!isEmpty_Rangei(buf->validRange) && buf->validRange.start <= drawn.end &&
+            drawn.start <= buf->validRange.end) {
+            buf->validRange = union_Rangei(buf->validRange, drawn);
+        }
+        else {
+            buf->validRange = drawn;
+        }
     }
 }
 
 void draw_VisBuf(const iVisBuf *d, iInt2 topLeft) {
     SDL_Renderer *render = renderer_Window(get_Window());
-    iForIndices(i, d->buffers) {
+    for (size_t i = 0; i < d->numAllocated; i++) {
         const iVisBufTexture *buf = d->buffers + i;
+        if (isEmpty_Rangei(intersect_Rangei(d->vis, region_VisBuf_(d, buf)))) {
+            continue;
+        }
         SDL_RenderCopy(render,
                        buf->texture,
                        NULL,
@@ -145,3 +196,75 @@ void draw_VisBuf(const iVisBuf *d, iInt2 topLeft) {
                                     d->texSize.y });
     }
 }
+
+void addRedrawCost_VisBuf(iVisBuf *d, int numRows, double seconds) {
+    if (numRows <= 0) {
+        return;
+    }
+    const float cost = (float) (seconds / numRows);
+    d->rowCost = (d->rowCost > 0.0f ? 0.9f * d->rowCost + 0.1f * cost : cost);
+}
+
+int prefetchRows_VisBuf(const iVisBuf *d, double secondsSpent) {
+    /* Leave time for the rest of the frame. Very small slices aren't worth the overhead. */
+    const double budget  = 1.0 / 120.0;
+    const int    minRows = iMax(1, d->texSize.y / 16);
+    if (d->rowCost <= 0.0f) {
+        return secondsSpent < budget ? iMax(minRows, d->texSize.y / 4) : 0; /* cost not known */
+    }
+    const double rows = (budget - secondsSpent) / d->rowCost;
+    return rows >= minRows ? (int) iMin(rows, (double) d->texSize.y) : 0;
+}
+
+iVisBufTexture *prefetch_VisBuf(iVisBuf *d, const iRangei full, int maxRows, iRangei *range_out) {
+    if (d->texSize.y <= 0 || isEmpty_Rangei(d->vis) || maxRows <= 0) {
+        return NULL;
+    }
+    const iRangei needed   = slots_VisBuf_(d, d->vis);
+    const int     numSlots = size_Range(&needed) / d->texSize.y;
+    const int     numAhead = (int) d->numAllocated - numSlots;
+    for (int j = 0; j < numAhead; j++) {
+        const int origin = d->scrollDir > 0 ? needed.end + j * d->texSize.y
+                                            : needed.start - (j + 1) * d->texSize.y;
+        const iRangei want = intersect_Rangei((iRangei){ origin, origin + d->texSize.y }, full);
+        if (isEmpty_Rangei(want)) {
+            break; /* end of the document */
+        }
+        size_t index = find_VisBuf_(d, origin);
+        if (index != iInvalidPos) {
+            const iRangei valid = d->buffers[index].validRange;
+            if (valid.start <= want.start && valid.end >= want.end) {
+                continue;
+            }
+        }
+        else {
+            const iRangei keep = d->scrollDir > 0 ? (iRangei){ needed.start, origin + d->texSize.y }
+                                                  : (iRangei){ origin, needed.end };
+            index = takeFarthest_VisBuf_(d, keep);
+            if (index == iInvalidPos) {
+                break;
+            }
+            d->buffers[index].origin = origin;
+        }
+        /* The caller will draw this slice now. Buffers are filled starting from the side
+           nearest to the visible range, and the valid range grows by at most `maxRows`. */
+        iRangei *valid = &d->buffers[index].validRange;
+        iRangei  draw;
+        if (isEmpty_Rangei(*valid) || valid->end < want.start || valid->start > want.end) {
+            draw = d->scrollDir > 0 ? (iRangei){ want.start, iMin(want.end, want.start + maxRows) }
+                                    : (iRangei){ iMax(want.start, want.end - maxRows), want.end };
+            *valid = draw;
+        }
+        else if (valid->end < want.end && (d->scrollDir > 0 || valid->start <= want.start)) {
+            draw = (iRangei){ valid->end, iMin(want.end, valid->end + maxRows) };
+            valid->end = draw.end;
+        }
+        else {
+            draw = (iRangei){ iMax(want.start, valid->start - maxRows), valid->start };
+            valid->start = draw.start;
+        }
+        *range_out = draw;
+        return &d->buffers[index];
+    }
+    return NULL;
+}
@@ -29,20 +29,32 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 iDeclareType(VisBuf)
 iDeclareType(VisBufTexture)
 
+enum iVisBufLimits {
+    minBuffers_VisBuf = 3, /* enough to cover the visible range */
+    maxBuffers_VisBuf = 8,
+};
+
 struct Impl_VisBufTexture {
     SDL_Texture *texture;
-    int origin;
+    int origin; /* always a multiple of the texture height */
     iRangei validRange;
 };
 
+/* Buffers beyond the ones needed for the visible range keep their contents while scrolling,
+   and may be filled in advance in the scroll direction (see prefetch_VisBuf). */
 struct Impl_VisBuf {
     iInt2 texSize;
     iRangei vis;
-    iVisBufTexture buffers[3];
+    int scrollDir;
+    size_t numBuffers;
+    size_t numAllocated;
+    float rowCost; /* average seconds per redrawn pixel row */
+    iVisBufTexture buffers[maxBuffers_VisBuf];
 };
 
 iDeclareTypeConstruction(VisBuf)
 
+void    setNumBuffers_VisBuf    (iVisBuf *, size_t count); /* takes effect in alloc_VisBuf */
 void    invalidate_VisBuf       (iVisBuf *);
 void    alloc_VisBuf            (iVisBuf *, const iInt2 size, int granularity);
 void    dealloc_VisBuf          (iVisBuf *);
@@ -51,3 +63,7 @@ void    validate_VisBuf         (iVisBuf *);
 
 void    invalidRanges_VisBuf    (const iVisBuf *, const iRangei full, iRangei *out_invalidRanges);
 void    draw_VisBuf             (const iVisBuf *, iInt2 topLeft);
+
+void    addRedrawCost_VisBuf    (iVisBuf *, int numRows, double seconds);
+int     prefetchRows_VisBuf     (const iVisBuf *, double secondsSpent); /* zero if no time left */
+iVisBufTexture *prefetch_VisBuf (iVisBuf *, const iRangei full, int maxRows, iRangei *range_out);
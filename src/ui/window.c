@@ -1858,7 +1858,9 @@ void draw_Window(iWindow *d) {
         SDL_RenderCopy(d->render, glyphCache_Text(), NULL, &rect);
     }
 #endif
+    endFrame_Text();
     SDL_RenderPresent(d->render);
+    finishStartupTrace_App();
     rasterizeSomePendingGlyphs_Text();
 }
 
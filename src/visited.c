@@ -22,15 +22,21 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include "visited.h"
 #include "app.h"
+#include "persist.h"
 
+#include <the_Foundation/buffer.h>
 #include <the_Foundation/file.h>
+#include <the_Foundation/fileinfo.h>
 #include <the_Foundation/mutex.h>
 #include <the_Foundation/path.h>
 #include <the_Foundation/ptrarray.h>
-#include <the_Foundation/sortedarray.h>
 
 const int maxAge_Visited = 2 * 3600 * 24 * 30; /* two months */
 
+static const char *fileName_Visited_       = "visited.3.bin";
+static const char *importFileName_Visited_ = "visited.2.txt";
+static const char *magic_Visited_          = "lgVi";
+
 void init_VisitedUrl(iVisitedUrl *d) {
     initCurrent_Time(&d->when);
     init_String(&d->url);
@@ -41,61 +47,174 @@ void deinit_VisitedUrl(iVisitedUrl *d) {
     deinit_String(&d->url);
 }
 
-static int cmpUrl_VisitedUrl_(const void *a, const void *b) {
-    return cmpString_String(&((const iVisitedUrl *) a)->url, &((const iVisitedUrl *) b)->url);
-}
-
 static int cmpNewer_VisitedUrl_(const void *insert, const void *existing) {
     return seconds_Time(&((const iVisitedUrl *) insert  )->when) >
            seconds_Time(&((const iVisitedUrl *) existing)->when);
 }
 
+static uint32_t hash_Rangecc_(iRangecc range) {
+    uint32_t hash = 2166136261u; /* FNV-1a */
+    for (const char *ch = range.start; ch < range.end; ch++) {
+        hash = (hash ^ (uint8_t) *ch) * 16777619u;
+    }
+    return hash;
+}
+
 /*----------------------------------------------------------------------------------------------*/
 
+iDeclareType(VisitedSlot)
+
+struct Impl_VisitedSlot {
+    uint32_t hash;
+    uint32_t pos; /* index in visited plus one; zero if the slot is empty */
+};
+
 struct Impl_Visited {
-    iMutex *mtx;
-    iSortedArray visited;
+    iMutex * mtx;
+    iArray   visited; /* VisitedUrls in no particular order */
+    iArray   index;   /* VisitedSlots; open addressing, size is a power of two */
+    uint32_t generation; /* incremented on every change */
 };
 
 iDefineTypeConstruction(Visited)
 
 void init_Visited(iVisited *d) {
     d->mtx = new_Mutex();
-    init_SortedArray(&d->visited, sizeof(iVisitedUrl), cmpUrl_VisitedUrl_);
+    init_Array(&d->visited, sizeof(iVisitedUrl));
+    init_Array(&d->index, sizeof(iVisitedSlot));
+    d->generation = 1;
 }
 
 void deinit_Visited(iVisited *d) {
     iGuardMutex(d->mtx, {
         clear_Visited(d);
-        deinit_SortedArray(&d->visited);
+        deinit_Array(&d->index);
+        deinit_Array(&d->visited);
     });
     delete_Mutex(d->mtx);
 }
 
-void save_Visited(const iVisited *d, const char *dirPath) {
-    iString *line = new_String();
-    iFile *f = newCStr_File(concatPath_CStr(dirPath, "visited.2.txt"));
-    if (open_File(f, writeOnly_FileMode | text_FileMode)) {
-        lock_Mutex(d->mtx);
-        iConstForEach(Array, i, &d->visited.values) {
-            const iVisitedUrl *item = i.value;
-            format_String(line,
-                          "%llu %04x %s\n",
-                          (unsigned long long) integralSeconds_Time(&item->when),
-                          item->flags,
-                          cstr_String(&item->url));
-            writeData_File(f, cstr_String(line), size_String(line));
+static iVisitedSlot *slot_Visited_(const iVisited *d, size_t index) {
+    return (iVisitedSlot *) constAt_Array(&d->index, index);
+}
+
+static size_t findSlot_Visited_(const iVisited *d, iRangecc url, uint32_t hash) {
+    if (isEmpty_Array(&d->index)) {
+        return iInvalidPos;
+    }
+    const size_t mask = size_Array(&d->index) - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        const iVisitedSlot *slot = slot_Visited_(d, i);
+        if (!slot->pos) {
+            return iInvalidPos;
+        }
+        if (slot->hash == hash &&
+            equal_Rangecc(url, cstr_String(
+                &((const iVisitedUrl *) constAt_Array(&d->visited, slot->pos - 1))->url))) {
+            return i;
         }
-        unlock_Mutex(d->mtx);
     }
-    iRelease(f);
-    delete_String(line);
 }
 
-void load_Visited(iVisited *d, const char *dirPath) {
-    iFile *f = newCStr_File(concatPath_CStr(dirPath, "visited.2.txt"));
+static void insertSlot_Visited_(iVisited *d, uint32_t hash, size_t pos) {
+    const size_t mask = size_Array(&d->index) - 1;
+    size_t i = hash & mask;
+    while (slot_Visited_(d, i)->pos) {
+        i = (i + 1) & mask;
+    }
+    *slot_Visited_(d, i) = (iVisitedSlot){ hash, pos + 1 };
+}
+
+static void rehash_Visited_(iVisited *d) {
+    /* Keep the load factor at or below one half. */
+    size_t size = 64;
+    while (size < 2 * size_Array(&d->visited)) {
+        size *= 2;
+    }
+    clear_Array(&d->index);
+    resize_Array(&d->index, size);
+    memset(data_Array(&d->index), 0, size * sizeof(iVisitedSlot));
+    iConstForEach(Array, i, &d->visited) {
+        const iVisitedUrl *item = i.value;
+        insertSlot_Visited_(d, hash_Rangecc_(range_String(&item->url)), index_ArrayConstIterator(&i));
+    }
+}
+
+static void removeSlot_Visited_(iVisited *d, size_t index) {
+    /* Backward shift deletion: move later entries of the probe sequence into the gap. */
+    const size_t mask = size_Array(&d->index) - 1;
+    size_t i = index;
+    size_t j = index;
+    slot_Visited_(d, i)->pos = 0;
+    for (;;) {
+        j = (j + 1) & mask;
+        iVisitedSlot *slot = slot_Visited_(d, j);
+        if (!slot->pos) {
+            break;
+        }
+        const size_t home = slot->hash & mask;
+        if (i <= j ? (i < home && home <= j) : (i < home || home <= j)) {
+            continue; /* Already reachable from its home slot. */
+        }
+        *slot_Visited_(d, i) = *slot;
+        slot->pos = 0;
+        i = j;
+    }
+}
+
+static void append_Visited_(iVisited *d, iVisitedUrl *item) {
+    pushBack_Array(&d->visited, item);
+    if (size_Array(&d->visited) * 2 > size_Array(&d->index)) {
+        rehash_Visited_(d);
+    }
+    else {
+        insertSlot_Visited_(d, hash_Rangecc_(range_String(&item->url)), size_Array(&d->visited) - 1);
+    }
+}
+
+static void remove_Visited_(iVisited *d, size_t slotIndex) {
+    /* The last item is moved to fill the gap. */
+    const size_t pos  = slot_Visited_(d, slotIndex)->pos - 1;
+    const size_t last = size_Array(&d->visited) - 1;
+    removeSlot_Visited_(d, slotIndex);
+    deinit_VisitedUrl(at_Array(&d->visited, pos));
+    if (pos != last) {
+        iVisitedUrl *moved = at_Array(&d->visited, last);
+        const size_t movedSlot =
+            findSlot_Visited_(d, range_String(&moved->url), hash_Rangecc_(range_String(&moved->url)));
+        iAssert(movedSlot != iInvalidPos);
+        slot_Visited_(d, movedSlot)->pos = pos + 1;
+        *(iVisitedUrl *) at_Array(&d->visited, pos) = *moved;
+    }
+    remove_Array(&d->visited, last);
+}
+
+static void serialize_Visited_(const void *object, iStream *outs) {
+    const iVisited *d = object;
+    writeData_Stream(outs, magic_Visited_, 4);
+    writeU32_Stream(outs, latest_FileVersion);
+    lock_Mutex(d->mtx);
+    writeU32_Stream(outs, size_Array(&d->visited));
+    iConstForEach(Array, i, &d->visited) {
+        const iVisitedUrl *item = i.value;
+        writeU64_Stream(outs, integralSeconds_Time(&item->when));
+        writeU16_Stream(outs, item->flags);
+        serialize_String(&item->url, outs);
+    }
+    unlock_Mutex(d->mtx);
+}
+
+void save_Visited(const iVisited *d, const char *dirPath) {
+    requestSave_Persist("visited",
+                        concatPath_CStr(dirPath, fileName_Visited_),
+                        serialize_Visited_,
+                        d);
+}
+
+static void importText_Visited_(iVisited *d, const char *path) {
+    /* The old text format: "seconds flags url" on each line. */
+    iFile *f = newCStr_File(path);
     if (open_File(f, readOnly_FileMode | text_FileMode)) {
-        lock_Mutex(d->mtx);
         const iRangecc src  = range_Block(collect_Block(readAll_File(f)));
         iRangecc       line = iNullRange;
         iTime          now;
@@ -114,81 +233,142 @@ void load_Visited(iVisited *d, const char *dirPath) {
             }
             item.flags = flags;
             initRange_String(&item.url, (iRangecc){ urlStart, line.end });
-            insert_SortedArray(&d->visited, &item);
+            const size_t existing = findSlot_Visited_(
+                d, range_String(&item.url), hash_Rangecc_(range_String(&item.url)));
+            if (existing != iInvalidPos) {
+                remove_Visited_(d, existing);
+            }
+            append_Visited_(d, &item);
         }
+    }
+    iRelease(f);
+}
+
+iBool exportText_Visited(const iVisited *d, const iString *path) {
+    /* Same format as importText_Visited_() reads. */
+    iFile *f = new_File(path);
+    if (!open_File(f, writeOnly_FileMode | text_FileMode)) {
+        iRelease(f);
+        return iFalse;
+    }
+    iString *line = new_String();
+    lock_Mutex(d->mtx);
+    iConstForEach(Array, i, &d->visited) {
+        const iVisitedUrl *item = i.value;
+        format_String(line,
+                      "%llu %04x %s\n",
+                      (unsigned long long) integralSeconds_Time(&item->when),
+                      item->flags,
+                      cstr_String(&item->url));
+        writeData_File(f, cstr_String(line), size_String(line));
+    }
+    unlock_Mutex(d->mtx);
+    delete_String(line);
+    iRelease(f);
+    return iTrue;
+}
+
+void load_Visited(iVisited *d, const char *dirPath) {
+    const char *path = concatPath_CStr(dirPath, fileName_Visited_);
+    lock_Mutex(d->mtx);
+    d->generation++;
+    if (!fileExistsCStr_FileInfo(path)) {
+        importText_Visited_(d, concatPath_CStr(dirPath, importFileName_Visited_));
         unlock_Mutex(d->mtx);
+        return;
+    }
+    iFile *f = newCStr_File(path);
+    if (open_File(f, readOnly_FileMode)) {
+        iBuffer *buf = new_Buffer();
+        open_Buffer(buf, collect_Block(readAll_File(f)));
+        iStream *ins = stream_Buffer(buf);
+        char magic[4];
+        readData_Buffer(buf, 4, magic);
+        if (!memcmp(magic, magic_Visited_, 4) && readU32_Stream(ins) <= latest_FileVersion) {
+            const size_t count = readU32_Stream(ins);
+            iTime now;
+            initCurrent_Time(&now);
+            /* Each URL is known to be unique, so the index can be built in one go. */
+            reserve_Array(&d->visited, count);
+            for (size_t i = 0; i < count && !atEnd_Buffer(buf); i++) {
+                iVisitedUrl item;
+                iZap(item.when);
+                item.when.ts.tv_sec = readU64_Stream(ins);
+                item.flags          = readU16_Stream(ins);
+                init_String(&item.url);
+                deserialize_String(&item.url, ins);
+                if (secondsSince_Time(&now, &item.when) > maxAge_Visited ||
+                    isEmpty_String(&item.url)) {
+                    deinit_String(&item.url); /* Too old. */
+                    continue;
+                }
+                pushBack_Array(&d->visited, &item);
+            }
+            rehash_Visited_(d);
+        }
+        iRelease(buf);
     }
     iRelease(f);
+    unlock_Mutex(d->mtx);
 }
 
 void clear_Visited(iVisited *d) {
     lock_Mutex(d->mtx);
-    iForEach(Array, v, &d->visited.values) {
+    iForEach(Array, v, &d->visited) {
         deinit_VisitedUrl(v.value);
     }
-    clear_SortedArray(&d->visited);
+    clear_Array(&d->visited);
+    clear_Array(&d->index);
+    d->generation++;
     unlock_Mutex(d->mtx);
 }
 
-static size_t find_Visited_(const iVisited *d, const iString *url) {
-    iVisitedUrl visit;
-    init_VisitedUrl(&visit);
-    set_String(&visit.url, url);
-    size_t pos = iInvalidPos;
-    iGuardMutex(d->mtx, {
-        locate_SortedArray(&d->visited, &visit, &pos);
-        deinit_VisitedUrl(&visit);
-    });
-    return pos;
-}
-
 void visitUrl_Visited(iVisited *d, const iString *url, uint16_t visitFlags) {
     if (isEmpty_String(url)) return;
     iVisitedUrl visit;
     init_VisitedUrl(&visit);
-    visit.flags = visitFlags;
-    set_String(&visit.url, url);
-    size_t pos;
     lock_Mutex(d->mtx);
-    if (locate_SortedArray(&d->visited, &visit, &pos)) {
-        iVisitedUrl *old = at_SortedArray(&d->visited, pos);
+    const size_t slot = findSlot_Visited_(d, range_String(url), hash_Rangecc_(range_String(url)));
+    if (slot != iInvalidPos) {
+        iVisitedUrl *old = at_Array(&d->visited, slot_Visited_(d, slot)->pos - 1);
         if (cmpNewer_VisitedUrl_(&visit, old)) {
-            old->when = visit.when;
+            old->when  = visit.when;
             old->flags = visitFlags;
-            unlock_Mutex(d->mtx);
-            deinit_VisitedUrl(&visit);
-            return;
+            d->generation++;
         }
+        unlock_Mutex(d->mtx);
+        deinit_VisitedUrl(&visit);
+        return;
     }
-    insert_SortedArray(&d->visited, &visit);
+    visit.flags = visitFlags;
+    set_String(&visit.url, url);
+    append_Visited_(d, &visit);
+    d->generation++;
     unlock_Mutex(d->mtx);
 }
 
 void removeUrl_Visited(iVisited *d, const iString *url) {
     iGuardMutex(d->mtx, {
-        size_t pos = find_Visited_(d, url);
-        if (pos < size_SortedArray(&d->visited)) {
-            iVisitedUrl *visUrl = at_SortedArray(&d->visited, pos);
-            if (equal_String(&visUrl->url, url)) {
-                deinit_VisitedUrl(visUrl);
-                remove_Array(&d->visited.values, pos);
-            }
+        const size_t slot =
+            findSlot_Visited_(d, range_String(url), hash_Rangecc_(range_String(url)));
+        if (slot != iInvalidPos) {
+            remove_Visited_(d, slot);
+            d->generation++;
         }
     });
 }
 
 iTime urlVisitTime_Visited(const iVisited *d, const iString *url) {
-    iVisitedUrl item;
-    size_t pos;
-    iZap(item);
-    initCopy_String(&item.url, url);
+    iTime when;
+    iZap(when);
     lock_Mutex(d->mtx);
-    if (locate_SortedArray(&d->visited, &item, &pos)) {
-        item.when = ((const iVisitedUrl *) constAt_SortedArray(&d->visited, pos))->when;
+    const size_t slot = findSlot_Visited_(d, range_String(url), hash_Rangecc_(range_String(url)));
+    if (slot != iInvalidPos) {
+        when = ((const iVisitedUrl *) constAt_Array(&d->visited, slot_Visited_(d, slot)->pos - 1))
+                   ->when;
     }
     unlock_Mutex(d->mtx);
-    deinit_String(&item.url);
-    return item.when;
+    return when;
 }
 
 iBool containsUrl_Visited(const iVisited *d, const iString *url) {
@@ -204,7 +384,7 @@ static int cmpWhenDescending_VisitedUrlPtr_(const void *a, const void *b) {
 const iArray *list_Visited(const iVisited *d, size_t count) {
     iPtrArray *urls = collectNew_PtrArray();
     iGuardMutex(d->mtx, {
-        iConstForEach(Array, i, &d->visited.values) {
+        iConstForEach(Array, i, &d->visited) {
             const iVisitedUrl *vis = i.value;
             if (~vis->flags & transient_VisitedUrlFlag) {
                 pushBack_PtrArray(urls, vis);
@@ -217,3 +397,17 @@ const iArray *list_Visited(const iVisited *d, size_t count) {
     }
     return urls;
 }
+
+uint32_t generation_Visited(const iVisited *d) {
+    uint32_t gen;
+    iGuardMutex(d->mtx, gen = d->generation);
+    return gen;
+}
+
+void forEach_Visited(const iVisited *d, iVisitedFunc func, void *context) {
+    iGuardMutex(d->mtx, {
+        iConstForEach(Array, i, &d->visited) {
+            func(context, i.value);
+        }
+    });
+}
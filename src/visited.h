@@ -46,9 +46,12 @@ enum iVisitedUrlFlag {
 iDeclareType(Visited)
 iDeclareTypeConstruction(Visited)
 
+typedef void (*iVisitedFunc)(void *context, const iVisitedUrl *);
+
 void    clear_Visited           (iVisited *);
 void    load_Visited            (iVisited *, const char *dirPath);
 void    save_Visited            (const iVisited *, const char *dirPath);
+iBool   exportText_Visited      (const iVisited *, const iString *path); /* one "seconds flags url" per line */
 
 iTime   urlVisitTime_Visited    (const iVisited *, const iString *url);
 void    visitUrl_Visited        (iVisited *, const iString *url, uint16_t visitFlags); /* adds URL to the visited URLs set */
@@ -56,3 +59,7 @@ void    removeUrl_Visited       (iVisited *, const iString *url);
 iBool   containsUrl_Visited     (const iVisited *, const iString *url);
 
 const iPtrArray *  list_Visited (const iVisited *, size_t count); /* returns collected */
+
+/* These can be called from any thread. forEach_Visited() holds the lock while calling `func`. */
+uint32_t    generation_Visited  (const iVisited *); /* changes whenever the URLs are modified */
+void        forEach_Visited     (const iVisited *, iVisitedFunc func, void *context);
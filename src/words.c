@@ -0,0 +1,92 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+
+#include "words.h"
+
+iBool isWordChar_Words(char ch) {
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') ||
+           (uint8_t) ch >= 0x80;
+}
+
+iBool nextWord_Words(iRangecc text, iRangecc *word) {
+    const char *pos = word->end ? word->end : text.start;
+    while (pos < text.end && !isWordChar_Words(*pos)) {
+        pos++;
+    }
+    if (pos == text.end) {
+        return iFalse;
+    }
+    word->start = pos;
+    while (pos < text.end && isWordChar_Words(*pos)) {
+        pos++;
+    }
+    word->end = pos;
+    return iTrue;
+}
+
+void setLowerWord_Words(iString *d, iRangecc word) {
+    setRange_String(d, word);
+    for (const char *ch = word.start; ch < word.end; ch++) {
+        if ((uint8_t) *ch >= 0x80) {
+            set_String(d, collect_String(lower_String(d)));
+            return;
+        }
+    }
+    for (char *ch = data_Block(&d->chars), *end = ch + size_String(d); ch < end; ch++) {
+        if (*ch >= 'A' && *ch <= 'Z') {
+            *ch += 'a' - 'A';
+        }
+    }
+}
+
+int cmpId_Words(const void *a, const void *b) {
+    return iCmp(*(const uint32_t *) a, *(const uint32_t *) b);
+}
+
+void sortUniqueIds_Words(iArray *ids) {
+    sort_Array(ids, cmpId_Words);
+    uint32_t *data = data_Array(ids);
+    size_t    out  = 0;
+    for (size_t i = 0; i < size_Array(ids); i++) {
+        if (out == 0 || data[out - 1] != data[i]) {
+            data[out++] = data[i];
+        }
+    }
+    resize_Array(ids, out);
+}
+
+void intersectIds_Words(iArray *ids, const iArray *other) {
+    const uint32_t *a = constData_Array(ids), *b = constData_Array(other);
+    const size_t    na = size_Array(ids), nb = size_Array(other);
+    size_t          out = 0;
+    for (size_t i = 0, j = 0; i < na && j < nb;) {
+        if (a[i] < b[j]) i++;
+        else if (a[i] > b[j]) j++;
+        else {
+            ((uint32_t *) data_Array(ids))[out++] = a[i];
+            i++;
+            j++;
+        }
+    }
+    resize_Array(ids, out);
+}
@@ -0,0 +1,182 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+
+/* Compares finding the run at a point with the position index against the linear scan
+   that GmDocument used before, over generated layouts of different sizes. Both methods are
+   timed separately with the same points, and their results are compared afterwards. */
+
+#include "gmrunindex.h"
+
+#include <the_Foundation/foundation.h>
+#include <the_Foundation/time.h>
+#include <stdio.h>
+
+static const int numLookups_ = 1000;
+static const int numRounds_  = 5;
+
+static void generateLayout_(iArray *layout, size_t numRuns) {
+    /* Paragraphs of text lines, with bullets and quote borders as decorations and some
+       space between the paragraphs. */
+    const int lineHeight = 20;
+    int       y          = 0;
+    int       paragraph  = 0;
+    while (size_Array(layout) < numRuns) {
+        const int   numLines = 1 + paragraph % 5;
+        const iBool isQuote  = (paragraph % 7 == 3);
+        if (paragraph % 4 == 1) {
+            iGmRun bullet = { .flags = decoration_GmRunFlag };
+            bullet.bounds = bullet.visBounds = init_Rect(10, y, 10, lineHeight);
+            pushBack_Array(layout, &bullet);
+        }
+        if (isQuote) {
+            iGmRun border = { .flags = decoration_GmRunFlag | quoteBorder_GmRunFlag };
+            border.bounds = border.visBounds = init_Rect(0, y, 4, numLines * lineHeight);
+            pushBack_Array(layout, &border);
+        }
+        for (int i = 0; i < numLines && size_Array(layout) < numRuns; i++) {
+            iGmRun run = { .flags = (i == 0 ? startOfLine_GmRunFlag : 0) };
+            run.visBounds = init_Rect(30, y, 600 - 40 * (i % 3), lineHeight);
+            run.bounds    = init_Rect(0, y, 800, lineHeight); /* extends to the edges */
+            pushBack_Array(layout, &run);
+            y += lineHeight;
+        }
+        y += lineHeight / 2;
+        paragraph++;
+    }
+}
+
+static int height_(const iArray *layout) {
+    return isEmpty_Array(layout) ? 0 : bottom_Rect(((const iGmRun *) back_Array(layout))->bounds);
+}
+
+static void generatePoints_(iArray *points, int height) {
+    /* Fixed pseudo-random sequence, including points above and below the document. */
+    uint32_t seed = 12345;
+    for (int i = 0; i < numLookups_; i++) {
+        seed = seed * 1103515245u + 12345u;
+        const int y = (int) ((seed >> 8) % (uint32_t) (height + 100)) - 50;
+        pushBack_Array(points, &(iInt2){ 100, y });
+    }
+}
+
+static const iGmRun *findRunLinear_(const iArray *layout, iInt2 pos) {
+    /* The linear scan GmDocument used before the index. */
+    const iGmRun *last = NULL;
+    iBool isFirstNonDecoration = iTrue;
+    iConstForEach(Array, i, layout) {
+        const iGmRun *run = i.value;
+        if (run->flags & decoration_GmRunFlag) continue;
+        const iRangei span = ySpan_Rect(run->bounds);
+        if (contains_Range(&span, pos.y)) {
+            return run;
+        }
+        if (isFirstNonDecoration && pos.y < top_Rect(run->bounds)) {
+            return run;
+        }
+        if (top_Rect(run->bounds) > pos.y) break; /* Below the point. */
+        last = run;
+        isFirstNonDecoration = iFalse;
+    }
+    return last;
+}
+
+static const iGmRun *findRunIndexed_(const iArray *index, const iArray *layout, iInt2 pos) {
+    const size_t found = find_GmRunPos(index, layout, pos);
+    return found != iInvalidPos ? constAt_Array(layout, found) : NULL;
+}
+
+static double benchLinear_(const iArray *layout, const iArray *points) {
+    iTime start;
+    initCurrent_Time(&start);
+    size_t sum = 0;
+    iConstForEach(Array, i, points) {
+        sum += (size_t) findRunLinear_(layout, *(const iInt2 *) i.value);
+    }
+    const double elapsed = elapsedSeconds_Time(&start);
+    if (sum == 0) puts("(no runs found)");
+    return elapsed;
+}
+
+static double benchIndexed_(const iArray *index, const iArray *layout, const iArray *points) {
+    iTime start;
+    initCurrent_Time(&start);
+    size_t sum = 0;
+    iConstForEach(Array, i, points) {
+        sum += (size_t) findRunIndexed_(index, layout, *(const iInt2 *) i.value);
+    }
+    const double elapsed = elapsedSeconds_Time(&start);
+    if (sum == 0) puts("(no runs found)");
+    return elapsed;
+}
+
+static size_t countMismatches_(const iArray *index, const iArray *layout, const iArray *points) {
+    size_t count = 0;
+    iConstForEach(Array, i, points) {
+        const iInt2 pos = *(const iInt2 *) i.value;
+        if (findRunLinear_(layout, pos) != findRunIndexed_(index, layout, pos)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+int main(void) {
+    static const size_t sizes_[] = { 100, 1000, 10000, 100000 };
+    init_Foundation();
+    int result = 0;
+    printf("%d lookups per layout; best of %d rounds\n", numLookups_, numRounds_);
+    iForIndices(s, sizes_) {
+        iArray layout, index, points;
+        init_Array(&layout, sizeof(iGmRun));
+        init_Array(&index, sizeof(iGmRunPos));
+        init_Array(&points, sizeof(iInt2));
+        generateLayout_(&layout, sizes_[s]);
+        generatePoints_(&points, height_(&layout));
+        iTime start;
+        initCurrent_Time(&start);
+        updateIndex_GmRunPos(&index, &layout, 0);
+        const double buildSeconds = elapsedSeconds_Time(&start);
+        double best[2] = { 1e9, 1e9 };
+        for (int round = 0; round < numRounds_; round++) {
+            best[0] = iMin(best[0], benchLinear_(&layout, &points));
+            best[1] = iMin(best[1], benchIndexed_(&index, &layout, &points));
+        }
+        const size_t mismatches = countMismatches_(&index, &layout, &points);
+        printf("%7zu runs   linear %8.3f ms   indexed %8.3f ms   %7.1fx   "
+               "(index built in %.3f ms, %zu mismatches)\n",
+               sizes_[s],
+               best[0] * 1000.0,
+               best[1] * 1000.0,
+               best[1] > 0.0 ? best[0] / best[1] : 0.0,
+               buildSeconds * 1000.0,
+               mismatches);
+        if (mismatches) {
+            result = 1;
+        }
+        deinit_Array(&points);
+        deinit_Array(&index);
+        deinit_Array(&layout);
+    }
+    deinit_Foundation();
+    return result;
+}
@@ -0,0 +1,169 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+
+/* Compares the speed of the line scanners in gmutil with the regular expressions they
+   replaced, using generated response headers, feed pages, and gopher menus. */
+
+#include "gmutil.h"
+#include "refparse.h"
+
+#include <the_Foundation/foundation.h>
+#include <the_Foundation/time.h>
+#include <stdio.h>
+
+static const int numHeaders_ = 100000;
+static const int numLines_   = 100000;
+static const int numRounds_  = 5;
+
+static void generateFeed_(iString *d) {
+    /* A typical subscribed page: dated links mixed with headings and text. */
+    for (int i = 0; i < numLines_; i++) {
+        switch (i % 4) {
+            case 0:
+                appendFormat_String(d,
+                                    "=> gemini://example.org/posts/%d.gmi 20%02d-%02d-%02d "
+                                    "Post number %d\n",
+                                    i, i % 100, 1 + i % 12, 1 + i % 28, i);
+                break;
+            case 1:
+                appendFormat_String(d, "## Heading %d\n", i);
+                break;
+            case 2:
+                appendFormat_String(d, "Some text on line %d that is not a link.\n", i);
+                break;
+            default:
+                appendFormat_String(d, "=> gemini://example.org/other/%d.gmi Undated\n", i);
+                break;
+        }
+    }
+}
+
+static void generateMenu_(iString *d) {
+    for (int i = 0; i < numLines_; i++) {
+        if (i % 3 == 0) {
+            appendFormat_String(d, "iInformation line %d\tfake\t(NULL)\t0\r\n", i);
+        }
+        else {
+            appendFormat_String(d,
+                                "%cItem %d\t/selector/%d\tgopher.example.org\t70\r\n",
+                                i % 3 == 1 ? '0' : '1', i, i);
+        }
+    }
+}
+
+static double benchHeaders_(iBool useRegex) {
+    /* The header pattern used to be compiled for each response. */
+    static const char *headers_[] = {
+        "20 text/gemini; charset=utf-8", "31 gemini://example.org/new", "51 Not found", "20",
+    };
+    iTime start;
+    initCurrent_Time(&start);
+    int sum = 0;
+    for (int i = 0; i < numHeaders_; i++) {
+        const char *line = headers_[i % iElemCount(headers_)];
+        iGmHeader   header;
+        if (useRegex) {
+            iRefPatterns ref = { .header = newHeaderPattern_RefPatterns() };
+            if (parseHeader_RefPatterns(&ref, &header, line)) {
+                sum += header.code;
+            }
+            iRelease(ref.header);
+        }
+        else if (parse_GmHeader(&header, range_CStr(line))) {
+            sum += header.code;
+        }
+    }
+    const double elapsed = elapsedSeconds_Time(&start);
+    if (sum == 0) puts("(no headers parsed)");
+    return elapsed;
+}
+
+static double benchFeed_(const iRefPatterns *ref, const iString *src) {
+    iTime start;
+    initCurrent_Time(&start);
+    size_t   count = 0;
+    iRangecc line  = iNullRange;
+    while (nextSplit_Rangecc(range_String(src), "\n", &line)) {
+        iGmDatedLink link;
+        if (ref ? parseDatedLink_RefPatterns(ref, &link, line) : parse_GmDatedLink(&link, line)) {
+            count++;
+        }
+    }
+    const double elapsed = elapsedSeconds_Time(&start);
+    if (count == 0) puts("(no links parsed)");
+    return elapsed;
+}
+
+static double benchMenu_(const iRefPatterns *ref, const iString *src) {
+    iTime start;
+    initCurrent_Time(&start);
+    size_t   count = 0;
+    iRangecc line  = iNullRange;
+    while (nextSplit_Rangecc(range_String(src), "\r\n", &line)) {
+        iGopherLine item;
+        if (ref ? parseGopherLine_RefPatterns(ref, &item, line) : parse_GopherLine(&item, line)) {
+            count++;
+        }
+    }
+    const double elapsed = elapsedSeconds_Time(&start);
+    if (count == 0) puts("(no items parsed)");
+    return elapsed;
+}
+
+static void report_(const char *name, double regexSeconds, double scanSeconds) {
+    printf("%-14s regex %8.2f ms   scanner %8.2f ms   %6.1fx\n",
+           name,
+           regexSeconds * 1000.0,
+           scanSeconds * 1000.0,
+           scanSeconds > 0.0 ? regexSeconds / scanSeconds : 0.0);
+}
+
+int main(void) {
+    init_Foundation();
+    iRefPatterns ref;
+    init_RefPatterns(&ref);
+    iString feed, menu;
+    init_String(&feed);
+    init_String(&menu);
+    generateFeed_(&feed);
+    generateMenu_(&menu);
+    printf("%d headers, %d feed lines, %d menu lines; best of %d rounds\n",
+           numHeaders_, numLines_, numLines_, numRounds_);
+    double best[3][2] = { { 1e9, 1e9 }, { 1e9, 1e9 }, { 1e9, 1e9 } };
+    for (int round = 0; round < numRounds_; round++) {
+        best[0][0] = iMin(best[0][0], benchHeaders_(iTrue));
+        best[0][1] = iMin(best[0][1], benchHeaders_(iFalse));
+        best[1][0] = iMin(best[1][0], benchFeed_(&ref, &feed));
+        best[1][1] = iMin(best[1][1], benchFeed_(NULL, &feed));
+        best[2][0] = iMin(best[2][0], benchMenu_(&ref, &menu));
+        best[2][1] = iMin(best[2][1], benchMenu_(NULL, &menu));
+    }
+    report_("Headers", best[0][0], best[0][1]);
+    report_("Feed links", best[1][0], best[1][1]);
+    report_("Gopher menu", best[2][0], best[2][1]);
+    deinit_String(&menu);
+    deinit_String(&feed);
+    deinit_RefPatterns(&ref);
+    deinit_Foundation();
+    return 0;
+}
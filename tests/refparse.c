@@ -0,0 +1,89 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+
+#include "refparse.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+iRegExp *newHeaderPattern_RefPatterns(void) {
+    return new_RegExp("^([0-9][0-9])(( )(.*))?", 0);
+}
+
+void init_RefPatterns(iRefPatterns *d) {
+    d->header    = newHeaderPattern_RefPatterns();
+    d->datedLink = new_RegExp("^=>\\s*([^\\s]+)\\s+"
+                              "([0-9][0-9][0-9][0-9]-[0-1][0-9]-[0-3][0-9])"
+                              "([^0-9].*)",
+                              0);
+    d->gopherLine = new_RegExp("(.)([^\t]*)\t([^\t]*)\t([^\t]*)\t([0-9]+)",
+                               caseInsensitive_RegExpOption);
+}
+
+void deinit_RefPatterns(iRefPatterns *d) {
+    iRelease(d->gopherLine);
+    iRelease(d->datedLink);
+    iRelease(d->header);
+}
+
+iBool parseHeader_RefPatterns(const iRefPatterns *d, iGmHeader *header, const char *line) {
+    /* As in processIncomingData_GmRequest_(): the code is read with atoi() and the <META> is
+       what follows it, without leading space. */
+    iRegExpMatch m;
+    init_RegExpMatch(&m);
+    if (!matchRange_RegExp(d->header, range_CStr(line), &m)) {
+        return iFalse;
+    }
+    header->code = atoi(capturedRange_RegExpMatch(&m, 1).start);
+    header->meta = (iRangecc){ capturedRange_RegExpMatch(&m, 1).end, line + strlen(line) };
+    trimStart_Rangecc(&header->meta);
+    return iTrue;
+}
+
+iBool parseDatedLink_RefPatterns(const iRefPatterns *d, iGmDatedLink *link, iRangecc line) {
+    iRegExpMatch m;
+    init_RegExpMatch(&m);
+    if (!matchRange_RegExp(d->datedLink, line, &m)) {
+        return iFalse;
+    }
+    const iRangecc date = capturedRange_RegExpMatch(&m, 2);
+    link->url   = capturedRange_RegExpMatch(&m, 1);
+    link->title = capturedRange_RegExpMatch(&m, 3);
+    sscanf(date.start, "%04d-%02d-%02d", &link->year, &link->month, &link->day);
+    return iTrue;
+}
+
+iBool parseGopherLine_RefPatterns(const iRefPatterns *d, iGopherLine *item, iRangecc line) {
+    iRegExpMatch m;
+    init_RegExpMatch(&m);
+    if (!matchRange_RegExp(d->gopherLine, line, &m)) {
+        return iFalse;
+    }
+    item->type   = *capturedRange_RegExpMatch(&m, 1).start;
+    item->text   = capturedRange_RegExpMatch(&m, 2);
+    item->path   = capturedRange_RegExpMatch(&m, 3);
+    item->domain = capturedRange_RegExpMatch(&m, 4);
+    item->port   = capturedRange_RegExpMatch(&m, 5);
+    return iTrue;
+}
@@ -0,0 +1,49 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+
+#pragma once
+
+#include "gmutil.h"
+
+#include <the_Foundation/regexp.h>
+
+/* The regular expressions that parse_GmHeader(), parse_GmDatedLink(), and parse_GopherLine()
+   replaced, kept as a reference for the tests and benchmarks. The results are the same
+   structures that the scanners fill in. */
+
+iDeclareType(RefPatterns)
+
+struct Impl_RefPatterns {
+    iRegExp *header;
+    iRegExp *datedLink;
+    iRegExp *gopherLine;
+};
+
+void    init_RefPatterns        (iRefPatterns *);
+void    deinit_RefPatterns      (iRefPatterns *);
+
+iRegExp *newHeaderPattern_RefPatterns(void); /* compiled for each response in the old code */
+
+iBool   parseHeader_RefPatterns     (const iRefPatterns *, iGmHeader *, const char *line);
+iBool   parseDatedLink_RefPatterns  (const iRefPatterns *, iGmDatedLink *, iRangecc line);
+iBool   parseGopherLine_RefPatterns (const iRefPatterns *, iGopherLine *, iRangecc line);
@@ -0,0 +1,255 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+
+/* Tests for the line scanners in gmutil. Each case lists the expected result, and the
+   scanner must also agree with the regular expression it replaced, except where a case
+   notes a deliberate difference. */
+
+#include "gmutil.h"
+#include "refparse.h"
+
+#include <the_Foundation/foundation.h>
+#include <stdio.h>
+#include <string.h>
+
+static int numFailed_ = 0;
+
+static void fail_(const char *what, const char *input) {
+    printf("FAIL: %s: \"", what);
+    for (const char *ch = input; *ch; ch++) {
+        if (*ch == '\t') printf("\\t");
+        else if (*ch == '\r') printf("\\r");
+        else if (*ch == '\n') printf("\\n");
+        else putchar(*ch);
+    }
+    printf("\"\n");
+    numFailed_++;
+}
+
+static iBool equalText_(iRangecc range, const char *text) {
+    return size_Range(&range) == strlen(text) && !memcmp(range.start, text, strlen(text));
+}
+
+static iBool sameRange_(iRangecc a, iRangecc b) {
+    return a.start == b.start && a.end == b.end;
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+static const struct {
+    const char *line;
+    iBool       isValid;
+    int         code;
+    const char *meta;
+    iBool       isRegexDifferent;
+} headerCases_[] = {
+    { "20 text/gemini", iTrue, 20, "text/gemini", iFalse },
+    { "20 text/gemini; charset=utf-8", iTrue, 20, "text/gemini; charset=utf-8", iFalse },
+    { "31   gemini://example.org/", iTrue, 31, "gemini://example.org/", iFalse },
+    /* The response reader strips the CRLF; a stray one is left in the meta. */
+    { "20 text/plain\r", iTrue, 20, "text/plain\r", iFalse },
+    { "20 text/plain\r\n", iTrue, 20, "text/plain\r\n", iFalse },
+    /* Missing meta. */
+    { "20", iTrue, 20, "", iFalse },
+    { "20 ", iTrue, 20, "", iFalse },
+    { "51\t", iTrue, 51, "", iFalse },
+    /* Malformed status. */
+    { "", iFalse, 0, "", iFalse },
+    { "2", iFalse, 0, "", iFalse },
+    { "2x text/gemini", iFalse, 0, "", iFalse },
+    { " 20 text/gemini", iFalse, 0, "", iFalse },
+    { "text/gemini", iFalse, 0, "", iFalse },
+    /* atoi() read every digit, so the code used to be 2034. */
+    { "2034 text/gemini", iTrue, 20, "34 text/gemini", iTrue },
+};
+
+static void testHeaders_(const iRefPatterns *ref) {
+    iForIndices(i, headerCases_) {
+        const char *line = headerCases_[i].line;
+        iGmHeader   header, refHeader;
+        const iBool isValid = parse_GmHeader(&header, range_CStr(line));
+        if (isValid != headerCases_[i].isValid) {
+            fail_("header validity", line);
+            continue;
+        }
+        if (isValid && (header.code != headerCases_[i].code ||
+                        !equalText_(header.meta, headerCases_[i].meta))) {
+            fail_("header fields", line);
+        }
+        if (headerCases_[i].isRegexDifferent) {
+            continue;
+        }
+        const iBool isRefValid = parseHeader_RefPatterns(ref, &refHeader, line);
+        if (isRefValid != isValid ||
+            (isValid && (refHeader.code != header.code ||
+                         !sameRange_(refHeader.meta, header.meta)))) {
+            fail_("header differs from regex", line);
+        }
+    }
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+static const struct {
+    const char *line;
+    iBool       isValid;
+    const char *url;
+    int         year, month, day;
+    const char *title;
+} datedLinkCases_[] = {
+    { "=> gemini://example.org/1.gmi 2021-03-04 Title", iTrue,
+      "gemini://example.org/1.gmi", 2021, 3, 4, " Title" },
+    { "=>gemini://example.org/ 2021-03-04 - Entry", iTrue,
+      "gemini://example.org/", 2021, 3, 4, " - Entry" },
+    { "=>   page.gmi\t2020-12-31\tTabs", iTrue, "page.gmi", 2020, 12, 31, "\tTabs" },
+    { "=> page.gmi 2021-03-04: colon", iTrue, "page.gmi", 2021, 3, 4, ": colon" },
+    /* A CR is not trimmed here; the feed parser trims lines before scanning. */
+    { "=> page.gmi 2021-03-04 Title\r", iTrue, "page.gmi", 2021, 3, 4, " Title\r" },
+    /* The pattern only limits the first digit of month and day. */
+    { "=> page.gmi 2021-19-39 x", iTrue, "page.gmi", 2021, 19, 39, " x" },
+    /* Malformed dates. */
+    { "=> page.gmi 2021-03-04", iFalse, NULL, 0, 0, 0, NULL },
+    { "=> page.gmi 2021-3-04 Title", iFalse, NULL, 0, 0, 0, NULL },
+    { "=> page.gmi 2021-03-4 Title", iFalse, NULL, 0, 0, 0, NULL },
+    { "=> page.gmi 2021-23-04 Title", iFalse, NULL, 0, 0, 0, NULL },
+    { "=> page.gmi 2021-03-44 Title", iFalse, NULL, 0, 0, 0, NULL },
+    { "=> page.gmi 2021-03-041 Title", iFalse, NULL, 0, 0, 0, NULL },
+    { "=> page.gmi 21-03-04 Title", iFalse, NULL, 0, 0, 0, NULL },
+    { "=> page.gmi 2021/03/04 Title", iFalse, NULL, 0, 0, 0, NULL },
+    { "=> page.gmi Title 2021-03-04", iFalse, NULL, 0, 0, 0, NULL },
+    /* Not a dated link. */
+    { "=> 2021-03-04 Title", iFalse, NULL, 0, 0, 0, NULL },
+    { "=> page.gmi", iFalse, NULL, 0, 0, 0, NULL },
+    { "=>", iFalse, NULL, 0, 0, 0, NULL },
+    { "", iFalse, NULL, 0, 0, 0, NULL },
+    { "Text => page.gmi 2021-03-04 Title", iFalse, NULL, 0, 0, 0, NULL },
+    { "= > page.gmi 2021-03-04 Title", iFalse, NULL, 0, 0, 0, NULL },
+};
+
+static void testDatedLinks_(const iRefPatterns *ref) {
+    iForIndices(i, datedLinkCases_) {
+        const char * line = datedLinkCases_[i].line;
+        iGmDatedLink link, refLink;
+        const iBool  isValid = parse_GmDatedLink(&link, range_CStr(line));
+        if (isValid != datedLinkCases_[i].isValid) {
+            fail_("dated link validity", line);
+            continue;
+        }
+        if (isValid && (!equalText_(link.url, datedLinkCases_[i].url) ||
+                        link.year != datedLinkCases_[i].year ||
+                        link.month != datedLinkCases_[i].month ||
+                        link.day != datedLinkCases_[i].day ||
+                        !equalText_(link.title, datedLinkCases_[i].title))) {
+            fail_("dated link fields", line);
+        }
+        const iBool isRefValid = parseDatedLink_RefPatterns(ref, &refLink, range_CStr(line));
+        if (isRefValid != isValid ||
+            (isValid && (!sameRange_(refLink.url, link.url) || refLink.year != link.year ||
+                         refLink.month != link.month || refLink.day != link.day ||
+                         !sameRange_(refLink.title, link.title)))) {
+            fail_("dated link differs from regex", line);
+        }
+    }
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+static const struct {
+    const char *line;
+    iBool       isValid;
+    char        type;
+    const char *text;
+    const char *path;
+    const char *domain;
+    const char *port;
+    iBool       isRegexDifferent;
+} gopherCases_[] = {
+    { "1Menu\t/menu\texample.org\t70", iTrue, '1', "Menu", "/menu", "example.org", "70", iFalse },
+    { "0File.txt\t/file.txt\texample.org\t7070", iTrue,
+      '0', "File.txt", "/file.txt", "example.org", "7070", iFalse },
+    { "iJust text\tfake\t(NULL)\t0", iTrue, 'i', "Just text", "fake", "(NULL)", "0", iFalse },
+    /* Gopher+ items have more fields after the port. */
+    { "1Plus\t/p\texample.org\t70\t+", iTrue, '1', "Plus", "/p", "example.org", "70", iFalse },
+    { "i\t\t\t0", iTrue, 'i', "", "", "", "0", iFalse },
+    /* A CR left at the end of the line follows the port. */
+    { "1Menu\t/menu\texample.org\t70\r", iTrue, '1', "Menu", "/menu", "example.org", "70",
+      iFalse },
+    /* Missing tab fields. */
+    { "", iFalse, 0, NULL, NULL, NULL, NULL, iFalse },
+    { "i", iFalse, 0, NULL, NULL, NULL, NULL, iFalse },
+    { "iJust text", iFalse, 0, NULL, NULL, NULL, NULL, iFalse },
+    { "1Menu\t/menu", iFalse, 0, NULL, NULL, NULL, NULL, iFalse },
+    { "1Menu\t/menu\texample.org", iFalse, 0, NULL, NULL, NULL, NULL, iFalse },
+    { "1Menu\t/menu\texample.org\t", iFalse, 0, NULL, NULL, NULL, NULL, iFalse },
+    { "1Menu\t/menu\texample.org\tport", iFalse, 0, NULL, NULL, NULL, NULL, iFalse },
+    { ".", iFalse, 0, NULL, NULL, NULL, NULL, iFalse },
+    /* The regex could also match starting in the middle of the line. */
+    { "xx\tMenu\t/menu\texample.org\t70", iFalse, 0, NULL, NULL, NULL, NULL, iTrue },
+};
+
+static void testGopherLines_(const iRefPatterns *ref) {
+    iForIndices(i, gopherCases_) {
+        const char *line = gopherCases_[i].line;
+        iGopherLine item, refItem;
+        const iBool isValid = parse_GopherLine(&item, range_CStr(line));
+        if (isValid != gopherCases_[i].isValid) {
+            fail_("gopher line validity", line);
+            continue;
+        }
+        if (isValid && (item.type != gopherCases_[i].type ||
+                        !equalText_(item.text, gopherCases_[i].text) ||
+                        !equalText_(item.path, gopherCases_[i].path) ||
+                        !equalText_(item.domain, gopherCases_[i].domain) ||
+                        !equalText_(item.port, gopherCases_[i].port))) {
+            fail_("gopher line fields", line);
+        }
+        if (gopherCases_[i].isRegexDifferent) {
+            continue;
+        }
+        const iBool isRefValid = parseGopherLine_RefPatterns(ref, &refItem, range_CStr(line));
+        if (isRefValid != isValid ||
+            (isValid && (refItem.type != item.type || !sameRange_(refItem.text, item.text) ||
+                         !sameRange_(refItem.path, item.path) ||
+                         !sameRange_(refItem.domain, item.domain) ||
+                         !sameRange_(refItem.port, item.port)))) {
+            fail_("gopher line differs from regex", line);
+        }
+    }
+}
+
+int main(void) {
+    init_Foundation();
+    iRefPatterns ref;
+    init_RefPatterns(&ref);
+    testHeaders_(&ref);
+    testDatedLinks_(&ref);
+    testGopherLines_(&ref);
+    deinit_RefPatterns(&ref);
+    deinit_Foundation();
+    if (numFailed_) {
+        printf("%d failed\n", numFailed_);
+        return 1;
+    }
+    printf("All passed\n");
+    return 0;
+}